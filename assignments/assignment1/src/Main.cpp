@@ -1,5 +1,6 @@
 // Include standard headers
 #include "common/stdafx.h"
+#include <frustum.h>
 #include "Vertices.h"
 #include "Horse.h"
 
@@ -54,6 +55,8 @@ void key_callback1(GLFWwindow* window, int key, int scancode, int action, int mo
 void mouse_callback(GLFWwindow* window, double xPos, double yPos);
 void mouse_button_callback(GLFWwindow* window, int key, int action, int mode);
 void window_size_callback(GLFWwindow* window, int width, int height);
+void drawHorsePart(const Frustum &camera, const glm::mat4 &model, int &visible);
+void showCulling(int cells, int totalCells, int parts);
 
 int main()
 {
@@ -160,6 +163,24 @@ int main()
     glBufferData(GL_ARRAY_BUFFER, sizeof(buffer_data_horse), buffer_data_horse, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
+    // bounds of every grid cell, in the order the loops below draw them
+    BoxBatch gridCells;
+    for(int i=1; i<=gridX; ++i)
+    {
+        for(int j=1; j<=gridZ; ++j)
+        {
+            gridCells.add(glm::vec3(i-1, 0.f, j-1), glm::vec3(i, 0.f, j));
+            gridCells.add(glm::vec3(i-1, 0.f, -j), glm::vec3(i, 0.f, 1-j));
+        }
+        for(int j=1; j<=gridZ; ++j)
+        {
+            gridCells.add(glm::vec3(-i, 0.f, j-1), glm::vec3(1-i, 0.f, j));
+            gridCells.add(glm::vec3(-i, 0.f, -j), glm::vec3(1-i, 0.f, 1-j));
+        }
+    }
+    std::vector<int> visibleCells;
+    std::vector<char> cellVisible(gridCells.size());
+
 
     do
     {
@@ -191,6 +212,17 @@ int main()
         // Our ModelViewProjection: multiplication of our 3 matrices
         glm::mat4 MVP = Projection * View * Model;
 
+        // only the cells and parts the camera sees are drawn
+        Frustum camera(Projection * View);
+        int cellsVisible = gridCells.cull(camera, visibleCells);
+        std::fill(cellVisible.begin(), cellVisible.end(), 0);
+        for(int k=0; k<cellsVisible; ++k)
+        {
+            cellVisible[visibleCells[k]] = 1;
+        }
+        int cell = 0;
+        int partsVisible = 0;
+
         /*
         By default, all client-side capabilities are disabled, including all generic vertex attribute arrays.
         If enabled, the values in the generic vertex attribute array will be accessed and used for rendering when calls are made to vertex array commands such as
@@ -212,28 +244,40 @@ int main()
             for(int j=1; j<=gridZ; ++j)
             {
                 glm::mat4 anchor_z1 = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, j-1));
-                glm::mat4 mvp1 = anchor_x1 * anchor_z1;
-                glUniformMatrix4fv(grid_mvp, 1, GL_FALSE, &mvp1[0][0]);
-                glDrawArrays(GL_LINE_LOOP, 0, 4*2);
+                if(cellVisible[cell++])
+                {
+                    glm::mat4 mvp1 = anchor_x1 * anchor_z1;
+                    glUniformMatrix4fv(grid_mvp, 1, GL_FALSE, &mvp1[0][0]);
+                    glDrawArrays(GL_LINE_LOOP, 0, 4*2);
+                }
 
                 glm::mat4 anchor_z2 = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, -j));
-                glm::mat4 mvp2 = anchor_x1 * anchor_z2;
-                glUniformMatrix4fv(grid_mvp, 1, GL_FALSE, &mvp2[0][0]);
-                glDrawArrays(GL_LINE_LOOP, 0, 4*2);
+                if(cellVisible[cell++])
+                {
+                    glm::mat4 mvp2 = anchor_x1 * anchor_z2;
+                    glUniformMatrix4fv(grid_mvp, 1, GL_FALSE, &mvp2[0][0]);
+                    glDrawArrays(GL_LINE_LOOP, 0, 4*2);
+                }
             }
 
             glm::mat4 anchor_x2 = MVP * glm::translate(glm::mat4(1.0f), glm::vec3(-i, 0.f, 0.f));
             for(int j=1; j<=gridZ; ++j)
             {
                 glm::mat4 anchor_1 = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, j-1));
-                glm::mat4 mvp1 = anchor_x2 * anchor_1;
-                glUniformMatrix4fv(grid_mvp, 1, GL_FALSE, &mvp1[0][0]);
-                glDrawArrays(GL_LINE_LOOP, 0, 4*2);
+                if(cellVisible[cell++])
+                {
+                    glm::mat4 mvp1 = anchor_x2 * anchor_1;
+                    glUniformMatrix4fv(grid_mvp, 1, GL_FALSE, &mvp1[0][0]);
+                    glDrawArrays(GL_LINE_LOOP, 0, 4*2);
+                }
 
                 glm::mat4 anchor_2 = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, -j));
-                glm::mat4 mvp2 = anchor_x2 * anchor_2;
-                glUniformMatrix4fv(grid_mvp, 1, GL_FALSE, &mvp2[0][0]);
-                glDrawArrays(GL_LINE_LOOP, 0, 12*3);
+                if(cellVisible[cell++])
+                {
+                    glm::mat4 mvp2 = anchor_x2 * anchor_2;
+                    glUniformMatrix4fv(grid_mvp, 1, GL_FALSE, &mvp2[0][0]);
+                    glDrawArrays(GL_LINE_LOOP, 0, 12*3);
+                }
             }
         }
 
@@ -275,83 +319,83 @@ int main()
         glm::mat4 h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.7f,0.7f,0.7f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // neck
         Model=getHorseModel(NECK,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.75f,0.75f,0.75f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // head
         Model=getHorseModel(HEAD,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.65f,0.65f,0.65f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // front left upper
         Model=getHorseModel(FRONT_LEFT_UPPER,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.6f,0.7f,0.7f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // front left lower
         Model=getHorseModel(FRONT_LEFT_LOWER,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.7f,0.6f,0.7f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // front right upper
         Model=getHorseModel(FRONT_RIGHT_UPPER,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.6f,0.7f,0.7f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // front right lower
         Model=getHorseModel(FRONT_RIGHT_LOWER,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.7f,0.6f,0.7f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // back left upper
         Model=getHorseModel(BACK_LEFT_UPPER,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.6f,0.7f,0.7f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // back left lower
         Model=getHorseModel(BACK_LEFT_LOWER,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.7f,0.6f,0.7f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // back right upper
         Model=getHorseModel(BACK_RIGHT_UPPER,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.6f,0.7f,0.7f);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         // back right lower
         Model=getHorseModel(BACK_RIGHT_LOWER,rotater,rotateOrientation,scaler,moveOnX,moveOnZ);
         h_mvp = Projection * View * Model;
         glUniformMatrix4fv(horse_mvp, 1, GL_FALSE, &h_mvp[0][0]);
         glUniform3f(horse_color, 0.7f,0.6f,0.7f);
-
-
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        drawHorsePart(camera, Model, partsVisible);
 
         glDisableVertexAttribArray(0);
         //glDisableVertexAttribArray(1);
 
+        showCulling(cellsVisible, gridCells.size(), partsVisible);
+
         // swaps the front and back buffers of the specified window.
         glfwSwapBuffers(window);
 
@@ -768,3 +812,30 @@ void window_size_callback(GLFWwindow* window, int width, int height)
     glfwGetFramebufferSize(window, &width_, &height_);
     glViewport(0, 0, width_, height_);//What does this do?
 }
+
+// one horse part, unless the camera cannot see the unit cube `model` places
+void drawHorsePart(const Frustum &camera, const glm::mat4 &model, int &visible)
+{
+    float radius = 0.5f * (glm::length(glm::vec3(model[0])) + glm::length(glm::vec3(model[1])) + glm::length(glm::vec3(model[2])));
+    if(camera.sees(glm::vec4(glm::vec3(model[3]), radius)))
+    {
+        ++visible;
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+}
+
+// this frame's visible of tested cells and parts in the window title, when they changed
+void showCulling(int cells, int totalCells, int parts)
+{
+    static int lastCells = -1, lastParts = -1;
+    if(cells == lastCells && parts == lastParts)
+    {
+        return;
+    }
+    lastCells = cells;
+    lastParts = parts;
+
+    char title[128];
+    snprintf(title, sizeof(title), "%s - grid %d/%d cells, horse %d/11 parts", TITLE.c_str(), cells, totalCells, parts);
+    glfwSetWindowTitle(window, title);
+}
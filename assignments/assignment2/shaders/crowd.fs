@@ -0,0 +1,46 @@
+#version 330 core
+out vec4 FragColor;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec4 Color;
+} fs_in;
+
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeFars;
+    int cascadeCount;
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+};
+
+// same lighting as the untextured horse in shadow_mapping.fs
+void main()
+{
+    vec3 norm = normalize(fs_in.Normal);
+    vec3 lightDir = normalize(lightPos - fs_in.FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+
+    float ambientStrength = 0.5;
+    vec3 ambient = ambientStrength * lightSpecular * vec3(fs_in.Color);
+
+    // diffuse
+    vec3 diffuse = diff * lightSpecular * vec3(fs_in.Color);
+
+    // specular
+    float specularStrength = 0.5;
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightSpecular * vec3(fs_in.Color);
+
+    FragColor = vec4(ambient + diffuse + specular, 1.0);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in vec4 aColor;
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec4 Color;
+} vs_out;
+
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeFars;
+    int cascadeCount;
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+};
+
+void main()
+{
+    vs_out.FragPos = vec3(aModel * vec4(aPos, 1.0));
+    vs_out.Normal = transpose(inverse(mat3(aModel))) * aNormal;
+    vs_out.Color = aColor;
+    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aModel;
+
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeFars;
+    int cascadeCount;
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+};
+
+uniform int cascade;
+
+void main()
+{
+    gl_Position = cascadeMatrices[cascade] * aModel * vec4(aPos, 1.0);
+}
@@ -0,0 +1,60 @@
+#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 72) out; // 4 lights x 6 faces x 3 corners
+
+// Every triangle into the six cube faces of up to four point lights at once.
+// Each face is a tile of the shadow atlas: the face's clip position is scaled
+// and moved onto its tile, and gl_ClipDistance cuts it to the tile's edges,
+// which the face's own [-w, w] square became.
+
+uniform int lightCount;
+uniform vec4 lights[4];     // position and far plane
+uniform vec4 tiles[4];      // lower-left texel of the light's 3 x 2 faces, face edge, atlas edge
+uniform mat4 faceViews[6];  // rotation of each face
+uniform float lightNear;
+
+void emitFace(int light, int face)
+{
+    float n = lightNear, f = lights[light].w;
+    vec4 clip[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        vec3 v = mat3(faceViews[face]) * (gl_in[i].gl_Position.xyz - lights[light].xyz);
+        clip[i] = vec4(v.xy, -(f + n) / (f - n) * v.z - 2.0 * f * n / (f - n), -v.z);
+    }
+    // not at all when every corner is past the same side of the face
+    if((clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) ||
+       (clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) ||
+       (clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) ||
+       (clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w) ||
+       (clip[0].w <= 0.0 && clip[1].w <= 0.0 && clip[2].w <= 0.0))
+    {
+        return;
+    }
+
+    vec4 tile = tiles[light];
+    vec2 corner = tile.xy + vec2(face % 3, face / 3) * tile.z;
+    float scale = tile.z / tile.w;
+    vec2 center = (2.0 * corner + tile.z) / tile.w - 1.0;
+    for(int i = 0; i < 3; ++i)
+    {
+        gl_Position = vec4(clip[i].xy * scale + center * clip[i].w, clip[i].zw);
+        gl_ClipDistance[0] = clip[i].w + clip[i].x;
+        gl_ClipDistance[1] = clip[i].w - clip[i].x;
+        gl_ClipDistance[2] = clip[i].w + clip[i].y;
+        gl_ClipDistance[3] = clip[i].w - clip[i].y;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
+
+void main()
+{
+    for(int light = 0; light < lightCount; ++light)
+    {
+        for(int face = 0; face < 6; ++face)
+        {
+            emitFace(light, face);
+        }
+    }
+}
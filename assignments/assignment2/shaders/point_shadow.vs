@@ -0,0 +1,34 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+#ifdef CROWD
+layout (location = 3) in mat4 aModel;
+#else
+layout (location = 3) in vec4 aPatch; // ground patches: corner in xyz, cell size in w; (0, 0, 0, 1) when not set
+uniform mat4 model;
+#endif
+
+// Built with "#define CROWD" for the instanced crowd, and with "#define FACE_PASS"
+// to project into one cube face itself; otherwise point_shadow.gs projects the
+// world position into every face of every light of the pass.
+#ifdef FACE_PASS
+uniform vec4 light;      // position and far plane
+uniform mat4 faceView;   // rotation of the face
+uniform float lightNear;
+#endif
+
+void main()
+{
+#ifdef CROWD
+    vec4 world = aModel * vec4(aPos, 1.0);
+#else
+    vec4 world = model * vec4(aPos * aPatch.w + aPatch.xyz, 1.0);
+#endif
+#ifdef FACE_PASS
+    // a 90 degree perspective, as glm::perspective makes it
+    vec3 v = mat3(faceView) * (world.xyz - light.xyz);
+    float n = lightNear, f = light.w;
+    gl_Position = vec4(v.xy, -(f + n) / (f - n) * v.z - 2.0 * f * n / (f - n), -v.z);
+#else
+    gl_Position = world;
+#endif
+}
@@ -5,17 +5,80 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+    float ViewDepth;
 } fs_in;
 
 uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeFars;
+    int cascadeCount;
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+};
 
+// Built once per feature combination, with "#define PERMUTED" and values for
+// TEXTURE_ON, SHADOW_ON, SHADOW_FILTER and PCF_KERNEL put after #version, so
+// the branches on them fold away, and "#define SHADOW_CUBE" for the point
+// light's cube shadows in place of the cascades, and "#define CLUSTERED" for
+// the lamps of ClusteredLights.h; without PERMUTED it is the uber-shader
+// switched by uniforms, filtering 3 x 3 by hand.
+#ifdef PERMUTED
+const bool texture_on = TEXTURE_ON;
+const bool shadow_on = SHADOW_ON;
+#else
 uniform bool texture_on;
 uniform bool shadow_on;
+#endif
+#ifndef PCF_KERNEL
+#define PCF_KERNEL 3 // texels a side of the shadow filter
+#endif
+
+// the shadow filters of ShadowFilter.h
+#define FILTER_PCF 0         // PCF_KERNEL^2 depth fetches compared by hand
+#define FILTER_HARDWARE 1    // PCF_KERNEL^2 fetches, each comparing and blending 2 x 2 texels
+#define FILTER_VARIANCE 2    // one fetch of the blurred, mipmapped depth moments
+#define FILTER_EXPONENTIAL 3 // one fetch of the blurred, mipmapped exp(c * depth)
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER FILTER_PCF
+#endif
+
+// one layer per cascade: depths, or the moments of shadow_moments.fs
+#if SHADOW_FILTER == FILTER_HARDWARE
+uniform sampler2DArrayShadow shadowMap;
+#else
+uniform sampler2DArray shadowMap;
+#endif
+
+#ifdef SHADOW_CUBE
+// the point light's six faces in the shadow atlas of ShadowAtlas.h, read through
+// hardware comparison in place of the cascades
+uniform sampler2DShadow pointShadowMap;
+uniform vec4 cubeTile;      // lower-left texel of the light's 3 x 2 faces, face edge, atlas edge
+uniform float cubeNear;
+uniform float cubeFar;
+uniform mat4 faceViews[6];  // rotation of each face
+#endif
+
+#ifdef CLUSTERED
+// the lamps of ClusteredLights.h, two texels each: position and reach, colour and intensity
+uniform samplerBuffer lampData;
+uniform usamplerBuffer clusterGrid;  // first index and count of every cluster
+uniform usamplerBuffer lampIndices;  // the lamps of each cluster, one cluster after another
+uniform float sliceScale;            // slice = log(view depth) * sliceScale + sliceBias
+uniform float sliceBias;
+uniform int tileWidth;
+uniform int tileHeight;
+uniform int lampCount;
+#endif
 
 // for texture only
 struct Material {
@@ -24,51 +87,68 @@ struct Material {
     float shininess;
 }; 
 
-struct Light {
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
 uniform Material material;
-uniform Light light;
 
 uniform vec4 shader_color;
 
 uniform sampler2D texture1;
 // end of for texture only
 
-float ShadowCalculation(vec4 fragPosLightSpace)
+float ShadowCalculation()
 {
+    // the first cascade reaching past the fragment
+    int cascade = 0;
+    for(int i = 0; i < cascadeCount - 1; ++i)
+    {
+        if(fs_in.ViewDepth > cascadeSplits[i])
+            cascade = i + 1;
+    }
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fs_in.FragPos, 1.0);
     // perform perspective divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     // transform to [0,1] range
     projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
     // get depth of current fragment from light's perspective
     float currentDepth = projCoords.z;
+#if SHADOW_FILTER == FILTER_VARIANCE || SHADOW_FILTER == FILTER_EXPONENTIAL
+    // linear depth over the far plane, as the moments were made
+    float depth = fragPosLightSpace.w / cascadeFars[cascade];
+    vec2 moments = texture(shadowMap, vec3(projCoords.xy, cascade)).rg;
+#if SHADOW_FILTER == FILTER_VARIANCE
+    // Chebyshev's upper bound on the lit share, its low end cut off against light bleeding
+    float variance = max(moments.y - moments.x * moments.x, 0.00002);
+    float d = depth - moments.x;
+    float lit = d <= 0.0 ? 1.0 : variance / (variance + d * d);
+    lit = clamp((lit - 0.3) / 0.7, 0.0, 1.0);
+#else
+    float lit = clamp(moments.x * exp(-ESM_EXPONENT * (depth - 0.002)), 0.0, 1.0);
+#endif
+    float shadow = 1.0 - lit;
+#else
     // calculate bias (based on depth map resolution and slope)
     vec3 normal = normalize(fs_in.Normal);
     vec3 lightDir = normalize(lightPos - fs_in.FragPos);
     float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
-    // check whether current frag pos is in shadow
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
+    // PCF over PCF_KERNEL x PCF_KERNEL texels
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    for(int x = -PCF_KERNEL / 2; x <= PCF_KERNEL / 2; ++x)
     {
-        for(int y = -1; y <= 1; ++y)
+        for(int y = -PCF_KERNEL / 2; y <= PCF_KERNEL / 2; ++y)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
-        }    
+            vec2 uv = projCoords.xy + vec2(x, y) * texelSize;
+#if SHADOW_FILTER == FILTER_HARDWARE
+            // the lit share of the 2 x 2 texels around uv
+            shadow += 1.0 - texture(shadowMap, vec4(uv, cascade, currentDepth - bias));
+#else
+            float pcfDepth = texture(shadowMap, vec3(uv, cascade)).r;
+            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;
+#endif
+        }
     }
-    shadow /= 3.0;
-    
+    shadow /= float(PCF_KERNEL * PCF_KERNEL);
+#endif
+
     // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
     if(projCoords.z > 1.0)
         shadow = 0.0;
@@ -76,6 +156,77 @@ float ShadowCalculation(vec4 fragPosLightSpace)
     return shadow;
 }
 
+#ifdef SHADOW_CUBE
+float PointShadowCalculation()
+{
+    // the face the light looks through at the fragment: that of its major axis
+    vec3 d = fs_in.FragPos - lightPos;
+    vec3 a = abs(d);
+    int face = a.x >= a.y && a.x >= a.z ? (d.x < 0.0 ? 1 : 0) : (a.y >= a.z ? (d.y < 0.0 ? 3 : 2) : (d.z < 0.0 ? 5 : 4));
+    vec3 v = mat3(faceViews[face]) * d;
+    // toward the light by a texel, more where the light grazes the surface
+    vec3 normal = normalize(fs_in.Normal);
+    float texel = 2.0 * -v.z / cubeTile.z;
+    v.z += texel * (1.0 + 2.0 * (1.0 - max(dot(normal, normalize(-d)), 0.0)));
+    float distance = -v.z;
+    if(distance > cubeFar)
+        return 0.0;
+    // the depth and texel point_shadow.gs gave it
+    float n = cubeNear, f = cubeFar;
+    float depth = 0.5 * ((f + n) / (f - n) - 2.0 * f * n / ((f - n) * distance)) + 0.5;
+    vec2 corner = cubeTile.xy + vec2(face % 3, face / 3) * cubeTile.z;
+    vec2 texelPos = corner + (v.xy / distance * 0.5 + 0.5) * cubeTile.z;
+    // PCF_KERNEL^2 compared and blended fetches, kept a texel inside the face
+    float shadow = 0.0;
+    for(int x = -PCF_KERNEL / 2; x <= PCF_KERNEL / 2; ++x)
+    {
+        for(int y = -PCF_KERNEL / 2; y <= PCF_KERNEL / 2; ++y)
+        {
+            vec2 uv = clamp(texelPos + vec2(x, y), corner + 1.0, corner + cubeTile.z - 1.0) / cubeTile.w;
+            shadow += 1.0 - texture(pointShadowMap, vec3(uv, depth));
+        }
+    }
+    return shadow / float(PCF_KERNEL * PCF_KERNEL);
+}
+#endif
+
+#ifdef CLUSTERED
+// the lamps listed in the fragment's cluster, or every lamp when built with ALL_LAMPS
+vec3 LampLighting(vec3 normal, vec3 viewDir, vec3 color)
+{
+#ifdef ALL_LAMPS
+    int first = 0, count = lampCount;
+#else
+    ivec3 cluster = ivec3(int(gl_FragCoord.x) / tileWidth, int(gl_FragCoord.y) / tileHeight,
+                          int(floor(log(fs_in.ViewDepth) * sliceScale + sliceBias)));
+    cluster = clamp(cluster, ivec3(0), ivec3(CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES) - 1);
+    uvec2 list = texelFetch(clusterGrid, cluster.x + CLUSTER_TILES_X * (cluster.y + CLUSTER_TILES_Y * cluster.z)).rg;
+    int first = int(list.x), count = int(list.y);
+#endif
+    vec3 sum = vec3(0.0);
+    for(int i = 0; i < count; ++i)
+    {
+#ifdef ALL_LAMPS
+        int lamp = i;
+#else
+        int lamp = int(texelFetch(lampIndices, first + i).r);
+#endif
+        vec4 position = texelFetch(lampData, 2 * lamp);
+        vec4 lampColor = texelFetch(lampData, 2 * lamp + 1);
+        vec3 toLamp = position.xyz - fs_in.FragPos;
+        float distance = length(toLamp);
+        // inverse square, brought down to nothing at the lamp's reach
+        float window = clamp(1.0 - pow(distance / position.w, 4.0), 0.0, 1.0);
+        float attenuation = lampColor.a * window * window / (distance * distance + 1.0);
+        vec3 lampDir = toLamp / max(distance, 0.0001);
+        float diff = max(dot(normal, lampDir), 0.0);
+        float spec = pow(max(dot(normal, normalize(lampDir + viewDir)), 0.0), 64.0);
+        sum += attenuation * lampColor.rgb * (diff * color + 0.5 * spec);
+    }
+    return sum;
+}
+#endif
+
 void main()
 {    
 	if(shadow_on){
@@ -96,38 +247,48 @@ void main()
 		spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
 		vec3 specular = spec * lightColor;    
 		// calculate shadow
-		float shadow = ShadowCalculation(fs_in.FragPosLightSpace);                      
+#ifdef SHADOW_CUBE
+		float shadow = PointShadowCalculation();
+#else
+		float shadow = ShadowCalculation();
+#endif
 		vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;    
+#ifdef CLUSTERED
+		lighting += LampLighting(normal, viewDir, color);
+#endif
 
 		FragColor = vec4(lighting, 1.0);
 	}else{
 		vec3 ambient, diffuse, specular;
 		vec3 norm = normalize(fs_in.Normal);
-		vec3 lightDir = normalize(light.position - fs_in.FragPos);
+		vec3 lightDir = normalize(lightPos - fs_in.FragPos);
 		float diff = max(dot(norm, lightDir), 0.0);
 		vec3 viewDir = normalize(viewPos - fs_in.FragPos);
 		vec3 reflectDir = reflect(-lightDir, norm);
 
 		if(texture_on){
-			ambient = light.ambient * texture(material.diffuse, fs_in.TexCoords).rgb;
-			diffuse = light.diffuse * diff * texture(material.diffuse, fs_in.TexCoords).rgb;
+			ambient = lightAmbient * texture(material.diffuse, fs_in.TexCoords).rgb;
+			diffuse = lightDiffuse * diff * texture(material.diffuse, fs_in.TexCoords).rgb;
 			float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-			specular = light.specular * (spec * material.specular);  
+			specular = lightSpecular * (spec * material.specular);  
 		}else{
 			float ambientStrength = 0.5;
-			ambient = ambientStrength * light.specular * vec3(shader_color);
+			ambient = ambientStrength * lightSpecular * vec3(shader_color);
 
 			// diffuse
-			diffuse = diff * light.specular * vec3(shader_color);
+			diffuse = diff * lightSpecular * vec3(shader_color);
 	
 			// specular
 			float specularStrength = 0.5;
 			float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-			specular = specularStrength * spec * light.specular * vec3(shader_color);
+			specular = specularStrength * spec * lightSpecular * vec3(shader_color);
 
 		}	
 
 		vec3 result = ambient + diffuse + specular;
+#ifdef CLUSTERED
+		result += LampLighting(norm, viewDir, texture_on ? texture(material.diffuse, fs_in.TexCoords).rgb : vec3(shader_color));
+#endif
 		FragColor = vec4(result, 1.0);
 	}     
     
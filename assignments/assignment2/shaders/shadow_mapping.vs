@@ -2,6 +2,7 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aPatch; // ground patches: corner in xyz, cell size in w; (0, 0, 0, 1) when not set
 
 out vec2 TexCoords;
 
@@ -9,19 +10,33 @@ out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
+    float ViewDepth;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeFars;
+    int cascadeCount;
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+};
+
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
+    // a ground patch scaled to its cells and moved to its corner, texture coordinates with it
+    vec3 position = aPos * aPatch.w + aPatch.xyz;
+    vs_out.FragPos = vec3(model * vec4(position, 1.0));
     vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
-    vs_out.TexCoords = aTexCoords;
-    vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vs_out.TexCoords = aTexCoords * aPatch.w + aPatch.xz;
+    vs_out.ViewDepth = -(view * vec4(vs_out.FragPos, 1.0)).z;
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file
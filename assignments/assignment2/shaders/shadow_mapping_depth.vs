@@ -1,10 +1,26 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec4 aPatch; // ground patches: corner in xyz, cell size in w; (0, 0, 0, 1) when not set
+
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeFars;
+    int cascadeCount;
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+};
 
-uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
+uniform int cascade;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = cascadeMatrices[cascade] * model * vec4(aPos * aPatch.w + aPatch.xyz, 1.0);
 }
\ No newline at end of file
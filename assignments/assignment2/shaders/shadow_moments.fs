@@ -0,0 +1,56 @@
+#version 330 core
+out vec2 Moments;
+
+// Built with "#define VARIANCE" or "#define EXPONENTIAL" and "#define ESM_EXPONENT",
+// and with "#define ACROSS" for the first of the two blur passes. ACROSS reads a
+// layer of the cascade depths, turns each depth into linear depth over the light
+// frustum's far plane and that into moments, and blurs them along x; the other
+// pass blurs its result along y into the layer of the moment map.
+
+#ifdef ACROSS
+uniform sampler2DArray depthMap;
+uniform int cascade;
+uniform float lightNear; // planes of the cascade's light frustum
+uniform float lightFar;
+#else
+uniform sampler2D blurMap;
+#endif
+
+// binomial weights of a 5 texel Gaussian
+const float weights[3] = float[](6.0 / 16.0, 4.0 / 16.0, 1.0 / 16.0);
+
+#ifdef ACROSS
+vec2 momentsAt(ivec2 texel)
+{
+    float depth = texelFetch(depthMap, ivec3(texel, cascade), 0).r;
+    float n = lightNear, f = lightFar;
+    float linear = 2.0 * n * f / (f + n - (2.0 * depth - 1.0) * (f - n)) / f;
+#ifdef VARIANCE
+    return vec2(linear, linear * linear);
+#else
+    return vec2(exp(ESM_EXPONENT * linear), 0.0);
+#endif
+}
+#endif
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+#ifdef ACROSS
+    ivec2 last = textureSize(depthMap, 0).xy - 1;
+    ivec2 step = ivec2(1, 0);
+#else
+    ivec2 last = textureSize(blurMap, 0) - 1;
+    ivec2 step = ivec2(0, 1);
+#endif
+    Moments = vec2(0.0);
+    for(int i = -2; i <= 2; ++i)
+    {
+        ivec2 tap = clamp(texel + i * step, ivec2(0), last);
+#ifdef ACROSS
+        Moments += weights[abs(i)] * momentsAt(tap);
+#else
+        Moments += weights[abs(i)] * texelFetch(blurMap, tap, 0).rg;
+#endif
+    }
+}
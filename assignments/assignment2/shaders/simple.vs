@@ -2,16 +2,40 @@
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec4 aColor;
+#ifdef INSTANCED
+layout (location = 3) in vec4 aInstance; // lamp cubes: centre in xyz, size in w
+#endif
 
 out vec4 fragmentColor;
 
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeFars;
+    int cascadeCount;
+    vec3 lightPos;
+    vec3 viewPos;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+};
+
+// Built with "#define INSTANCED" to draw every lamp cube in one call, each
+// instance placed by its own attribute instead of the model matrix.
+#ifndef INSTANCED
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
 
 
 void main()
 {
+#ifdef INSTANCED
+	gl_Position = projection * view * vec4(aPos * aInstance.w + aInstance.xyz, 1.0);
+#else
 	gl_Position = projection * view * model * vec4(aPos, 1.0);
+#endif
 	fragmentColor = aColor;
 }
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Keyframe animation.
+// A clip keeps one track of (time, angle) keys per joint and is sampled at
+// any point of its cycle, so playback follows wall-clock time instead of the
+// frame rate. Every joint turns about one fixed axis, where slerp between two
+// quaternions is the same as turning the angle along the shorter arc; that is
+// what INTERPOLATE_SLERP does, without building the quaternions.
+//----------------------------------------------------------------------------
+const int MAX_JOINTS = 32; // tracks per clip
+
+enum Interpolation
+{
+    INTERPOLATE_STEP,   // hold each key until the next one, like the old pose snapping
+    INTERPOLATE_LINEAR, // straight from one key angle to the next
+    INTERPOLATE_SLERP   // along the shorter arc
+};
+
+// an angle difference in degrees brought into [-180, 180)
+inline float shortestArc(float degrees)
+{
+    return degrees - 360.0f * floor((degrees + 180.0f) / 360.0f);
+}
+
+// the keys of one joint, times ascending from 0
+struct Track
+{
+    std::vector<float> times;
+    std::vector<float> angles;
+    float rest; // the angle of a track without keys
+
+    Track() :
+        rest(0.0f) {}
+
+    void add(float time, float angle)
+    {
+        times.push_back(time);
+        angles.push_back(angle);
+    }
+
+    // angle at `time` in [0, end); after the last key the track turns back to the first by `end`
+    float sample(float time, float end, Interpolation mode) const
+    {
+        const int n = (int)times.size();
+        if(n == 0)
+        {
+            return rest;
+        }
+        int key = (int)(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+        key = std::max(key, 0);
+        if(mode == INTERPOLATE_STEP || n == 1)
+        {
+            return angles[key];
+        }
+
+        float t0 = times[key];
+        float t1 = key + 1 < n ? times[key + 1] : end;
+        float a0 = angles[key];
+        float a1 = key + 1 < n ? angles[key + 1] : angles[0];
+        float t = t1 > t0 ? (time - t0) / (t1 - t0) : 0.0f;
+        float delta = mode == INTERPOLATE_SLERP ? shortestArc(a1 - a0) : a1 - a0;
+        return a0 + t * delta;
+    }
+};
+
+// a looping cycle with one track per joint
+class AnimationClip
+{
+public:
+    float duration; // seconds per cycle
+    Interpolation interpolation;
+    std::vector<Track> tracks;
+
+    AnimationClip() :
+        duration(1.0f), interpolation(INTERPOLATE_SLERP), aligned(true) {}
+
+    bool empty() const
+    {
+        return tracks.empty();
+    }
+
+    // the angles of joints whose tracks have no keys, the rest pose
+    void setRest(const GLfloat* angles, int joints)
+    {
+        if(joints > (int)tracks.size())
+        {
+            tracks.resize(joints);
+        }
+        for(int i=0; i<joints; ++i)
+        {
+            tracks[i].rest = angles[i];
+        }
+    }
+
+    // a key on every joint at `time` seconds
+    void addPose(float time, const GLfloat* angles, int joints)
+    {
+        aligned = aligned && (tracks.empty() || (int)tracks.size() == joints);
+        tracks.resize(joints);
+        for(int i=0; i<joints; ++i)
+        {
+            tracks[i].add(time, angles[i]);
+        }
+    }
+
+    // a key on one joint only
+    void addKey(int joint, float time, float angle)
+    {
+        if(joint >= (int)tracks.size())
+        {
+            tracks.resize(joint + 1);
+        }
+        tracks[joint].add(time, angle);
+        aligned = false;
+    }
+
+    // joint angles at `phase` (0-1) through the cycle; joints without keys keep their rest angle
+    void sample(float phase, GLfloat* angles) const
+    {
+        const float time = phase * duration;
+        if(!aligned || tracks.empty() || tracks[0].times.empty())
+        {
+            for(size_t i=0; i<tracks.size(); ++i)
+            {
+                angles[i] = tracks[i].sample(time, duration, interpolation);
+            }
+            return;
+        }
+
+        // every track has its keys at the same times: find the segment once
+        const std::vector<float>& times = tracks[0].times;
+        const int n = (int)times.size();
+        int key = std::max((int)(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1, 0);
+        int next = key + 1 < n ? key + 1 : 0;
+        float t1 = key + 1 < n ? times[key + 1] : duration;
+        float t = (interpolation == INTERPOLATE_STEP || t1 <= times[key]) ? 0.0f : (time - times[key]) / (t1 - times[key]);
+        for(size_t i=0; i<tracks.size(); ++i)
+        {
+            float a0 = tracks[i].angles[key];
+            float delta = tracks[i].angles[next] - a0;
+            angles[i] = a0 + t * (interpolation == INTERPOLATE_SLERP ? shortestArc(delta) : delta);
+        }
+    }
+
+private:
+    bool aligned; // all keys came through addPose, so the tracks share their key times
+};
+
+// where one animated skeleton is in its gait
+struct AnimationState
+{
+    float phase;  // 0-1 through the cycle
+    float blend;  // 0 walks, 1 runs
+    float target; // blend eases towards this
+    float speed;  // playback rate
+
+    AnimationState() :
+        phase(0.0f), blend(1.0f), target(1.0f), speed(1.0f) {}
+};
+
+//----------------------------------------------------------------------------
+// Walk and run cycles mixed by AnimationState::blend. Both clips are sampled
+// at the same phase so the feet stay in step while the blend changes, and the
+// cycle length is mixed along with the poses.
+//----------------------------------------------------------------------------
+class GaitBlend
+{
+public:
+    AnimationClip walk;
+    AnimationClip run;
+    float easing; // blend change per second on the way to the target
+
+    GaitBlend() :
+        easing(2.0f) {}
+
+    int joints() const
+    {
+        return (int)run.tracks.size();
+    }
+
+    // move the state on by `seconds` of wall-clock time
+    void advance(AnimationState& state, float seconds) const
+    {
+        float step = easing * seconds;
+        state.blend += std::max(-step, std::min(step, state.target - state.blend));
+
+        float cycle = walk.duration + state.blend * (run.duration - walk.duration);
+        state.phase = fmod(state.phase + seconds * state.speed / cycle, 1.0f);
+    }
+
+    // joint angles of the state, the two clips mixed along the shorter arc
+    void sample(const AnimationState& state, GLfloat* angles) const
+    {
+        if(state.blend >= 1.0f)
+        {
+            run.sample(state.phase, angles);
+            return;
+        }
+        walk.sample(state.phase, angles);
+        if(state.blend <= 0.0f)
+        {
+            return;
+        }
+
+        GLfloat running[MAX_JOINTS];
+        run.sample(state.phase, running);
+        for(int i=0; i<joints(); ++i)
+        {
+            angles[i] += state.blend * shortestArc(running[i] - angles[i]);
+        }
+    }
+
+    // advance and sample many independent states; angles holds joints() values per state
+    void update(AnimationState* states, int count, float seconds, GLfloat* angles) const
+    {
+        const int n = joints();
+        for(int i=0; i<count; ++i)
+        {
+            advance(states[i], seconds);
+            sample(states[i], angles + (size_t)i * n);
+        }
+    }
+};
@@ -0,0 +1,1116 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+//----------------------------------------------------------------------------
+// Frame-time benchmarks, run with "Robot_Horse --bench <name>".
+// Every benchmark renders into the normal window, or the offscreen target with
+// --headless, and prints one line per case.
+//----------------------------------------------------------------------------
+
+// mean milliseconds per frame over `frames` frames; glFinish makes every frame
+// include the GPU work it queued
+template<typename DrawFunction>
+double timeFrames(int frames, DrawFunction draw)
+{
+    glFinish();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i=0; i<frames; ++i)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        draw();
+        glFinish();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+// mean milliseconds per call of a CPU-only workload
+template<typename Function>
+double timeCpu(int iterations, Function work)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i=0; i<iterations; ++i)
+    {
+        work();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// mean GPU milliseconds of `work` over `frames` calls, from GL_TIME_ELAPSED queries
+template<typename Function>
+double timeGpu(int frames, Function work)
+{
+    GLuint query;
+    glGenQueries(1, &query);
+    GLuint64 total = 0;
+    for(int i=0; i<frames; ++i)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        work(i);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        total += elapsed;
+    }
+    glDeleteQueries(1, &query);
+    return total / 1e6 / frames;
+}
+
+// the shared uniforms for the current camera, with the cascades as last fitted
+void uploadBenchmarkFrame()
+{
+    FrameData frame;
+    frame.projection = Projection;
+    frame.view = View;
+    shadows.fill(frame);
+    frame.lightPos = glm::vec4(lightPos, 1.0f);
+    frame.viewPos = glm::vec4(c_pos, 1.0f);
+    frame.lightAmbient = frame.lightDiffuse = frame.lightSpecular = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+    frameBuffer.update(frame);
+}
+
+// the default orbit camera of the render loop
+void setBenchmarkCamera(const ShaderProgram &shader)
+{
+    c_pos = glm::vec3(0.0f, 0.0f, c_radius);
+    View = glm::lookAt(c_pos, glm::vec3(0.0f), c_up);
+    Projection = glm::perspective(glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, viewDistance());
+    uploadBenchmarkFrame();
+
+    glViewport(0, 0, WIDTH, HEIGHT);
+    shader.use();
+    shader.setBool("shadow_on", false);
+}
+
+// per-cell loop against the quadtree ground with every patch at full detail and with
+// level of detail, in line and textured mode, from the orbit camera raised 10 degrees so the
+// ground reaches the horizon
+void benchmarkGrid(const ShaderProgram &shader)
+{
+    const int sizes[] = { 50, 200, 1000, 5000 };
+    bool texture_was_on = texture_on;
+    int gridX_was = gridX, gridZ_was = gridZ;
+
+    glBindTexture(GL_TEXTURE_2D, grassTexture);
+
+    for(int size : sizes)
+    {
+        gridX = gridZ = size;
+        setBenchmarkCamera(shader);
+        c_pos = c_radius * glm::vec3(0.0f, sin(glm::radians(10.0f)), cos(glm::radians(10.0f)));
+        View = glm::lookAt(c_pos, glm::vec3(0.0f), c_up);
+        uploadBenchmarkFrame();
+        Frustum camera(Projection * View);
+        const float pixelScale = 0.5f * HEIGHT * Projection[1][1];
+
+        Grid ground;
+        ground.build(size, size);
+        int frames = std::max(3, 3000 / size);
+        long cells = 4L * size * size;
+
+        for(int textured = 0; textured < 2; ++textured)
+        {
+            texture_on = textured != 0;
+            shader.setBool("texture_on", texture_on);
+            shader.setMat4("model", glm::mat4(1.0f));
+
+            // the per-cell loop would take minutes past 1000 cells a quadrant
+            double loop = size <= 1000 ? timeFrames(frames, [&]() { renderGridCells(shader, size, size); }) : 0.0;
+            shader.setMat4("model", glm::mat4(1.0f));
+            double full = timeFrames(frames, [&]()
+            {
+                ground.select(camera, c_pos, 1e30f);
+                ground.draw(texture_on);
+            });
+            int fullPatches = (int)ground.patches.size();
+            double lod = timeFrames(frames, [&]()
+            {
+                ground.select(camera, c_pos, pixelScale);
+                ground.draw(texture_on);
+            });
+
+            printf("grid %4d x %-4d %-8s ", size, size, texture_on ? "textured" : "lines");
+            if(loop > 0.0)
+            {
+                printf("loop %10.3f ms (%ld draws)  ", loop, cells);
+            }
+            else
+            {
+                printf("loop %10s    (%ld draws)  ", "-", cells);
+            }
+            printf("full %8.3f ms (%d patches)  lod %8.3f ms (%d patches, %d nodes tested)  x%.1f\n",
+                   full, fullPatches, lod, (int)ground.patches.size(), ground.tested, full / lod);
+        }
+        ground.release();
+    }
+
+    gridX = gridX_was;
+    gridZ = gridZ_was;
+    texture_on = texture_was_on;
+}
+
+// the recursive traversal of Horse.h without the drawing, writing world matrices in visiting order
+void traverseWorld(Node* node, glm::mat4*& out)
+{
+    if (node == NULL)
+    {
+        return;
+    }
+
+    {
+        MatrixStack<MVSTACK_DEPTH>::Scope scope(mvstack, node->transform);
+        *out++ = mvstack.top();
+
+        if (node->child)
+        {
+            traverseWorld(node->child, out);
+        }
+    }
+
+    if (node->sibling)
+    {
+        traverseWorld(node->sibling, out);
+    }
+}
+
+// world matrices of many skeletons: recursive node traversal against the flattened sweep
+void benchmarkSkeleton()
+{
+    const int counts[] = { 1, 1000, 10000 };
+    const int iterations = 50;
+
+    initSkeleton();
+    for(int count : counts)
+    {
+        SkeletonPoses many;
+        many.resize(&skeleton, count);
+        for(int i=0; i<count; ++i)
+        {
+            poseHorse(many, i);
+        }
+
+        std::vector<glm::mat4> out((size_t)skeleton.size() * count);
+        double recursive = timeCpu(iterations, [&]()
+        {
+            glm::mat4* write = out.data();
+            for(int i=0; i<count; ++i)
+            {
+                traverseWorld(&nodes[Torso], write);
+            }
+        });
+        double flat = timeCpu(iterations, [&]() { many.evaluate(); });
+
+        printf("skeletons %6d  recursive %9.3f ms  flat %9.3f ms  x%.1f\n", count, recursive, flat, recursive / flat);
+    }
+}
+
+// the heap-allocated stack MatrixStack<N> replaced, for comparison
+class HeapMatrixStack
+{
+    int _index;
+    int _size;
+    glm::mat4* _matrices;
+
+public:
+    HeapMatrixStack(int numMatrices) : _index(0), _size(numMatrices)
+    {
+        _matrices = new glm::mat4[numMatrices];
+    }
+
+    ~HeapMatrixStack()
+    {
+        delete[] _matrices;
+    }
+
+    void push(const glm::mat4& m)
+    {
+        _matrices[_index++] = m;
+    }
+
+    glm::mat4& pop()
+    {
+        return _matrices[--_index];
+    }
+};
+
+// the traversal and part functions as they were: a push and pop per node,
+// and another pair around every part's instance matrix
+void traverseHeap(Node* node, HeapMatrixStack& stack, glm::mat4& model, const glm::mat4& shape, glm::mat4*& out)
+{
+    stack.push(model);
+    model *= node->transform;
+
+    stack.push(model);
+    *out++ = model * shape;
+    model = stack.pop();
+
+    if (node->child)
+    {
+        traverseHeap(node->child, stack, model, shape, out);
+    }
+    model = stack.pop();
+
+    if (node->sibling)
+    {
+        traverseHeap(node->sibling, stack, model, shape, out);
+    }
+}
+
+// the same with a scoped push-multiply per node and the instance composed locally
+template<int N>
+void traverseInline(Node* node, MatrixStack<N>& stack, const glm::mat4& shape, glm::mat4*& out)
+{
+    {
+        typename MatrixStack<N>::Scope scope(stack, node->transform);
+        *out++ = stack.top() * shape;
+
+        if (node->child)
+        {
+            traverseInline(node->child, stack, shape, out);
+        }
+    }
+
+    if (node->sibling)
+    {
+        traverseInline(node->sibling, stack, shape, out);
+    }
+}
+
+// model matrices of deep and wide node hierarchies, the old heap stack against MatrixStack<N>
+void benchmarkMatrixStack()
+{
+    const int STACK_DEPTH = 2048;
+    const int chainLength = 1024;
+    const int treeLevels = 12;
+    const int horses = 1000;
+    const int iterations = 200;
+
+    // one long chain, a full binary tree, and many horse skeletons as siblings
+    std::vector<Node> chain(chainLength), tree((1 << treeLevels) - 1), herd(horses * NumNodes);
+    for(int i=0; i<chainLength; ++i)
+    {
+        chain[i].transform = JointZ(glm::vec3(0.0f, 0.01f, 0.0f), 0.1f * i);
+        chain[i].child = i + 1 < chainLength ? &chain[i + 1] : NULL;
+    }
+    for(size_t i=0; i<tree.size(); ++i)
+    {
+        tree[i].transform = JointZ(glm::vec3(0.1f, 0.2f, 0.0f), (float)(i % 90));
+        size_t left = 2 * i + 1;
+        if(left < tree.size())
+        {
+            tree[i].child = &tree[left];
+            tree[left].sibling = &tree[left + 1];
+        }
+    }
+    initSkeleton();
+    for(int h=0; h<horses; ++h)
+    {
+        Node* horse = &herd[h * NumNodes];
+        for(int i=0; i<NumNodes; ++i)
+        {
+            horse[i] = nodes[i];
+            horse[i].sibling = nodes[i].sibling ? horse + (nodes[i].sibling - nodes) : NULL;
+            horse[i].child = nodes[i].child ? horse + (nodes[i].child - nodes) : NULL;
+        }
+        horse[Torso].sibling = h + 1 < horses ? horse + NumNodes : NULL;
+    }
+
+    struct Case { const char *name; Node* root; int count; int depth; };
+    const Case cases[] =
+    {
+        { "chain", &chain[0], chainLength, chainLength },
+        { "binary tree", &tree[0], (int)tree.size(), treeLevels },
+        { "horses", &herd[Torso], (int)herd.size(), 4 },
+    };
+
+    const glm::mat4 shape = partShape(Torso);
+    std::vector<glm::mat4> out(herd.size() + tree.size() + chain.size());
+    volatile float sink = 0.0f;
+    for(const Case& c : cases)
+    {
+        HeapMatrixStack heap(STACK_DEPTH);
+        MatrixStack<STACK_DEPTH> stack;
+        double before = timeCpu(iterations, [&]()
+        {
+            glm::mat4 model(1.0f);
+            glm::mat4* write = out.data();
+            traverseHeap(c.root, heap, model, shape, write);
+        });
+        sink = sink + out[c.count - 1][3][0];
+        double after = timeCpu(iterations, [&]()
+        {
+            glm::mat4* write = out.data();
+            traverseInline(c.root, stack, shape, write);
+        });
+        sink = sink + out[c.count - 1][3][0];
+
+        printf("matrixstack %-12s %6d nodes depth %5d  heap %6.2f ns/node  inline %6.2f ns/node  x%.2f\n",
+               c.name, c.count, c.depth, before * 1e6 / c.count, after * 1e6 / c.count, before / after);
+    }
+}
+
+// frustum tests of many spheres and boxes, one at a time against the SSE batches
+void benchmarkCulling()
+{
+    const int counts[] = { 1000, 10000, 100000 };
+    const int iterations = 200;
+
+    // the default orbit camera over bounds scattered across twice the width of the grid
+    glm::vec3 eye(0.0f, 0.0f, c_radius);
+    Frustum camera(glm::perspective(glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, 100.0f)
+                   * glm::lookAt(eye, glm::vec3(0.0f), c_up));
+    for(int count : counts)
+    {
+        SphereBatch spheres;
+        BoxBatch boxes;
+        for(int i=0; i<count; ++i)
+        {
+            glm::vec3 centre((rand() % 2000) / 10.0f - 100.0f, (rand() % 100) / 10.0f, (rand() % 2000) / 10.0f - 100.0f);
+            float size = 0.5f + (rand() % 40) / 10.0f;
+            spheres.add(glm::vec4(centre, size));
+            boxes.add(centre - glm::vec3(size), centre + glm::vec3(size));
+        }
+
+        std::vector<int> visible;
+        int kept = 0;
+        double sphereOne = timeCpu(iterations, [&]()
+        {
+            kept = 0;
+            for(int i=0; i<count; ++i)
+            {
+                kept += camera.sees(glm::vec4(spheres.x[i], spheres.y[i], spheres.z[i], spheres.r[i])) ? 1 : 0;
+            }
+        });
+        double sphereBatch = timeCpu(iterations, [&]() { spheres.cull(camera, visible); });
+        if(kept != (int)visible.size())
+        {
+            printf("culling: %d spheres kept one by one, %d by the batch\n", kept, (int)visible.size());
+        }
+        printf("culling %6d spheres  one by one %7.3f ms  batch %7.3f ms  x%.1f  (%d visible)\n",
+               count, sphereOne, sphereBatch, sphereOne / sphereBatch, kept);
+
+        double boxOne = timeCpu(iterations, [&]()
+        {
+            kept = 0;
+            for(int i=0; i<count; ++i)
+            {
+                glm::vec3 centre(boxes.x[i], boxes.y[i], boxes.z[i]), extent(boxes.ex[i], boxes.ey[i], boxes.ez[i]);
+                kept += camera.sees(centre - extent, centre + extent) ? 1 : 0;
+            }
+        });
+        double boxBatch = timeCpu(iterations, [&]() { boxes.cull(camera, visible); });
+        if(kept != (int)visible.size())
+        {
+            printf("culling: %d boxes kept one by one, %d by the batch\n", kept, (int)visible.size());
+        }
+        printf("culling %6d boxes    one by one %7.3f ms  batch %7.3f ms  x%.1f  (%d visible)\n",
+               count, boxOne, boxBatch, boxOne / boxBatch, kept);
+    }
+}
+
+// sampling the gait clips and posing many independent horses, against a fixed share of a 60 Hz frame
+const double ANIMATION_BUDGET_MS = 8.0;
+void benchmarkAnimation()
+{
+    const int counts[] = { 1, 1000, 10000 };
+    const Interpolation modes[] = { INTERPOLATE_STEP, INTERPOLATE_LINEAR, INTERPOLATE_SLERP };
+    const char *names[] = { "step", "linear", "slerp" };
+    const int iterations = 50;
+    const float frameSeconds = 1.0f / 60.0f;
+
+    initSkeleton();
+    for(int count : counts)
+    {
+        std::vector<AnimationState> states(count);
+        for(AnimationState& state : states)
+        {
+            state.phase = (float)(rand() % 100) / 100.0f;
+            state.blend = state.target = (float)(rand() % 101) / 100.0f;
+        }
+        std::vector<GLfloat> angles((size_t)count * NumNodes);
+        SkeletonPoses many;
+        many.resize(&skeleton, count);
+
+        for(int mode=0; mode<3; ++mode)
+        {
+            gaits.walk.interpolation = gaits.run.interpolation = modes[mode];
+            double sampling = timeCpu(iterations, [&]() { gaits.update(states.data(), count, frameSeconds, angles.data()); });
+            double posing = timeCpu(iterations, [&]()
+            {
+                for(int i=0; i<count; ++i)
+                {
+                    glm::mat4 root = glm::translate(glm::mat4(1.0f), glm::vec3(i % 100, 1.9*TORSO_HEIGHT, i / 100));
+                    poseHorse(many, i, &angles[(size_t)i * NumNodes], root);
+                }
+                many.evaluate();
+            });
+            double total = sampling + posing;
+
+            printf("animations %6d %-6s  sample+blend %8.3f ms  pose+evaluate %8.3f ms  total %8.3f ms  %s %.1f ms budget\n",
+                   count, names[mode], sampling, posing, total, total <= ANIMATION_BUDGET_MS ? "within" : "OVER", ANIMATION_BUDGET_MS);
+        }
+    }
+    gaits.walk.interpolation = gaits.run.interpolation = INTERPOLATE_SLERP;
+}
+
+// animating and filling the instances of 10000 crowd horses on 1 job thread up to every core, and
+// at least as many threads as --threads asks for, against the same work done in one loop
+void benchmarkJobs()
+{
+    const int count = 10000;
+    const int iterations = 50;
+    const float frameSeconds = 1.0f / 60.0f;
+
+    std::vector<int> threads;
+    const int most = std::max((int)std::thread::hardware_concurrency(), jobs.size());
+    for(int t = 1; t < most; t *= 2)
+    {
+        threads.push_back(t);
+    }
+    threads.push_back(most);
+    const int threads_was = jobs.size();
+
+    initSkeleton();
+    Crowd many;
+    many.spawn(count, gridX, gridZ);
+
+    double serial = timeCpu(iterations, [&]()
+    {
+        many.update(frameSeconds);
+        many.fill();
+    });
+    printf("jobs %5d horses  one loop   %7.3f ms\n", count, serial);
+
+    for(int t : threads)
+    {
+        jobs.resize(t);
+        double ms = timeCpu(iterations, [&]()
+        {
+            JobCounter animated, filled;
+            jobs.parallelFor(count, CROWD_SLICE, [&](int first, int n) { many.update(first, n, frameSeconds); }, animated);
+            jobs.parallelFor(count, CROWD_SLICE, [&](int first, int n) { many.fill(first, n); }, filled, &animated);
+            jobs.wait(filled);
+        });
+        printf("jobs %5d horses  %2d thread(s) %7.3f ms  x%.2f over one loop, %3.0f%% of linear scaling\n",
+               count, t, ms, serial / ms, 100.0 * serial / ms / t);
+    }
+    jobs.resize(threads_was);
+}
+
+// N horses drawn part by part through the node drawing path against one instanced crowd draw
+void benchmarkCrowd(const ShaderProgram &shader, const ShaderProgram &shader_crowd)
+{
+    const int counts[] = { 1, 100, 1000, 10000 };
+    const float frameSeconds = 1.0f / 60.0f;
+    bool texture_was_on = texture_on;
+
+    if (horseVAO == 0)
+    {
+        initHorseBuffers();
+    }
+    texture_on = false;
+    setBenchmarkCamera(shader);
+    shader.setBool("texture_on", false);
+
+    for(int count : counts)
+    {
+        Crowd many;
+        many.init(horseVBO[0], horseVBO[1]);
+        many.spawn(count, gridX, gridZ);
+        int frames = std::max(5, 20000 / count);
+
+        double parts = timeFrames(frames, [&]()
+        {
+            many.update(frameSeconds);
+            shader.use();
+            shader_current = &shader;
+            glBindVertexArray(horseVAO);
+            for(int i=0; i<count; ++i)
+            {
+                drawSkeleton(many.poses.worldOf(i));
+            }
+            glBindVertexArray(0);
+        });
+        double instanced = timeFrames(frames, [&]()
+        {
+            many.update(frameSeconds);
+            many.upload();
+            shader_crowd.use();
+            many.draw();
+        });
+
+        printf("horses %6d  per part %9.3f ms (%d draws)  instanced %8.3f ms (1 draw)  x%.1f\n",
+               count, parts, count * NumNodes, instanced, parts / instanced);
+
+        many.release();
+    }
+
+    texture_on = texture_was_on;
+}
+
+// depth-pass GPU time and shadow texel size of the original single map against 1-4 cascades, with 1000 horses
+void benchmarkShadows(const ShaderProgram &shader, const ShaderProgram &shader_depth, const ShaderProgram &shader_crowd_depth)
+{
+    const float distances[] = { 10.0f, 40.0f, 80.0f };
+    const int frames = 50;
+    int crowd_was = crowd_size;
+
+    setBenchmarkCamera(shader);
+    crowd_size = 1000;
+    updateCrowd(0.0f);
+
+    // case 0 is the single 130 degree map the cascades replace
+    for(int cascades = 0; cascades <= MAX_CASCADES; ++cascades)
+    {
+        shadows.create(cascades == 0 ? 1 : cascades, 1024);
+        if(cascades == 0)
+        {
+            shadows.fitSingle(lightPos);
+        }
+        else
+        {
+            shadows.fit(View, glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, viewDistance(), lightPos);
+        }
+        setBenchmarkCamera(shader);
+
+        double gpu = timeGpu(frames, [&](int) { renderShadowCasters(shader_depth, shader_crowd_depth, true); });
+
+        int casters = 0;
+        for(int c=0; c<shadows.count; ++c)
+        {
+            casters += shadows.casters[c];
+        }
+        char label[16] = "single";
+        if(cascades > 0)
+        {
+            snprintf(label, sizeof(label), "%d cascade%s", cascades, cascades > 1 ? "s" : "");
+        }
+        printf("shadows %-10s depth pass %7.3f ms GPU (%5d casters)  texel", label, gpu, casters);
+        for(float distance : distances)
+        {
+            glm::vec3 p = c_pos + distance * glm::normalize(-c_pos);
+            printf("  %.0fm: %6.2f cm", distance, 100.0f * shadows.texelSize(shadows.cascadeAt(distance), p));
+        }
+        printf("\n");
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    crowd_size = crowd_was;
+    shadows.create(shadow_cascades, shadow_resolution);
+    shadowCache.invalidate();
+}
+
+// shadow pass GPU time per frame through the dirty tracking: the horse standing still,
+// running, and the camera orbiting, against redrawing everything every frame
+void benchmarkShadowCache(const ShaderProgram &shader, const ShaderProgram &shader_depth, const ShaderProgram &shader_crowd_depth)
+{
+    const int frames = 200;
+    const char *names[] = { "idle", "running", "orbiting" };
+    float horizontal_was = c_horizontal;
+
+    resetHorse();
+    shadows.create(shadow_cascades, shadow_resolution);
+    for(int motion = 0; motion < 3; ++motion)
+    {
+        ShadowCache cache;
+        double always = 0.0, cached = 0.0;
+        for(int tracked = 0; tracked < 2; ++tracked)
+        {
+            resetHorse();
+            c_horizontal = horizontal_was;
+            double gpu = timeGpu(frames, [&](int i)
+            {
+                if(motion == 1)
+                {
+                    gaitPose(i % 6 + 1, theta);
+                }
+                else if(motion == 2)
+                {
+                    c_horizontal = horizontal_was + i;
+                }
+                c_pos = glm::vec3(c_radius * glm::cos(glm::radians(c_horizontal)), 0.0f, c_radius * glm::sin(glm::radians(c_horizontal)));
+                View = glm::lookAt(c_pos, glm::vec3(0.0f), c_up);
+                shadows.fit(View, glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, viewDistance(), lightPos);
+                uploadBenchmarkFrame();
+
+                ShadowWork work = tracked ? cache.check(View) : SHADOW_ALL;
+                if(work != SHADOW_REUSE)
+                {
+                    renderShadowCasters(shader_depth, shader_crowd_depth, work == SHADOW_ALL);
+                }
+            });
+            if(tracked)
+            {
+                cached = gpu;
+            }
+            else
+            {
+                always = gpu;
+            }
+        }
+        printf("shadow cache %-8s every frame %7.3f ms GPU  tracked %7.3f ms GPU (%d full, %d horse only, %d skipped)\n",
+               names[motion], always, cached, cache.all, cache.casters, cache.reused);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    c_horizontal = horizontal_was;
+    resetHorse();
+    setBenchmarkCamera(shader);
+    shadowCache.invalidate();
+}
+
+// scene pass frame time of the uber-shader, branching on uniforms per fragment, against the
+// variant built for each feature combination, from the orbit camera raised 30 degrees so the
+// ground fills the screen; the cascades are drawn once first
+void benchmarkPermutations(const ShaderProgram &shader, const ShaderProgram &shader_depth, const ShaderProgram &shader_crowd_depth)
+{
+    const int frames = 100;
+    bool texture_was_on = texture_on, shadow_was_on = shadow_on;
+
+    setBenchmarkCamera(shader);
+    c_pos = c_radius * glm::vec3(0.0f, sin(glm::radians(30.0f)), cos(glm::radians(30.0f)));
+    View = glm::lookAt(c_pos, glm::vec3(0.0f), c_up);
+    cameraFrustum.extract(Projection * View);
+    shadows.create(shadow_cascades, shadow_resolution);
+    shadows.fit(View, glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, viewDistance(), lightPos);
+    uploadBenchmarkFrame();
+    renderShadowCasters(shader_depth, shader_crowd_depth, true);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+    glViewport(0, 0, WIDTH, HEIGHT);
+
+    struct Case { const char *name; bool textured, shadowed; int kernel; };
+    const Case cases[] = {
+        { "lines", false, false, 0 }, { "textured", true, false, 0 },
+        { "shadowed 1x1", true, true, 1 }, { "shadowed 3x3", true, true, 3 }, { "shadowed 5x5", true, true, 5 } };
+    for(const Case &c : cases)
+    {
+        texture_on = c.textured;
+        shadow_on = c.shadowed;
+        const ShaderProgram &variant = *sceneShaders.find(sceneDefines(c.textured, c.shadowed, SHADOW_PCF, c.kernel));
+        // one frame first, so neither side pays for the driver's first use of a program
+        auto draw = [&](const ShaderProgram &program)
+        {
+            auto frame = [&]()
+            {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                program.use();
+                renderScene(program);
+            };
+            frame();
+            glFinish();
+            return timeFrames(frames, frame);
+        };
+
+        // the uber-shader only ever filters 3 x 3
+        printf("permutations %-13s", c.name);
+        if(!c.shadowed || c.kernel == 3)
+        {
+            shader.use();
+            shader.setBool("texture_on", texture_on);
+            shader.setBool("shadow_on", shadow_on);
+            printf(" uber %7.3f ms ", draw(shader));
+        }
+        else
+        {
+            printf(" uber %7s    ", "-");
+        }
+        printf(" variant %7.3f ms\n", draw(variant));
+    }
+
+    texture_on = texture_was_on;
+    shadow_on = shadow_was_on;
+    setBenchmarkCamera(shader);
+    shadowCache.invalidate();
+}
+
+// GPU time per frame of every shadow filter, from the orbit camera raised 30 degrees: making the
+// moment maps from the cascade depths, for the two filters that need them, and the scene pass
+// reading the shadows, with the shadow map fetches of each shaded fragment. Each pass is also
+// timed to glFinish, for drivers whose timer queries miss work they defer (llvmpipe)
+void benchmarkShadowFilters(const ShaderProgram &shader, const ShaderProgram &shader_depth, const ShaderProgram &shader_crowd_depth)
+{
+    const int frames = 50;
+    bool texture_was_on = texture_on, shadow_was_on = shadow_on;
+    int filter_was = shadow_filter, kernel_was = pcf_kernel;
+
+    setBenchmarkCamera(shader);
+    c_pos = c_radius * glm::vec3(0.0f, sin(glm::radians(30.0f)), cos(glm::radians(30.0f)));
+    View = glm::lookAt(c_pos, glm::vec3(0.0f), c_up);
+    cameraFrustum.extract(Projection * View);
+    shadows.create(shadow_cascades, shadow_resolution);
+    shadows.fit(View, glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, viewDistance(), lightPos);
+    shadows.compare(false);
+    uploadBenchmarkFrame();
+    renderShadowCasters(shader_depth, shader_crowd_depth, true);
+    shadowMoments.create(shadows.count, shadows.resolution);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+    glViewport(0, 0, WIDTH, HEIGHT);
+
+    texture_on = shadow_on = true;
+    for(int filter = 0; filter < SHADOW_FILTERS; ++filter)
+    {
+        for(int kernel : PCF_KERNELS)
+        {
+            // the moment filters have no kernel
+            if(filtersMoments(filter) && kernel != PCF_KERNELS[0])
+            {
+                continue;
+            }
+            shadow_filter = filter;
+            pcf_kernel = kernel;
+            shadows.compare(filter == SHADOW_HARDWARE);
+
+            double moments = 0.0, momentsFinished = 0.0;
+            if(filtersMoments(filter))
+            {
+                moments = timeGpu(frames, [&](int) { renderShadowMoments(filter); });
+                momentsFinished = timeFrames(frames, [&]() { renderShadowMoments(filter); });
+            }
+
+            const ShaderProgram &variant = *sceneShaders.find(sceneDefines(true, true, filter, kernel));
+            auto frame = [&](int)
+            {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                variant.use();
+                renderScene(variant);
+            };
+            frame(0);
+            double scene = timeGpu(frames, frame);
+            double sceneFinished = timeFrames(frames, [&]() { frame(0); });
+
+            char label[24];
+            if(filtersMoments(filter))
+            {
+                snprintf(label, sizeof(label), "%s", SHADOW_FILTER_NAMES[filter]);
+                printf("shadow filter %-12s moments %7.3f ms GPU %8.3f ms finished  scene %7.3f ms GPU %8.3f ms finished  "
+                       "1 trilinear fetch, %d texels blurred per map texel\n", label, moments, momentsFinished, scene, sceneFinished, 5 + 5);
+            }
+            else
+            {
+                snprintf(label, sizeof(label), "%s %dx%d", SHADOW_FILTER_NAMES[filter], kernel, kernel);
+                printf("shadow filter %-12s moments %7s        %8s              scene %7.3f ms GPU %8.3f ms finished  %d %sfetch%s\n",
+                       label, "-", "-", scene, sceneFinished, kernel * kernel, filter == SHADOW_HARDWARE ? "compared 2 x 2 " : "depth ",
+                       kernel > 1 ? "es" : "");
+            }
+        }
+    }
+
+    texture_on = texture_was_on;
+    shadow_on = shadow_was_on;
+    shadow_filter = filter_was;
+    pcf_kernel = kernel_was;
+    shadows.compare(false);
+    setBenchmarkCamera(shader);
+    shadowCache.invalidate();
+}
+
+// the atlas's lights drawn as before the layered pass: each face of each light on its own, its
+// tile picked by the viewport, every caster drawn once per face
+void renderPointShadowFaces(const ShaderProgram &shader_face, const ShaderProgram &shader_crowd_face)
+{
+    Frustum scene = pointShadowScene();
+    lightCulls = CullStats();
+    if(crowd_size > 0)
+    {
+        jobs.wait(crowdFilled);
+        crowd.cullCasters(scene, lightCulls.crowd);
+    }
+
+    shadowAtlas.begin(false);
+    for(int light=0; light<(int)shadowAtlas.lights.size(); ++light)
+    {
+        for(int face=0; face<6; ++face)
+        {
+            shader_face.use();
+            shadowAtlas.bindFace(shader_face, light, face);
+            renderGrid(shader_face, scene, 0.0f, lightCulls.grid);
+            renderHorse(shader_face, scene, lightCulls.parts);
+            if(crowd_size > 0)
+            {
+                shader_crowd_face.use();
+                shadowAtlas.bindFace(shader_crowd_face, light, face);
+                crowd.drawCasters(0);
+            }
+        }
+    }
+    shadowAtlas.end();
+}
+
+// GPU time of the point light cube shadows for 1 to 8 lights around the horse, with 1000 crowd
+// horses: six passes a light, one per face, against one pass for every ATLAS_LIGHTS_PER_PASS
+// lights through point_shadow.gs; all lights share one atlas of ATLAS_BUDGET bytes, so their
+// faces shrink as they grow in number. Each is also timed to glFinish (llvmpipe)
+void benchmarkPointShadows(const ShaderProgram &shader)
+{
+    const int frames = 20;
+    int crowd_was = crowd_size;
+
+    setBenchmarkCamera(shader);
+    uploadBenchmarkFrame();
+    crowd_size = 1000;
+    updateCrowd(0.0f);
+    shadowAtlas.create(ATLAS_BUDGET);
+
+    const ShaderProgram &layered = *pointShadowShaders.find("");
+    const ShaderProgram &layeredCrowd = *pointShadowShaders.find("#define CROWD\n");
+    const ShaderProgram &faces = *faceShadowShaders.find("#define FACE_PASS\n");
+    const ShaderProgram &facesCrowd = *faceShadowShaders.find("#define FACE_PASS\n#define CROWD\n");
+    for(int count : { 1, 2, 4, 8 })
+    {
+        // the lamps on a circle around the horse, at the light's height
+        std::vector<PointShadow> lights;
+        for(int i=0; i<count; ++i)
+        {
+            float angle = glm::two_pi<float>() * i / count;
+            lights.push_back(pointShadowAt(glm::vec3(10.0f * cos(angle), lightPos.y, 10.0f * sin(angle))));
+        }
+        shadowAtlas.place(lights, shadow_resolution);
+        renderPointShadowFaces(faces, facesCrowd);
+        renderPointShadows(layered, layeredCrowd);
+
+        double face = timeGpu(frames, [&](int) { renderPointShadowFaces(faces, facesCrowd); });
+        double faceFinished = timeFrames(frames, [&]() { renderPointShadowFaces(faces, facesCrowd); });
+        double pass = timeGpu(frames, [&](int) { renderPointShadows(layered, layeredCrowd); });
+        double passFinished = timeFrames(frames, [&]() { renderPointShadows(layered, layeredCrowd); });
+        int passes = (count + ATLAS_LIGHTS_PER_PASS - 1) / ATLAS_LIGHTS_PER_PASS;
+
+        printf("point shadows %d light%s  %4d x %4d faces in %d x %d  per face: %2d passes %8.3f ms GPU %8.3f ms finished  "
+               "layered: %d pass%s %8.3f ms GPU %8.3f ms finished\n", count, count > 1 ? "s" : " ",
+               shadowAtlas.tile, shadowAtlas.tile, shadowAtlas.size, shadowAtlas.size, 6 * count, face, faceFinished,
+               passes, passes > 1 ? "es" : "  ", pass, passFinished);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+    glViewport(0, 0, WIDTH, HEIGHT);
+    crowd_size = crowd_was;
+    shadowCache.invalidate();
+}
+
+// the RGB of the target, for comparing two ways of drawing the same frame
+std::vector<unsigned char> readBenchmarkPixels()
+{
+    std::vector<unsigned char> pixels((size_t)WIDTH * HEIGHT * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    return pixels;
+}
+
+// frame time of 1, 64, 256 and 1024 moving point lamps over the textured scene, from the orbit
+// camera raised 30 degrees: binning them into the clusters on the CPU, and the scene pass shading
+// each fragment with its cluster's lamps against shading it with every lamp, with the lamps
+// listed per cluster and the pixels where the two differ by more than one step
+void benchmarkClusteredLights(const ShaderProgram &shader)
+{
+    const int frames = 10;
+    bool texture_was_on = texture_on, shadow_was_on = shadow_on;
+    int lamps_were = lamp_count;
+
+    setBenchmarkCamera(shader);
+    c_pos = c_radius * glm::vec3(0.0f, sin(glm::radians(30.0f)), cos(glm::radians(30.0f)));
+    View = glm::lookAt(c_pos, glm::vec3(0.0f), c_up);
+    cameraFrustum.extract(Projection * View);
+    uploadBenchmarkFrame();
+    texture_on = true;
+    shadow_on = false;
+
+    auto scenePass = [&](const ShaderProgram &variant)
+    {
+        return [&variant](int)
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            variant.use();
+            if(lamp_count > 0)
+            {
+                lamps.setUniforms(variant);
+            }
+            renderScene(variant);
+        };
+    };
+
+    lamp_count = 0;
+    auto plain = scenePass(*sceneShaders.find(sceneDefines(true, false, SHADOW_PCF, 0)));
+    plain(0);
+    printf("lamps %4d  %30s scene %8.3f ms GPU %8.3f ms finished\n", 0, "", timeGpu(frames, plain),
+           timeFrames(frames, [&]() { plain(0); }));
+
+    const std::string clusteredDefines = sceneDefines(true, false, SHADOW_PCF, 0, false, true);
+    for(int count : { 1, 64, 256, 1024 })
+    {
+        lamp_count = count;
+        lamps.scatter(count, std::min(std::min(gridX, gridZ), 50));
+        lamps.animate(0.0);
+        double binning = timeCpu(100, [&]()
+        {
+            lamps.bin(cameraFrustum, View, glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, viewDistance(), WIDTH, HEIGHT);
+        });
+        lamps.upload();
+
+        auto clustered = scenePass(*sceneShaders.find(clusteredDefines));
+        auto every = scenePass(*sceneShaders.find(clusteredDefines + "#define ALL_LAMPS\n"));
+        clustered(0);
+        std::vector<unsigned char> clusteredPixels = readBenchmarkPixels();
+        double clusteredGpu = timeGpu(frames, clustered);
+        double clusteredFinished = timeFrames(frames, [&]() { clustered(0); });
+        every(0);
+        std::vector<unsigned char> everyPixels = readBenchmarkPixels();
+        double everyGpu = timeGpu(frames / 2, every);
+        double everyFinished = timeFrames(frames / 2, [&]() { every(0); });
+
+        int differing = 0;
+        for(size_t i=0; i<clusteredPixels.size(); i+=3)
+        {
+            for(int c=0; c<3; ++c)
+            {
+                if(abs(clusteredPixels[i + c] - everyPixels[i + c]) > 1)
+                {
+                    ++differing;
+                    break;
+                }
+            }
+        }
+        printf("lamps %4d  %4d seen, bin %7.3f ms CPU  clustered %8.3f ms GPU %8.3f ms finished, "
+               "%5.1f lamps per cluster (at most %3d)  every lamp %9.3f ms GPU %9.3f ms finished  %d pixels differ\n",
+               count, (int)lamps.visible.size(), binning, clusteredGpu, clusteredFinished,
+               (double)lamps.listed() / CLUSTERS, lamps.mostInCluster(), everyGpu, everyFinished, differing);
+    }
+
+    texture_on = texture_was_on;
+    shadow_on = shadow_was_on;
+    lamp_count = lamps_were;
+    setBenchmarkCamera(shader);
+}
+
+// frames per second of the CPU rasterizer at 800 x 800 and 1920 x 1080 as the raster threads grow,
+// the ground in lines, textured, and textured with cascaded shadows; needs no GL
+void benchmarkSoftware()
+{
+    const int sizes[][2] = { { 800, 800 }, { 1920, 1080 } };
+    const char *modes[] = { "lines", "textured", "shadows" };
+    const int frames = 20;
+    bool texture_was_on = texture_on, shadow_was_on = shadow_on;
+
+    std::vector<int> threads;
+    const int hardware = std::max(1, (int)std::thread::hardware_concurrency());
+    for(int t = 1; t < hardware; t *= 2)
+    {
+        threads.push_back(t);
+    }
+    threads.push_back(hardware);
+
+    // the orbit camera raised 30 degrees so the ground fills the view
+    resetHorse();
+    glm::vec3 eye = c_radius * glm::vec3(0.0f, sin(glm::radians(30.0f)), cos(glm::radians(30.0f)));
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), c_up);
+
+    SoftwareRenderer renderer;
+    for(int s=0; s<2; ++s)
+    {
+        renderer.resize(sizes[s][0], sizes[s][1]);
+        glm::mat4 projection = glm::perspective(glm::radians(fov), (float)sizes[s][0] / sizes[s][1], 0.1f, viewDistance());
+        for(int mode=0; mode<3; ++mode)
+        {
+            texture_on = mode > 0;
+            shadow_on = mode == 2;
+            double single = 0.0;
+            for(size_t t=0; t<threads.size(); ++t)
+            {
+                renderer.raster.setThreads(threads[t]);
+                renderer.render(view, projection);
+                double ms = timeCpu(frames, [&]() { renderer.render(view, projection); });
+                if(t == 0)
+                {
+                    single = ms;
+                }
+                printf("software %4dx%-4d %-8s %2d thread%s %7.1f fps %8.2f ms  x%.2f  (%d primitives on screen)\n",
+                       sizes[s][0], sizes[s][1], modes[mode], threads[t], threads[t] > 1 ? "s" : " ",
+                       1000.0 / ms, ms, single / ms, renderer.raster.primitives);
+            }
+        }
+    }
+
+    texture_on = texture_was_on;
+    shadow_on = shadow_was_on;
+}
+
+int runBenchmark(const char *name, const ShaderProgram &shader, const ShaderProgram &shader_crowd,
+                 const ShaderProgram &shader_depth, const ShaderProgram &shader_crowd_depth)
+{
+    if(strcmp(name, "grid") == 0)
+    {
+        benchmarkGrid(shader);
+        return 0;
+    }
+    if(strcmp(name, "crowd") == 0)
+    {
+        benchmarkCrowd(shader, shader_crowd);
+        return 0;
+    }
+    if(strcmp(name, "animation") == 0)
+    {
+        benchmarkAnimation();
+        return 0;
+    }
+    if(strcmp(name, "jobs") == 0)
+    {
+        benchmarkJobs();
+        return 0;
+    }
+    if(strcmp(name, "skeleton") == 0)
+    {
+        benchmarkSkeleton();
+        return 0;
+    }
+    if(strcmp(name, "matrixstack") == 0)
+    {
+        benchmarkMatrixStack();
+        return 0;
+    }
+    if(strcmp(name, "culling") == 0)
+    {
+        benchmarkCulling();
+        return 0;
+    }
+    if(strcmp(name, "shadows") == 0)
+    {
+        benchmarkShadows(shader, shader_depth, shader_crowd_depth);
+        return 0;
+    }
+    if(strcmp(name, "shadowcache") == 0)
+    {
+        benchmarkShadowCache(shader, shader_depth, shader_crowd_depth);
+        return 0;
+    }
+    if(strcmp(name, "permutations") == 0)
+    {
+        benchmarkPermutations(shader, shader_depth, shader_crowd_depth);
+        return 0;
+    }
+    if(strcmp(name, "shadowfilters") == 0)
+    {
+        benchmarkShadowFilters(shader, shader_depth, shader_crowd_depth);
+        return 0;
+    }
+    if(strcmp(name, "pointshadows") == 0)
+    {
+        benchmarkPointShadows(shader);
+        return 0;
+    }
+    if(strcmp(name, "clustered") == 0)
+    {
+        benchmarkClusteredLights(shader);
+        return 0;
+    }
+    if(strcmp(name, "software") == 0)
+    {
+        benchmarkSoftware();
+        return 0;
+    }
+
+    fprintf(stderr, "Unknown benchmark: %s\n", name);
+    return -1;
+}
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Clustered forward shading of many point lamps besides the main light.
+// The camera frustum is cut into CLUSTER_TILES_X x CLUSTER_TILES_Y screen
+// tiles and CLUSTER_SLICES slices spaced logarithmically in depth. Every
+// frame the lamps are culled against the camera four at a time (SphereBatch)
+// and each one left is added to the clusters its sphere of influence
+// touches; the scene shader then finds its fragment's cluster from
+// gl_FragCoord and its view depth and shades only the lamps listed there,
+// not all of them. GL 3.3 has no storage buffers, so the lamps, the
+// per-cluster (first, count) pairs and the lamp index lists go to the shader
+// as three texture buffers.
+//----------------------------------------------------------------------------
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 16;
+const int CLUSTER_SLICES = 24;
+const int CLUSTERS = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+const float LAMP_INTENSITY = 4.0f; // a lamp's light one unit away, before its colour
+
+struct PointLamp
+{
+    glm::vec3 centre;  // of the circle it moves on
+    float orbit;       // radius of that circle
+    float phase;       // radians at time zero
+    float radius;      // no light reaches further
+    glm::vec3 color;
+};
+
+class ClusteredLights
+{
+public:
+    std::vector<PointLamp> lamps;
+    std::vector<glm::vec4> positions; // where each lamp is this frame, radius in w
+    SphereBatch spheres;
+    std::vector<int> visible;         // lamps the camera sees, after bin()
+
+    std::vector<GLuint> grid;         // first index and count of every cluster
+    std::vector<GLuint> indices;      // lamps of each cluster, one cluster after another
+
+    GLuint buffers[3];  // lamp data, grid, indices
+    GLuint textures[3]; // the texture buffers over them
+
+    float sliceScale, sliceBias;      // slice = log(depth) * sliceScale + sliceBias
+    int tileWidth, tileHeight;        // pixels of a screen tile
+
+    ClusteredLights() :
+        sliceScale(0.0f), sliceBias(0.0f), tileWidth(1), tileHeight(1), total(0)
+    {
+        for(int i=0; i<3; ++i)
+        {
+            buffers[i] = textures[i] = 0;
+        }
+    }
+
+    // lamps scattered over the ground within `extent` of the origin, with random colours and reach
+    void scatter(int count, int extent)
+    {
+        lamps.resize(count);
+        for(PointLamp &lamp : lamps)
+        {
+            lamp.centre = glm::vec3(rand() % (2 * extent + 1) - extent, 1.0f + (rand() % 200) / 100.0f, rand() % (2 * extent + 1) - extent);
+            lamp.orbit = 1.0f + (rand() % 300) / 100.0f;
+            lamp.phase = (rand() % 628) / 100.0f;
+            lamp.radius = 3.0f + (rand() % 500) / 100.0f;
+            lamp.color = glm::vec3(rand() % 101, rand() % 101, rand() % 101) / 100.0f;
+        }
+    }
+
+    int size() const
+    {
+        return (int)lamps.size();
+    }
+
+    // every lamp at `seconds`, each going round its circle once in about six seconds
+    void animate(double seconds)
+    {
+        positions.resize(lamps.size());
+        spheres.clear();
+        for(size_t i=0; i<lamps.size(); ++i)
+        {
+            const PointLamp &lamp = lamps[i];
+            float angle = lamp.phase + (float)seconds;
+            positions[i] = glm::vec4(lamp.centre + lamp.orbit * glm::vec3(cos(angle), 0.0f, sin(angle)), lamp.radius);
+            spheres.add(positions[i]);
+        }
+    }
+
+    // the lamp lists of every cluster of the camera (fovy in radians) for a `width` x `height`
+    // target; returns how many lamps the camera sees
+    int bin(const Frustum &camera, const glm::mat4 &view, float fovy, float aspect, float zNear, float zFar, int width, int height)
+    {
+        const float logRange = log(zFar / zNear);
+        sliceScale = CLUSTER_SLICES / logRange;
+        sliceBias = -CLUSTER_SLICES * log(zNear) / logRange;
+        tileWidth = (width + CLUSTER_TILES_X - 1) / CLUSTER_TILES_X;
+        tileHeight = (height + CLUSTER_TILES_Y - 1) / CLUSTER_TILES_Y;
+        const float tanY = tan(0.5f * fovy), tanX = tanY * aspect;
+        // screen tiles per unit of x / depth and y / depth, and the tile column and row of the view axis
+        const float tilesX = 0.5f * width / (tanX * tileWidth), tilesY = 0.5f * height / (tanY * tileHeight);
+        const float centreX = 0.5f * width / tileWidth, centreY = 0.5f * height / tileHeight;
+
+        int count = spheres.cull(camera, visible);
+        visible.resize(count);
+
+        // the clusters of each lamp, counted first and then listed
+        ranges.clear();
+        std::fill(counts, counts + CLUSTERS, 0);
+        for(int k=0; k<count; ++k)
+        {
+            const glm::vec4 &sphere = positions[visible[k]];
+            glm::vec3 centre = glm::vec3(view * glm::vec4(glm::vec3(sphere), 1.0f));
+            const float depth = -centre.z, r = sphere.w;
+            if(depth + r < zNear || depth - r > zFar)
+            {
+                continue;
+            }
+            int first = sliceAt(std::max(depth - r, zNear)), last = sliceAt(std::min(depth + r, zFar));
+            for(int s=first; s<=last; ++s)
+            {
+                // the part of the sphere's box in the slice, whose corners bound it on screen
+                float nearest = std::max(std::max(depth - r, zNear), sliceDepth(s, zNear, logRange));
+                float farthest = std::min(depth + r, sliceDepth(s + 1, zNear, logRange));
+                if(nearest > farthest)
+                {
+                    continue;
+                }
+                float lowX = std::min((centre.x - r) / nearest, (centre.x - r) / farthest);
+                float highX = std::max((centre.x + r) / nearest, (centre.x + r) / farthest);
+                float lowY = std::min((centre.y - r) / nearest, (centre.y - r) / farthest);
+                float highY = std::max((centre.y + r) / nearest, (centre.y + r) / farthest);
+                Range range;
+                range.lamp = visible[k];
+                range.slice = s;
+                range.x0 = std::max(0, (int)floor(centreX + lowX * tilesX));
+                range.x1 = std::min(CLUSTER_TILES_X - 1, (int)floor(centreX + highX * tilesX));
+                range.y0 = std::max(0, (int)floor(centreY + lowY * tilesY));
+                range.y1 = std::min(CLUSTER_TILES_Y - 1, (int)floor(centreY + highY * tilesY));
+                if(range.x0 > range.x1 || range.y0 > range.y1)
+                {
+                    continue;
+                }
+                for(int y=range.y0; y<=range.y1; ++y)
+                {
+                    for(int x=range.x0; x<=range.x1; ++x)
+                    {
+                        ++counts[clusterOf(x, y, s)];
+                    }
+                }
+                ranges.push_back(range);
+            }
+        }
+
+        grid.resize(2 * CLUSTERS);
+        total = 0;
+        for(int c=0; c<CLUSTERS; ++c)
+        {
+            grid[2 * c] = total;
+            grid[2 * c + 1] = 0;
+            total += counts[c];
+        }
+        indices.resize(std::max(total, 1u));
+        for(const Range &range : ranges)
+        {
+            for(int y=range.y0; y<=range.y1; ++y)
+            {
+                for(int x=range.x0; x<=range.x1; ++x)
+                {
+                    int c = clusterOf(x, y, range.slice);
+                    indices[grid[2 * c] + grid[2 * c + 1]++] = (GLuint)range.lamp;
+                }
+            }
+        }
+        return count;
+    }
+
+    // the lamps, the grid and the lists into their texture buffers
+    void upload()
+    {
+        if(buffers[0] == 0)
+        {
+            const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+            glGenBuffers(3, buffers);
+            glGenTextures(3, textures);
+            for(int i=0; i<3; ++i)
+            {
+                glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+                glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+                glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+                glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+            }
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+
+        // two texels a lamp: position and reach, then colour
+        data.resize(2 * std::max(lamps.size(), (size_t)1));
+        for(size_t i=0; i<lamps.size(); ++i)
+        {
+            data[2 * i] = positions[i];
+            data[2 * i + 1] = glm::vec4(lamps[i].color, LAMP_INTENSITY);
+        }
+        fill(buffers[0], data.data(), data.size() * sizeof(glm::vec4));
+        fill(buffers[1], grid.data(), grid.size() * sizeof(GLuint));
+        fill(buffers[2], indices.data(), indices.size() * sizeof(GLuint));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // the three texture buffers on units `unit` to `unit` + 2
+    void bind(int unit) const
+    {
+        for(int i=0; i<3; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the cluster uniforms of a scene program built with CLUSTERED
+    void setUniforms(const ShaderProgram &program) const
+    {
+        program.setFloat("sliceScale", sliceScale);
+        program.setFloat("sliceBias", sliceBias);
+        program.setInt("tileWidth", tileWidth);
+        program.setInt("tileHeight", tileHeight);
+        program.setInt("lampCount", size());
+    }
+
+    // lamps listed, summed over the clusters
+    int listed() const
+    {
+        return (int)total;
+    }
+
+    // the most lamps any cluster lists
+    int mostInCluster() const
+    {
+        int most = 0;
+        for(int c=0; c<CLUSTERS; ++c)
+        {
+            most = std::max(most, (int)grid[2 * c + 1]);
+        }
+        return most;
+    }
+
+    void release()
+    {
+        if(buffers[0] != 0)
+        {
+            glDeleteTextures(3, textures);
+            glDeleteBuffers(3, buffers);
+            for(int i=0; i<3; ++i)
+            {
+                buffers[i] = textures[i] = 0;
+            }
+        }
+    }
+
+private:
+    // the screen tiles of one slice a lamp reaches
+    struct Range
+    {
+        int lamp, slice;
+        int x0, x1, y0, y1;
+    };
+    std::vector<Range> ranges;
+    GLuint counts[CLUSTERS];
+    GLuint total;
+    std::vector<glm::vec4> data;
+
+    int sliceAt(float depth) const
+    {
+        return std::max(0, std::min(CLUSTER_SLICES - 1, (int)floor(log(depth) * sliceScale + sliceBias)));
+    }
+
+    static float sliceDepth(int slice, float zNear, float logRange)
+    {
+        return zNear * exp(logRange * slice / CLUSTER_SLICES);
+    }
+
+    static int clusterOf(int x, int y, int slice)
+    {
+        return x + CLUSTER_TILES_X * (y + CLUSTER_TILES_Y * slice);
+    }
+
+    static void fill(GLuint buffer, const void *values, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, values);
+    }
+};
@@ -1,8 +1,8 @@
 const std::string TITLE = "RobotHorse";
 unsigned int WIDTH=800, HEIGHT=800;
 
-const int gridX = 50;
-const int gridZ = 50;
+int gridX = 50; // ground cells on each side of the origin, set by --grid and Key Z
+int gridZ = 50;
 
 //float c_rotate_x = 0.0f;
 float c_vertical = 0.0f;
@@ -13,9 +13,27 @@ float c_dir_z = 0.0f;
 
 float fov = 45.0f;//perspective angle
 
+// far plane of the camera: across the whole ground, and never nearer than the original 100
+float viewDistance()
+{
+    return 2.0f * (float)std::max(std::max(gridX, gridZ), 50);
+}
+
 bool texture_on = false;
 bool shadow_on = false;
 
+int crowd_size = 0; // horses in crowd mode, 0 when off
+
+bool stats_on = false; // print GL call counts
+
+int shadow_cascades = 3;      // layers of the cascaded shadow map
+int shadow_resolution = 1024; // width and height of every layer
+int pcf_kernel = 3;           // texels a side of the PCF filters: 1, 3 or 5
+int shadow_filter = 0;        // a ShadowFilterMode of ShadowFilter.h
+bool shadow_cube = false;     // the point light's cube shadows of ShadowAtlas.h in place of the cascades
+
+int lamp_count = 0; // point lamps shaded through ClusteredLights.h, 0 for none
+
 // lighting
 // -------------
 glm::vec3 lightPos(0.0f, 20.0f, 0.0f);
@@ -40,4 +58,14 @@ void resetConfiguration()
 
     texture_on = false;
     shadow_on = false;
+
+    crowd_size = 0;
+
+    shadow_cascades = 3;
+    shadow_resolution = 1024;
+    pcf_kernel = 3;
+    shadow_filter = 0;
+    shadow_cube = false;
+
+    lamp_count = 0;
 }
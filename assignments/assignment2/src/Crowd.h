@@ -0,0 +1,323 @@
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Crowd mode: many independent horses drawn with one instanced call.
+// Every body part of every horse is one instance of the unit cube; its model
+// matrix and colour come from a per-instance buffer refilled each frame.
+// The main pass draws from a second buffer holding only the horses inside the
+// camera frustum; the shadow pass from a third holding, cascade after cascade,
+// only the horses inside that cascade's light frustum.
+//----------------------------------------------------------------------------
+
+struct CrowdHorse
+{
+    glm::vec3 position;
+    float heading; // degrees about Y
+    float scale;
+};
+
+// per-instance vertex data, attributes 3-6 (model) and 7 (colour)
+struct CrowdInstance
+{
+    glm::mat4 model;
+    glm::vec4 color;
+};
+
+class Crowd
+{
+public:
+    std::vector<CrowdHorse> horses;
+    HorseShape shape; // the parts at the BASE_* sizes, whatever the interactive horse's scale
+    SkeletonPoses poses;
+    std::vector<CrowdInstance> instances;
+
+    GLuint VAO;
+    GLuint instanceVBO;
+
+    // the horses the camera sees
+    std::vector<CrowdInstance> visible;
+    GLuint visibleVAO;
+    GLuint visibleVBO;
+
+    // shadow casters, grouped by cascade
+    std::vector<CrowdInstance> casters;
+    GLuint casterVAO;
+    GLuint casterVBO;
+    int casterFirst[MAX_CASCADES];
+    int casterCount[MAX_CASCADES];
+
+    std::vector<AnimationState> animations; // one per horse
+    std::vector<GLfloat> angles;            // NumNodes per horse, sampled from the gait clips
+    glm::vec4 restBounds; // bounding sphere of a unit horse around its feet, with room for the gait
+    SphereBatch spheres;  // bounds() of every horse, which stay put while they gallop
+    std::vector<int> kept; // horses that passed the last cull
+
+    Crowd() :
+        shape(1.0), VAO(0), instanceVBO(0), visibleVAO(0), visibleVBO(0), casterVAO(0), casterVBO(0) {}
+
+    // the cube comes from the horse's own position and normal buffers
+    void init(GLuint pointsVBO, GLuint normalsVBO)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+        glGenVertexArrays(1, &visibleVAO);
+        glGenBuffers(1, &visibleVBO);
+        glGenVertexArrays(1, &casterVAO);
+        glGenBuffers(1, &casterVBO);
+
+        GLuint arrays[3] = { VAO, visibleVAO, casterVAO };
+        GLuint buffers[3] = { instanceVBO, visibleVBO, casterVBO };
+        for(int i=0; i<3; ++i)
+        {
+            glBindVertexArray(arrays[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, pointsVBO);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+            glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+            pointInstances(buffers[i], 0);
+        }
+        glBindVertexArray(0);
+    }
+
+    // per-instance attributes of the bound VAO read from `buffer`, starting at instance `first`
+    void pointInstances(GLuint buffer, size_t first)
+    {
+        const size_t base = first * sizeof(CrowdInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for(int column=0; column<4; ++column)
+        {
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(CrowdInstance), (void*)(base + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + column, 1);
+        }
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(CrowdInstance), (void*)(base + offsetof(CrowdInstance, color)));
+        glVertexAttribDivisor(7, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // scatter `count` horses over the ground with random size, heading, gait phase and walk/run blend
+    void spawn(int count, int extentX, int extentZ)
+    {
+        horses.resize(count);
+        for(CrowdHorse& horse : horses)
+        {
+            horse.position = glm::vec3(rand() % (2 * extentX + 1) - extentX, 0.0f, rand() % (2 * extentZ + 1) - extentZ);
+            horse.heading = (float)(rand() % 360);
+            horse.scale = 0.5f + (rand() % 100) / 100.0f;
+        }
+        animations.resize(count);
+        for(AnimationState& animation : animations)
+        {
+            animation.phase = (float)(rand() % 100) / 100.0f;
+            animation.blend = animation.target = (float)(rand() % 101) / 100.0f;
+        }
+        angles.resize((size_t)count * NumNodes);
+        poses.resize(&skeleton, count);
+        instances.resize((size_t)count * skeleton.size());
+
+        SkeletonPoses rest;
+        rest.resize(&skeleton, 1);
+        poseHorse(rest, 0, restTheta, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, shape.lift(), 0.0f)), shape);
+        rest.evaluate();
+        restBounds = skeletonBounds(rest.worldOf(0), shape);
+        restBounds.w *= 1.25f;
+
+        spheres.clear();
+        for(int i=0; i<count; ++i)
+        {
+            spheres.add(bounds(i));
+        }
+    }
+
+    // bounding sphere of one horse
+    glm::vec4 bounds(int i) const
+    {
+        const CrowdHorse& horse = horses[i];
+        glm::vec3 offset = glm::vec3(RotateY(horse.heading) * glm::vec4(glm::vec3(restBounds), 0.0f));
+        return glm::vec4(horse.position + horse.scale * offset, horse.scale * restBounds.w);
+    }
+
+    int size() const
+    {
+        return (int)horses.size();
+    }
+
+    // advance every gait by `seconds` and evaluate all skeletons
+    void update(float seconds)
+    {
+        update(0, size(), seconds);
+    }
+
+    // the same for horses [first, first + count); horses share nothing, so slices can run in parallel
+    void update(int first, int count, float seconds)
+    {
+        gaits.update(animations.data() + first, count, seconds, angles.data() + (size_t)first * NumNodes);
+        for(int i = first; i < first + count; ++i)
+        {
+            const CrowdHorse& horse = horses[i];
+            glm::mat4 root = glm::translate(glm::mat4(1.0f), horse.position) * RotateY(horse.heading)
+                             * glm::scale(glm::mat4(1.0f), glm::vec3(horse.scale))
+                             * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, shape.lift(), 0.0f));
+            poseHorse(poses, i, &angles[(size_t)i * NumNodes], root, shape);
+        }
+        poses.evaluate(first, count);
+    }
+
+    // one instance per body part: joint * shape, and the part's colour
+    void fill()
+    {
+        fill(0, size());
+    }
+
+    // the instances of horses [first, first + count)
+    void fill(int first, int count)
+    {
+        glm::mat4 shapes[NumNodes];
+        for(int part=0; part<NumNodes; ++part)
+        {
+            shapes[part] = partShape(glm::vec3(shape.sizes[part]));
+        }
+
+        const int parts = skeleton.size();
+        for(int i = first; i < first + count; ++i)
+        {
+            const glm::mat4* world = poses.worldOf(i);
+            CrowdInstance* out = &instances[(size_t)i * parts];
+            for(int j=0; j<parts; ++j)
+            {
+                out[j].model = world[j] * shapes[skeleton.part[j]];
+                out[j].color = partColor[skeleton.part[j]];
+            }
+        }
+    }
+
+    // fill() and every instance into the buffer draw() reads
+    void upload()
+    {
+        fill();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(CrowdInstance), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(CrowdInstance), instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // every part of every horse in one call
+    void draw() const
+    {
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, NumVertices, (GLsizei)instances.size());
+        glBindVertexArray(0);
+        restorePatchAttribute();
+    }
+
+    // copy the instances of the horses the camera sees into the visible buffer, after fill();
+    // returns how many horses were kept
+    int cull(const Frustum& camera)
+    {
+        visible.clear();
+        int count = spheres.cull(camera, kept);
+        copyKept(visible, count);
+
+        glBindBuffer(GL_ARRAY_BUFFER, visibleVBO);
+        glBufferData(GL_ARRAY_BUFFER, visible.size() * sizeof(CrowdInstance), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, visible.size() * sizeof(CrowdInstance), visible.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return count;
+    }
+
+    // the horses kept by cull()
+    void drawVisible() const
+    {
+        if(visible.empty())
+        {
+            return;
+        }
+        glBindVertexArray(visibleVAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, NumVertices, (GLsizei)visible.size());
+        glBindVertexArray(0);
+        restorePatchAttribute();
+    }
+
+    // copy the instances of the horses each cascade sees into the caster buffer, after fill();
+    // adds the horses tested and kept to `counts`
+    void cullCasters(const ShadowCascades& shadows, CullCount& counts)
+    {
+        casters.clear();
+        for(int c=0; c<shadows.count; ++c)
+        {
+            casterFirst[c] = (int)casters.size();
+            int count = spheres.cull(shadows.frustums[c], kept);
+            copyKept(casters, count);
+            counts.add(size(), count);
+            casterCount[c] = (int)casters.size() - casterFirst[c];
+        }
+        uploadCasters();
+    }
+
+    // the same for a single frustum, the horses it sees drawn by drawCasters(0);
+    // for the point light, whose six faces share one pass
+    void cullCasters(const Frustum& frustum, CullCount& counts)
+    {
+        casters.clear();
+        int count = spheres.cull(frustum, kept);
+        copyKept(casters, count);
+        counts.add(size(), count);
+        casterFirst[0] = 0;
+        casterCount[0] = (int)casters.size();
+        uploadCasters();
+    }
+
+    // the casters of one cascade; returns how many horses
+    int drawCasters(int cascade)
+    {
+        if(casterCount[cascade] == 0)
+        {
+            return 0;
+        }
+        glBindVertexArray(casterVAO);
+        pointInstances(casterVBO, casterFirst[cascade]);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, NumVertices, casterCount[cascade]);
+        glBindVertexArray(0);
+        restorePatchAttribute();
+        return casterCount[cascade] / skeleton.size();
+    }
+
+    void release()
+    {
+        if(VAO != 0)
+        {
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &instanceVBO);
+            glDeleteVertexArrays(1, &visibleVAO);
+            glDeleteBuffers(1, &visibleVBO);
+            glDeleteVertexArrays(1, &casterVAO);
+            glDeleteBuffers(1, &casterVBO);
+            VAO = instanceVBO = visibleVAO = visibleVBO = casterVAO = casterVBO = 0;
+        }
+    }
+
+private:
+    void uploadCasters()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, casterVBO);
+        glBufferData(GL_ARRAY_BUFFER, casters.size() * sizeof(CrowdInstance), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, casters.size() * sizeof(CrowdInstance), casters.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // append the instances of the first `count` horses in `kept` to `out`
+    void copyKept(std::vector<CrowdInstance>& out, int count) const
+    {
+        const size_t parts = skeleton.size();
+        for(int k=0; k<count; ++k)
+        {
+            std::vector<CrowdInstance>::const_iterator first = instances.begin() + kept[k] * parts;
+            out.insert(out.end(), first, first + parts);
+        }
+    }
+};
@@ -0,0 +1,25 @@
+//----------------------------------------------------------------------------
+// Per-frame uniforms shared by every program through the std140 block
+//
+//     layout (std140) uniform FrameData { ... };
+//
+// declared at the top of each shader. vec3 members of the block take 16 bytes
+// in std140, hence the vec4s here; cascadeCount is padded to the next vec4.
+//----------------------------------------------------------------------------
+const GLuint FRAME_DATA_BINDING = 0;
+
+struct FrameData
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 cascadeMatrices[4];   // MAX_CASCADES light matrices
+    glm::vec4 cascadeSplits;        // far end of each cascade along the view axis
+    glm::vec4 cascadeFars;          // far plane of each light frustum, the depth range of the moment maps
+    GLint cascadeCount;
+    GLint padding[3];
+    glm::vec4 lightPos;
+    glm::vec4 viewPos;
+    glm::vec4 lightAmbient;
+    glm::vec4 lightDiffuse;
+    glm::vec4 lightSpecular;
+};
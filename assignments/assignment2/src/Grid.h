@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Ground grid as a quadtree of patches with distance-based level of detail.
+// The ground is (2*cellsX) x (2*cellsZ) unit cells centred at the origin.
+// Every patch is the same mesh of GRID_CHUNK x GRID_CHUNK cells, built once:
+// a leaf patch covers GRID_CHUNK unit cells a side, and each level up covers
+// twice the width with cells twice as wide. select() walks the quadtree from
+// the root, dropping the nodes a frustum does not see and stopping at the
+// first node whose cells would look no wider than GRID_PIXEL_ERROR pixels.
+// The patches it keeps go out in one instanced draw, each instance giving its
+// corner and cell size to the aPatch attribute of the ground shaders, which
+// scale and move the texture coordinates with the position: they stay the
+// world x/z of each vertex, so with GL_REPEAT the texture runs on unbroken
+// across patches of any level. A shallow skirt hangs under every patch edge
+// to hide cracks where a coarse patch meets finer ones.
+// Nothing is stored per node, so resizing the ground costs nothing.
+//----------------------------------------------------------------------------
+const int GRID_CHUNK = 10;             // cells per side of a patch
+const float GRID_PIXEL_ERROR = 4.0f;   // widest a merged cell may look on screen, in pixels
+const float GRID_SKIRT = 1.0f / 32.0f; // depth of the skirts, in cells of their patch
+
+// cells on each side of the origin for a ground `cells` wide, rounded up to whole patches
+int gridHalfSize(int cells)
+{
+    return std::max(1, (cells + GRID_CHUNK - 1) / GRID_CHUNK) * GRID_CHUNK / 2;
+}
+
+// An instanced draw leaves the current value of the attributes it reads from an array
+// undefined, and the meshes without a patch read aPatch from that value: every draw that
+// feeds location 3 from an array puts back the (0, 0, 0, 1) of a unit patch at the origin
+inline void restorePatchAttribute()
+{
+    glVertexAttrib4f(3, 0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+class Grid
+{
+public:
+    GLuint VAO;
+    GLuint VBO;
+    GLuint EBO;
+    GLuint instanceVBO; // one vec4 per patch: corner x, 0, corner z, cell size
+
+    int cellsX;
+    int cellsZ;
+    int levels; // the root covers GRID_CHUNK << levels cells a side
+
+    GLsizei triangleIndices; // number of indices for the textured patch, skirts included
+    GLsizei lineIndices;     // number of indices for the line patch, stored after the triangles
+
+    std::vector<glm::vec4> patches; // kept by the last select()
+    int tested;                     // nodes the last select() tested against the frustum
+
+    Grid() :
+        VAO(0), VBO(0), EBO(0), instanceVBO(0), cellsX(0), cellsZ(0), levels(0),
+        triangleIndices(0), lineIndices(0), tested(0) {}
+
+    // cellsX cells on each side of the origin along X, cellsZ along Z, both multiples of GRID_CHUNK / 2;
+    // the patch mesh is made on the first call only
+    void build(int numCellsX, int numCellsZ)
+    {
+        resize(numCellsX, numCellsZ);
+        if(VAO == 0)
+        {
+            buildPatch();
+        }
+    }
+
+    // the quadtree for the new size, without touching GL; select() works after this alone
+    void resize(int numCellsX, int numCellsZ)
+    {
+        cellsX = numCellsX;
+        cellsZ = numCellsZ;
+        levels = 0;
+        while((GRID_CHUNK << levels) < 2 * std::max(cellsX, cellsZ))
+        {
+            ++levels;
+        }
+    }
+
+    // the unit patch: (GRID_CHUNK + 1)^2 vertices on y = 0, then a skirt vertex under each edge vertex.
+    // vertexData gets position(3), normal(3), texture(2), the layout of buffer_data_grid with texture = x/z;
+    // indexData gets the triangles, skirts included, then the line segments. Returns how many triangle indices
+    static GLsizei patchMesh(std::vector<GLfloat>& vertexData, std::vector<GLuint>& indexData)
+    {
+        const int n = GRID_CHUNK;
+        const int columns = n + 1;
+
+        vertexData.clear();
+        indexData.clear();
+        for(int j = 0; j <= n; ++j)
+        {
+            for(int i = 0; i <= n; ++i)
+            {
+                GLfloat vertex[8] = { (float)i, 0.0f, (float)j, 0.0f, 1.0f, 0.0f, (float)i, (float)j };
+                vertexData.insert(vertexData.end(), vertex, vertex + 8);
+            }
+        }
+
+        // the four edges as lists of surface vertices: z = 0, x = n, z = n, x = 0
+        std::vector<GLuint> edges[4];
+        for(int k = 0; k <= n; ++k)
+        {
+            edges[0].push_back((GLuint)k);
+            edges[1].push_back((GLuint)(k * columns + n));
+            edges[2].push_back((GLuint)(n * columns + k));
+            edges[3].push_back((GLuint)(k * columns));
+        }
+
+        for(int j = 0; j < n; ++j)
+        {
+            for(int i = 0; i < n; ++i)
+            {
+                GLuint v00 = (GLuint)(j * columns + i);
+                GLuint v10 = v00 + 1;
+                GLuint v01 = v00 + (GLuint)columns;
+                GLuint v11 = v01 + 1;
+                // same winding as the indices of the single quad
+                GLuint quad[6] = { v00, v10, v01, v10, v11, v01 };
+                indexData.insert(indexData.end(), quad, quad + 6);
+            }
+        }
+        for(int e = 0; e < 4; ++e)
+        {
+            GLuint skirt = (GLuint)(vertexData.size() / 8);
+            for(int k = 0; k <= n; ++k)
+            {
+                const GLfloat* top = &vertexData[edges[e][k] * 8];
+                GLfloat vertex[8] = { top[0], -GRID_SKIRT, top[2], 0.0f, 1.0f, 0.0f, top[6], top[7] };
+                vertexData.insert(vertexData.end(), vertex, vertex + 8);
+            }
+            for(int k = 0; k < n; ++k)
+            {
+                GLuint quad[6] = { edges[e][k], edges[e][k + 1], skirt + k, edges[e][k + 1], skirt + k + 1, skirt + k };
+                indexData.insert(indexData.end(), quad, quad + 6);
+            }
+        }
+        const GLsizei triangles = (GLsizei)indexData.size();
+
+        // one segment per grid line across the patch; the skirts have no lines
+        for(int j = 0; j <= n; ++j)
+        {
+            indexData.push_back((GLuint)(j * columns));
+            indexData.push_back((GLuint)(j * columns + n));
+        }
+        for(int i = 0; i <= n; ++i)
+        {
+            indexData.push_back((GLuint)i);
+            indexData.push_back((GLuint)(n * columns + i));
+        }
+        return triangles;
+    }
+
+    // the patches the frustum sees, as coarse as `pixelScale` allows: the pixels one
+    // world unit covers at a distance of one, 0 for the coarsest patches. Returns how many
+    int select(const Frustum& frustum, const glm::vec3& eye, float pixelScale)
+    {
+        patches.clear();
+        tested = 0;
+        visit(frustum, eye, pixelScale, levels, 0, 0);
+        return (int)patches.size();
+    }
+
+    // the patches of the last select() in one draw call; the caller sets the "model" uniform
+    void draw(bool textured) const
+    {
+        if(patches.empty())
+        {
+            return;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, patches.size() * sizeof(glm::vec4), patches.data(), GL_STREAM_DRAW);
+
+        glBindVertexArray(VAO);
+        if(textured)
+        {
+            glDrawElementsInstanced(GL_TRIANGLES, triangleIndices, GL_UNSIGNED_INT, 0, (GLsizei)patches.size());
+        }
+        else
+        {
+            glDrawElementsInstanced(GL_LINES, lineIndices, GL_UNSIGNED_INT, (void*)(triangleIndices * sizeof(GLuint)), (GLsizei)patches.size());
+        }
+        glBindVertexArray(0);
+        restorePatchAttribute();
+    }
+
+    void release()
+    {
+        if(VAO != 0)
+        {
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &EBO);
+            glDeleteBuffers(1, &instanceVBO);
+            VAO = VBO = EBO = instanceVBO = 0;
+        }
+    }
+
+private:
+    // node (ix, iz) of a level, GRID_CHUNK << level cells a side
+    void visit(const Frustum& frustum, const glm::vec3& eye, float pixelScale, int level, int ix, int iz)
+    {
+        const int side = GRID_CHUNK << level;
+        const int x0 = ix * side, z0 = iz * side;
+        if(x0 >= 2 * cellsX || z0 >= 2 * cellsZ)
+        {
+            return;
+        }
+
+        glm::vec3 low((float)(x0 - cellsX), 0.0f, (float)(z0 - cellsZ));
+        glm::vec3 high((float)(std::min(x0 + side, 2 * cellsX) - cellsX), 0.0f, (float)(std::min(z0 + side, 2 * cellsZ) - cellsZ));
+        ++tested;
+        if(!frustum.sees(low, high))
+        {
+            return;
+        }
+
+        // a node over the edge of the ground always splits; leaves never reach over it
+        const float cell = (float)(1 << level);
+        bool whole = x0 + side <= 2 * cellsX && z0 + side <= 2 * cellsZ;
+        if(whole && (level == 0 || cell * pixelScale <= GRID_PIXEL_ERROR * glm::distance(eye, glm::clamp(eye, low, high))))
+        {
+            patches.push_back(glm::vec4(low.x, 0.0f, low.z, cell));
+            return;
+        }
+        for(int k=0; k<4; ++k)
+        {
+            visit(frustum, eye, pixelScale, level - 1, 2 * ix + (k & 1), 2 * iz + (k >> 1));
+        }
+    }
+
+    // patchMesh() in a VAO, with the per-patch attribute 3 fed from instanceVBO
+    void buildPatch()
+    {
+        std::vector<GLfloat> vertexData;
+        std::vector<GLuint> indexData;
+        triangleIndices = patchMesh(vertexData, indexData);
+        lineIndices = (GLsizei)indexData.size() - triangleIndices;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &instanceVBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(GLfloat), vertexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(GLuint), indexData.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, 1);
+
+        glBindVertexArray(0);
+    }
+};
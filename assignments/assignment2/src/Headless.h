@@ -0,0 +1,546 @@
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Headless mode, "Robot_Horse --headless [frames]".
+// The GL context comes from EGL on a surfaceless display, so no window system
+// is needed, and every frame is rendered into an offscreen framebuffer of
+// WIDTH x HEIGHT that stands in for the window. A fixed number of frames is
+// run at a fixed 1/60 s step, so two runs draw exactly the same frames; the
+// CPU and GPU time of each frame is recorded and each frame can be saved as
+// a PNG.
+//----------------------------------------------------------------------------
+
+// where a frame ends up: 0 is the window, the offscreen target when headless
+GLuint screenFBO = 0;
+
+struct HeadlessOptions
+{
+    bool headless;
+    int frames;          // frames to render when headless
+    const char *dumpDir; // a PNG per frame goes here when set
+    const char *timings; // per-frame CSV goes here when set
+    const char *bench;   // benchmark to run instead of the render loop
+    bool software;       // draw on the CPU rasterizer instead of GL
+    int threads;         // raster threads of the CPU rasterizer
+    bool profile;        // time the passes and print their percentiles at exit
+    const char *trace;   // Chrome trace-event JSON of the passes goes here when set
+
+    // scene set up on the command line, in place of the keys
+    bool shadows, textures, running;
+    bool cube;  // the point light's cube shadows, with shadows on
+    int crowd;
+    int lamps;  // point lamps, 0 for none
+    int ground; // cells a side, 0 for the default
+    int pcf;    // shadow filter texels a side, 0 for the default
+    int filter; // a ShadowFilterMode, -1 for the default
+    bool stats; // GL call and culling counts once a second, as the key does
+
+    HeadlessOptions() :
+        headless(false), frames(300), dumpDir(NULL), timings(NULL), bench(NULL),
+        software(false), threads(std::max(1u, std::thread::hardware_concurrency())), profile(false), trace(NULL),
+        shadows(false), textures(false), running(false), cube(false), crowd(0), lamps(0), ground(0), pcf(0), filter(-1), stats(false) {}
+
+    // false on an unknown or incomplete option
+    bool parse(int argc, char *argv[])
+    {
+        for(int i=1; i<argc; ++i)
+        {
+            const char *arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if(strcmp(arg, "--headless") == 0 || strcmp(arg, "--software") == 0)
+            {
+                headless = true;
+                software = software || strcmp(arg, "--software") == 0;
+                if(hasValue && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+                {
+                    frames = atoi(argv[++i]);
+                }
+            }
+            else if(strcmp(arg, "--dump") == 0 && hasValue)
+            {
+                dumpDir = argv[++i];
+            }
+            else if(strcmp(arg, "--timings") == 0 && hasValue)
+            {
+                timings = argv[++i];
+            }
+            else if(strcmp(arg, "--bench") == 0 && hasValue)
+            {
+                bench = argv[++i];
+            }
+            else if(strcmp(arg, "--profile") == 0)
+            {
+                profile = true;
+                if(hasValue && strncmp(argv[i + 1], "--", 2) != 0)
+                {
+                    trace = argv[++i];
+                }
+            }
+            else if(strcmp(arg, "--threads") == 0 && hasValue)
+            {
+                threads = std::max(1, atoi(argv[++i]));
+            }
+            else if(strcmp(arg, "--crowd") == 0 && hasValue)
+            {
+                crowd = atoi(argv[++i]);
+            }
+            else if(strcmp(arg, "--lamps") == 0 && hasValue)
+            {
+                lamps = atoi(argv[++i]);
+            }
+            else if(strcmp(arg, "--grid") == 0 && hasValue)
+            {
+                ground = atoi(argv[++i]);
+            }
+            else if(strcmp(arg, "--pcf") == 0 && hasValue)
+            {
+                pcf = atoi(argv[++i]);
+            }
+            else if(strcmp(arg, "--shadow-filter") == 0 && hasValue && shadowFilterNamed(argv[i + 1]) >= 0)
+            {
+                filter = shadowFilterNamed(argv[++i]);
+            }
+            else if(strcmp(arg, "--shadows") == 0)
+            {
+                shadows = textures = true;
+            }
+            else if(strcmp(arg, "--cube") == 0)
+            {
+                cube = shadows = textures = true;
+            }
+            else if(strcmp(arg, "--textures") == 0)
+            {
+                textures = true;
+            }
+            else if(strcmp(arg, "--run") == 0)
+            {
+                running = true;
+            }
+            else if(strcmp(arg, "--stats") == 0)
+            {
+                stats = true;
+            }
+            else
+            {
+                fprintf(stderr, "unknown option %s\nusage: Robot_Horse [--bench <name>] [--headless [frames] | --software [frames]] "
+                        "[--threads <n>] [--dump <dir>] [--timings <csv>] [--profile [trace.json]] [--textures] [--shadows] [--crowd <horses>] [--lamps <n>] [--grid <cells>] [--pcf <1|3|5>] [--shadow-filter <pcf|hardware|vsm|esm>] [--cube] [--run] [--stats]\n", arg);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void apply() const
+    {
+        texture_on = texture_on || textures;
+        shadow_on = shadow_on || shadows;
+        shadow_cube = shadow_cube || cube;
+        run_on = run_on || running;
+        stats_on = stats_on || stats;
+        crowd_size = crowd > 0 ? crowd : crowd_size;
+        lamp_count = lamps > 0 ? lamps : lamp_count;
+        if(ground > 0)
+        {
+            gridX = gridZ = gridHalfSize(ground);
+        }
+        if(pcf > 0)
+        {
+            pcf_kernel = std::min(5, pcf | 1);
+        }
+        if(filter >= 0)
+        {
+            shadow_filter = filter;
+        }
+        profiler().enabled = profiler().enabled || profile;
+        profiler().tracing = profiler().tracing || trace != NULL;
+    }
+
+    // the pass percentiles, and the trace when one was asked for
+    void finishProfile() const
+    {
+        if(profile)
+        {
+            profileReport(trace);
+        }
+    }
+
+    // clock of the render loop: frame n of a headless run is always n/60 s in
+    double frameTime(int frame) const
+    {
+        return frame / 60.0;
+    }
+};
+
+EGLDisplay headlessDisplay = EGL_NO_DISPLAY;
+EGLContext headlessContext = EGL_NO_CONTEXT;
+GLuint headlessColor = 0, headlessDepth = 0;
+
+void release_headless()
+{
+    if(screenFBO != 0)
+    {
+        glDeleteFramebuffers(1, &screenFBO);
+        glDeleteRenderbuffers(1, &headlessColor);
+        glDeleteRenderbuffers(1, &headlessDepth);
+        screenFBO = headlessColor = headlessDepth = 0;
+    }
+    if(headlessDisplay != EGL_NO_DISPLAY)
+    {
+        eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if(headlessContext != EGL_NO_CONTEXT)
+        {
+            eglDestroyContext(headlessDisplay, headlessContext);
+        }
+        eglTerminate(headlessDisplay);
+        headlessDisplay = EGL_NO_DISPLAY;
+        headlessContext = EGL_NO_CONTEXT;
+    }
+}
+
+// a 3.3 core context without a window and the offscreen target it draws into
+int init_headless(int width, int height)
+{
+    // the surfaceless platform needs no X server or GPU device node; fall back to the default display
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay != NULL)
+    {
+        headlessDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if(headlessDisplay == EGL_NO_DISPLAY)
+    {
+        headlessDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if(headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+    {
+        fprintf(stderr, "Failed to initialize EGL\n");
+        release_headless();
+        return -1;
+    }
+
+    const EGLint configAttributes[] =
+    {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    eglChooseConfig(headlessDisplay, configAttributes, &config, 1, &configs);
+
+    const EGLint contextAttributes[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    headlessContext = eglCreateContext(headlessDisplay, configs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttributes);
+    if(headlessContext == EGL_NO_CONTEXT || !eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext))
+    {
+        fprintf(stderr, "Failed to create a surfaceless OpenGL 3.3 context\n");
+        release_headless();
+        return -1;
+    }
+
+    // GLEW built for GLX reports the missing X display after it has loaded the GL entry points
+    glewExperimental = GL_TRUE;
+    GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if(status == GLEW_ERROR_NO_GLX_DISPLAY)
+    {
+        status = GLEW_OK;
+    }
+#endif
+    if(status != GLEW_OK)
+    {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        release_headless();
+        return -1;
+    }
+
+    glGenRenderbuffers(1, &headlessColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, headlessColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &headlessDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, headlessDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &screenFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headlessColor);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headlessDepth);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Offscreen framebuffer is incomplete\n");
+        release_headless();
+        return -1;
+    }
+    glViewport(0, 0, width, height);
+
+    printf("headless: %s, EGL %d.%d\n", (const char*)glGetString(GL_RENDERER), major, minor);
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+// Frame dumps. The PNG is written uncompressed (stored deflate blocks), which
+// needs nothing beyond the two checksums and keeps the dump cheap to write.
+//----------------------------------------------------------------------------
+unsigned long pngCrc(const unsigned char *data, size_t length, unsigned long crc = 0xffffffffUL)
+{
+    static unsigned long table[256];
+    static bool tableReady = false;
+    if(!tableReady)
+    {
+        for(unsigned long n=0; n<256; ++n)
+        {
+            unsigned long c = n;
+            for(int k=0; k<8; ++k)
+            {
+                c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    for(size_t i=0; i<length; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+void putBigEndian(std::vector<unsigned char> &out, unsigned long value)
+{
+    out.push_back((value >> 24) & 0xff);
+    out.push_back((value >> 16) & 0xff);
+    out.push_back((value >> 8) & 0xff);
+    out.push_back(value & 0xff);
+}
+
+void putPngChunk(FILE *file, const char *type, const std::vector<unsigned char> &data)
+{
+    std::vector<unsigned char> chunk;
+    putBigEndian(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian(chunk, pngCrc(&chunk[4], chunk.size() - 4) ^ 0xffffffffUL);
+    fwrite(&chunk[0], 1, chunk.size(), file);
+}
+
+// rgb holds `height` rows of 3 * width bytes, top row first
+bool writePNG(const char *path, int width, int height, const std::vector<unsigned char> &rgb)
+{
+    FILE *file = fopen(path, "wb");
+    if(file == NULL)
+    {
+        return false;
+    }
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite(signature, 1, sizeof(signature), file);
+
+    std::vector<unsigned char> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    header.push_back(8); // bits per channel
+    header.push_back(2); // RGB
+    header.push_back(0); // deflate
+    header.push_back(0); // adaptive filtering
+    header.push_back(0); // not interlaced
+    putPngChunk(file, "IHDR", header);
+
+    // every row behind a 0 (no filter) byte
+    const size_t stride = 3 * (size_t)width;
+    std::vector<unsigned char> raw;
+    raw.reserve((stride + 1) * height);
+    for(int y=0; y<height; ++y)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * stride, rgb.begin() + (y + 1) * stride);
+    }
+
+    // zlib stream of stored blocks of at most 65535 bytes
+    std::vector<unsigned char> z;
+    z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    z.push_back(0x78);
+    z.push_back(0x01);
+    unsigned long a = 1, b = 0;
+    size_t offset = 0;
+    do
+    {
+        size_t length = std::min(raw.size() - offset, (size_t)65535);
+        z.push_back(offset + length == raw.size() ? 1 : 0);
+        z.push_back(length & 0xff);
+        z.push_back((length >> 8) & 0xff);
+        z.push_back(~length & 0xff);
+        z.push_back((~length >> 8) & 0xff);
+        for(size_t i=offset; i<offset + length; ++i)
+        {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        z.insert(z.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    }
+    while(offset < raw.size());
+    putBigEndian(z, (b << 16) | a);
+    putPngChunk(file, "IDAT", z);
+
+    putPngChunk(file, "IEND", std::vector<unsigned char>());
+    return fclose(file) == 0;
+}
+
+// rgb as <dir>/frame_NNNNN.png
+bool saveFrame(const char *dir, int frame, int width, int height, const std::vector<unsigned char> &rgb)
+{
+    mkdir(dir, 0755);
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/frame_%05d.png", dir, frame);
+    return writePNG(path, width, height, rgb);
+}
+
+// save what the offscreen target holds as <dir>/frame_NNNNN.png
+bool dumpFrame(const char *dir, int frame, int width, int height)
+{
+    static std::vector<unsigned char> pixels, flipped;
+    const size_t stride = 3 * (size_t)width;
+    pixels.resize(stride * height);
+    flipped.resize(stride * height);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, screenFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+    // GL rows start at the bottom, PNG rows at the top
+    for(int y=0; y<height; ++y)
+    {
+        memcpy(&flipped[y * stride], &pixels[(height - 1 - y) * stride], stride);
+    }
+
+    return saveFrame(dir, frame, width, height, flipped);
+}
+
+//----------------------------------------------------------------------------
+// Per-frame timing. The CPU side is the wall-clock time from the start of the
+// frame until all of its GL calls are issued; the GPU side comes from a
+// GL_TIME_ELAPSED query around the same calls. Two queries take turns, so a
+// frame's result is read while the next one is queued and the loop never
+// waits on the GPU just to time it.
+//----------------------------------------------------------------------------
+class FrameTimer
+{
+public:
+    std::vector<double> cpu, gpu; // milliseconds per frame
+
+    FrameTimer() :
+        frame(0)
+    {
+        queries[0] = queries[1] = 0;
+    }
+
+    void begin()
+    {
+        if(queries[0] == 0)
+        {
+            glGenQueries(2, queries);
+        }
+        start = std::chrono::steady_clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame & 1]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        cpu.push_back(elapsed.count());
+        if(frame > 0)
+        {
+            collect(frame - 1);
+        }
+        ++frame;
+    }
+
+    // read the last result and free the queries
+    void finish()
+    {
+        if(frame > 0 && (int)gpu.size() < frame)
+        {
+            collect(frame - 1);
+        }
+        if(queries[0] != 0)
+        {
+            glDeleteQueries(2, queries);
+            queries[0] = queries[1] = 0;
+        }
+    }
+
+    bool write(const char *path) const
+    {
+        FILE *file = fopen(path, "w");
+        if(file == NULL)
+        {
+            return false;
+        }
+        fprintf(file, "frame,cpu_ms,gpu_ms\n");
+        for(size_t i=0; i<cpu.size(); ++i)
+        {
+            if(i < gpu.size())
+            {
+                fprintf(file, "%d,%.4f,%.4f\n", (int)i, cpu[i], gpu[i]);
+            }
+            else
+            {
+                fprintf(file, "%d,%.4f,\n", (int)i, cpu[i]);
+            }
+        }
+        return fclose(file) == 0;
+    }
+
+    void report() const
+    {
+        printf("headless: %d frames, cpu %s, gpu %s\n", (int)cpu.size(), summary(cpu).c_str(), summary(gpu).c_str());
+    }
+
+private:
+    GLuint queries[2];
+    int frame;
+    std::chrono::steady_clock::time_point start;
+
+    void collect(int index)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[index & 1], GL_QUERY_RESULT, &elapsed);
+        gpu.push_back(elapsed / 1e6);
+    }
+
+    static std::string summary(std::vector<double> times)
+    {
+        if(times.empty())
+        {
+            return "-";
+        }
+        double total = 0.0;
+        for(size_t i=0; i<times.size(); ++i)
+        {
+            total += times[i];
+        }
+        std::sort(times.begin(), times.end());
+        char text[96];
+        snprintf(text, sizeof(text), "mean %.3f ms (median %.3f, max %.3f)",
+                 total / times.size(), times[times.size() / 2], times.back());
+        return text;
+    }
+};
@@ -11,17 +11,45 @@ bool getRandomBool()
 }
 
 //----------------------------------------------------------------------------
+// rotations about the coordinate axes, in degrees; written out instead of going
+// through glm::rotate's arbitrary axis since every skeleton joint calls one
 glm::mat4 RotateX(float f)
 {
-    return glm::rotate(glm::mat4(1.0f), glm::radians(f), glm::vec3(1, 0, 0));
+    float c = cos(glm::radians(f)), s = sin(glm::radians(f));
+    glm::mat4 m(1.0f);
+    m[1][1] = c;
+    m[1][2] = s;
+    m[2][1] = -s;
+    m[2][2] = c;
+    return m;
 }
 
 glm::mat4 RotateY(float f)
 {
-    return glm::rotate(glm::mat4(1.0f), glm::radians(f), glm::vec3(0, 1, 0));
+    float c = cos(glm::radians(f)), s = sin(glm::radians(f));
+    glm::mat4 m(1.0f);
+    m[0][0] = c;
+    m[0][2] = -s;
+    m[2][0] = s;
+    m[2][2] = c;
+    return m;
 }
 
 glm::mat4 RotateZ(float f)
 {
-    return glm::rotate(glm::mat4(1.0f), glm::radians(f), glm::vec3(0, 0, 1));
+    float c = cos(glm::radians(f)), s = sin(glm::radians(f));
+    glm::mat4 m(1.0f);
+    m[0][0] = c;
+    m[0][1] = s;
+    m[1][0] = -s;
+    m[1][1] = c;
+    return m;
+}
+
+// translate(offset) * RotateZ(f) without the matrix product
+glm::mat4 JointZ(const glm::vec3& offset, float f)
+{
+    glm::mat4 m = RotateZ(f);
+    m[3] = glm::vec4(offset, 1.0f);
+    return m;
 }
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 //----------------------------------------------------------------------------
 
 #define BASE_TORSO_HEIGHT 1.0
@@ -99,8 +101,8 @@ enum
     NumNodes
 };
 
-// Joint angles with initial values
-GLfloat theta[NumNodes] =
+// Joint angles of the standing horse
+const GLfloat restTheta[NumNodes] =
 {
     0.0,	// Torso
     80.0,	// Head
@@ -115,6 +117,9 @@ GLfloat theta[NumNodes] =
     45.0	// Neck
 };
 
+// Joint angles, set to restTheta by resetHorse()
+GLfloat theta[NumNodes];
+
 //----------------------------------------------------------------------------
 
 Node nodes[NumNodes];
@@ -197,90 +202,119 @@ void updateTorso()
     HEAD_DEPTH = BASE_HEAD_DEPTH * base_scale;
 }
 
-int tmp_step = 1;
-// to waste some frames to keep the horse run slowly
-int tmp_time = 0;
-int speedDivision = 10;
-
-void run()
+// write the joint angles of one of the six poses of the run cycle
+void gaitPose(int step, GLfloat angles[NumNodes])
 {
-    switch(tmp_step)
+    switch(step)
     {
     case 1 :
-        theta[RightUpperLeg] = 150;
-        theta[RightLowerLeg] = 90;
-        theta[LeftUpperLeg] = 110;
-        theta[LeftLowerLeg] = 90;
-        theta[RightUpperArm] = 130;
-        theta[RightLowerArm] = -10;
-        theta[LeftUpperArm] = 150;
-        theta[LeftLowerArm] = -20;
-        theta[Neck] = 55;
-        theta[Torso] = 0;
+        angles[RightUpperLeg] = 150;
+        angles[RightLowerLeg] = 90;
+        angles[LeftUpperLeg] = 110;
+        angles[LeftLowerLeg] = 90;
+        angles[RightUpperArm] = 130;
+        angles[RightLowerArm] = -10;
+        angles[LeftUpperArm] = 150;
+        angles[LeftLowerArm] = -20;
+        angles[Neck] = 55;
+        angles[Torso] = 0;
         break;
     case 2 :
-        theta[RightUpperLeg] = 110;
-        theta[RightLowerLeg] = 90;
-        theta[LeftUpperLeg] = 110;
-        theta[LeftLowerLeg] = 50;
-        theta[RightUpperArm] = 170;
-        theta[RightLowerArm] = -10;
-        theta[LeftUpperArm] = 220;
-        theta[LeftLowerArm] = -20;
-        theta[Neck] = 45;
-        theta[Torso] = -5;
+        angles[RightUpperLeg] = 110;
+        angles[RightLowerLeg] = 90;
+        angles[LeftUpperLeg] = 110;
+        angles[LeftLowerLeg] = 50;
+        angles[RightUpperArm] = 170;
+        angles[RightLowerArm] = -10;
+        angles[LeftUpperArm] = 220;
+        angles[LeftLowerArm] = -20;
+        angles[Neck] = 45;
+        angles[Torso] = -5;
         break;
     case 3 :
-        theta[RightUpperLeg] = 120;
-        theta[RightLowerLeg] = 70;
-        theta[LeftUpperLeg] = 160;
-        theta[LeftLowerLeg] = 0;
-        theta[RightUpperArm] = 200;
-        theta[RightLowerArm] = -30;
-        theta[LeftUpperArm] = 250;
-        theta[LeftLowerArm] = -10;
-        theta[Neck] = 55;
-        theta[Torso] = -2;
+        angles[RightUpperLeg] = 120;
+        angles[RightLowerLeg] = 70;
+        angles[LeftUpperLeg] = 160;
+        angles[LeftLowerLeg] = 0;
+        angles[RightUpperArm] = 200;
+        angles[RightLowerArm] = -30;
+        angles[LeftUpperArm] = 250;
+        angles[LeftLowerArm] = -10;
+        angles[Neck] = 55;
+        angles[Torso] = -2;
         break;
     case 4 :
-        theta[RightUpperLeg] = 160;
-        theta[RightLowerLeg] = 0;
-        theta[LeftUpperLeg] = 190;
-        theta[LeftLowerLeg] = 0;
-        theta[RightUpperArm] = 220;
-        theta[RightLowerArm] = -20;
-        theta[LeftUpperArm] = 250;
-        theta[LeftLowerArm] = -70;
-        theta[Neck] = 45;
-        theta[Torso] = 2;
+        angles[RightUpperLeg] = 160;
+        angles[RightLowerLeg] = 0;
+        angles[LeftUpperLeg] = 190;
+        angles[LeftLowerLeg] = 0;
+        angles[RightUpperArm] = 220;
+        angles[RightLowerArm] = -20;
+        angles[LeftUpperArm] = 250;
+        angles[LeftLowerArm] = -70;
+        angles[Neck] = 45;
+        angles[Torso] = 2;
         break;
     case 5 :
-        theta[RightUpperLeg] = 190;
-        theta[RightLowerLeg] = 0;
-        theta[LeftUpperLeg] = 200;
-        theta[LeftLowerLeg] = 10;
-        theta[RightUpperArm] = 250;
-        theta[RightLowerArm] = -90;
-        theta[LeftUpperArm] = 230;
-        theta[LeftLowerArm] = -90;
-        theta[Neck] = 55;
-        theta[Torso] = 5;
+        angles[RightUpperLeg] = 190;
+        angles[RightLowerLeg] = 0;
+        angles[LeftUpperLeg] = 200;
+        angles[LeftLowerLeg] = 10;
+        angles[RightUpperArm] = 250;
+        angles[RightLowerArm] = -90;
+        angles[LeftUpperArm] = 230;
+        angles[LeftLowerArm] = -90;
+        angles[Neck] = 55;
+        angles[Torso] = 5;
         break;
     case 6 :
-        theta[RightUpperLeg] = 200;
-        theta[RightLowerLeg] = 20;
-        theta[LeftUpperLeg] = 170;
-        theta[LeftLowerLeg] = 80;
-        theta[RightUpperArm] = 210;
-        theta[RightLowerArm] = -90;
-        theta[LeftUpperArm] = 190;
-        theta[LeftLowerArm] = -80;
-        theta[Neck] = 55;
-        theta[Torso] = 2;
+        angles[RightUpperLeg] = 200;
+        angles[RightLowerLeg] = 20;
+        angles[LeftUpperLeg] = 170;
+        angles[LeftLowerLeg] = 80;
+        angles[RightUpperArm] = 210;
+        angles[RightLowerArm] = -90;
+        angles[LeftUpperArm] = 190;
+        angles[LeftLowerArm] = -80;
+        angles[Neck] = 55;
+        angles[Torso] = 2;
         break;
     }
 }
 
+// The gait clips: the six run poses a sixth of a second apart, and a walk
+// with half of their swing around the standing pose over a longer cycle
+GaitBlend gaits;
+AnimationState horseAnimation;
+
+void buildGaits()
+{
+    const float walkSeconds = 1.6f;
+    gaits.run.duration = 1.0f;
+    gaits.walk.duration = walkSeconds;
+    gaits.run.setRest(restTheta, NumNodes);
+    gaits.walk.setRest(restTheta, NumNodes);
+    for(int step=1; step<=6; ++step)
+    {
+        GLfloat running[NumNodes], walking[NumNodes];
+        std::copy(restTheta, restTheta + NumNodes, running);
+        gaitPose(step, running);
+        for(int i=0; i<NumNodes; ++i)
+        {
+            walking[i] = restTheta[i] + 0.5f * (running[i] - restTheta[i]);
+        }
+        gaits.run.addPose((step - 1) / 6.0f, running, NumNodes);
+        gaits.walk.addPose((step - 1) / 6.0f * walkSeconds, walking, NumNodes);
+    }
+}
+
+// advance the horse's gait by `seconds` of wall-clock time and pose it
+void run(float seconds)
+{
+    gaits.advance(horseAnimation, seconds);
+    gaits.sample(horseAnimation, theta);
+}
+
 void resetHorse(){
     base_scale = 1.0;
     updateTorso();
@@ -293,28 +327,21 @@ void resetHorse(){
     rotateY = 0.0;
     rotateZ = 0.0;
 
-    tmp_step = 1;
-    tmp_time = 0;
-    speedDivision = 10;
+    if(gaits.run.empty())
+    {
+        buildGaits();
+    }
+    horseAnimation = AnimationState();
     run_on = false;
 
-    theta[Torso] = 0.0f;
-    theta[Head] = 80.0f;
-    theta[LeftUpperArm] = 190.0f;
-    theta[LeftLowerArm] = -10.0f;
-    theta[RightUpperArm] = 190.0f;
-    theta[RightLowerArm] = -10.0f;
-    theta[LeftUpperLeg] = 180.0f;
-    theta[LeftLowerLeg] = 0.0f;
-    theta[RightUpperLeg] = 180.0f;
-    theta[RightLowerLeg] = 0.0f;
-    theta[Neck] = 45.0f;
+    std::copy(restTheta, restTheta + NumNodes, theta);
 }
 
 
-MatrixStack mvstack;
-glm::mat4 base_model;
-GLuint shader_current;
+// model matrix of the part being drawn on top; deep enough for any skeleton
+const int MVSTACK_DEPTH = 32;
+MatrixStack<MVSTACK_DEPTH> mvstack;
+const ShaderProgram* shader_current;
 
 //----------------------------------------------------------------------------
 
@@ -325,17 +352,15 @@ void traverse(Node* node)
         return;
     }
 
-    mvstack.push(base_model);
-
-    base_model *= node->transform;
-    node->render();
-
-    if (node->child)
     {
-        traverse(node->child);
-    }
+        MatrixStack<MVSTACK_DEPTH>::Scope scope(mvstack, node->transform);
+        node->render();
 
-    base_model = mvstack.pop();
+        if (node->child)
+        {
+            traverse(node->child);
+        }
+    }
 
     if (node->sibling)
     {
@@ -345,185 +370,304 @@ void traverse(Node* node)
 
 //----------------------------------------------------------------------------
 
-void torso()
+// colour of every body part, indexed like theta[]
+const glm::vec4 partColor[NumNodes] =
 {
-    mvstack.push(base_model);
-
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.7f,1.0f,0.7f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.5f * TORSO_HEIGHT, 0.0f));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(TORSO_WIDTH, TORSO_HEIGHT, TORSO_DEPTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
+    glm::vec4(0.7f, 1.0f, 0.7f, 1.0f),   // Torso
+    glm::vec4(0.6f, 0.6f, 0.65f, 1.0f),  // Head
+    glm::vec4(0.6f, 0.7f, 0.8f, 1.0f),   // LeftUpperArm
+    glm::vec4(0.7f, 0.6f, 0.7f, 1.0f),   // LeftLowerArm
+    glm::vec4(0.6f, 0.7f, 0.8f, 1.0f),   // RightUpperArm
+    glm::vec4(0.7f, 0.6f, 0.7f, 1.0f),   // RightLowerArm
+    glm::vec4(0.6f, 0.7f, 0.8f, 1.0f),   // LeftUpperLeg
+    glm::vec4(0.7f, 0.6f, 0.7f, 1.0f),   // LeftLowerLeg
+    glm::vec4(0.6f, 0.7f, 0.8f, 1.0f),   // RightUpperLeg
+    glm::vec4(0.7f, 0.6f, 0.7f, 1.0f),   // RightLowerLeg
+    glm::vec4(0.8f, 0.9f, 0.75f, 1.0f)   // Neck
+};
 
-    base_model = mvstack.pop();
+// width, height and depth of the box of a body part
+glm::vec3 partSize(int part)
+{
+    switch(part)
+    {
+    case Torso :
+        return glm::vec3(TORSO_WIDTH, TORSO_HEIGHT, TORSO_DEPTH);
+    case Neck :
+        return glm::vec3(NECK_WIDTH, NECK_HEIGHT, NECK_DEPTH);
+    case Head :
+        return glm::vec3(HEAD_WIDTH, HEAD_HEIGHT, HEAD_DEPTH);
+    case LeftUpperArm :
+    case RightUpperArm :
+        return glm::vec3(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH);
+    case LeftLowerArm :
+    case RightLowerArm :
+        return glm::vec3(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH);
+    case LeftUpperLeg :
+    case RightUpperLeg :
+        return glm::vec3(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH);
+    default :
+        return glm::vec3(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH);
+    }
 }
 
-void neck()
+// the box of every body part of one horse. The crowd keeps its own, made
+// from the BASE_* sizes when it spawns, so U/J only rescale the interactive
+// horse and the crowd jobs never read the globals updateTorso() rewrites
+struct HorseShape
 {
-    mvstack.push(base_model);
+    glm::dvec3 sizes[NumNodes]; // width, height and depth of each part, like partSize()
 
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.8f,0.9f,0.75f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * NECK_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(NECK_WIDTH, NECK_HEIGHT, NECK_DEPTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
+    // the parts at `scale` times the BASE_* sizes
+    explicit HorseShape(double scale)
+    {
+        const glm::dvec3 upperArm(BASE_UPPER_ARM_WIDTH * scale, BASE_UPPER_ARM_HEIGHT * scale, BASE_UPPER_ARM_WIDTH * scale);
+        const glm::dvec3 lowerArm(BASE_LOWER_ARM_WIDTH * scale, BASE_LOWER_ARM_HEIGHT * scale, BASE_LOWER_ARM_WIDTH * scale);
+        const glm::dvec3 upperLeg(BASE_UPPER_LEG_WIDTH * scale, BASE_UPPER_LEG_HEIGHT * scale, BASE_UPPER_LEG_WIDTH * scale);
+        const glm::dvec3 lowerLeg(BASE_LOWER_LEG_WIDTH * scale, BASE_LOWER_LEG_HEIGHT * scale, BASE_LOWER_LEG_WIDTH * scale);
+        sizes[Torso] = glm::dvec3(BASE_TORSO_WIDTH * scale, BASE_TORSO_HEIGHT * scale, BASE_TORSO_DEPTH * scale);
+        sizes[Neck] = glm::dvec3(BASE_NECK_WIDTH * scale, BASE_NECK_HEIGHT * scale, BASE_NECK_DEPTH * scale);
+        sizes[Head] = glm::dvec3(BASE_HEAD_WIDTH * scale, BASE_HEAD_HEIGHT * scale, BASE_HEAD_DEPTH * scale);
+        sizes[LeftUpperArm] = sizes[RightUpperArm] = upperArm;
+        sizes[LeftLowerArm] = sizes[RightLowerArm] = lowerArm;
+        sizes[LeftUpperLeg] = sizes[RightUpperLeg] = upperLeg;
+        sizes[LeftLowerLeg] = sizes[RightLowerLeg] = lowerLeg;
+    }
 
-    base_model = mvstack.pop();
+    // the interactive horse as updateTorso() last sized it
+    static HorseShape current()
+    {
+        return HorseShape(base_scale);
+    }
+
+    // height of the torso centre above the feet
+    double lift() const
+    {
+        return 1.9 * sizes[Torso].y;
+    }
+};
+
+// the unit cube placed on top of the joint and scaled to a part's box
+glm::mat4 partShape(const glm::vec3 &size)
+{
+    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.5f * size.y, 0.0f));
+    glm::mat4 scale = glm::scale(glm::mat4(1.0f), size);
+    return translate * scale;
 }
 
-void head()
+// the same for a part of the interactive horse
+glm::mat4 partShape(int part)
 {
-    mvstack.push(base_model);
+    return partShape(partSize(part));
+}
 
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.6f,0.6f,0.65f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * HEAD_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(HEAD_WIDTH, HEAD_HEIGHT, HEAD_DEPTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
+// the part's box only scales this one draw, so it is composed with the joint
+// locally instead of being pushed onto mvstack and popped again
+void drawPart(int part, const glm::mat4& joint)
+{
+    shader_current->setVec4("shader_color", partColor[part]);
+    shader_current->setMat4("model", joint * partShape(part));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
+}
 
-    base_model = mvstack.pop();
+void torso()
+{
+    drawPart(Torso, mvstack.top());
 }
 
-void left_upper_arm()
+void neck()
 {
-    mvstack.push(base_model);
+    drawPart(Neck, mvstack.top());
+}
 
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.6f,0.7f,0.8f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * UPPER_ARM_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
+void head()
+{
+    drawPart(Head, mvstack.top());
+}
 
-    base_model = mvstack.pop();
+void left_upper_arm()
+{
+    drawPart(LeftUpperArm, mvstack.top());
 }
 
 void left_lower_arm()
 {
-    mvstack.push(base_model);
-
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.7f,0.6f,0.7f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * LOWER_ARM_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
+    drawPart(LeftLowerArm, mvstack.top());
 }
 
 void right_upper_arm()
 {
-    mvstack.push(base_model);
-
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.6f,0.7f,0.8f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * UPPER_ARM_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
+    drawPart(RightUpperArm, mvstack.top());
 }
 
 void right_lower_arm()
 {
-    mvstack.push(base_model);
-
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.7f,0.6f,0.7f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * LOWER_ARM_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
+    drawPart(RightLowerArm, mvstack.top());
 }
 
 void left_upper_leg()
 {
-    mvstack.push(base_model);
-
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.6f,0.7f,0.8f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * UPPER_LEG_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
+    drawPart(LeftUpperLeg, mvstack.top());
 }
 
 void left_lower_leg()
 {
-    mvstack.push(base_model);
-
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.7f,0.6f,0.7f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * LOWER_LEG_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
+    drawPart(LeftLowerLeg, mvstack.top());
 }
 
 void right_upper_leg()
 {
-    mvstack.push(base_model);
-
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.6f,0.7f,0.8f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * UPPER_LEG_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
+    drawPart(RightUpperLeg, mvstack.top());
 }
 
 void right_lower_leg()
 {
-    mvstack.push(base_model);
+    drawPart(RightLowerLeg, mvstack.top());
+}
 
-    glUniform4f(glGetUniformLocation(shader_current, "shader_color"), 0.7f,0.6f,0.7f,1.0f);
-    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(0.0, 0.5 * LOWER_LEG_HEIGHT, 0.0));
-    glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH));
-    glUniformMatrix4fv(glGetUniformLocation(shader_current, "model"), 1, GL_FALSE, value_ptr(base_model * translate * scale));
-    glDrawArrays(GL_TRIANGLES, 0, NumVertices);
+// placement of the torso centre of the interactive horse
+glm::mat4 horseRoot()
+{
+    return glm::translate(glm::mat4(1.0), glm::vec3(base_x, base_y + 1.9*TORSO_HEIGHT, base_z)) * RotateX(rotateX) * RotateY(rotateY) * RotateZ(rotateZ);
+}
 
-    base_model = mvstack.pop();
+// joint transforms of every part relative to its parent, indexed like theta[], for a horse of `shape`
+void localTransforms(glm::mat4 local[NumNodes], const GLfloat angles[NumNodes], const glm::mat4& root, const HorseShape& shape)
+{
+    const glm::dvec3 torso = shape.sizes[Torso], neck = shape.sizes[Neck];
+    const double upperArmWidth = shape.sizes[LeftUpperArm].x, upperArmHeight = shape.sizes[LeftUpperArm].y;
+    const double upperLegWidth = shape.sizes[LeftUpperLeg].x, upperLegHeight = shape.sizes[LeftUpperLeg].y;
+    local[Torso] = root * RotateZ(angles[Torso]);
+    local[Neck] = JointZ(glm::vec3(-(torso.x / 2 - neck.x / 2), torso.y, 0.0), angles[Neck]);
+    local[Head] = JointZ(glm::vec3(0.0, neck.y, 0.0), angles[Head]);
+    local[LeftUpperArm] = JointZ(glm::vec3(torso.x / 2 - upperLegWidth / 2, 0.1*upperLegHeight, -torso.z/2 + upperLegWidth / 2), angles[LeftUpperArm]);
+    local[RightUpperArm] = JointZ(glm::vec3(torso.x / 2 - upperLegWidth / 2, 0.1*upperArmHeight, torso.z/2 - upperArmWidth / 2), angles[RightUpperArm]);
+    local[LeftUpperLeg] = JointZ(glm::vec3(-(torso.x / 2 - upperArmWidth / 2), 0.1*upperArmHeight, -torso.z/2 + upperArmWidth / 2), angles[LeftUpperLeg]);
+    local[RightUpperLeg] = JointZ(glm::vec3(-(torso.x / 2 - upperLegWidth / 2), 0.1*upperLegHeight, torso.z/2 - upperLegWidth / 2), angles[RightUpperLeg]);
+    local[LeftLowerArm] = JointZ(glm::vec3(0.0, upperArmHeight, 0.0), angles[LeftLowerArm]);
+    local[RightLowerArm] = JointZ(glm::vec3(0.0, upperArmHeight, 0.0), angles[RightLowerArm]);
+    local[LeftLowerLeg] = JointZ(glm::vec3(0.0, upperLegHeight, 0.0), angles[LeftLowerLeg]);
+    local[RightLowerLeg] = JointZ(glm::vec3(0.0, upperLegHeight, 0.0), angles[RightLowerLeg]);
 }
 
+// the same for the interactive horse at its current scale
+void localTransforms(glm::mat4 local[NumNodes], const GLfloat angles[NumNodes], const glm::mat4& root)
+{
+    localTransforms(local, angles, root, HorseShape::current());
+}
 
 void initNodes()
 {
-    glm::mat4  m;
+    glm::mat4 local[NumNodes];
+    localTransforms(local, theta, horseRoot());
+
+    nodes[Torso] = Node(local[Torso], torso, NULL, &nodes[Neck]);
+    nodes[Neck] = Node(local[Neck], neck, &nodes[LeftUpperArm], &nodes[Head]);
+    nodes[Head] = Node(local[Head], head, NULL, NULL);
+    nodes[LeftUpperArm] = Node(local[LeftUpperArm], left_upper_arm, &nodes[RightUpperArm], &nodes[LeftLowerArm]);
+    nodes[RightUpperArm] = Node(local[RightUpperArm], right_upper_arm, &nodes[LeftUpperLeg], &nodes[RightLowerArm]);
+    nodes[LeftUpperLeg] = Node(local[LeftUpperLeg], left_upper_leg, &nodes[RightUpperLeg], &nodes[LeftLowerLeg]);
+    nodes[RightUpperLeg] = Node(local[RightUpperLeg], right_upper_leg, NULL, &nodes[RightLowerLeg]);
+    nodes[LeftLowerArm] = Node(local[LeftLowerArm], left_lower_arm, NULL, NULL);
+    nodes[RightLowerArm] = Node(local[RightLowerArm], right_lower_arm, NULL, NULL);
+    nodes[LeftLowerLeg] = Node(local[LeftLowerLeg], left_lower_leg, NULL, NULL);
+    nodes[RightLowerLeg] = Node(local[RightLowerLeg], right_lower_leg, NULL, NULL);
+}
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(base_x, base_y + 1.9*TORSO_HEIGHT, base_z)) * RotateX(rotateX) * RotateY(rotateY) * RotateZ(rotateZ + theta[Torso]);
-    nodes[Torso] = Node(m, torso, NULL, &nodes[Neck]);
+//----------------------------------------------------------------------------
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(-(TORSO_WIDTH / 2 - NECK_WIDTH / 2), TORSO_HEIGHT, 0.0)) * RotateZ(theta[Neck]);
-    nodes[Neck] = Node(m, neck, &nodes[LeftUpperArm], &nodes[Head]);
+// the node tree flattened once, and the poses evaluated from it
+Skeleton skeleton;
+SkeletonPoses poses;
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(0.0, NECK_HEIGHT, 0.0)) * RotateZ(theta[Head]);
-    nodes[Head] = Node(m, head, NULL, NULL);
+void initSkeleton()
+{
+    initNodes();
+    skeleton.build(&nodes[Torso], nodes);
+    poses.resize(&skeleton, 1);
+}
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(TORSO_WIDTH / 2 - UPPER_LEG_WIDTH / 2, 0.1*UPPER_LEG_HEIGHT, -TORSO_DEPTH/2 + UPPER_LEG_WIDTH / 2)) * RotateZ(theta[LeftUpperArm]);
-    nodes[LeftUpperArm] = Node(m, left_upper_arm, &nodes[RightUpperArm], &nodes[LeftLowerArm]);
+// copy the joint transforms of a horse of `shape` into one skeleton's local array
+void poseHorse(SkeletonPoses& p, int instance, const GLfloat angles[NumNodes], const glm::mat4& root, const HorseShape& shape)
+{
+    glm::mat4 local[NumNodes];
+    localTransforms(local, angles, root, shape);
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(TORSO_WIDTH / 2 - UPPER_LEG_WIDTH / 2, 0.1*UPPER_ARM_HEIGHT, TORSO_DEPTH/2 - UPPER_ARM_WIDTH / 2)) * RotateZ(theta[RightUpperArm]);
-    nodes[RightUpperArm] = Node(m, right_upper_arm, &nodes[LeftUpperLeg], &nodes[RightLowerArm]);
+    glm::mat4* out = p.localOf(instance);
+    for(int i=0; i<skeleton.size(); ++i)
+    {
+        out[i] = local[skeleton.part[i]];
+    }
+}
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(-(TORSO_WIDTH / 2 - UPPER_ARM_WIDTH / 2), 0.1*UPPER_ARM_HEIGHT, -TORSO_DEPTH/2 + UPPER_ARM_WIDTH / 2)) * RotateZ(theta[LeftUpperLeg]);
-    nodes[LeftUpperLeg] = Node(m, left_upper_leg, &nodes[RightUpperLeg], &nodes[LeftLowerLeg]);
+// the same at the interactive horse's current scale
+void poseHorse(SkeletonPoses& p, int instance, const GLfloat angles[NumNodes], const glm::mat4& root)
+{
+    poseHorse(p, instance, angles, root, HorseShape::current());
+}
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(-(TORSO_WIDTH / 2 - UPPER_LEG_WIDTH / 2), 0.1*UPPER_LEG_HEIGHT, TORSO_DEPTH/2 - UPPER_LEG_WIDTH / 2)) * RotateZ(theta[RightUpperLeg]);
-    nodes[RightUpperLeg] = Node(m, right_upper_leg, NULL, &nodes[RightLowerLeg]);
+// the interactive horse
+void poseHorse(SkeletonPoses& p, int instance)
+{
+    poseHorse(p, instance, theta, horseRoot());
+}
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(0.0, UPPER_ARM_HEIGHT, 0.0)) * RotateZ(theta[LeftLowerArm]);
-    nodes[LeftLowerArm] = Node(m, left_lower_arm, NULL, NULL);
+// draw a skeleton from its evaluated world transforms
+void drawSkeleton(const glm::mat4* world)
+{
+    for(int i=0; i<skeleton.size(); ++i)
+    {
+        drawPart(skeleton.part[i], world[i]);
+    }
+}
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(0.0, UPPER_ARM_HEIGHT, 0.0)) * RotateZ(theta[RightLowerArm]);
-    nodes[RightLowerArm] = Node(m, right_lower_arm, NULL, NULL);
+// bounding sphere of one part's box at its joint; the joint may scale, as crowd horses do
+glm::vec4 partBounds(int part, const glm::mat4& joint)
+{
+    glm::vec3 size = partSize(part);
+    glm::vec3 centre = glm::vec3(joint * glm::vec4(0.0f, 0.5f * size.y, 0.0f, 1.0f));
+    float scale = std::max(glm::length(glm::vec3(joint[0])), std::max(glm::length(glm::vec3(joint[1])), glm::length(glm::vec3(joint[2]))));
+    return glm::vec4(centre, 0.5f * glm::length(size) * scale);
+}
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(0.0, UPPER_LEG_HEIGHT, 0.0)) * RotateZ(theta[LeftLowerLeg]);
-    nodes[LeftLowerLeg] = Node(m, left_lower_leg, NULL, NULL);
+// only the parts whose boxes the frustum sees; returns how many were drawn
+SphereBatch partSpheres;
+std::vector<int> partsVisible;
+int drawSkeleton(const glm::mat4* world, const Frustum& frustum)
+{
+    partSpheres.clear();
+    for(int i=0; i<skeleton.size(); ++i)
+    {
+        partSpheres.add(partBounds(skeleton.part[i], world[i]));
+    }
+    int count = partSpheres.cull(frustum, partsVisible);
+    for(int k=0; k<count; ++k)
+    {
+        int i = partsVisible[k];
+        drawPart(skeleton.part[i], world[i]);
+    }
+    return count;
+}
 
-    m = glm::translate(glm::mat4(1.0), glm::vec3(0.0, UPPER_LEG_HEIGHT, 0.0))* RotateZ(theta[RightLowerLeg]);
-    nodes[RightLowerLeg] = Node(m, right_lower_leg, NULL, NULL);
+// bounding sphere (xyz centre, w radius) of the boxes of an evaluated skeleton of `shape`
+glm::vec4 skeletonBounds(const glm::mat4* world, const HorseShape& shape)
+{
+    glm::vec3 low(1e30f), high(-1e30f);
+    for(int i=0; i<skeleton.size(); ++i)
+    {
+        glm::mat4 box = world[i] * partShape(glm::vec3(shape.sizes[skeleton.part[i]]));
+        for(int c=0; c<8; ++c)
+        {
+            glm::vec3 corner = glm::vec3(box * glm::vec4(vertices[c], 1.0f));
+            low = glm::min(low, corner);
+            high = glm::max(high, corner);
+        }
+    }
+    return glm::vec4(0.5f * (low + high), 0.5f * glm::length(high - low));
 }
 
+// the same for the interactive horse at its current scale
+glm::vec4 skeletonBounds(const glm::mat4* world)
+{
+    return skeletonBounds(world, HorseShape::current());
+}
@@ -13,14 +13,35 @@
 
 #include <stb_image.h>
 #include <shader_gl.h>
+#include <shader_program.h>
+#include <shader_builder.h>
+#include <shader_variants.h>
+#include <texture_streamer.h>
+#include <profiler.h>
+#include <frustum.h>
+#include <jobs.h>
 
 #include "Vertices.h"
 #include "Config.h"
+#include "FrameData.h"
+#include "ShadowCascades.h"
+#include "ShadowFilter.h"
+#include "ShadowAtlas.h"
+#include "ClusteredLights.h"
 #include "Helper.h"
 #include "MatrixStack.h"
 #include "Node.h"
+#include "Skeleton.h"
+#include "Animation.h"
+#include "Grid.h"
 
 #include "Horse.h"
+#include "Simulation.h"
+#include "Crowd.h"
+#include "ShadowCache.h"
+#include "Headless.h"
+#include "Rasterizer.h"
+#include "SoftwareRenderer.h"
 
 int init_window(int width, int height, const std::string title);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -30,15 +51,42 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
-void renderScene(const GLuint &shader);
-void renderGrid(const GLuint &shader_grid);
-void renderHorse(const GLuint &shader_horse);
-
-void renderAxis(const Shader &shader_axis);
-void renderLamp(const Shader &shader_lamp);
+std::string sceneDefines(bool textured, bool shadowed, int filter, int kernel, bool cube = false, bool clustered = false);
+void submitSceneShaders(ShaderBuilder &builder, bool bench);
+std::string momentDefines(int filter, bool across);
+void submitMomentShaders(ShaderBuilder &builder);
+bool momentShadersReady(int filter);
+void renderShadowMoments(int filter);
+void submitPointShadowShaders(ShaderBuilder &builder, bool faces);
+bool pointShadowsReady();
+PointShadow pointShadowAt(const glm::vec3 &position);
+void placePointShadow();
+void renderPointShadows(const ShaderProgram &shader_point, const ShaderProgram &shader_crowd_point);
+void renderScene(const ShaderProgram &shader);
+int renderGrid(const ShaderProgram &shader_grid, const Frustum &frustum, float pixelScale, CullCount &counts);
+void renderGridCells(const ShaderProgram &shader_grid, int cellsX, int cellsZ);
+int renderHorse(const ShaderProgram &shader_horse, const Frustum &frustum, CullCount &counts);
+void updateCrowd(float seconds);
+void finishCrowd();
+void renderCrowd(const ShaderProgram &shader_crowd);
+void renderShadowCasters(const ShaderProgram &shader_depth, const ShaderProgram &shader_crowd_depth, bool ground);
+
+void renderAxis(const ShaderProgram &shader_axis);
+void renderLamp(const ShaderProgram &shader_lamp);
+void updateLamps(double seconds);
+void renderLamps(const ShaderProgram &shader_lamp);
 
 unsigned int loadTexture(const char *path);
 
+void reportGLStats(double now);
+
+int runBenchmark(const char *name, const ShaderProgram &shader, const ShaderProgram &shader_crowd,
+                 const ShaderProgram &shader_depth, const ShaderProgram &shader_crowd_depth);
+void benchmarkSoftware();
+
+void updateCamera(float aspect);
+int runSoftware(HeadlessOptions &options);
+
 GLFWwindow* window;
 
 glm::mat4 View;
@@ -46,122 +94,298 @@ glm::mat4 Projection;
 
 unsigned int bricksTexture;
 unsigned int grassTexture;
-unsigned int depthMap;
 
-int main()
+ShadowCascades shadows;
+ShadowCache shadowCache;
+ShadowMoments shadowMoments; // the cascades filtered for SHADOW_VSM and SHADOW_ESM
+ShadowAtlas shadowAtlas;     // the point light's cube faces, with shadow_cube
+ClusteredLights lamps;       // the lamp_count point lamps and their clusters
+
+// objects tested against a frustum and kept, per kind
+struct CullStats
 {
-    if (init_window(WIDTH, HEIGHT, TITLE) != 0)
+    CullCount grid;  // ground chunks
+    CullCount parts; // parts of the interactive horse
+    CullCount crowd; // crowd horses
+    CullCount debug; // axis and lamp
+};
+Frustum cameraFrustum;
+CullStats cameraCulls; // this frame's main pass
+CullStats lightCulls;  // the last shadow pass, summed over the cascades
+
+UniformBuffer<FrameData> frameBuffer;
+// the scene shader once per combination of texture, shadows and shadow filter
+ShaderVariants sceneShaders("shaders/shadow_mapping.vs", "shaders/shadow_mapping.fs");
+// the two blur passes that make the moment maps, per moment filter
+ShaderVariants momentShaders("shaders/shadow_moments.vs", "shaders/shadow_moments.fs");
+// depth of every cube face of up to ATLAS_LIGHTS_PER_PASS point lights in one pass, for the
+// ground and horse and for the crowd; and one face at a time, only for the benchmarks
+ShaderVariants pointShadowShaders("shaders/point_shadow.vs", "shaders/shadow_mapping_depth.fs", "shaders/point_shadow.gs");
+ShaderVariants faceShadowShaders("shaders/point_shadow.vs", "shaders/shadow_mapping_depth.fs");
+
+JobSystem jobs; // CPU work of the frame; GL calls stay on this thread
+Simulation simulation; // owns the horse; the frame draws its interpolated snapshots
+
+int main(int argc, char *argv[])
+{
+    HeadlessOptions options;
+    if (!options.parse(argc, argv))
     {
         return -1;
     }
 
-    //glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetWindowSizeCallback(window, window_size_callback);
-    glfwSetKeyCallback(window, key_callback);
-    glfwSetCursorPosCallback(window, cursor_position_callback);
-    glfwSetMouseButtonCallback(window, mouse_button_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    // "--software" draws on the CPU and never touches GL
+    if (options.software)
+    {
+        return runSoftware(options);
+    }
+
+    jobs.resize(options.threads);
+
+    // "--headless" renders offscreen without a window
+    if (options.headless)
+    {
+        if (init_headless(WIDTH, HEIGHT) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        if (init_window(WIDTH, HEIGHT, TITLE) != 0)
+        {
+            return -1;
+        }
+
+        //glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetWindowSizeCallback(window, window_size_callback);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetCursorPosCallback(window, cursor_position_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+    }
 
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
+    resetHorse();
+    options.apply();
+
     // build and compile shaders
     // -------------------------
-    GLuint shader = loadShaders("shaders/shadow_mapping.vs", "shaders/shadow_mapping.fs");
-    GLuint simpleDepthShader = loadShaders("shaders/shadow_mapping_depth.vs", "shaders/shadow_mapping_depth.fs");
-
-    Shader simpleShader("shaders/simple.vs", "shaders/simple.fs");
+    // every program is submitted at once and compiles while the first frames
+    // draw the passes whose programs are ready
+    // (linked binaries of an earlier run come from the program cache)
+    ShaderBuilder builder;
+    ShaderProgram shader, simpleDepthShader, simpleShader, lampShader, crowdShader, crowdDepthShader;
+
+    // per-frame uniforms live in one buffer shared by every program
+    frameBuffer.create(FRAME_DATA_BINDING);
+    submitSceneShaders(builder, options.bench != NULL);
+    submitMomentShaders(builder);
+    submitPointShadowShaders(builder, options.bench != NULL);
+    // the uber-shader switched by uniforms; the benchmarks still draw with it
+    if(options.bench != NULL)
+    {
+        builder.submit(shader, "shaders/shadow_mapping.vs", "shaders/shadow_mapping.fs", [&shader]()
+        {
+            frameBuffer.attach(shader, "FrameData");
+            shader.use();
+            shader.setInt("diffuseTexture", 0);
+            shader.setInt("shadowMap", 1);
+        });
+    }
+    builder.submit(simpleDepthShader, "shaders/shadow_mapping_depth.vs", "shaders/shadow_mapping_depth.fs", [&simpleDepthShader]()
+    {
+        frameBuffer.attach(simpleDepthShader, "FrameData");
+    });
+    builder.submit(simpleShader, "shaders/simple.vs", "shaders/simple.fs", [&simpleShader]()
+    {
+        frameBuffer.attach(simpleShader, "FrameData");
+    });
+    builder.submit(lampShader, "shaders/simple.vs", "shaders/simple.fs", [&lampShader]()
+    {
+        frameBuffer.attach(lampShader, "FrameData");
+    }, "#define INSTANCED\n");
+    builder.submit(crowdShader, "shaders/crowd.vs", "shaders/crowd.fs", [&crowdShader]()
+    {
+        frameBuffer.attach(crowdShader, "FrameData");
+    });
+    builder.submit(crowdDepthShader, "shaders/crowd_depth.vs", "shaders/shadow_mapping_depth.fs", [&crowdDepthShader]()
+    {
+        frameBuffer.attach(crowdDepthShader, "FrameData");
+    });
 
-    // load textures
+    // load textures (decoded in the background, grey until they arrive)
     // -------------
     bricksTexture = loadTexture("resources/bricks.jpg");
     grassTexture = loadTexture("resources/grass.jpg");
 
-    // configure depth map FBO
-    // -----------------------
-    const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-    // create depth texture
-//    unsigned int depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    // attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-    // shader configuration
-    // --------------------
-    //shader.use();
-    //shader.setInt("diffuseTexture", 0);
-    //shader.setInt("shadowMap", 1);
-    glUseProgram(shader);
-    glUniform1i(glGetUniformLocation(shader, "diffuseTexture"), 0);
-    glUniform1i(glGetUniformLocation(shader, "shadowMap"), 1);
+    // configure the cascaded depth maps
+    // ---------------------------------
+    shadows.create(shadow_cascades, shadow_resolution);
+
+    // "--bench <name>" runs one of the benchmarks instead of the interactive loop
+    if(options.bench != NULL)
+    {
+        builder.finish();
+        textureStreamer().finish();
+        int status = runBenchmark(options.bench, shader, crowdShader, simpleDepthShader, crowdDepthShader);
+        if(options.headless)
+        {
+            release_headless();
+        }
+        else
+        {
+            glfwTerminate();
+        }
+        return status;
+    }
+
+    // the horse from here on belongs to the simulation, stepped on its own
+    // thread in a window and before each frame of a headless run
+    HorseState horse;
+    horse.capture();
+    simulation.reset(horse);
+    if(!options.headless)
+    {
+        simulation.run();
+    }
+
+    // a headless run draws every frame fully textured and shaded
+    FrameTimer frameTimer;
+    int frameIndex = 0;
+    if(options.headless)
+    {
+        builder.finish();
+        builder.report();
+        textureStreamer().finish();
+    }
 
     //horse = Horse();
+    double lastFrame = options.headless ? options.frameTime(0) : glfwGetTime();
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (options.headless ? frameIndex < options.frames : !glfwWindowShouldClose(window))
     {
+        // GPU times of earlier frames that have landed
+        profiler().frame();
+        PROFILE_GPU_ZONE("frame");
 
-        glfwSetWindowSizeCallback(window, window_size_callback);
-        glfwSetKeyCallback(window, key_callback);
-        glfwSetCursorPosCallback(window, cursor_position_callback);
-        glfwSetMouseButtonCallback(window, mouse_button_callback);
-        glfwSetScrollCallback(window, scroll_callback);
+        double currentFrame = options.headless ? options.frameTime(frameIndex + 1) : glfwGetTime();
+        float deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
+        // the horse a step behind the simulation, between its two newest steps
+        {
+            PROFILE_ZONE("animation");
+            if(options.headless)
+            {
+                simulation.advanceTo(currentFrame);
+            }
+            simulation.sample(options.headless ? currentFrame : simulation.now()).apply();
+        }
+
+        if(options.headless)
+        {
+            frameTimer.begin();
+            glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+        }
+        else
+        {
+            glfwSetWindowSizeCallback(window, window_size_callback);
+            glfwSetKeyCallback(window, key_callback);
+            glfwSetCursorPosCallback(window, cursor_position_callback);
+            glfwSetMouseButtonCallback(window, mouse_button_callback);
+            glfwSetScrollCallback(window, scroll_callback);
+        }
+
+        // programs linked since the last frame
+        if(builder.waiting() > 0 && builder.poll() == 0)
+        {
+            builder.report();
+        }
+
+        // textures decoded since the last frame
+        {
+            PROFILE_ZONE("texture uploads");
+            textureStreamer().update();
+        }
 
         // render
         // ------
         glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        double c_pos_x = c_radius * glm::cos(glm::radians(c_vertical)) * glm::cos(glm::radians(c_horizontal));
-        double c_pos_y = c_radius * glm::sin(glm::radians(c_vertical));
-        double c_pos_z = c_radius * glm::cos(glm::radians(c_vertical)) * glm::sin(glm::radians(c_horizontal));
-        c_pos = glm::vec3(c_pos_x, c_pos_y, c_pos_z); // camera position
-        c_dir = glm::vec3(c_dir_x, c_dir_y, c_dir_z); // camera direction
-        // Camera matrix
-        View = glm::lookAt(c_pos, c_dir, c_up);
-
-        Projection = glm::perspective(glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, 100.0f);
+        updateCamera((float)WIDTH/(float)HEIGHT);
+        cameraFrustum.extract(Projection * View);
+        cameraCulls = CullStats();
         //std::cout << "texture_on:" << texture_on << ", shadow_on:" << shadow_on << std::endl;
 
-        // for shadow only
-        glm::mat4 lightProjection, lightView;
-        glm::mat4 lightSpaceMatrix;
-        if(shadow_on)
+        if(crowd_size > 0)
+        {
+            updateCrowd(deltaTime);
+        }
+        if(lamp_count > 0)
         {
-            glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-            glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-            glClear(GL_DEPTH_BUFFER_BIT);
+            updateLamps(currentFrame);
+        }
 
-            // 1. render depth of scene to texture (from light's perspective)
+        // for shadow only: one light frustum per slice of the camera frustum
+        shadows.create(shadow_cascades, shadow_resolution);
+        shadows.sceneMin = glm::vec3(-gridX, 0.0f, -gridZ);
+        shadows.sceneMax = glm::vec3(gridX, lightPos.y, gridZ);
+        shadows.fit(View, glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, viewDistance(), lightPos);
+        shadows.compare(shadow_filter == SHADOW_HARDWARE);
+
+        // one upload of everything the programs share this frame
+        FrameData frame;
+        frame.projection = Projection;
+        frame.view = View;
+        shadows.fill(frame);
+        frame.lightPos = glm::vec4(lightPos, 1.0f);
+        frame.viewPos = glm::vec4(c_pos, 1.0f);
+        frame.lightAmbient = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+        frame.lightDiffuse = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+        frame.lightSpecular = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+        frameBuffer.update(frame);
+
+        // passes whose programs are still compiling are left out
+        const bool shadowsReady = shadow_on && (shadow_cube ? pointShadowsReady() :
+                                  simpleDepthShader.ready() && crowdDepthShader.ready() && momentShadersReady(shadow_filter));
+        if(shadowsReady && shadow_cube)
+        {
+            // 1. render depth of scene into the six faces around the light in one pass,
+            //    unless no caster or the light moved; the camera does not matter to them
+            // -----------------------------------------------------------------------
+            placePointShadow();
+            if(shadowCache.check(glm::mat4(1.0f)) != SHADOW_REUSE)
+            {
+                renderPointShadows(*pointShadowShaders.find(""), *pointShadowShaders.find("#define CROWD\n"));
+            }
+            glViewport(0, 0, WIDTH, HEIGHT);
+        }
+        else if(shadowsReady)
+        {
+            // 1. render depth of scene to texture (from light's perspective),
+            //    unless no caster, light or cascade changed since last time
             // --------------------------------------------------------------
-            float near_plane = 1.0f, far_plane = 100.0f;
-            //// note that if you use a perspective projection matrix you'll have to change the light position as the current light position isn't enough to reflect the whole scene
-            lightProjection = glm::perspective(glm::radians(130.0f), (GLfloat)SHADOW_WIDTH / (GLfloat)SHADOW_HEIGHT, near_plane, far_plane);
-            //lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-            lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 0.0, 1.0));
-            lightSpaceMatrix = lightProjection * lightView;
-            // render scene from light's point of view
-            glUseProgram(simpleDepthShader);
-            glUniformMatrix4fv(glGetUniformLocation(simpleDepthShader, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-            renderScene(simpleDepthShader);
-
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            ShadowWork work = shadowCache.check(View);
+            if(work != SHADOW_REUSE)
+            {
+                renderShadowCasters(simpleDepthShader, crowdDepthShader, work == SHADOW_ALL);
+            }
+            // the moment maps follow the depths, and the filter
+            if(filtersMoments(shadow_filter))
+            {
+                shadowMoments.create(shadows.count, shadows.resolution);
+                if(work != SHADOW_REUSE || shadowMoments.filter != shadow_filter)
+                {
+                    renderShadowMoments(shadow_filter);
+                }
+            }
+
             // reset viewport
             glViewport(0, 0, WIDTH, HEIGHT);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -173,115 +397,326 @@ int main()
         glViewport(0, 0, WIDTH, HEIGHT);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(shader);
-
-        if(texture_on){
-            glUniform1i(glGetUniformLocation(shader, "texture_on"), 1);
-            if(shadow_on){
-                glUniform1i(glGetUniformLocation(shader, "shadow_on"), 1);
-            }else{
-                glUniform1i(glGetUniformLocation(shader, "shadow_on"), 0);
+        // the scene variant for this frame's features
+        const ShaderProgram *scene = sceneShaders.find(sceneDefines(texture_on, texture_on && shadowsReady, shadow_filter, pcf_kernel,
+                                                                    shadow_cube, lamp_count > 0));
+        if(scene != NULL && scene->ready())
+        {
+            scene->use();
+            if(lamp_count > 0)
+            {
+                lamps.setUniforms(*scene);
             }
-        }else{
-            glUniform1i(glGetUniformLocation(shader, "texture_on"), 0);
-            glUniform1i(glGetUniformLocation(shader, "shadow_on"), 0);
+            if(shadow_cube && shadowsReady)
+            {
+                scene->setVec4("cubeTile", shadowAtlas.tileOf(0));
+                scene->setFloat("cubeFar", shadowAtlas.lights[0].far);
+            }
+            renderScene(*scene);
         }
 
-        // for shadow only
-        glUniform3fv(glGetUniformLocation(shader, "lightPos"), 1, glm::value_ptr(lightPos));
-        glUniformMatrix4fv(glGetUniformLocation(shader, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-
-        // for lighting only (no shadow, with or without texture)
-        glUniform3fv(glGetUniformLocation(shader, "light.position"), 1, glm::value_ptr(lightPos));
-        glUniform3fv(glGetUniformLocation(shader, "light.ambient"), 1, glm::value_ptr(glm::vec3(0.5f, 0.5f, 0.5f)));
-        glUniform3fv(glGetUniformLocation(shader, "light.diffuse"), 1, glm::value_ptr(glm::vec3(0.5f, 0.5f, 0.5f)));
-        glUniform3fv(glGetUniformLocation(shader, "light.specular"), 1, glm::value_ptr(glm::vec3(0.5f, 0.5f, 0.5f)));
+        if(crowd_size > 0 && crowdShader.ready())
+        {
+            renderCrowd(crowdShader);
+        }
 
+        if(simpleShader.ready())
+        {
+            simpleShader.use();
+            renderAxis(simpleShader);
 
-        glUniformMatrix4fv(glGetUniformLocation(shader, "projection"), 1, GL_FALSE, glm::value_ptr(Projection));
-        glUniformMatrix4fv(glGetUniformLocation(shader, "view"), 1, GL_FALSE, glm::value_ptr(View));
+            renderLamp(simpleShader);
+        }
 
-        // set light uniforms
-        glUniform3fv(glGetUniformLocation(shader, "viewPos"), 1, glm::value_ptr(c_pos));
+        if(lamp_count > 0 && lampShader.ready())
+        {
+            lampShader.use();
+            renderLamps(lampShader);
+        }
 
-        renderScene(shader);
+        if(stats_on)
+        {
+            reportGLStats(currentFrame);
+        }
+        glStats() = GLStats();
 
-        simpleShader.use();
-        simpleShader.setMat4("projection", Projection);
-        simpleShader.setMat4("view", View);
-        renderAxis(simpleShader);
+        finishCrowd();
 
-        // only calculate when in normal frame
-        if(run_on) // let's run
+        if(options.headless)
         {
-            run();
-            ++tmp_time;
-            tmp_time %= (speedDivision+1);
-            tmp_step += (tmp_time / speedDivision);
-            if(tmp_step > 6)
+            frameTimer.end();
+            if(options.dumpDir != NULL && !dumpFrame(options.dumpDir, frameIndex, WIDTH, HEIGHT))
             {
-                tmp_step = 1;
+                fprintf(stderr, "Failed to write frame %d to %s\n", frameIndex, options.dumpDir);
+                options.dumpDir = NULL;
             }
+            ++frameIndex;
+            continue;
         }
 
-        renderLamp(simpleShader);
-
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        {
+            PROFILE_ZONE("swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
+    if(options.headless)
+    {
+        frameTimer.finish();
+        frameTimer.report();
+        if(options.timings != NULL && !frameTimer.write(options.timings))
+        {
+            fprintf(stderr, "Failed to write %s\n", options.timings);
+        }
+    }
+    simulation.stop();
+    options.finishProfile();
+
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
+    textureStreamer().release();
+    shadows.release();
+    shadowAtlas.release();
+    lamps.release();
 
-    glfwTerminate();
+    if(options.headless)
+    {
+        release_headless();
+    }
+    else
+    {
+        glfwTerminate();
+    }
     return 0;
 }
 
-void renderScene(const GLuint &shader)
+// the shadow filter sizes a scene variant is built for
+const int PCF_KERNELS[3] = { 1, 3, 5 };
+
+// the defines of one scene variant; the filter only matters with shadows, which are
+// only drawn on textured surfaces, and its size only to the two PCF filters; the cube
+// shadows of the point light always compare in hardware; the lamps light textured surfaces only
+std::string sceneDefines(bool textured, bool shadowed, int filter, int kernel, bool cube, bool clustered)
+{
+    shadowed = shadowed && textured;
+    std::string defines = "#define PERMUTED\n";
+    if(clustered && textured)
+    {
+        defines += "#define CLUSTERED\n#define CLUSTER_TILES_X " + std::to_string(CLUSTER_TILES_X) + "\n#define CLUSTER_TILES_Y " +
+                   std::to_string(CLUSTER_TILES_Y) + "\n#define CLUSTER_SLICES " + std::to_string(CLUSTER_SLICES) + "\n";
+    }
+    defines += textured ? "#define TEXTURE_ON true\n" : "#define TEXTURE_ON false\n";
+    defines += shadowed ? "#define SHADOW_ON true\n" : "#define SHADOW_ON false\n";
+    if(shadowed && cube)
+    {
+        defines += "#define SHADOW_CUBE\n#define PCF_KERNEL " + std::to_string(kernel) + "\n";
+    }
+    else if(shadowed)
+    {
+        defines += "#define SHADOW_FILTER " + std::to_string(filter) + "\n";
+        if(filtersMoments(filter))
+        {
+            defines += "#define ESM_EXPONENT " + std::to_string(ESM_EXPONENT) + "\n";
+        }
+        else
+        {
+            defines += "#define PCF_KERNEL " + std::to_string(kernel) + "\n";
+        }
+    }
+    return defines;
+}
+
+// every variant a frame can ask for, so none compiles on a key press; `bench` adds the
+// lamps shaded without clusters
+void submitSceneShaders(ShaderBuilder &builder, bool bench)
 {
+    std::function<void(ShaderProgram&)> setup = [](ShaderProgram &program)
+    {
+        frameBuffer.attach(program, "FrameData");
+        program.use();
+        program.setInt("diffuseTexture", 0);
+        program.setInt("shadowMap", 1);
+        program.setInt("pointShadowMap", 2);
+        program.setFloat("cubeNear", LIGHT_NEAR);
+        shadowAtlas.bindFaces(program);
+        program.setInt("lampData", 3);
+        program.setInt("clusterGrid", 4);
+        program.setInt("lampIndices", 5);
+    };
+    sceneShaders.submit(builder, sceneDefines(false, false, SHADOW_PCF, 0), setup);
+    for(bool clustered : { false, true })
+    {
+        sceneShaders.submit(builder, sceneDefines(true, false, SHADOW_PCF, 0, false, clustered), setup);
+        for(int filter = 0; filter < SHADOW_FILTERS; ++filter)
+        {
+            for(int kernel : PCF_KERNELS)
+            {
+                sceneShaders.submit(builder, sceneDefines(true, true, filter, kernel, false, clustered), setup);
+            }
+        }
+        for(int kernel : PCF_KERNELS)
+        {
+            sceneShaders.submit(builder, sceneDefines(true, true, SHADOW_HARDWARE, kernel, true, clustered), setup);
+        }
+    }
+    if(bench)
+    {
+        sceneShaders.submit(builder, sceneDefines(true, false, SHADOW_PCF, 0, false, true) + "#define ALL_LAMPS\n", setup);
+    }
+}
+
+// the defines of one pass of shadow_moments.fs
+std::string momentDefines(int filter, bool across)
+{
+    std::string defines = filter == SHADOW_VSM ? "#define VARIANCE\n" : "#define EXPONENTIAL\n";
+    defines += "#define ESM_EXPONENT " + std::to_string(ESM_EXPONENT) + "\n";
+    if(across)
+    {
+        defines += "#define ACROSS\n";
+    }
+    return defines;
+}
+
+void submitMomentShaders(ShaderBuilder &builder)
+{
+    std::function<void(ShaderProgram&)> setup = [](ShaderProgram &program)
+    {
+        program.use();
+        program.setInt("depthMap", 0);
+        program.setInt("blurMap", 0);
+    };
+    for(int filter : { SHADOW_VSM, SHADOW_ESM })
+    {
+        momentShaders.submit(builder, momentDefines(filter, true), setup);
+        momentShaders.submit(builder, momentDefines(filter, false), setup);
+    }
+}
+
+// are both passes of the filter built; always for the filters without moment maps
+bool momentShadersReady(int filter)
+{
+    return !filtersMoments(filter) || (momentShaders.find(momentDefines(filter, true))->ready() &&
+                                       momentShaders.find(momentDefines(filter, false))->ready());
+}
+
+// the moment maps of `filter` from the cascade depths just rendered
+void renderShadowMoments(int filter)
+{
+    shadowMoments.update(shadows, filter, *momentShaders.find(momentDefines(filter, true)),
+                         *momentShaders.find(momentDefines(filter, false)));
+}
+
+// the point shadow programs: the layered pass, and with `faces` the pass of one face at a time
+void submitPointShadowShaders(ShaderBuilder &builder, bool faces)
+{
+    std::function<void(ShaderProgram&)> setup = [](ShaderProgram &program)
+    {
+        frameBuffer.attach(program, "FrameData");
+    };
+    pointShadowShaders.submit(builder, "", setup);
+    pointShadowShaders.submit(builder, "#define CROWD\n", setup);
+    if(faces)
+    {
+        faceShadowShaders.submit(builder, "#define FACE_PASS\n", setup);
+        faceShadowShaders.submit(builder, "#define FACE_PASS\n#define CROWD\n", setup);
+    }
+}
+
+bool pointShadowsReady()
+{
+    return pointShadowShaders.find("")->ready() && pointShadowShaders.find("#define CROWD\n")->ready();
+}
+
+// a point light at `position` whose faces reach the farthest corner of the scene
+PointShadow pointShadowAt(const glm::vec3 &position)
+{
+    glm::vec3 low(-gridX, 0.0f, -gridZ), high(gridX, std::max(position.y, 1.0f), gridZ);
+    PointShadow light;
+    light.position = position;
+    light.far = LIGHT_NEAR;
+    for(int c=0; c<8; ++c)
+    {
+        glm::vec3 corner((c & 1) ? high.x : low.x, (c & 2) ? high.y : low.y, (c & 4) ? high.z : low.z);
+        light.far = std::max(light.far, glm::length(corner - position) * 1.01f);
+    }
+    return light;
+}
+
+// the scene's one point light in the atlas
+void placePointShadow()
+{
+    shadowAtlas.create(ATLAS_BUDGET);
+    shadowAtlas.place(std::vector<PointShadow>(1, pointShadowAt(lightPos)), shadow_resolution);
+}
+
+void renderScene(const ShaderProgram &shader)
+{
+    PROFILE_GPU_ZONE("renderScene");
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, grassTexture);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, filtersMoments(shadow_filter) ? shadowMoments.momentArray : shadows.depthArray);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, shadow_cube ? shadowAtlas.depthMap : 0);
+    if(lamp_count > 0)
+    {
+        lamps.bind(3);
+    }
 
-    // grid
-    renderGrid(shader);
+    // grid, each patch as coarse as its distance allows
+    renderGrid(shader, cameraFrustum, 0.5f * HEIGHT * Projection[1][1], cameraCulls.grid);
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, bricksTexture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
 
     // horse
-    renderHorse(shader);
+    renderHorse(shader, cameraFrustum, cameraCulls.parts);
 }
 
+Grid grid;
+// the ground patches the frustum sees, with cells no wider on screen than GRID_PIXEL_ERROR
+// for `pixelScale` pixels per unit at distance one; returns how many were drawn
+int renderGrid(const ShaderProgram &shader_grid, const Frustum &frustum, float pixelScale, CullCount &counts)
+{
+    if(grid.cellsX != gridX || grid.cellsZ != gridZ)
+    {
+        grid.build(gridX, gridZ);
+    }
+
+    // for no texture only
+    shader_grid.setVec4("shader_color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    // for texture only
+    shader_grid.setInt("material.diffuse", 0);
+    shader_grid.setVec3("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
+    shader_grid.setFloat("material.shininess", 64.0f);
+
+    // the patches carry their own place in the world
+    shader_grid.setMat4("model", glm::mat4(1.0f));
+    int visible = grid.select(frustum, c_pos, pixelScale);
+    counts.add(grid.tested, visible);
+    grid.draw(texture_on);
+    return visible;
+}
+
+// the original per-cell loop: one model upload and one draw call per cell
+// only used by the grid benchmark as the reference to compare against
 GLuint vertexArray_grid = 0;
 GLuint vertexBuffer_grid = 0;
 GLuint EBO = 0;
-void renderGrid(const GLuint &shader_grid)
+void renderGridCells(const ShaderProgram &shader_grid, int cellsX, int cellsZ)
 {
-
     if(vertexArray_grid == 0)
     {
         glGenVertexArrays(1, &vertexArray_grid);
         glGenBuffers(1, &vertexBuffer_grid);
         glGenBuffers(1, &EBO);
 
-/*
-        GLfloat buffer_data_grid[] =
-        {
-            -50.f, 0.f, 50.f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f,
-            50.f, 0.f, 50.f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-            50.f, 0.f, -50.f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f,
-            -50.f, 0.f, -50.f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-        };
-*/
-
         glBindVertexArray(vertexArray_grid);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexArray_grid);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_grid);
         glBufferData(GL_ARRAY_BUFFER, sizeof(buffer_data_grid), buffer_data_grid, GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
@@ -298,133 +733,249 @@ void renderGrid(const GLuint &shader_grid)
 
     glBindVertexArray(vertexArray_grid);
 
-    // for no texture only
-    glUniform4fv(glGetUniformLocation(shader_grid, "shader_color"), 1, glm::value_ptr(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
-
-    // for texture only
-    glUniform1i(glGetUniformLocation(shader_grid, "material.diffuse"), 0.3);
-    glUniform3fv(glGetUniformLocation(shader_grid, "material.specular"), 1, glm::value_ptr(glm::vec3(0.5f, 0.5f, 0.5f)));
-    glUniform1f(glGetUniformLocation(shader_grid, "material.shininess"), 64.0f);
-
-/*
-    glUniformMatrix4fv(glGetUniformLocation(shader_grid, "model"), 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
-    if(texture_on)
-    {
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    }
-    else
-    {
-        glDrawArrays(GL_LINE_LOOP, 0, 4*2);
-    }
-    return;
-*/
-
-    for(int i=1; i<=gridX; ++i)
+    for(int i=1; i<=cellsX; ++i)
     {
         glm::mat4 anchor_x1 = glm::translate(glm::mat4(1.0f), glm::vec3(i-1, 0.f, 0.f));
-        for(int j=1; j<=gridZ; ++j)
+        glm::mat4 anchor_x2 = glm::translate(glm::mat4(1.0f), glm::vec3(-i, 0.f, 0.f));
+        for(int j=1; j<=cellsZ; ++j)
         {
             glm::mat4 anchor_z1 = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, j-1));
-            glUniformMatrix4fv(glGetUniformLocation(shader_grid, "model"), 1, GL_FALSE, glm::value_ptr(anchor_x1 * anchor_z1));
-            if(texture_on)
-            {
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-            }
-            else
-            {
-                glDrawArrays(GL_LINE_LOOP, 0, 4*2);
-            }
-
             glm::mat4 anchor_z2 = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, -j));
-            glUniformMatrix4fv(glGetUniformLocation(shader_grid, "model"), 1, GL_FALSE, glm::value_ptr(anchor_x1 * anchor_z2));
-            if(texture_on)
-            {
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-            }
-            else
+            glm::mat4 cells[4] = { anchor_x1 * anchor_z1, anchor_x1 * anchor_z2, anchor_x2 * anchor_z1, anchor_x2 * anchor_z2 };
+            for(int k=0; k<4; ++k)
             {
-                glDrawArrays(GL_LINE_LOOP, 0, 4*2);
+                shader_grid.setMat4("model", cells[k]);
+                if(texture_on)
+                {
+                    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+                }
+                else
+                {
+                    glDrawArrays(GL_LINE_LOOP, 0, 4);
+                }
             }
         }
+    }
+    glBindVertexArray(0);
+}
 
-        glm::mat4 anchor_x2 = glm::translate(glm::mat4(1.0f), glm::vec3(-i, 0.f, 0.f));
-        for(int j=1; j<=gridZ; ++j)
-        {
-            glm::mat4 anchor_1 = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, j-1));
-            glUniformMatrix4fv(glGetUniformLocation(shader_grid, "model"), 1, GL_FALSE, glm::value_ptr(anchor_x2 * anchor_1));
-            if(texture_on)
-            {
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-            }
-            else
-            {
-                glDrawArrays(GL_LINE_LOOP, 0, 4*2);
-            }
+GLuint horseVAO = 0;
+GLuint horseVBO[3];
+void initHorseBuffers()
+{
+    generateBaseCube();
 
-            glm::mat4 anchor_2 = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, -j));
-            glUniformMatrix4fv(glGetUniformLocation(shader_grid, "model"), 1, GL_FALSE, glm::value_ptr(anchor_x2 * anchor_2));
-            if(texture_on)
-            {
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-            }
-            else
+    glGenVertexArrays(1, &horseVAO);
+    glGenBuffers(3, horseVBO);
+
+    glBindVertexArray(horseVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, horseVBO[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(points), points, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);// vertices shader, layout=0
+
+    glBindBuffer(GL_ARRAY_BUFFER, horseVBO[1]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);// vertices shader, layout=1
+
+    glBindBuffer(GL_ARRAY_BUFFER, horseVBO[2]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(textures), textures, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);// vertices shader, layout=2
+
+    glBindVertexArray(0);
+
+    initSkeleton();
+}
+
+// the parts of the interactive horse the frustum sees; returns how many were drawn
+int renderHorse(const ShaderProgram &shader_horse, const Frustum &frustum, CullCount &counts)
+{
+    shader_current = &shader_horse;
+    if (horseVAO == 0)
+    {
+        initHorseBuffers();
+    }
+
+    if(texture_on && !shadow_on){
+        shader_horse.setInt("material.diffuse", 0);
+        shader_horse.setVec3("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
+        shader_horse.setFloat("material.shininess", 64.0f);
+    }
+
+    glBindVertexArray(horseVAO);
+    poseHorse(poses, 0);
+    poses.evaluate();
+    int visible = drawSkeleton(poses.worldOf(0), frustum);
+    counts.add(skeleton.size(), visible);
+
+    glBindVertexArray(0);
+    return visible;
+}
+
+Crowd crowd;
+const int CROWD_SLICE = 64;       // horses per job
+JobCounter crowdAnimated;         // gaits sampled and skeletons evaluated
+JobCounter crowdFilled;           // instances written; the GL passes wait for it
+
+// animate the crowd and refill its instance buffer, once per frame; the work is queued
+// on the job threads in slices of horses and runs while the frame goes on
+void updateCrowd(float seconds)
+{
+    PROFILE_ZONE("updateCrowd");
+    if (horseVAO == 0)
+    {
+        initHorseBuffers();
+    }
+    if (crowd.VAO == 0)
+    {
+        crowd.init(horseVBO[0], horseVBO[1]);
+    }
+    jobs.wait(crowdFilled);
+    if (crowd.size() != crowd_size)
+    {
+        crowd.spawn(crowd_size, gridX, gridZ);
+    }
+
+    jobs.parallelFor(crowd.size(), CROWD_SLICE, [seconds](int first, int count) { crowd.update(first, count, seconds); }, crowdAnimated);
+    jobs.parallelFor(crowd.size(), CROWD_SLICE, [](int first, int count) { crowd.fill(first, count); }, crowdFilled, &crowdAnimated);
+}
+
+// the crowd jobs of a frame end with it, even when no pass waited for them:
+// the next frame's animation and a respawn rewrite what they read
+void finishCrowd()
+{
+    jobs.wait(crowdFilled);
+}
+
+// the caller sets the per-frame uniforms of the crowd program
+void renderCrowd(const ShaderProgram &shader_crowd)
+{
+    PROFILE_GPU_ZONE("renderCrowd");
+    jobs.wait(crowdFilled);
+    cameraCulls.crowd.add(crowd.size(), crowd.cull(cameraFrustum));
+    shader_crowd.use();
+    crowd.drawVisible();
+}
+
+// depth of everything each cascade's light frustum sees, one layer per cascade;
+// the ground chunks, the horse's parts and every crowd horse are tested against the frustum first.
+// The ground goes into the static layers, redrawn only when `ground` is set
+void renderShadowCasters(const ShaderProgram &shader_depth, const ShaderProgram &shader_crowd_depth, bool ground)
+{
+    PROFILE_GPU_ZONE("renderShadowCasters");
+    if (horseVAO == 0)
+    {
+        initHorseBuffers();
+    }
+
+    shader_depth.use();
+    if(ground)
+    {
+        lightCulls.grid = CullCount();
+        for(int c=0; c<shadows.count; ++c)
+        {
+            shadows.bindStaticLayer(c);
+            shader_depth.setInt("cascade", c);
+            // the ground is flat, so the coarsest patches give the same depth
+            if(renderGrid(shader_depth, shadows.frustums[c], 0.0f, lightCulls.grid) > 0)
             {
-                glDrawArrays(GL_LINE_LOOP, 0, 4*2);
+                ++shadows.staticCasters[c];
             }
         }
     }
-    glBindVertexArray(0);
-}
 
-GLuint horseVAO = 0;
-GLuint horseVBO[3];
-void renderHorse(const GLuint &shader_horse)
-{
-    shader_current = shader_horse;
-    if (horseVAO == 0)
+    lightCulls.parts = lightCulls.crowd = CullCount();
+    if(crowd_size > 0)
     {
-        generateBaseCube();
-
-        glGenVertexArrays(1, &horseVAO);
-        glGenBuffers(3, horseVBO);
+        jobs.wait(crowdFilled);
+        crowd.cullCasters(shadows, lightCulls.crowd);
+    }
 
-        glBindVertexArray(horseVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, horseVBO[0]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(points), points, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);// vertices shader, layout=0
+    for(int c=0; c<shadows.count; ++c)
+    {
+        shadows.bindLayer(c);
 
-        glBindBuffer(GL_ARRAY_BUFFER, horseVBO[1]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);// vertices shader, layout=1
+        shader_depth.use();
+        shader_depth.setInt("cascade", c);
+        if(renderHorse(shader_depth, shadows.frustums[c], lightCulls.parts) > 0)
+        {
+            ++shadows.casters[c];
+        }
 
-        glBindBuffer(GL_ARRAY_BUFFER, horseVBO[2]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(textures), textures, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);// vertices shader, layout=2
+        if(crowd_size > 0)
+        {
+            shader_crowd_depth.use();
+            shader_crowd_depth.setInt("cascade", c);
+            shadows.casters[c] += crowd.drawCasters(c);
+        }
+    }
 
-        glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
 
+// the box of the scene up to the highest of the atlas's lights, as a frustum to cull against
+Frustum pointShadowScene()
+{
+    float top = 1.0f;
+    for(size_t i=0; i<shadowAtlas.lights.size(); ++i)
+    {
+        top = std::max(top, shadowAtlas.lights[i].position.y);
     }
+    Frustum scene;
+    scene.extract(glm::ortho((float)-gridX, (float)gridX, -1.0f, top, (float)-gridZ, (float)gridZ));
+    return scene;
+}
 
-    if(texture_on && !shadow_on){
-        glUniform1i(glGetUniformLocation(shader_horse, "material.diffuse"), 0);
-        glUniform3fv(glGetUniformLocation(shader_horse, "material.specular"), 1, glm::value_ptr(glm::vec3(0.5f, 0.5f, 0.5f)));
-        glUniform1f(glGetUniformLocation(shader_horse, "material.shininess"), 64.0f);
+// depth of everything around the atlas's lights, every face of up to ATLAS_LIGHTS_PER_PASS
+// lights per draw; casters are tested against the box of the scene, which the lights see whole
+void renderPointShadows(const ShaderProgram &shader_point, const ShaderProgram &shader_crowd_point)
+{
+    PROFILE_GPU_ZONE("renderPointShadows");
+    if (horseVAO == 0)
+    {
+        initHorseBuffers();
     }
 
-    glBindVertexArray(horseVAO);
-    initNodes();
-    traverse(&nodes[Torso]);
+    Frustum scene = pointShadowScene();
+    lightCulls = CullStats();
+    if(crowd_size > 0)
+    {
+        jobs.wait(crowdFilled);
+        crowd.cullCasters(scene, lightCulls.crowd);
+    }
 
-    glBindVertexArray(0);
+    shadowAtlas.begin(true);
+    for(int first=0; first<(int)shadowAtlas.lights.size(); first+=ATLAS_LIGHTS_PER_PASS)
+    {
+        int count = std::min(ATLAS_LIGHTS_PER_PASS, (int)shadowAtlas.lights.size() - first);
+        shader_point.use();
+        shadowAtlas.bindPass(shader_point, first, count);
+        renderGrid(shader_point, scene, 0.0f, lightCulls.grid);
+        renderHorse(shader_point, scene, lightCulls.parts);
+        if(crowd_size > 0)
+        {
+            shader_crowd_point.use();
+            shadowAtlas.bindPass(shader_crowd_point, first, count);
+            crowd.drawCasters(0);
+        }
+    }
+    shadowAtlas.end();
 }
 
 GLuint vertexArray_axis = 0;
 GLuint vertexBuffer_axis = 0;
-void renderAxis(const Shader &shader_axis)
+void renderAxis(const ShaderProgram &shader_axis)
 {
+    PROFILE_GPU_ZONE("renderAxis");
+    // the three 5 unit arrows from the origin
+    bool visible = cameraFrustum.sees(glm::vec3(-0.2f), glm::vec3(5.0f));
+    cameraCulls.debug.add(1, visible ? 1 : 0);
+    if(!visible)
+    {
+        return;
+    }
     if(vertexArray_axis == 0)
     {
         glGenVertexArrays(1, &vertexArray_axis);
@@ -456,19 +1007,47 @@ void renderAxis(const Shader &shader_axis)
 
 unsigned int vertexArray_lamp = 0;
 unsigned int lightVBO = 0;
-void renderLamp(const Shader &shader_lamp)
+unsigned int vertexArray_lamps = 0;  // the same cube, one instance per lamp
+unsigned int lampInstanceVBO = 0;    // one vec4 per lamp cube: centre, size
+std::vector<glm::vec4> lampInstances;
+void initLampBuffers()
+{
+    glGenVertexArrays(1, &vertexArray_lamp);
+    glGenBuffers(1, &lightVBO);
+
+    glBindVertexArray(vertexArray_lamp);
+    glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(buffer_data_cube), buffer_data_cube, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+
+    glGenVertexArrays(1, &vertexArray_lamps);
+    glGenBuffers(1, &lampInstanceVBO);
+
+    glBindVertexArray(vertexArray_lamps);
+    glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, lampInstanceVBO);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+    glBindVertexArray(0);
+}
+
+void renderLamp(const ShaderProgram &shader_lamp)
 {
+    PROFILE_GPU_ZONE("renderLamp");
+    // the 0.2 unit cube at the light
+    bool visible = cameraFrustum.sees(glm::vec4(lightPos, 0.2f));
+    cameraCulls.debug.add(1, visible ? 1 : 0);
+    if(!visible)
+    {
+        return;
+    }
     if(vertexArray_lamp == 0)
     {
-        glGenVertexArrays(1, &vertexArray_lamp);
-        glGenBuffers(1, &lightVBO);
-
-        glBindVertexArray(vertexArray_lamp);
-        glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(buffer_data_cube), buffer_data_cube, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glBindVertexArray(0);
+        initLampBuffers();
     }
 
     glBindVertexArray(vertexArray_lamp);
@@ -481,6 +1060,50 @@ void renderLamp(const Shader &shader_lamp)
     glBindVertexArray(0);
 }
 
+// the lamps where they are at `seconds`, and the lamps of every cluster of this frame's camera
+void updateLamps(double seconds)
+{
+    PROFILE_ZONE("updateLamps");
+    if(lamps.size() != lamp_count)
+    {
+        lamps.scatter(lamp_count, std::min(std::min(gridX, gridZ), 50));
+    }
+    lamps.animate(seconds);
+    lamps.bin(cameraFrustum, View, glm::radians(fov), (float)WIDTH/(float)HEIGHT, 0.1f, viewDistance(), WIDTH, HEIGHT);
+    lamps.upload();
+}
+
+// a 0.1 unit cube at every lamp whose light the camera sees, all in one instanced
+// draw of shader_lamp built with INSTANCED
+void renderLamps(const ShaderProgram &shader_lamp)
+{
+    PROFILE_GPU_ZONE("renderLamps");
+    cameraCulls.debug.add(lamps.size(), (int)lamps.visible.size());
+    if(lamps.visible.empty())
+    {
+        return;
+    }
+    if(vertexArray_lamp == 0)
+    {
+        initLampBuffers();
+    }
+
+    lampInstances.clear();
+    for(int lamp : lamps.visible)
+    {
+        lampInstances.push_back(glm::vec4(glm::vec3(lamps.positions[lamp]), 0.1f));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, lampInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, lampInstances.size() * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, lampInstances.size() * sizeof(glm::vec4), lampInstances.data());
+
+    glBindVertexArray(vertexArray_lamps);
+    shader_lamp.setBool("self_color", false);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)lampInstances.size());
+    glBindVertexArray(0);
+    restorePatchAttribute();
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -498,114 +1121,19 @@ void window_size_callback(GLFWwindow* window, int width, int height)
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
-    //Pressing the spacebar should re-position the horse at a random location on the grid
-    if(key == GLFW_KEY_SPACE && action == GLFW_PRESS)
-    {
-        if(getRandomBool())
-        {
-            base_x = getRandomFromRange(gridX);
-            base_z = getRandomFromRange(gridX);
-        }
-        else
-        {
-            base_x = -getRandomFromRange(gridX);
-            base_z = -getRandomFromRange(gridX);
-        }
-    }
-    //pressing ‘U’ for scale-up and ‘J’ for scale-down
-    else if (key == GLFW_KEY_U && action == GLFW_PRESS)
-    {
-        base_scale += 0.1f;
-        updateTorso();
-
-    }
-    else if (key == GLFW_KEY_J && action == GLFW_PRESS)
-    {
-        if(base_scale >= 0.1)
-        {
-            base_scale -= 0.1f;
-        }
-        updateTorso();
-    }
-    //A ​ → move left 1 grid unit,
-    //D → move right 1 grid unit,
-    //W → move up 1 grid unit,
-    //S → move down 1 grid unit
-    //a ​ → rotate left 5 degrees about Y axis,
-    //d → rotate right 5 degrees about Y axis,
-    //w → rotate upwards 5 degrees raising the front legs,
-    //s → rotate downwards 5 degrees raising the hind legs.
-    else if(key == GLFW_KEY_A && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            --base_x;
-        }
-        else
-        {
-            rotateY +=5;
-        }
-    }
-    else if(key == GLFW_KEY_D && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            ++base_x;
-        }
-        else
-        {
-            rotateY -=5;
-        }
-    }
-    else if(key == GLFW_KEY_W && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            ++base_y;
-        }
-        else
-        {
-            rotateZ +=5;
-        }
-    }
-    else if(key == GLFW_KEY_S && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            if(base_y >= 1.0f)
-            {
-                --base_y;
-            }
-        }
-        else
-        {
-            rotateZ -=5;
-        }
-    }
-    else if(key == GLFW_KEY_Q && action == GLFW_PRESS)
+    //The horse keys reach the horse at the next simulation step
+    if(action == GLFW_PRESS && HorseState::owns(key, mode))
     {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            ++base_z;
-        }
-        else
-        {
-            rotateX +=5;
-        }
+        simulation.post([key, mode](HorseState& horse) { horse.key(key, mode); });
     }
-    else if(key == GLFW_KEY_E && action == GLFW_PRESS)
+    //Pressing the spacebar should re-position the horse at a random location on the grid
+    else if(key == GLFW_KEY_SPACE && action == GLFW_PRESS)
     {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            if(base_z >= 1.0f)
-            {
-                --base_z;
-            }
-        }
-        else
-        {
-            rotateX -=5;
-        }
+        // drawn here, so the simulation only ever sees its inputs
+        float sign = getRandomBool() ? 1.0f : -1.0f;
+        float x = sign * getRandomFromRange(gridX);
+        float z = sign * getRandomFromRange(gridX);
+        simulation.post([x, z](HorseState& horse) { horse.base_x = x; horse.base_z = z; });
     }
     //The world orientation
     else if (key == GLFW_KEY_LEFT)
@@ -650,7 +1178,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     else if(key == GLFW_KEY_HOME && action == GLFW_PRESS)
     {
         resetConfiguration();
-        resetHorse();
+        simulation.post([](HorseState& horse) { horse.reset(); });
     }
     //rendering mode
     //‘P’ for points, key ‘L’ for lines, key ‘T’ for triangles
@@ -666,161 +1194,91 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     {
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
-    //Rotate joint 0 by 5 degrees (Key_0 clockwise and the corresponding Shift + Key_0 for counterclockwise
-    else if(key == GLFW_KEY_0 && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[Head] += 1.0;
-        }
-        else
-        {
-            theta[Head] -= 1.0;
-        }
-    }
-    else if(key == GLFW_KEY_1 && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[Neck] += 1.0;
-        }
-        else
-        {
-            theta[Neck] -= 1.0;
-        }
-    }
-    else if(key == GLFW_KEY_2 && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[LeftUpperArm] += 1.0;
-        }
-        else
-        {
-            theta[LeftUpperArm] -= 1.0;
-        }
-    }
-    else if(key == GLFW_KEY_3 && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[LeftLowerArm] += 1.0;
-        }
-        else
-        {
-            theta[LeftLowerArm] -= 1.0;
-        }
-    }
-    else if(key == GLFW_KEY_4 && action == GLFW_PRESS)
-    {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[RightUpperArm] += 1.0;
-        }
-        else
-        {
-            theta[RightUpperArm] -= 1.0;
-        }
-    }
-    else if(key == GLFW_KEY_5 && action == GLFW_PRESS)
+    //Crowd mode: cycle through no crowd, 100, 1000 and 10000 extra horses (Key C)
+    else if(key == GLFW_KEY_C && action == GLFW_PRESS)
     {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[RightLowerArm] += 1.0;
-        }
-        else
+        crowd_size = (crowd_size == 0) ? 100 : crowd_size * 10;
+        if(crowd_size > 10000)
         {
-            theta[RightLowerArm] -= 1.0;
+            crowd_size = 0;
         }
     }
-    else if(key == GLFW_KEY_6 && action == GLFW_PRESS)
+    //Ground size: cycle through 100, 1000 and 10000 cells a side (Key Z)
+    else if(key == GLFW_KEY_Z && action == GLFW_PRESS)
     {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[LeftUpperLeg] += 1.0;
-        }
-        else
-        {
-            theta[LeftUpperLeg] -= 1.0;
-        }
+        int cells = 2 * gridX < 1000 ? 1000 : (2 * gridX < 10000 ? 10000 : 100);
+        gridX = gridZ = gridHalfSize(cells);
+        printf("ground: %d x %d cells\n", 2 * gridX, 2 * gridZ);
     }
-    else if(key == GLFW_KEY_7 && action == GLFW_PRESS)
+    //Print the uniform calls made and saved by the shader layer once per second (Key I)
+    else if(key == GLFW_KEY_I && action == GLFW_PRESS)
     {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[LeftLowerLeg] += 1.0;
-        }
-        else
-        {
-            theta[LeftLowerLeg] -= 1.0;
-        }
+        stats_on = !stats_on;
     }
-    else if(key == GLFW_KEY_8 && action == GLFW_PRESS)
+    //Time the passes on the CPU and GPU (Key F); turning it off prints their percentiles
+    else if(key == GLFW_KEY_F && action == GLFW_PRESS)
     {
-        if(mode == GLFW_MOD_SHIFT)
-        {
-            theta[RightUpperLeg] += 1.0;
-        }
-        else
+        profiler().enabled = !profiler().enabled;
+        if(!profiler().enabled)
         {
-            theta[RightUpperLeg] -= 1.0;
+            profiler().finish();
+            profiler().summary();
         }
     }
-    else if(key == GLFW_KEY_9 && action == GLFW_PRESS)
+    //Cycle the shadow cascades 1-4 (Key K), or the resolution of every cascade 512-4096 (Shift + K)
+    else if(key == GLFW_KEY_K && action == GLFW_PRESS)
     {
         if(mode == GLFW_MOD_SHIFT)
         {
-            theta[RightLowerLeg] += 1.0;
+            shadow_resolution = (shadow_resolution >= 4096) ? 512 : shadow_resolution * 2;
         }
         else
         {
-            theta[RightLowerLeg] -= 1.0;
+            shadow_cascades = shadow_cascades % MAX_CASCADES + 1;
         }
+        printf("shadows: %d cascade(s) of %d x %d\n", shadow_cascades, shadow_resolution, shadow_resolution);
     }
-    else if(key == GLFW_KEY_R && action == GLFW_PRESS)
+    //Render the scene with grass texture on the ground mesh and horse-skin texture on the horse
+    else if(key == GLFW_KEY_X && action == GLFW_PRESS)//debug
     {
-        if(run_on) // stop
+        if(texture_on)
         {
-            run_on = false;
+            texture_on = false;
+            shadow_on = false;
         }
         else
         {
-            run_on = true;
+            texture_on = true;
         }
     }
-    else if(key == GLFW_KEY_EQUAL && action == GLFW_PRESS && mode == GLFW_MOD_SHIFT)
+    //Cycle the PCF kernel through 1 x 1, 3 x 3 and 5 x 5 texels (Shift + Key B)
+    else if(key == GLFW_KEY_B && action == GLFW_PRESS && mode == GLFW_MOD_SHIFT)
     {
-        --speedDivision;
-        if(speedDivision < 1)
-        {
-            speedDivision = 1;
-        }
+        pcf_kernel = pcf_kernel >= 5 ? 1 : pcf_kernel + 2;
+        printf("PCF kernel: %d x %d texels\n", pcf_kernel, pcf_kernel);
     }
-    else if(key == GLFW_KEY_MINUS && action == GLFW_PRESS && mode == GLFW_MOD_SHIFT)
+    //Cycle the shadow filter: PCF, hardware PCF, variance and exponential shadow maps (Key V)
+    else if(key == GLFW_KEY_V && action == GLFW_PRESS)
     {
-        ++speedDivision;
+        shadow_filter = (shadow_filter + 1) % SHADOW_FILTERS;
+        printf("shadow filter: %s\n", SHADOW_FILTER_NAMES[shadow_filter]);
     }
-    else if(key == GLFW_KEY_N && action == GLFW_PRESS)//debug
+    //Shadow the point light all around with a cube of six faces in the shadow atlas, in place of the cascades (Key O)
+    else if(key == GLFW_KEY_O && action == GLFW_PRESS)
     {
-        run();
-        tmp_step += 1;
-        if(tmp_step > 6)
-        {
-            tmp_step = 1;
-        }
+        shadow_cube = !shadow_cube;
+        shadowCache.invalidate();
+        printf("shadows: %s\n", shadow_cube ? "point light cube" : "cascades");
     }
-    //Render the scene with grass texture on the ground mesh and horse-skin texture on the horse
-    else if(key == GLFW_KEY_X && action == GLFW_PRESS)//debug
+    //Point lamps: cycle through 1, 64, 256 and 1024 lamps shaded through light clusters, then off (Key M)
+    else if(key == GLFW_KEY_M && action == GLFW_PRESS)
     {
-        if(texture_on)
-        {
-            texture_on = false;
-            shadow_on = false;
-        }
-        else
+        lamp_count = lamp_count == 0 ? 1 : (lamp_count == 1 ? 64 : lamp_count * 4);
+        if(lamp_count > 1024)
         {
-            texture_on = true;
+            lamp_count = 0;
         }
+        printf("lamps: %d\n", lamp_count);
     }
     //Render the scene with shadows using two pass shadow algorithm (Key B)
     else if(key == GLFW_KEY_B && action == GLFW_PRESS)//debug
@@ -964,43 +1422,143 @@ int init_window(int width, int height, const std::string title)
     return 0;
 }
 
+// print the GL calls of the last frame once per second
+// -----------------------------------------------------
+double lastReport = 0.0;
+// visible of tested, per kind of object
+void printCulls(const char *pass, const CullStats &culls)
+{
+    printf("%s culling: ground patches %d of %d, horse parts %d of %d, crowd horses %d of %d, debug %d of %d\n",
+           pass, culls.grid.visible, culls.grid.tested, culls.parts.visible, culls.parts.tested,
+           culls.crowd.visible, culls.crowd.tested, culls.debug.visible, culls.debug.tested);
+}
+
+void reportGLStats(double now)
+{
+    if(now - lastReport < 1.0)
+    {
+        return;
+    }
+    lastReport = now;
+    printf("per frame: %ld glGetUniformLocation calls served from cache, %ld glUniform calls, "
+           "%ld uniform buffer update(s) replacing %ld glUniform calls\n",
+           glStats().cachedLookups, glStats().uniformCalls, glStats().blockUpdates, glStats().blockUniforms);
+    if(shadow_on)
+    {
+        printf("shadow casters per cascade:");
+        for(int c=0; c<shadows.count; ++c)
+        {
+            printf(" %d (to %.1f)", shadows.casters[c], shadows.splits[c]);
+        }
+        printf("; shadow pass since last report: %d full, %d horses only, %d skipped\n",
+               shadowCache.all, shadowCache.casters, shadowCache.reused);
+    }
+    if(lamp_count > 0)
+    {
+        printf("lamps: %d of %d lighting the view, %d listed over %d clusters, at most %d in one\n",
+               (int)lamps.visible.size(), lamps.size(), lamps.listed(), CLUSTERS, lamps.mostInCluster());
+    }
+    printCulls("camera", cameraCulls);
+    if(shadow_on)
+    {
+        printCulls("light", lightCulls);
+    }
+    shadowCache.resetCounts();
+}
+
 // utility function for loading a 2D texture from file
 // ---------------------------------------------------
+// the texture shows a placeholder until textureStreamer().update() uploads the image
 unsigned int loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    return textureStreamer().request(path);
+}
+
+// the orbit camera: View and Projection from the camera angles and radius
+// ----------------------------------------------------------------------
+void updateCamera(float aspect)
+{
+    double c_pos_x = c_radius * glm::cos(glm::radians(c_vertical)) * glm::cos(glm::radians(c_horizontal));
+    double c_pos_y = c_radius * glm::sin(glm::radians(c_vertical));
+    double c_pos_z = c_radius * glm::cos(glm::radians(c_vertical)) * glm::sin(glm::radians(c_horizontal));
+    c_pos = glm::vec3(c_pos_x, c_pos_y, c_pos_z); // camera position
+    c_dir = glm::vec3(c_dir_x, c_dir_y, c_dir_z); // camera direction
+    // Camera matrix
+    View = glm::lookAt(c_pos, c_dir, c_up);
+
+    Projection = glm::perspective(glm::radians(fov), aspect, 0.1f, viewDistance());
+}
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
+// the scene on the CPU rasterizer for a fixed number of frames, like a headless run
+// ----------------------------------------------------------------------------------
+int runSoftware(HeadlessOptions &options)
+{
+    if(options.bench != NULL)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        if(strcmp(options.bench, "software") != 0)
+        {
+            fprintf(stderr, "Only the software benchmark runs with --software\n");
+            return -1;
+        }
+        benchmarkSoftware();
+        return 0;
+    }
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    resetHorse();
+    options.apply();
+    if(crowd_size > 0)
+    {
+        printf("software: the crowd is not drawn\n");
+    }
 
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    SoftwareRenderer renderer;
+    renderer.resize(WIDTH, HEIGHT);
+    renderer.raster.setThreads(options.threads);
 
-        stbi_image_free(data);
-    }
-    else
+    FrameTimer frameTimer;
+    std::vector<unsigned char> rgb((size_t)WIDTH * HEIGHT * 3);
+    for(int frame=0; frame<options.frames; ++frame)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        PROFILE_ZONE("frame");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        updateCamera((float)WIDTH/(float)HEIGHT);
+        renderer.render(View, Projection);
+        if(run_on)
+        {
+            run(1.0f / 60.0f);
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        frameTimer.cpu.push_back(elapsed.count());
+
+        if(options.dumpDir != NULL)
+        {
+            for(size_t i=0; i<renderer.pixels.size(); ++i)
+            {
+                memcpy(&rgb[i * 3], &renderer.pixels[i], 3);
+            }
+            if(!saveFrame(options.dumpDir, frame, WIDTH, HEIGHT, rgb))
+            {
+                fprintf(stderr, "Failed to write frame %d to %s\n", frame, options.dumpDir);
+                options.dumpDir = NULL;
+            }
+        }
     }
 
-    return textureID;
+    frameTimer.report();
+    double total = 0.0;
+    for(size_t i=0; i<frameTimer.cpu.size(); ++i)
+    {
+        total += frameTimer.cpu[i];
+    }
+    printf("software: %ux%u, %d thread(s), %.1f frames per second\n", WIDTH, HEIGHT, renderer.raster.threads(),
+           total > 0.0 ? 1000.0 * frameTimer.cpu.size() / total : 0.0);
+    options.finishProfile();
+    if(options.timings != NULL && !frameTimer.write(options.timings))
+    {
+        fprintf(stderr, "Failed to write %s\n", options.timings);
+    }
+    return 0;
 }
+
+// the benchmarks drive the render functions above
+#include "Benchmark.h"
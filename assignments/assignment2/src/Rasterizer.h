@@ -0,0 +1,859 @@
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTER_SSE 1
+#endif
+
+//----------------------------------------------------------------------------
+// Tiled software rasterizer.
+// Draws are queued against one target and run when flushed, in two parallel
+// phases. Geometry: the queued primitives are cut into chunks, and each chunk
+// is vertex shaded, clipped, set up and sorted into bins, one per 64 x 64
+// tile. Raster: every tile walks the bins of all chunks in submission order,
+// so the result does not depend on the thread count. It tests four pixels at
+// a time against the edge functions and the tile's depth, keeps the nearest
+// primitive per pixel, and shades each visible pixel once.
+//----------------------------------------------------------------------------
+const int RASTER_TILE = 64;        // tile edge in pixels
+const int RASTER_CHUNK = 512;      // primitives per geometry job
+const int RASTER_VARYINGS = 9;     // world position, normal, texture coordinates, view depth
+const float RASTER_GUARD = 16.0f;  // clip x and y at this many viewport half-widths, keeps setup exact
+
+// a model-space mesh drawn as triangles or as line segments through `indices`
+struct RasterMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<unsigned int> indices;
+
+    void add(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec2 &uv)
+    {
+        indices.push_back((unsigned int)positions.size());
+        positions.push_back(position);
+        normals.push_back(normal);
+        uvs.push_back(uv);
+    }
+};
+
+enum RasterMode
+{
+    RASTER_TRIANGLES,
+    RASTER_LINES
+};
+
+// where a pass draws; row 0 is the top of the image when flipY is set, the bottom like GL otherwise
+struct RasterTarget
+{
+    int width, height;
+    uint32_t* color; // RGBA8, NULL for a depth-only pass
+    float* depth;    // written for depth-only passes
+    bool flipY;
+
+    RasterTarget() :
+        width(0), height(0), color(NULL), depth(NULL), flipY(true) {}
+};
+
+// a triangle or line after setup, in pixels of the target
+struct RasterPrimitive
+{
+    float x[3], y[3], z[3];
+    float invW[3];
+    float varyings[3][RASTER_VARYINGS]; // divided by w, for perspective-correct interpolation
+    float A[3], B[3];                   // edge k runs opposite vertex k: A*x + B*y grows inwards
+    float invArea;
+    int minX, minY, maxX, maxY;         // pixel bounds, inclusive
+    int material;
+    int width;                          // line width in pixels, 0 for a triangle
+};
+
+//----------------------------------------------------------------------------
+// The raster threads. run() hands indices out through an atomic counter to
+// the workers and the calling thread alike and returns when all are done.
+//----------------------------------------------------------------------------
+class RasterWorkers
+{
+public:
+    RasterWorkers() :
+        stopping(false), generation(0), busy(0), jobCount(0), job(NULL) {}
+
+    ~RasterWorkers()
+    {
+        stop();
+    }
+
+    // threads including the caller
+    int size() const
+    {
+        return (int)workers.size() + 1;
+    }
+
+    void resize(int threads)
+    {
+        stop();
+        stopping = false;
+        for(int i=1; i<threads; ++i)
+        {
+            workers.push_back(std::thread(&RasterWorkers::loop, this, i));
+        }
+    }
+
+    // job(index, thread) for every index in [0, count)
+    void run(int count, const std::function<void(int, int)> &work)
+    {
+        if(workers.empty() || count <= 1)
+        {
+            for(int i=0; i<count; ++i)
+            {
+                work(i, 0);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &work;
+            jobCount = count;
+            next = 0;
+            busy = (int)workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+        take(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+        job = NULL;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool stopping;
+    int generation;
+    int busy;
+    int jobCount;
+    std::atomic<int> next;
+    const std::function<void(int, int)>* job;
+
+    void take(int thread)
+    {
+        PROFILE_ZONE("raster worker");
+        for(int i = next++; i < jobCount; i = next++)
+        {
+            (*job)(i, thread);
+        }
+    }
+
+    void loop(int thread)
+    {
+        int seen = 0;
+        for(;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if(stopping)
+                {
+                    return;
+                }
+                seen = generation;
+            }
+            take(thread);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(--busy == 0)
+                {
+                    done.notify_one();
+                }
+            }
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(size_t i=0; i<workers.size(); ++i)
+        {
+            workers[i].join();
+        }
+        workers.clear();
+    }
+};
+
+class Rasterizer
+{
+public:
+    int primitives; // set up by the last flush, after clipping and culling
+
+    Rasterizer() :
+        primitives(0), clearColor(0), depthOnly(false), tilesX(0), tilesY(0)
+    {
+        setThreads(1);
+    }
+
+    void setThreads(int threads)
+    {
+        workers.resize(threads);
+        scratch.resize(threads);
+    }
+
+    int threads() const
+    {
+        return workers.size();
+    }
+
+    // start a pass; `view` only feeds the view depth varying
+    void begin(const RasterTarget &target, const glm::mat4 &viewProjection, const glm::mat4 &view, uint32_t clear)
+    {
+        this->target = target;
+        this->viewProjection = viewProjection;
+        this->view = view;
+        clearColor = clear;
+        depthOnly = target.color == NULL;
+        tilesX = (target.width + RASTER_TILE - 1) / RASTER_TILE;
+        tilesY = (target.height + RASTER_TILE - 1) / RASTER_TILE;
+        draws.clear();
+    }
+
+    // queue `count` primitives of the mesh from `first` (all when -1)
+    void draw(const RasterMesh &mesh, RasterMode mode, const glm::mat4 &model, int material, float lineWidth = 1.0f,
+              int first = 0, int count = -1)
+    {
+        Draw d;
+        d.mesh = &mesh;
+        d.mode = mode;
+        d.model = model;
+        d.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        d.material = material;
+        d.width = std::max(1, (int)(lineWidth + 0.5f));
+        d.first = first;
+        d.count = count >= 0 ? count : (int)mesh.indices.size() / (mode == RASTER_LINES ? 2 : 3) - first;
+        draws.push_back(d);
+    }
+
+    // run the queued draws; shader(material, varyings) gives the colour of a visible pixel
+    template<typename Shader>
+    void flush(const Shader &shader)
+    {
+        // cut the draws into chunks
+        int used = 0;
+        for(size_t d=0; d<draws.size(); ++d)
+        {
+            for(int first = 0; first < draws[d].count; first += RASTER_CHUNK)
+            {
+                if(used == (int)chunks.size())
+                {
+                    chunks.push_back(Chunk());
+                }
+                Chunk &chunk = chunks[used++];
+                chunk.draw = (int)d;
+                chunk.first = draws[d].first + first;
+                chunk.count = std::min(RASTER_CHUNK, draws[d].count - first);
+            }
+        }
+        chunkCount = used;
+
+        {
+            PROFILE_ZONE("raster setup");
+            workers.run(chunkCount, [this](int c, int) { setup(chunks[c]); });
+        }
+
+        primitives = 0;
+        for(int c=0; c<chunkCount; ++c)
+        {
+            primitives += (int)chunks[c].out.size();
+        }
+
+        PROFILE_ZONE("raster tiles");
+        workers.run(tilesX * tilesY, [this, &shader](int tile, int thread)
+        {
+            renderTile(tile, scratch[thread], shader);
+        });
+        draws.clear();
+    }
+
+private:
+    struct Draw
+    {
+        const RasterMesh* mesh;
+        RasterMode mode;
+        glm::mat4 model;
+        glm::mat3 normalMatrix;
+        int material;
+        int width;
+        int first, count;
+    };
+
+    struct Chunk
+    {
+        int draw, first, count;
+        std::vector<RasterPrimitive> out;
+        std::vector<std::vector<int> > bins; // primitives of `out` touching each tile
+    };
+
+    struct ClipVertex
+    {
+        glm::vec4 clip;
+        float varyings[RASTER_VARYINGS];
+    };
+
+    // the nearest primitive of every pixel of a tile, found before anything is shaded
+    struct Scratch
+    {
+        float depth[RASTER_TILE * RASTER_TILE];
+        const RasterPrimitive* primitive[RASTER_TILE * RASTER_TILE];
+        float b1[RASTER_TILE * RASTER_TILE], b2[RASTER_TILE * RASTER_TILE]; // screen-space weights of vertex 1 and 2
+    };
+
+    RasterTarget target;
+    glm::mat4 viewProjection, view;
+    uint32_t clearColor;
+    bool depthOnly;
+    int tilesX, tilesY;
+
+    RasterWorkers workers;
+    std::vector<Scratch> scratch;
+    std::vector<Draw> draws;
+    std::vector<Chunk> chunks;
+    int chunkCount;
+
+    //------------------------------------------------------------------------
+    // geometry
+
+    // the port of shadow_mapping.vs; a depth pass only needs the position
+    void shadeVertex(const Draw &d, unsigned int index, ClipVertex &out) const
+    {
+        glm::vec4 world = d.model * glm::vec4(d.mesh->positions[index], 1.0f);
+        out.clip = viewProjection * world;
+        if(depthOnly)
+        {
+            return;
+        }
+        glm::vec3 normal = d.mesh->normals.empty() ? glm::vec3(0.0f, 1.0f, 0.0f) : d.normalMatrix * d.mesh->normals[index];
+        glm::vec2 uv = d.mesh->uvs.empty() ? glm::vec2(0.0f) : d.mesh->uvs[index];
+        float v[RASTER_VARYINGS] = { world.x, world.y, world.z, normal.x, normal.y, normal.z, uv.x, uv.y, -(view * world).z };
+        memcpy(out.varyings, v, sizeof(v));
+    }
+
+    // signed distance to clip plane p: near, then the four guard band sides
+    static float planeDistance(const glm::vec4 &c, int p)
+    {
+        switch(p)
+        {
+        case 0 :
+            return c.z + c.w;
+        case 1 :
+            return RASTER_GUARD * c.w - c.x;
+        case 2 :
+            return RASTER_GUARD * c.w + c.x;
+        case 3 :
+            return RASTER_GUARD * c.w - c.y;
+        default :
+            return RASTER_GUARD * c.w + c.y;
+        }
+    }
+
+    static void lerp(const ClipVertex &a, const ClipVertex &b, float t, ClipVertex &result)
+    {
+        result.clip = a.clip + t * (b.clip - a.clip);
+        for(int k=0; k<RASTER_VARYINGS; ++k)
+        {
+            result.varyings[k] = a.varyings[k] + t * (b.varyings[k] - a.varyings[k]);
+        }
+    }
+
+    // the point where the edge crosses the plane, always interpolated from the inside end
+    // so that two triangles sharing the edge get the same vertex
+    static void intersect(const ClipVertex &in, float dIn, const ClipVertex &out, float dOut, ClipVertex &result)
+    {
+        lerp(in, out, dIn / (dIn - dOut), result);
+    }
+
+    // Sutherland-Hodgman against the planes the polygon crosses; returns the vertex count
+    int clipPolygon(ClipVertex* polygon, int n) const
+    {
+        ClipVertex buffer[16];
+        for(int p=0; p<5 && n > 0; ++p)
+        {
+            float d[16];
+            bool crossing = false;
+            for(int i=0; i<n; ++i)
+            {
+                d[i] = planeDistance(polygon[i].clip, p);
+                crossing = crossing || d[i] < 0.0f;
+            }
+            if(!crossing)
+            {
+                continue;
+            }
+
+            int m = 0;
+            for(int i=0; i<n; ++i)
+            {
+                int j = (i + 1) % n;
+                if(d[i] >= 0.0f)
+                {
+                    buffer[m++] = polygon[i];
+                }
+                if((d[i] >= 0.0f) != (d[j] >= 0.0f))
+                {
+                    if(d[i] >= 0.0f)
+                    {
+                        intersect(polygon[i], d[i], polygon[j], d[j], buffer[m++]);
+                    }
+                    else
+                    {
+                        intersect(polygon[j], d[j], polygon[i], d[i], buffer[m++]);
+                    }
+                }
+            }
+            n = m;
+            std::copy(buffer, buffer + n, polygon);
+        }
+        return n;
+    }
+
+    // clip space to pixels; x and y snapped to 1/16 pixel so edge setup below is exact
+    void project(const ClipVertex &v, RasterPrimitive &p, int k) const
+    {
+        float invW = 1.0f / v.clip.w;
+        float x = (v.clip.x * invW * 0.5f + 0.5f) * target.width;
+        float y = v.clip.y * invW * 0.5f;
+        y = (target.flipY ? 0.5f - y : 0.5f + y) * target.height;
+        p.x[k] = floor(x * 16.0f + 0.5f) / 16.0f;
+        p.y[k] = floor(y * 16.0f + 0.5f) / 16.0f;
+        p.z[k] = v.clip.z * invW * 0.5f + 0.5f;
+        p.invW[k] = invW;
+        if(!depthOnly)
+        {
+            for(int i=0; i<RASTER_VARYINGS; ++i)
+            {
+                p.varyings[k][i] = v.varyings[i] * invW;
+            }
+        }
+    }
+
+    // pixel bounds with `pad` pixels around the vertices; false when nothing is on the target
+    bool bound(RasterPrimitive &p, int vertices, float pad) const
+    {
+        float lowX = p.x[0], highX = p.x[0], lowY = p.y[0], highY = p.y[0];
+        for(int k=1; k<vertices; ++k)
+        {
+            lowX = std::min(lowX, p.x[k]);
+            highX = std::max(highX, p.x[k]);
+            lowY = std::min(lowY, p.y[k]);
+            highY = std::max(highY, p.y[k]);
+        }
+        p.minX = std::max(0, (int)floor(lowX - pad));
+        p.minY = std::max(0, (int)floor(lowY - pad));
+        p.maxX = std::min(target.width - 1, (int)ceil(highX + pad));
+        p.maxY = std::min(target.height - 1, (int)ceil(highY + pad));
+        return p.minX <= p.maxX && p.minY <= p.maxY;
+    }
+
+    void emitTriangle(Chunk &chunk, const ClipVertex &a, const ClipVertex &b, const ClipVertex &c, int material)
+    {
+        RasterPrimitive p;
+        project(a, p, 0);
+        project(b, p, 1);
+        project(c, p, 2);
+
+        // no culling: turn clockwise triangles around so the inside is always positive
+        float area = (p.x[2] - p.x[1]) * (p.y[0] - p.y[1]) - (p.y[2] - p.y[1]) * (p.x[0] - p.x[1]);
+        if(area == 0.0f || !bound(p, 3, 0.0f))
+        {
+            return;
+        }
+        if(area < 0.0f)
+        {
+            std::swap(p.x[1], p.x[2]);
+            std::swap(p.y[1], p.y[2]);
+            std::swap(p.z[1], p.z[2]);
+            std::swap(p.invW[1], p.invW[2]);
+            if(!depthOnly)
+            {
+                std::swap(p.varyings[1], p.varyings[2]);
+            }
+            area = -area;
+        }
+        for(int k=0; k<3; ++k)
+        {
+            int i = (k + 1) % 3, j = (k + 2) % 3;
+            p.A[k] = p.y[i] - p.y[j];
+            p.B[k] = p.x[j] - p.x[i];
+        }
+        p.invArea = 1.0f / area;
+        p.material = material;
+        p.width = 0;
+        store(chunk, p);
+    }
+
+    void emitLine(Chunk &chunk, ClipVertex* ends, int material, int width)
+    {
+        // clip the segment parametrically against the same planes
+        float t0 = 0.0f, t1 = 1.0f;
+        for(int p=0; p<5; ++p)
+        {
+            float d0 = planeDistance(ends[0].clip, p), d1 = planeDistance(ends[1].clip, p);
+            if(d0 < 0.0f && d1 < 0.0f)
+            {
+                return;
+            }
+            if(d0 < 0.0f)
+            {
+                t0 = std::max(t0, d0 / (d0 - d1));
+            }
+            else if(d1 < 0.0f)
+            {
+                t1 = std::min(t1, d0 / (d0 - d1));
+            }
+        }
+        if(t0 >= t1)
+        {
+            return;
+        }
+
+        ClipVertex a, b;
+        lerp(ends[0], ends[1], t0, a);
+        lerp(ends[0], ends[1], t1, b);
+
+        RasterPrimitive p;
+        project(a, p, 0);
+        project(b, p, 1);
+        project(a, p, 2);
+        if(!bound(p, 2, 0.5f * width + 1.0f))
+        {
+            return;
+        }
+        p.material = material;
+        p.width = width;
+        store(chunk, p);
+    }
+
+    void store(Chunk &chunk, const RasterPrimitive &p)
+    {
+        int index = (int)chunk.out.size();
+        chunk.out.push_back(p);
+        for(int ty = p.minY / RASTER_TILE; ty <= p.maxY / RASTER_TILE; ++ty)
+        {
+            for(int tx = p.minX / RASTER_TILE; tx <= p.maxX / RASTER_TILE; ++tx)
+            {
+                chunk.bins[ty * tilesX + tx].push_back(index);
+            }
+        }
+    }
+
+    // geometry phase of one chunk
+    void setup(Chunk &chunk)
+    {
+        const Draw &d = draws[chunk.draw];
+        const int vertices = d.mode == RASTER_LINES ? 2 : 3;
+        chunk.out.clear();
+        chunk.bins.resize(tilesX * tilesY);
+        for(size_t t=0; t<chunk.bins.size(); ++t)
+        {
+            chunk.bins[t].clear();
+        }
+
+        ClipVertex polygon[16];
+        for(int i = chunk.first; i < chunk.first + chunk.count; ++i)
+        {
+            for(int k=0; k<vertices; ++k)
+            {
+                shadeVertex(d, d.mesh->indices[(size_t)i * vertices + k], polygon[k]);
+            }
+            if(d.mode == RASTER_LINES)
+            {
+                emitLine(chunk, polygon, d.material, d.width);
+                continue;
+            }
+            int n = clipPolygon(polygon, 3);
+            for(int k=1; k+1<n; ++k)
+            {
+                emitTriangle(chunk, polygon[0], polygon[k], polygon[k + 1], d.material);
+            }
+        }
+    }
+
+    //------------------------------------------------------------------------
+    // raster
+
+    // depth test four pixels of a tile row; `inside` marks the lanes covered
+    void testQuad(Scratch &s, int index, const float* z, const float* b1, const float* b2, int inside, const RasterPrimitive &p) const
+    {
+        for(int lane=0; lane<4; ++lane)
+        {
+            if((inside >> lane & 1) && z[lane] < s.depth[index + lane])
+            {
+                s.depth[index + lane] = z[lane];
+                s.primitive[index + lane] = &p;
+                s.b1[index + lane] = b1[lane];
+                s.b2[index + lane] = b2[lane];
+            }
+        }
+    }
+
+    void rasterTriangle(const RasterPrimitive &p, Scratch &s, int tileX, int tileY, int tileW, int tileH) const
+    {
+        const int x0 = std::max(p.minX - tileX, 0), x1 = std::min(p.maxX - tileX, tileW - 1);
+        const int y0 = std::max(p.minY - tileY, 0), y1 = std::min(p.maxY - tileY, tileH - 1);
+        if(x0 > x1 || y0 > y1)
+        {
+            return;
+        }
+
+        // edges at the tile's first pixel centre, in double so both triangles of a shared edge get exactly opposite values;
+        // on the edge itself the pixel belongs to the triangle whose edge points up and left (top-left rule)
+        float origin[3];
+        bool owns[3];
+        for(int k=0; k<3; ++k)
+        {
+            int i = (k + 1) % 3;
+            origin[k] = (float)((double)p.A[k] * (tileX + 0.5 - p.x[i]) + (double)p.B[k] * (tileY + 0.5 - p.y[i]));
+            owns[k] = p.A[k] > 0.0f || (p.A[k] == 0.0f && p.B[k] > 0.0f);
+        }
+        const float dz1 = p.z[1] - p.z[0], dz2 = p.z[2] - p.z[0];
+
+#ifdef RASTER_SSE
+        const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 zero = _mm_setzero_ps();
+        __m128 A[3], own[3];
+        for(int k=0; k<3; ++k)
+        {
+            A[k] = _mm_set1_ps(p.A[k]);
+            own[k] = _mm_castsi128_ps(_mm_set1_epi32(owns[k] ? -1 : 0));
+        }
+        const __m128 invArea = _mm_set1_ps(p.invArea);
+        const __m128 z0 = _mm_set1_ps(p.z[0]), vz1 = _mm_set1_ps(dz1), vz2 = _mm_set1_ps(dz2);
+        const __m128 lastColumn = _mm_set1_ps((float)x1 + 0.5f), firstColumn = _mm_set1_ps((float)x0 - 0.5f);
+
+        for(int y = y0; y <= y1; ++y)
+        {
+            __m128 row[3];
+            for(int k=0; k<3; ++k)
+            {
+                row[k] = _mm_set1_ps(origin[k] + (float)y * p.B[k]);
+            }
+            for(int x = x0 & ~3; x <= x1; x += 4)
+            {
+                __m128 column = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+                __m128 inside = _mm_and_ps(_mm_cmplt_ps(column, lastColumn), _mm_cmpgt_ps(column, firstColumn));
+                __m128 e[3];
+                for(int k=0; k<3; ++k)
+                {
+                    e[k] = _mm_add_ps(row[k], _mm_mul_ps(column, A[k]));
+                    __m128 in = _mm_or_ps(_mm_cmpgt_ps(e[k], zero), _mm_and_ps(_mm_cmpeq_ps(e[k], zero), own[k]));
+                    inside = _mm_and_ps(inside, in);
+                }
+                if(_mm_movemask_ps(inside) == 0)
+                {
+                    continue;
+                }
+
+                __m128 b1 = _mm_mul_ps(e[1], invArea), b2 = _mm_mul_ps(e[2], invArea);
+                __m128 z = _mm_add_ps(z0, _mm_add_ps(_mm_mul_ps(b1, vz1), _mm_mul_ps(b2, vz2)));
+                const int index = y * RASTER_TILE + x;
+                __m128 depth = _mm_loadu_ps(&s.depth[index]);
+                __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, depth));
+                int mask = _mm_movemask_ps(pass);
+                if(mask == 0)
+                {
+                    continue;
+                }
+                _mm_storeu_ps(&s.depth[index], _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, depth)));
+                if(depthOnly)
+                {
+                    continue;
+                }
+                float w1[4], w2[4];
+                _mm_storeu_ps(w1, b1);
+                _mm_storeu_ps(w2, b2);
+                for(int lane=0; lane<4; ++lane)
+                {
+                    if(mask >> lane & 1)
+                    {
+                        s.primitive[index + lane] = &p;
+                        s.b1[index + lane] = w1[lane];
+                        s.b2[index + lane] = w2[lane];
+                    }
+                }
+            }
+        }
+#else
+        for(int y = y0; y <= y1; ++y)
+        {
+            float row[3];
+            for(int k=0; k<3; ++k)
+            {
+                row[k] = origin[k] + (float)y * p.B[k];
+            }
+            for(int x = x0 & ~3; x <= x1; x += 4)
+            {
+                float z[4], b1[4], b2[4];
+                int inside = 0;
+                for(int lane=0; lane<4; ++lane)
+                {
+                    float column = (float)(x + lane);
+                    bool in = x + lane >= x0 && x + lane <= x1;
+                    float e[3];
+                    for(int k=0; k<3; ++k)
+                    {
+                        e[k] = row[k] + column * p.A[k];
+                        in = in && (e[k] > 0.0f || (e[k] == 0.0f && owns[k]));
+                    }
+                    b1[lane] = e[1] * p.invArea;
+                    b2[lane] = e[2] * p.invArea;
+                    z[lane] = p.z[0] + (b1[lane] * dz1 + b2[lane] * dz2);
+                    inside |= (in ? 1 : 0) << lane;
+                }
+                testQuad(s, y * RASTER_TILE + x, z, b1, b2, inside, p);
+            }
+        }
+#endif
+    }
+
+    // one pixel of a line
+    void plot(const RasterPrimitive &p, Scratch &s, int x, int y, float t) const
+    {
+        const int index = y * RASTER_TILE + x;
+        float z = p.z[0] + t * (p.z[1] - p.z[0]);
+        if(z < s.depth[index])
+        {
+            s.depth[index] = z;
+            s.primitive[index] = &p;
+            s.b1[index] = t;
+            s.b2[index] = 0.0f;
+        }
+    }
+
+    // a DDA along the longer axis, `width` pixels across it
+    void rasterLine(const RasterPrimitive &p, Scratch &s, int tileX, int tileY, int tileW, int tileH) const
+    {
+        const float dx = p.x[1] - p.x[0], dy = p.y[1] - p.y[0];
+        const bool alongX = fabs(dx) >= fabs(dy);
+        const float d = alongX ? dx : dy;
+        if(d == 0.0f)
+        {
+            return;
+        }
+        const float start = alongX ? p.x[0] : p.y[0], end = alongX ? p.x[1] : p.y[1];
+        const float slope = alongX ? dy / dx : dx / dy;
+        const float across0 = alongX ? p.y[0] : p.x[0];
+        const int low = alongX ? tileX : tileY, high = low + (alongX ? tileW : tileH) - 1;
+        const int lowAcross = alongX ? tileY : tileX, highAcross = lowAcross + (alongX ? tileH : tileW) - 1;
+
+        // pixel centres between the ends along the major axis
+        const int first = std::max(low, (int)ceil(std::min(start, end) - 0.5f));
+        const int last = std::min(high, (int)ceil(std::max(start, end) - 0.5f) - 1);
+        const int behind = (p.width - 1) / 2;
+        for(int m = first; m <= last; ++m)
+        {
+            float centre = m + 0.5f;
+            float t = (centre - start) / d;
+            int across = (int)floor(across0 + (centre - start) * slope);
+            for(int o = across - behind; o < across - behind + p.width; ++o)
+            {
+                if(o < lowAcross || o > highAcross)
+                {
+                    continue;
+                }
+                if(alongX)
+                {
+                    plot(p, s, m - tileX, o - tileY, t);
+                }
+                else
+                {
+                    plot(p, s, o - tileX, m - tileY, t);
+                }
+            }
+        }
+    }
+
+    template<typename Shader>
+    void renderTile(int tile, Scratch &s, const Shader &shader) const
+    {
+        const int tileX = (tile % tilesX) * RASTER_TILE, tileY = (tile / tilesX) * RASTER_TILE;
+        const int tileW = std::min(RASTER_TILE, target.width - tileX), tileH = std::min(RASTER_TILE, target.height - tileY);
+
+        for(int y=0; y<tileH; ++y)
+        {
+            std::fill(s.depth + y * RASTER_TILE, s.depth + y * RASTER_TILE + RASTER_TILE, 1.0f);
+            std::fill(s.primitive + y * RASTER_TILE, s.primitive + y * RASTER_TILE + RASTER_TILE, (const RasterPrimitive*)NULL);
+        }
+
+        for(int c=0; c<chunkCount; ++c)
+        {
+            const Chunk &chunk = chunks[c];
+            const std::vector<int> &bin = chunk.bins[tile];
+            for(size_t i=0; i<bin.size(); ++i)
+            {
+                const RasterPrimitive &p = chunk.out[bin[i]];
+                if(p.width == 0)
+                {
+                    rasterTriangle(p, s, tileX, tileY, tileW, tileH);
+                }
+                else
+                {
+                    rasterLine(p, s, tileX, tileY, tileW, tileH);
+                }
+            }
+        }
+
+        if(depthOnly)
+        {
+            for(int y=0; y<tileH; ++y)
+            {
+                memcpy(&target.depth[(size_t)(tileY + y) * target.width + tileX], &s.depth[y * RASTER_TILE], tileW * sizeof(float));
+            }
+            return;
+        }
+
+        // shade what is left visible, once per pixel
+        for(int y=0; y<tileH; ++y)
+        {
+            uint32_t* out = &target.color[(size_t)(tileY + y) * target.width + tileX];
+            for(int x=0; x<tileW; ++x)
+            {
+                const int index = y * RASTER_TILE + x;
+                const RasterPrimitive* p = s.primitive[index];
+                if(p == NULL)
+                {
+                    out[x] = clearColor;
+                    continue;
+                }
+
+                // perspective-correct weights from the screen-space ones
+                float b1 = s.b1[index], b2 = s.b2[index];
+                float w0 = (1.0f - b1 - b2), w1 = b1, w2 = b2;
+                float invW = 1.0f / (w0 * p->invW[0] + w1 * p->invW[1] + w2 * p->invW[2]);
+                float varyings[RASTER_VARYINGS];
+                for(int k=0; k<RASTER_VARYINGS; ++k)
+                {
+                    varyings[k] = (w0 * p->varyings[0][k] + w1 * p->varyings[1][k] + w2 * p->varyings[2][k]) * invW;
+                }
+                out[x] = packColor(shader(p->material, varyings));
+            }
+        }
+    }
+
+public:
+    static uint32_t packColor(const glm::vec3 &color)
+    {
+        glm::vec3 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return (uint32_t)c.r | (uint32_t)c.g << 8 | (uint32_t)c.b << 16 | 0xff000000u;
+    }
+};
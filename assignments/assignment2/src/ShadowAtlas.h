@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Omnidirectional shadows of point lights, kept in one shadow atlas.
+// Every light gets a 3 x 2 block of square tiles in a single depth texture,
+// one tile per cube face, so several lights share a texture sized to a
+// memory budget instead of a cube map each; the more lights, the smaller the
+// tiles. A pass draws the casters once for up to ATLAS_LIGHTS_PER_PASS
+// lights: point_shadow.gs sends every triangle to each face of each light,
+// moved onto the face's tile and clipped to it, where six draws per light
+// with a viewport per tile did the same before.
+//----------------------------------------------------------------------------
+const int ATLAS_LIGHTS_PER_PASS = 4; // 4 lights x 6 faces x 3 corners: point_shadow.gs's max_vertices
+const int ATLAS_BUDGET = 16 << 20;  // bytes of depth texture for every light together
+
+// the cube faces, in the order of GL's cube map targets
+const glm::vec3 CUBE_FACE_DIRECTIONS[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                            glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+const glm::vec3 CUBE_FACE_UPS[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+                                     glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+
+struct PointShadow
+{
+    glm::vec3 position;
+    float far;          // the faces see this far from the light
+    glm::ivec2 corner;  // lower-left texel of the light's 3 x 2 tiles
+};
+
+class ShadowAtlas
+{
+public:
+    int size;      // width and height of the atlas
+    int tile;      // width and height of one face
+    GLuint FBO;
+    GLuint depthMap; // GL_TEXTURE_2D, read through sampler2DShadow
+    std::vector<PointShadow> lights;
+    glm::mat4 faceViews[6]; // rotation of each face, the light at the origin
+
+    ShadowAtlas() :
+        size(0), tile(0), FBO(0), depthMap(0), previous(0), clipping(false)
+    {
+        for(int f=0; f<6; ++f)
+        {
+            faceViews[f] = glm::lookAt(glm::vec3(0.0f), CUBE_FACE_DIRECTIONS[f], CUBE_FACE_UPS[f]);
+        }
+    }
+
+    // (re)allocate the largest square atlas of 24 bit depth, padded to 32, that fits `budget` bytes
+    void create(int budget)
+    {
+        int edge = 1;
+        while((long long)(2 * edge) * (2 * edge) * 4 <= budget)
+        {
+            edge *= 2;
+        }
+        if(FBO != 0 && edge == size)
+        {
+            return;
+        }
+        release();
+        size = edge;
+
+        GLint bound = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+
+        glGenTextures(1, &depthMap);
+        glBindTexture(GL_TEXTURE_2D, depthMap);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, bound);
+    }
+
+    void release()
+    {
+        if(FBO != 0)
+        {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteTextures(1, &depthMap);
+            FBO = depthMap = 0;
+        }
+    }
+
+    // give every light its block of faces, each face as large as fits and no larger than `maxTile`
+    void place(const std::vector<PointShadow> &points, int maxTile)
+    {
+        lights = points;
+        const int count = std::max((int)lights.size(), 1);
+        // the blocks in `columns` columns of as many rows as it takes; the widest tiles win
+        tile = 0;
+        int best = 1;
+        for(int columns=1; columns<=count; ++columns)
+        {
+            int rows = (count + columns - 1) / columns;
+            int edge = std::min(size / (3 * columns), size / (2 * rows));
+            if(edge > tile)
+            {
+                tile = edge;
+                best = columns;
+            }
+        }
+        tile = std::min(tile, maxTile);
+        for(size_t i=0; i<lights.size(); ++i)
+        {
+            lights[i].corner = glm::ivec2((int)i % best * 3 * tile, (int)i / best * 2 * tile);
+        }
+    }
+
+    // render target for every light, cleared; a layered pass clips the faces to their
+    // tiles by gl_ClipDistance, one face at a time by its viewport
+    void begin(bool layered)
+    {
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, size, size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        clipping = layered;
+        for(int i=0; i<4 && clipping; ++i)
+        {
+            glEnable(GL_CLIP_DISTANCE0 + i);
+        }
+    }
+
+    // back to the framebuffer bound before begin()
+    void end()
+    {
+        for(int i=0; i<4 && clipping; ++i)
+        {
+            glDisable(GL_CLIP_DISTANCE0 + i);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    }
+
+    // the uniforms of point_shadow.gs for `count` lights from `first`
+    void bindPass(const ShaderProgram &program, int first, int count) const
+    {
+        program.setInt("lightCount", count);
+        program.setFloat("lightNear", LIGHT_NEAR);
+        for(int i=0; i<count; ++i)
+        {
+            const PointShadow &light = lights[first + i];
+            const std::string index = "[" + std::to_string(i) + "]";
+            program.setVec4("lights" + index, glm::vec4(light.position, light.far));
+            program.setVec4("tiles" + index, tileOf(first + i));
+        }
+        bindFaces(program);
+    }
+
+    // the rotation of each face, for point_shadow.gs and the scene
+    void bindFaces(const ShaderProgram &program) const
+    {
+        for(int f=0; f<6; ++f)
+        {
+            program.setMat4("faceViews[" + std::to_string(f) + "]", faceViews[f]);
+        }
+    }
+
+    // one face of one light alone, for point_shadow.vs built with FACE_PASS
+    void bindFace(const ShaderProgram &program, int light, int face) const
+    {
+        const PointShadow &point = lights[light];
+        glViewport(point.corner.x + face % 3 * tile, point.corner.y + face / 3 * tile, tile, tile);
+        program.setVec4("light", glm::vec4(point.position, point.far));
+        program.setMat4("faceView", faceViews[face]);
+        program.setFloat("lightNear", LIGHT_NEAR);
+    }
+
+    // the tile of a light for the scene: lower-left texel, face edge and atlas edge
+    glm::vec4 tileOf(int light) const
+    {
+        return glm::vec4(lights[light].corner.x, lights[light].corner.y, tile, size);
+    }
+
+private:
+    GLint previous; // the framebuffer bound before begin()
+    bool clipping;
+};
@@ -0,0 +1,120 @@
+#include <cstring>
+
+//----------------------------------------------------------------------------
+// Dirty tracking for the shadow pass.
+// The depth maps only change when a caster or the light moves, or when the
+// cascades are refitted to a moved camera. The inputs are snapshotted each
+// time the maps are rendered and compared against the next frame's. The
+// ground never moves, so its depth lives in separate layers that are only
+// redrawn when the light or the cascades change.
+//----------------------------------------------------------------------------
+enum ShadowWork
+{
+    SHADOW_REUSE,   // nothing changed, keep last frame's maps
+    SHADOW_CASTERS, // only the horses moved, redraw them over the cached ground
+    SHADOW_ALL      // light or cascades changed, redraw the ground too
+};
+
+// all floats, so two snapshots can be compared with memcmp
+struct ShadowInputs
+{
+    // the light and the cascade fit
+    GLfloat light[3];
+    GLfloat view[16];
+    GLfloat fit[6];   // fov, aspect, cascades, resolution, gridX, gridZ
+
+    // the casters
+    GLfloat theta[NumNodes];
+    GLfloat horse[7]; // base_x/y/z, rotateX/Y/Z, base_scale
+    GLfloat crowd;
+
+    void capture(const glm::mat4 &camera)
+    {
+        light[0] = lightPos.x;
+        light[1] = lightPos.y;
+        light[2] = lightPos.z;
+        memcpy(view, &camera[0][0], sizeof(view));
+        fit[0] = fov;
+        fit[1] = (float)WIDTH / (float)HEIGHT;
+        fit[2] = (float)shadow_cascades;
+        fit[3] = (float)shadow_resolution;
+        fit[4] = (float)gridX;
+        fit[5] = (float)gridZ;
+
+        memcpy(this->theta, ::theta, sizeof(this->theta));
+        horse[0] = base_x;
+        horse[1] = base_y;
+        horse[2] = base_z;
+        horse[3] = (float)rotateX;
+        horse[4] = (float)rotateY;
+        horse[5] = (float)rotateZ;
+        horse[6] = (float)base_scale;
+        crowd = (float)crowd_size;
+    }
+
+    bool sameStatic(const ShadowInputs &other) const
+    {
+        return memcmp(light, other.light, sizeof(light)) == 0 && memcmp(view, other.view, sizeof(view)) == 0
+               && memcmp(fit, other.fit, sizeof(fit)) == 0;
+    }
+
+    bool sameCasters(const ShadowInputs &other) const
+    {
+        return memcmp(this->theta, other.theta, sizeof(this->theta)) == 0 && memcmp(horse, other.horse, sizeof(horse)) == 0
+               && crowd == other.crowd;
+    }
+};
+
+class ShadowCache
+{
+public:
+    // frames of each kind since the last reset, for the stats report
+    int reused, casters, all;
+
+    ShadowCache() :
+        reused(0), casters(0), all(0), valid(false) {}
+
+    // what the shadow pass has to redraw this frame; the crowd runs every frame
+    ShadowWork check(const glm::mat4 &view)
+    {
+        ShadowInputs now;
+        now.capture(view);
+
+        ShadowWork work = SHADOW_ALL;
+        if(valid && now.sameStatic(last))
+        {
+            work = (now.sameCasters(last) && crowd_size == 0) ? SHADOW_REUSE : SHADOW_CASTERS;
+        }
+        last = now;
+        valid = true;
+
+        if(work == SHADOW_REUSE)
+        {
+            ++reused;
+        }
+        else if(work == SHADOW_CASTERS)
+        {
+            ++casters;
+        }
+        else
+        {
+            ++all;
+        }
+        return work;
+    }
+
+    // force a full redraw next frame
+    void invalidate()
+    {
+        valid = false;
+    }
+
+    void resetCounts()
+    {
+        reused = casters = all = 0;
+    }
+
+private:
+    ShadowInputs last;
+    bool valid;
+};
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+// Cascaded shadow maps for the point light.
+// The camera frustum is cut into `count` slices along the view direction and
+// every slice gets its own layer of a depth texture array, rendered through a
+// perspective light frustum aimed from the lamp at the slice's bounding sphere
+// and just wide enough to contain it. Near slices thus get many texels per
+// metre, far ones few, instead of one fixed 130 degree map for everything.
+//----------------------------------------------------------------------------
+const int MAX_CASCADES = 4;
+const float LIGHT_NEAR = 1.0f; // near plane of every light frustum
+const float LIGHT_MAX_FOV = glm::radians(170.0f); // widest light frustum; a perspective one stops short of 180
+
+class ShadowCascades
+{
+public:
+    int count;
+    int resolution;     // width and height of every layer
+    float lambda;       // split scheme: 0 uniform, 1 logarithmic
+    glm::vec3 sceneMin, sceneMax; // box around everything that casts or receives shadows
+
+    GLuint FBO;
+    GLuint depthArray;  // GL_TEXTURE_2D_ARRAY, one layer per cascade
+    GLuint staticFBO;
+    GLuint staticArray; // depth of the static casters alone, copied into depthArray before the moving ones
+    bool comparing;     // depthArray read through sampler2DArrayShadow, see compare()
+
+    glm::mat4 matrices[MAX_CASCADES];   // world to light clip space
+    float splits[MAX_CASCADES];         // far end of each cascade, distance along the view axis
+    float fovs[MAX_CASCADES];           // vertical field of view of each light frustum, radians
+    float fars[MAX_CASCADES];           // far plane of each light frustum
+    glm::mat4 lightViews[MAX_CASCADES];
+    Frustum frustums[MAX_CASCADES];     // of matrices[], for culling the casters of each cascade
+    int casters[MAX_CASCADES];          // casters drawn into each cascade last frame
+    int staticCasters[MAX_CASCADES];    // of which static, drawn when the static layers were
+
+    ShadowCascades() :
+        count(0), resolution(0), lambda(0.75f), sceneMin(-1e30f), sceneMax(1e30f), FBO(0), depthArray(0), staticFBO(0), staticArray(0), comparing(false) {}
+
+    // (re)allocate the layers; a no-op when nothing changed
+    void create(int cascades, int size)
+    {
+        if(FBO != 0 && cascades == count && size == resolution)
+        {
+            return;
+        }
+        release();
+        count = cascades;
+        resolution = size;
+
+        allocate(FBO, depthArray);
+        allocate(staticFBO, staticArray);
+        filterDepth();
+    }
+
+    // read depthArray through a sampler2DArrayShadow, which compares and filters the four
+    // nearest texels bilinearly in one fetch, or as plain depths with GL_NEAREST
+    void compare(bool on)
+    {
+        if(on != comparing)
+        {
+            comparing = on;
+            filterDepth();
+        }
+    }
+
+    void release()
+    {
+        if(FBO != 0)
+        {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteTextures(1, &depthArray);
+            glDeleteFramebuffers(1, &staticFBO);
+            glDeleteTextures(1, &staticArray);
+            FBO = depthArray = staticFBO = staticArray = 0;
+        }
+    }
+
+    // split the camera frustum (fovy in radians) and fit one light frustum per slice
+    void fit(const glm::mat4 &view, float fovy, float aspect, float zNear, float zFar, const glm::vec3 &light)
+    {
+        const glm::mat4 cameraToWorld = glm::inverse(view);
+        const float tanY = tan(0.5f * fovy), tanX = tanY * aspect;
+
+        float begin = zNear;
+        for(int i=0; i<count; ++i)
+        {
+            float t = (float)(i + 1) / count;
+            float uniform = zNear + (zFar - zNear) * t;
+            float logarithmic = zNear * pow(zFar / zNear, t);
+            float end = lambda * logarithmic + (1.0f - lambda) * uniform;
+
+            // box around the slice's eight corners, cut down to the scene
+            glm::vec3 low(1e30f), high(-1e30f);
+            for(int c=0; c<8; ++c)
+            {
+                float z = (c & 4) ? end : begin;
+                glm::vec4 corner(((c & 1) ? 1.0f : -1.0f) * z * tanX, ((c & 2) ? 1.0f : -1.0f) * z * tanY, -z, 1.0f);
+                glm::vec3 world = glm::vec3(cameraToWorld * corner);
+                low = glm::min(low, world);
+                high = glm::max(high, world);
+            }
+            low = glm::max(low, sceneMin);
+            high = glm::max(low, glm::min(high, sceneMax));
+
+            aim(i, light, low, high);
+            splits[i] = end;
+            begin = end;
+        }
+    }
+
+    // the original single map: one 130 degree frustum looking at the origin
+    void fitSingle(const glm::vec3 &light)
+    {
+        fovs[0] = glm::radians(130.0f);
+        fars[0] = 100.0f;
+        lightViews[0] = glm::lookAt(light, glm::vec3(0.0f), glm::vec3(0.0, 0.0, 1.0));
+        matrices[0] = glm::perspective(fovs[0], 1.0f, LIGHT_NEAR, fars[0]) * lightViews[0];
+        splits[0] = 1e30f;
+        frustums[0].extract(matrices[0]);
+    }
+
+    // is any part of the sphere inside the light frustum of the cascade
+    bool sees(int cascade, const glm::vec4 &sphere) const
+    {
+        return frustums[cascade].sees(sphere);
+    }
+
+    // world-space edge of one shadow texel at p in the given cascade
+    float texelSize(int cascade, const glm::vec3 &p) const
+    {
+        float depth = -(lightViews[cascade] * glm::vec4(p, 1.0f)).z;
+        return 2.0f * depth * tan(0.5f * fovs[cascade]) / resolution;
+    }
+
+    // cascade the main pass picks for a point `distance` along the view axis
+    int cascadeAt(float distance) const
+    {
+        int cascade = 0;
+        while(cascade < count - 1 && distance > splits[cascade])
+        {
+            ++cascade;
+        }
+        return cascade;
+    }
+
+    void fill(FrameData &frame) const
+    {
+        for(int i=0; i<MAX_CASCADES; ++i)
+        {
+            frame.cascadeMatrices[i] = matrices[i < count ? i : count - 1];
+            frame.cascadeSplits[i] = i < count ? splits[i] : 1e30f;
+            frame.cascadeFars[i] = fars[i < count ? i : count - 1];
+        }
+        frame.cascadeCount = count;
+    }
+
+    // render target for the static casters of one cascade; kept until the light or the fit changes
+    void bindStaticLayer(int cascade)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+        glViewport(0, 0, resolution, resolution);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticArray, 0, cascade);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        staticCasters[cascade] = 0;
+    }
+
+    // render target for the moving casters of one cascade, starting from its static depth
+    void bindLayer(int cascade)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticArray, 0, cascade);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, cascade);
+        glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, resolution, resolution);
+        casters[cascade] = staticCasters[cascade];
+    }
+
+private:
+    // one depth array of `count` layers and a framebuffer to render into it
+    void allocate(GLuint &framebuffer, GLuint &texture)
+    {
+        // put back whatever was bound, the window or the headless target
+        GLint bound = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, count, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, bound);
+    }
+
+    void filterDepth()
+    {
+        GLint filter = comparing ? GL_LINEAR : GL_NEAREST;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, comparing ? GL_COMPARE_REF_TO_TEXTURE : GL_NONE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    // a perspective frustum from the light that just contains the box's bounding sphere, or,
+    // with the light inside that sphere, the box itself: the cone around the mean direction
+    // of its corners, widened to the farthest one and clamped to LIGHT_MAX_FOV
+    void aim(int cascade, const glm::vec3 &light, const glm::vec3 &low, const glm::vec3 &high)
+    {
+        const glm::vec3 center = 0.5f * (low + high);
+        const float radius = 0.5f * glm::length(high - low);
+        glm::vec3 direction = center - light, target = center;
+        float distance = glm::length(direction);
+        if(distance > radius * 1.01f)
+        {
+            direction /= distance;
+            fovs[cascade] = 2.0f * asin(radius / distance);
+        }
+        else
+        {
+            glm::vec3 corners[8];
+            glm::vec3 sum(0.0f);
+            for(int c=0; c<8; ++c)
+            {
+                corners[c] = glm::vec3((c & 1) ? high.x : low.x, (c & 2) ? high.y : low.y, (c & 4) ? high.z : low.z) - light;
+                float length = glm::length(corners[c]);
+                corners[c] = length > 1e-4f ? corners[c] / length : glm::vec3(0.0f);
+                sum += corners[c];
+            }
+            // the scene box ends at the light's height, so a box around the light lies below it
+            direction = glm::length(sum) > 1e-4f ? glm::normalize(sum) : glm::vec3(0.0f, -1.0f, 0.0f);
+            float widest = 0.0f;
+            for(int c=0; c<8; ++c)
+            {
+                if(corners[c] != glm::vec3(0.0f))
+                {
+                    widest = std::max(widest, (float)acos(glm::clamp(glm::dot(direction, corners[c]), -1.0f, 1.0f)));
+                }
+            }
+            fovs[cascade] = std::min(2.0f * widest * 1.01f, LIGHT_MAX_FOV);
+            target = light + direction;
+        }
+        glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+        // near stays at the lamp so casters between it and the slice still land in the map
+        fars[cascade] = distance + radius;
+        lightViews[cascade] = glm::lookAt(light, target, up);
+        matrices[cascade] = glm::perspective(fovs[cascade], 1.0f, LIGHT_NEAR, fars[cascade]) * lightViews[cascade];
+        frustums[cascade].extract(matrices[cascade]);
+    }
+};
@@ -0,0 +1,141 @@
+//----------------------------------------------------------------------------
+// How the scene filters the cascaded shadow maps, chosen with Key V.
+// SHADOW_PCF compares PCF_KERNEL^2 depths by hand as the original shader did;
+// SHADOW_HARDWARE reads the same depths through a sampler2DArrayShadow, so
+// every fetch compares and blends 2 x 2 texels. The other two filter the map
+// itself: after each shadow pass ShadowMoments turns every cascade into
+// moments of linear depth, blurs them in two separable passes and mipmaps
+// them, and the scene reads them with one trilinear fetch, as variance
+// (depth, depth^2) or exponential (exp(c depth)) shadow maps.
+//----------------------------------------------------------------------------
+enum ShadowFilterMode
+{
+    SHADOW_PCF,
+    SHADOW_HARDWARE,
+    SHADOW_VSM,
+    SHADOW_ESM,
+    SHADOW_FILTERS
+};
+
+const char *const SHADOW_FILTER_NAMES[SHADOW_FILTERS] = { "pcf", "hardware", "vsm", "esm" };
+
+const float ESM_EXPONENT = 80.0f; // c of exp(c depth); higher is sharper until it overflows
+
+// the filter named `name`, -1 for none
+int shadowFilterNamed(const char *name)
+{
+    for(int i=0; i<SHADOW_FILTERS; ++i)
+    {
+        if(strcmp(name, SHADOW_FILTER_NAMES[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool filtersMoments(int filter)
+{
+    return filter == SHADOW_VSM || filter == SHADOW_ESM;
+}
+
+class ShadowMoments
+{
+public:
+    int count;
+    int resolution;
+    int filter;          // what the layers hold, -1 when they need making again
+    GLuint momentArray;  // GL_TEXTURE_2D_ARRAY of RG32F with mipmaps, one layer per cascade
+    GLuint blurTexture;  // one layer blurred along x
+    GLuint FBO;
+    GLuint VAO;          // no attributes, shadow_moments.vs makes its triangle
+
+    ShadowMoments() :
+        count(0), resolution(0), filter(-1), momentArray(0), blurTexture(0), FBO(0), VAO(0) {}
+
+    // (re)allocate for the cascades; a no-op when nothing changed
+    void create(int cascades, int size)
+    {
+        if(FBO != 0 && cascades == count && size == resolution)
+        {
+            return;
+        }
+        release();
+        count = cascades;
+        resolution = size;
+
+        glGenTextures(1, &momentArray);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, momentArray);
+        for(int level = 0; (size >> level) > 0; ++level)
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RG32F, size >> level, size >> level, count, 0, GL_RG, GL_FLOAT, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenTextures(1, &blurTexture);
+        glBindTexture(GL_TEXTURE_2D, blurTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, size, size, 0, GL_RG, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &FBO);
+        glGenVertexArrays(1, &VAO);
+        filter = -1;
+    }
+
+    void release()
+    {
+        if(FBO != 0)
+        {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteTextures(1, &momentArray);
+            glDeleteTextures(1, &blurTexture);
+            glDeleteVertexArrays(1, &VAO);
+            FBO = momentArray = blurTexture = VAO = 0;
+        }
+        filter = -1;
+    }
+
+    // the moments of every cascade of `shadows` for `mode`, from the depths just rendered;
+    // `across` and `down` are the two passes of shadow_moments.fs built for the mode
+    void update(const ShadowCascades &shadows, int mode, const ShaderProgram &across, const ShaderProgram &down)
+    {
+        PROFILE_GPU_ZONE("shadowMoments");
+        GLint bound = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, resolution, resolution);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(VAO);
+        glActiveTexture(GL_TEXTURE0);
+        for(int c=0; c<count; ++c)
+        {
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, blurTexture, 0);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, shadows.depthArray);
+            across.use();
+            across.setInt("cascade", c);
+            across.setFloat("lightNear", LIGHT_NEAR);
+            across.setFloat("lightFar", shadows.fars[c]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentArray, 0, c);
+            glBindTexture(GL_TEXTURE_2D, blurTexture);
+            down.use();
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, momentArray);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, bound);
+        filter = mode;
+    }
+};
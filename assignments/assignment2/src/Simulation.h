@@ -0,0 +1,386 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// The horse simulated at a fixed step, apart from the frame rate. The horse
+// keys and the gait only ever change a HorseState owned by the simulation;
+// after each batch of steps it publishes the last two states through a
+// triple buffer, and the render thread copies out the newest pair without
+// waiting and draws the pose one step in the past, interpolated between
+// them. Steps happen at whole multiples of SIM_STEP, so the same inputs give
+// the same horse whatever the frame rate. A window runs the steps on their
+// own thread; a headless run makes them on the render thread before each
+// frame so that its dumps do not depend on thread timing.
+//----------------------------------------------------------------------------
+const float SIM_STEP = 1.0f / 60.0f; // seconds of simulation per step
+
+// everything the simulation owns: what the globals of Horse.h hold for the renderer
+struct HorseState
+{
+    GLfloat theta[NumNodes];
+    float base_x, base_y, base_z;
+    double rotateX, rotateY, rotateZ;
+    double base_scale;
+    AnimationState animation;
+    bool running;
+    glm::vec3 light;
+
+    // from the globals, as resetHorse() and the options left them
+    void capture()
+    {
+        std::copy(::theta, ::theta + NumNodes, theta);
+        base_x = ::base_x;
+        base_y = ::base_y;
+        base_z = ::base_z;
+        rotateX = ::rotateX;
+        rotateY = ::rotateY;
+        rotateZ = ::rotateZ;
+        base_scale = ::base_scale;
+        animation = horseAnimation;
+        running = run_on;
+        light = lightPos;
+    }
+
+    // to the globals; render thread only
+    void apply() const
+    {
+        std::copy(theta, theta + NumNodes, ::theta);
+        ::base_x = base_x;
+        ::base_y = base_y;
+        ::base_z = base_z;
+        ::rotateX = rotateX;
+        ::rotateY = rotateY;
+        ::rotateZ = rotateZ;
+        ::base_scale = base_scale;
+        horseAnimation = animation;
+        run_on = running;
+        lightPos = light;
+        updateTorso();
+    }
+
+    // what resetHorse() does, the light left where it is
+    void reset()
+    {
+        std::copy(restTheta, restTheta + NumNodes, theta);
+        base_x = base_y = base_z = 0.0f;
+        rotateX = rotateY = rotateZ = 0.0;
+        base_scale = 1.0;
+        animation = AnimationState();
+        running = false;
+    }
+
+    // the gait moved on by `seconds` and posed
+    void advance(float seconds)
+    {
+        gaits.advance(animation, seconds);
+        gaits.sample(animation, theta);
+    }
+
+    void step(float seconds)
+    {
+        if(running)
+        {
+            advance(seconds);
+        }
+    }
+
+    // is it one of the keys below
+    static bool owns(int key, int mode)
+    {
+        switch(key)
+        {
+        case GLFW_KEY_U: case GLFW_KEY_J:
+        case GLFW_KEY_A: case GLFW_KEY_D: case GLFW_KEY_W: case GLFW_KEY_S: case GLFW_KEY_Q: case GLFW_KEY_E:
+        case GLFW_KEY_R: case GLFW_KEY_N: case GLFW_KEY_G:
+            return true;
+        case GLFW_KEY_EQUAL: case GLFW_KEY_MINUS:
+            return mode == GLFW_MOD_SHIFT;
+        default:
+            return key >= GLFW_KEY_0 && key <= GLFW_KEY_9;
+        }
+    }
+
+    // a press of a horse key, as key_callback handled it before
+    void key(int key, int mode)
+    {
+        const bool shift = mode == GLFW_MOD_SHIFT;
+        switch(key)
+        {
+        //pressing ‘U’ for scale-up and ‘J’ for scale-down
+        case GLFW_KEY_U:
+            base_scale += 0.1f;
+            break;
+        case GLFW_KEY_J:
+            if(base_scale >= 0.1)
+            {
+                base_scale -= 0.1f;
+            }
+            break;
+        //Shift + A/D/W/S/Q/E move 1 grid unit along X, Y and Z, without Shift rotate 5 degrees
+        case GLFW_KEY_A:
+            if(shift)
+            {
+                --base_x;
+            }
+            else
+            {
+                rotateY += 5;
+            }
+            break;
+        case GLFW_KEY_D:
+            if(shift)
+            {
+                ++base_x;
+            }
+            else
+            {
+                rotateY -= 5;
+            }
+            break;
+        case GLFW_KEY_W:
+            if(shift)
+            {
+                ++base_y;
+            }
+            else
+            {
+                rotateZ += 5;
+            }
+            break;
+        case GLFW_KEY_S:
+            if(!shift)
+            {
+                rotateZ -= 5;
+            }
+            else if(base_y >= 1.0f)
+            {
+                --base_y;
+            }
+            break;
+        case GLFW_KEY_Q:
+            if(shift)
+            {
+                ++base_z;
+            }
+            else
+            {
+                rotateX += 5;
+            }
+            break;
+        case GLFW_KEY_E:
+            if(!shift)
+            {
+                rotateX -= 5;
+            }
+            else if(base_z >= 1.0f)
+            {
+                --base_z;
+            }
+            break;
+        //Rotate a joint by a degree (Key_0 - Key_9 clockwise, Shift for counterclockwise)
+        case GLFW_KEY_0: theta[Head] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_1: theta[Neck] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_2: theta[LeftUpperArm] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_3: theta[LeftLowerArm] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_4: theta[RightUpperArm] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_5: theta[RightLowerArm] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_6: theta[LeftUpperLeg] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_7: theta[LeftLowerLeg] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_8: theta[RightUpperLeg] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_9: theta[RightLowerLeg] += shift ? 1.0f : -1.0f; break;
+        case GLFW_KEY_R:
+            running = !running;
+            break;
+        //Shift + '=' and Shift + '-' speed the gait up and down
+        case GLFW_KEY_EQUAL:
+            animation.speed = std::min(animation.speed * 1.25f, 8.0f);
+            break;
+        case GLFW_KEY_MINUS:
+            animation.speed = std::max(animation.speed / 1.25f, 0.125f);
+            break;
+        case GLFW_KEY_N://debug
+            // one of the six run poses further
+            advance(gaits.run.duration / 6.0f);
+            break;
+        //Blend the gait between running and walking (Key G)
+        case GLFW_KEY_G:
+            animation.target = animation.target > 0.5f ? 0.0f : 1.0f;
+            break;
+        }
+    }
+};
+
+// `a` to `b` by `t`, joint angles along the shorter arc
+HorseState interpolate(const HorseState& a, const HorseState& b, float t)
+{
+    HorseState state = b;
+    for(int i=0; i<NumNodes; ++i)
+    {
+        state.theta[i] = a.theta[i] + t * shortestArc(b.theta[i] - a.theta[i]);
+    }
+    state.base_x = a.base_x + t * (b.base_x - a.base_x);
+    state.base_y = a.base_y + t * (b.base_y - a.base_y);
+    state.base_z = a.base_z + t * (b.base_z - a.base_z);
+    state.rotateX = a.rotateX + t * (b.rotateX - a.rotateX);
+    state.rotateY = a.rotateY + t * (b.rotateY - a.rotateY);
+    state.rotateZ = a.rotateZ + t * (b.rotateZ - a.rotateZ);
+    state.base_scale = a.base_scale + t * (b.base_scale - a.base_scale);
+    state.light = a.light + t * (b.light - a.light);
+    return state;
+}
+
+class Simulation
+{
+public:
+    typedef std::function<void(HorseState&)> Command;
+
+    Simulation() :
+        steps(0), front(0), back(1), middle(2), stopping(false) {}
+
+    ~Simulation()
+    {
+        stop();
+    }
+
+    // start over from `state` at time zero; not while the thread runs
+    void reset(const HorseState& state)
+    {
+        previous = current = state;
+        steps = 0;
+        for(int i=0; i<3; ++i)
+        {
+            slots[i].previous = slots[i].current = state;
+            slots[i].steps = 0;
+        }
+        front = 0;
+        back = 1;
+        middle = 2;
+        commands.clear();
+        start = std::chrono::steady_clock::now();
+    }
+
+    // seconds since reset()
+    double now() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // make the steps on a thread of their own, keeping up with now()
+    void run()
+    {
+        stopping = false;
+        thread = std::thread(&Simulation::loop, this);
+    }
+
+    void stop()
+    {
+        if(!thread.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+
+    // change the state at the start of the next step, in the order posted
+    void post(const Command& command)
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        commands.push_back(command);
+    }
+
+    // every step up to `seconds` since reset(); from one thread at a time
+    void advanceTo(double seconds)
+    {
+        const long long target = (long long)std::floor(seconds / SIM_STEP + 1e-6);
+        if(target <= steps)
+        {
+            return;
+        }
+
+        std::vector<Command> pending;
+        while(steps < target)
+        {
+            previous = current;
+            {
+                std::lock_guard<std::mutex> lock(commandMutex);
+                pending.swap(commands);
+            }
+            for(size_t i=0; i<pending.size(); ++i)
+            {
+                pending[i](current);
+            }
+            pending.clear();
+            current.step(SIM_STEP);
+            ++steps;
+        }
+
+        // hand the newest pair over without waiting for the renderer
+        Snapshot& slot = slots[back];
+        slot.previous = previous;
+        slot.current = current;
+        slot.steps = steps;
+        back = middle.exchange(back | FRESH) & ~FRESH;
+    }
+
+    // the horse at `seconds` since reset() less one step, between the newest two states; render thread only
+    HorseState sample(double seconds)
+    {
+        if(middle.load() & FRESH)
+        {
+            front = middle.exchange(front) & ~FRESH;
+        }
+        const Snapshot& slot = slots[front];
+        double t = (seconds - SIM_STEP) / SIM_STEP - (double)(slot.steps - 1);
+        return interpolate(slot.previous, slot.current, (float)std::max(0.0, std::min(1.0, t)));
+    }
+
+private:
+    static const int FRESH = 4; // set in `middle` when its slot is newer than the renderer's
+
+    struct Snapshot
+    {
+        HorseState previous; // at step steps - 1
+        HorseState current;  // at step steps
+        long long steps;
+    };
+
+    // simulation side
+    HorseState previous;
+    HorseState current;
+    long long steps;
+    std::vector<Command> commands;
+    std::mutex commandMutex;
+
+    // the three slots: the renderer reads `front`, the simulation writes `back`
+    Snapshot slots[3];
+    int front;
+    int back;
+    std::atomic<int> middle;
+
+    std::chrono::steady_clock::time_point start;
+    std::thread thread;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while(!stopping)
+        {
+            advanceTo(now());
+            std::chrono::duration<double> next((steps + 1) * (double)SIM_STEP);
+            wake.wait_until(lock, start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(next));
+        }
+    }
+};
@@ -0,0 +1,95 @@
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Flattened skeleton.
+// The Node tree is walked once and stored as a parent-index array in
+// topological order (every parent comes before its children), so world
+// transforms are computed by one linear sweep instead of a recursive
+// traversal through the matrix stack.
+//----------------------------------------------------------------------------
+class Skeleton
+{
+public:
+    std::vector<int> parent; // index of the parent entry, -1 for the root
+    std::vector<int> part;   // position of the entry's node in the node array
+
+    // flatten the tree below root; part ids are the offsets of the nodes in `base`
+    void build(Node* root, Node* base)
+    {
+        parent.clear();
+        part.clear();
+        append(root, base, -1);
+    }
+
+    int size() const
+    {
+        return (int)parent.size();
+    }
+
+private:
+    void append(Node* node, Node* base, int parentIndex)
+    {
+        for(; node != NULL; node = node->sibling)
+        {
+            int index = size();
+            parent.push_back(parentIndex);
+            part.push_back((int)(node - base));
+            append(node->child, base, index);
+        }
+    }
+};
+
+//----------------------------------------------------------------------------
+// Local and world transforms of many skeletons sharing one layout, kept in two
+// separate arrays and stored skeleton after skeleton.
+//----------------------------------------------------------------------------
+class SkeletonPoses
+{
+public:
+    const Skeleton* skeleton;
+    int instances;
+    std::vector<glm::mat4> local;
+    std::vector<glm::mat4> world;
+
+    SkeletonPoses() :
+        skeleton(NULL), instances(0) {}
+
+    void resize(const Skeleton* s, int numInstances)
+    {
+        skeleton = s;
+        instances = numInstances;
+        local.resize((size_t)s->size() * numInstances);
+        world.resize((size_t)s->size() * numInstances);
+    }
+
+    glm::mat4* localOf(int instance)
+    {
+        return &local[(size_t)instance * skeleton->size()];
+    }
+
+    const glm::mat4* worldOf(int instance) const
+    {
+        return &world[(size_t)instance * skeleton->size()];
+    }
+
+    // world = world(parent) * local, one pass per skeleton in array order
+    void evaluate(int first, int count)
+    {
+        const int n = skeleton->size();
+        const int* parents = skeleton->parent.data();
+        for(int instance = first; instance < first + count; ++instance)
+        {
+            const glm::mat4* l = &local[(size_t)instance * n];
+            glm::mat4* w = &world[(size_t)instance * n];
+            for(int i=0; i<n; ++i)
+            {
+                w[i] = parents[i] < 0 ? l[i] : w[parents[i]] * l[i];
+            }
+        }
+    }
+
+    void evaluate()
+    {
+        evaluate(0, instances);
+    }
+};
@@ -0,0 +1,360 @@
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// The scene on the CPU rasterizer, for hosts without a GPU.
+// The ground, the horse boxes, the axis and the lamp are drawn from the same
+// vertex data as the GL path (the Grid patch, the generateBaseCube() arrays,
+// buffer_data_axis and buffer_data_cube); the ground is the patches
+// Grid::select() keeps for the camera or a cascade, so its cost follows the
+// view and not the size of the ground. The fragment stage is
+// a port of shadow_mapping.fs and simple.fs, including the cascaded shadow
+// maps, which get one depth-only pass per cascade like the GL depth pass.
+// No GL call is made on this path. The crowd is not drawn.
+//----------------------------------------------------------------------------
+
+// an RGB image sampled like the GL textures: bilinear, repeating
+struct SoftwareTexture
+{
+    int width, height;
+    std::vector<unsigned char> rgb;
+
+    SoftwareTexture() :
+        width(0), height(0) {}
+
+    // a grey texel when the file cannot be read, like the streamer's placeholder
+    void load(const char *path)
+    {
+        int components;
+        unsigned char *pixels = stbi_load(path, &width, &height, &components, 3);
+        if(pixels == NULL)
+        {
+            fprintf(stderr, "Failed to load texture %s\n", path);
+            width = height = 1;
+            rgb.assign(3, 128);
+            return;
+        }
+        rgb.assign(pixels, pixels + (size_t)width * height * 3);
+        stbi_image_free(pixels);
+    }
+
+    glm::vec3 sample(const glm::vec2 &uv) const
+    {
+        // wrap first, so only the first and last texel of a row or column need their neighbour wrapped
+        float u = (uv.x - floor(uv.x)) * width - 0.5f, v = (uv.y - floor(uv.y)) * height - 0.5f;
+        int x0 = (int)floor(u), y0 = (int)floor(v);
+        float s = u - x0, t = v - y0;
+        int x1 = x0 + 1 < width ? x0 + 1 : 0, y1 = y0 + 1 < height ? y0 + 1 : 0;
+        x0 = x0 < 0 ? width - 1 : x0;
+        y0 = y0 < 0 ? height - 1 : y0;
+
+        const unsigned char *a = &rgb[((size_t)y0 * width + x0) * 3], *b = &rgb[((size_t)y0 * width + x1) * 3];
+        const unsigned char *c = &rgb[((size_t)y1 * width + x0) * 3], *d = &rgb[((size_t)y1 * width + x1) * 3];
+        float wa = (1.0f - s) * (1.0f - t), wb = s * (1.0f - t), wc = (1.0f - s) * t, wd = s * t;
+        return glm::vec3(wa * a[0] + wb * b[0] + wc * c[0] + wd * d[0],
+                         wa * a[1] + wb * b[1] + wc * c[1] + wd * d[1],
+                         wa * a[2] + wb * b[2] + wc * c[2] + wd * d[2]) * (1.0f / 255.0f);
+    }
+};
+
+// x to the power 2^n by squaring, for the fixed shininess exponents
+inline float powerOfTwo(float x, int n)
+{
+    for(int i=0; i<n; ++i)
+    {
+        x *= x;
+    }
+    return x;
+}
+
+enum SoftwareProgram
+{
+    SOFTWARE_SCENE,  // shadow_mapping.fs
+    SOFTWARE_SIMPLE  // simple.fs
+};
+
+// the uniforms of one draw
+struct SoftwareMaterial
+{
+    SoftwareProgram program;
+    glm::vec3 color;                // shader_color, or the colour simple.fs writes
+    const SoftwareTexture* texture; // material.diffuse / diffuseTexture
+    bool worldUV;                   // textured at the world x/z, like the ground shaders with aPatch
+
+    SoftwareMaterial(SoftwareProgram program, const glm::vec3 &color, const SoftwareTexture* texture, bool worldUV = false) :
+        program(program), color(color), texture(texture), worldUV(worldUV) {}
+};
+
+class SoftwareRenderer
+{
+public:
+    Rasterizer raster;
+    int width, height;
+    std::vector<uint32_t> pixels; // RGBA8, top row first
+
+    SoftwareRenderer() :
+        width(0), height(0), built(false), patchTriangles(0), shadowsOn(false) {}
+
+    void resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        pixels.assign((size_t)w * h, 0);
+    }
+
+    // one frame of the scene seen through the given camera
+    void render(const glm::mat4 &view, const glm::mat4 &projection)
+    {
+        if(!built)
+        {
+            build();
+        }
+
+        // the interactive horse, posed like the GL path
+        poseHorse(poses, 0);
+        poses.evaluate();
+        const glm::mat4* world = poses.worldOf(0);
+
+        shadowsOn = texture_on && shadow_on;
+        viewPos = glm::vec3(glm::inverse(view)[3]);
+        materials.clear();
+
+        if(shadowsOn)
+        {
+            PROFILE_ZONE("software shadows");
+            renderShadows(view, world);
+        }
+
+        RasterTarget screen;
+        screen.width = width;
+        screen.height = height;
+        screen.color = &pixels[0];
+        raster.begin(screen, projection * view, view, Rasterizer::packColor(glm::vec3(0.5f)));
+
+        // grid, as fine as renderGrid() picks it
+        int ground = material(SOFTWARE_SCENE, glm::vec3(0.0f), &grass, true);
+        drawGround(Frustum(projection * view), 0.5f * height * projection[1][1], !texture_on, ground);
+
+        // horse
+        for(int i=0; i<skeleton.size(); ++i)
+        {
+            int part = skeleton.part[i];
+            raster.draw(cube, RASTER_TRIANGLES, world[i] * partShape(part), material(SOFTWARE_SCENE, glm::vec3(partColor[part]), &bricks));
+        }
+
+        // axis, one colour per arrow
+        for(int a=0; a<3; ++a)
+        {
+            const GLfloat *color = &buffer_data_axis[a * 6 * 7 + 3];
+            raster.draw(axis, RASTER_LINES, glm::mat4(1.0f), material(SOFTWARE_SIMPLE, glm::vec3(color[0], color[1], color[2]), NULL), 5.0f, a * 3, 3);
+        }
+
+        // lamp
+        glm::mat4 lamp = glm::scale(glm::translate(glm::mat4(1.0f), lightPos), glm::vec3(0.2f));
+        raster.draw(lampCube, RASTER_TRIANGLES, lamp, material(SOFTWARE_SIMPLE, glm::vec3(1.0f), NULL));
+
+        PROFILE_ZONE("software scene");
+        raster.flush([this](int m, const float *varyings) { return shade(materials[m], varyings); });
+    }
+
+private:
+    bool built;
+    Grid grid;            // only sized and selected, never built: no GL
+    RasterMesh patch;     // Grid::patchMesh(), lines after the triangles
+    int patchTriangles;   // triangles of the patch, skirts included
+    RasterMesh cube, axis, lampCube;
+    SoftwareTexture grass, bricks;
+    std::vector<SoftwareMaterial> materials;
+
+    bool shadowsOn;
+    glm::vec3 viewPos;
+    ShadowCascades cascades;       // only the fit is used, the layers live in shadowDepth
+    std::vector<float> shadowDepth; // resolution^2 per cascade, bottom row first like the GL layers
+
+    int material(SoftwareProgram program, const glm::vec3 &color, const SoftwareTexture* texture, bool worldUV = false)
+    {
+        materials.push_back(SoftwareMaterial(program, color, texture, worldUV));
+        return (int)materials.size() - 1;
+    }
+
+    // the patches the frustum sees, as Grid::draw() would draw them
+    void drawGround(const Frustum &frustum, float pixelScale, bool lines, int m)
+    {
+        if(grid.cellsX != gridX || grid.cellsZ != gridZ)
+        {
+            grid.resize(gridX, gridZ);
+        }
+        grid.select(frustum, viewPos, pixelScale);
+
+        const int lineCount = ((int)patch.indices.size() - 3 * patchTriangles) / 2;
+        for(size_t p=0; p<grid.patches.size(); ++p)
+        {
+            const glm::vec4 &corner = grid.patches[p];
+            glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(corner)), glm::vec3(corner.w, 1.0f, corner.w));
+            if(lines)
+            {
+                raster.draw(patch, RASTER_LINES, model, m, 0.5f, 3 * patchTriangles / 2, lineCount);
+            }
+            else
+            {
+                raster.draw(patch, RASTER_TRIANGLES, model, m, 1.0f, 0, patchTriangles);
+            }
+        }
+    }
+
+    void build()
+    {
+        if(skeleton.size() == 0)
+        {
+            generateBaseCube();
+            initSkeleton();
+        }
+        for(int i=0; i<NumVertices; ++i)
+        {
+            cube.add(points[i], normals[i], textures[i]);
+        }
+        for(int i=0; i<36; ++i)
+        {
+            lampCube.add(glm::vec3(buffer_data_cube[i * 3], buffer_data_cube[i * 3 + 1], buffer_data_cube[i * 3 + 2]),
+                         glm::vec3(0.0f), glm::vec2(0.0f));
+        }
+        for(int i=0; i<18; ++i)
+        {
+            const GLfloat *v = &buffer_data_axis[i * 7];
+            axis.add(glm::vec3(v[0], v[1], v[2]), glm::vec3(0.0f), glm::vec2(0.0f));
+        }
+
+        // the patch of the GL ground, vertex for vertex
+        std::vector<GLfloat> vertexData;
+        std::vector<GLuint> indexData;
+        patchTriangles = (int)Grid::patchMesh(vertexData, indexData) / 3;
+        for(size_t v=0; v<vertexData.size(); v+=8)
+        {
+            const GLfloat *p = &vertexData[v];
+            patch.positions.push_back(glm::vec3(p[0], p[1], p[2]));
+            patch.normals.push_back(glm::vec3(p[3], p[4], p[5]));
+            patch.uvs.push_back(glm::vec2(p[6], p[7]));
+        }
+        patch.indices.assign(indexData.begin(), indexData.end());
+
+        grass.load("resources/grass.jpg");
+        bricks.load("resources/bricks.jpg");
+        built = true;
+    }
+
+    // the port of shadow_mapping_depth.vs: one depth-only pass per cascade
+    void renderShadows(const glm::mat4 &view, const glm::mat4* world)
+    {
+        cascades.count = shadow_cascades;
+        cascades.resolution = shadow_resolution;
+        cascades.sceneMin = glm::vec3(-gridX, 0.0f, -gridZ);
+        cascades.sceneMax = glm::vec3(gridX, lightPos.y, gridZ);
+        cascades.fit(view, glm::radians(fov), (float)width / (float)height, 0.1f, viewDistance(), lightPos);
+
+        const size_t layer = (size_t)cascades.resolution * cascades.resolution;
+        shadowDepth.resize(layer * cascades.count);
+
+        glm::vec4 horseBounds = skeletonBounds(world);
+        for(int c=0; c<cascades.count; ++c)
+        {
+            RasterTarget target;
+            target.width = target.height = cascades.resolution;
+            target.depth = &shadowDepth[layer * c];
+            target.flipY = false;
+            raster.begin(target, cascades.matrices[c], view, 0);
+            drawGround(cascades.frustums[c], 0.0f, false, 0);
+            if(cascades.sees(c, horseBounds))
+            {
+                for(int i=0; i<skeleton.size(); ++i)
+                {
+                    raster.draw(cube, RASTER_TRIANGLES, world[i] * partShape(skeleton.part[i]), 0);
+                }
+            }
+            raster.flush([](int, const float*) { return glm::vec3(0.0f); });
+        }
+    }
+
+    // texture(shadowMap, vec3(uv, cascade)).r with GL_NEAREST and a white border
+    float shadowTexel(int cascade, const glm::vec2 &uv) const
+    {
+        const int size = cascades.resolution;
+        int x = (int)floor(uv.x * size), y = (int)floor(uv.y * size);
+        if(x < 0 || y < 0 || x >= size || y >= size)
+        {
+            return 1.0f;
+        }
+        return shadowDepth[(size_t)cascade * size * size + (size_t)y * size + x];
+    }
+
+    // ShadowCalculation() of shadow_mapping.fs with SHADOW_PCF, whatever the filter
+    float shadowOf(const glm::vec3 &fragPos, const glm::vec3 &normal, float viewDepth) const
+    {
+        int cascade = 0;
+        for(int i = 0; i < cascades.count - 1; ++i)
+        {
+            if(viewDepth > cascades.splits[i])
+                cascade = i + 1;
+        }
+        glm::vec4 fragPosLightSpace = cascades.matrices[cascade] * glm::vec4(fragPos, 1.0f);
+        glm::vec3 projCoords = glm::vec3(fragPosLightSpace) / fragPosLightSpace.w;
+        projCoords = projCoords * 0.5f + 0.5f;
+        float currentDepth = projCoords.z;
+        glm::vec3 lightDir = glm::normalize(lightPos - fragPos);
+        float bias = std::max(0.05f * (1.0f - glm::dot(normal, lightDir)), 0.005f);
+
+        float shadow = 0.0f;
+        float texelSize = 1.0f / cascades.resolution;
+        for(int x = -pcf_kernel / 2; x <= pcf_kernel / 2; ++x)
+        {
+            for(int y = -pcf_kernel / 2; y <= pcf_kernel / 2; ++y)
+            {
+                float pcfDepth = shadowTexel(cascade, glm::vec2(projCoords) + glm::vec2(x, y) * texelSize);
+                shadow += currentDepth - bias > pcfDepth ? 1.0f : 0.0f;
+            }
+        }
+        shadow /= (float)(pcf_kernel * pcf_kernel);
+
+        if(projCoords.z > 1.0f)
+            shadow = 0.0f;
+
+        return shadow;
+    }
+
+    // main() of shadow_mapping.fs, or simple.fs; the light colours are the 0.5 grey of FrameData
+    glm::vec3 shade(const SoftwareMaterial &m, const float *v) const
+    {
+        if(m.program == SOFTWARE_SIMPLE)
+        {
+            return m.color;
+        }
+
+        const glm::vec3 fragPos(v[0], v[1], v[2]);
+        const glm::vec3 normal = glm::normalize(glm::vec3(v[3], v[4], v[5]));
+        const glm::vec2 uv = m.worldUV ? glm::vec2(v[0], v[2]) : glm::vec2(v[6], v[7]);
+        const glm::vec3 light(0.5f);
+        glm::vec3 lightDir = glm::normalize(lightPos - fragPos);
+        glm::vec3 viewDir = glm::normalize(viewPos - fragPos);
+
+        if(shadowsOn)
+        {
+            glm::vec3 color = m.texture->sample(uv);
+            glm::vec3 ambient = 0.3f * color;
+            float diff = std::max(glm::dot(lightDir, normal), 0.0f);
+            glm::vec3 halfwayDir = glm::normalize(lightDir + viewDir);
+            float spec = powerOfTwo(std::max(glm::dot(normal, halfwayDir), 0.0f), 6);
+            float shadow = shadowOf(fragPos, normal, v[8]);
+            return (ambient + (1.0f - shadow) * (glm::vec3(diff) + glm::vec3(spec))) * color;
+        }
+
+        float diff = std::max(glm::dot(normal, lightDir), 0.0f);
+        glm::vec3 reflectDir = glm::reflect(-lightDir, normal);
+        if(texture_on)
+        {
+            glm::vec3 texel = m.texture->sample(uv);
+            float spec = powerOfTwo(std::max(glm::dot(viewDir, reflectDir), 0.0f), 6);
+            return light * texel + light * diff * texel + light * (spec * glm::vec3(0.5f));
+        }
+        float spec = powerOfTwo(std::max(glm::dot(viewDir, reflectDir), 0.0f), 5);
+        return 0.5f * light * m.color + diff * light * m.color + 0.5f * spec * light * m.color;
+    }
+};
@@ -0,0 +1,269 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <cmath>
+#include <vector>
+
+#if !defined(FRUSTUM_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define FRUSTUM_SIMD 1
+#include <xmmintrin.h>
+#endif
+
+// View-frustum culling. A Frustum holds the six planes of a view-projection
+// matrix with unit inward normals. Bounds meant to be culled together are
+// kept as structure-of-arrays batches, spheres or axis-aligned boxes, so that
+// cull() tests four of them against a plane with one SSE compare and writes
+// out the indices that survive all six. Define FRUSTUM_NO_SIMD for the plain
+// loops; both give the same answer.
+
+class Frustum
+{
+public:
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far; xyz inward normal
+
+    Frustum() {}
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        extract(viewProjection);
+    }
+
+    // the planes of projection * view, from the rows of the matrix
+    void extract(const glm::mat4 &m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for(int i=0; i<6; ++i)
+        {
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+        }
+    }
+
+    // is any part of the sphere (xyz centre, w radius) inside
+    bool sees(const glm::vec4 &sphere) const
+    {
+        for(int p=0; p<6; ++p)
+        {
+            if(glm::dot(glm::vec3(planes[p]), glm::vec3(sphere)) + planes[p].w < -sphere.w)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // is any part of the box inside; conservative near the frustum's edges, like the sphere test
+    bool sees(const glm::vec3 &low, const glm::vec3 &high) const
+    {
+        glm::vec3 centre = 0.5f * (low + high);
+        glm::vec3 extent = 0.5f * (high - low);
+        for(int p=0; p<6; ++p)
+        {
+            glm::vec3 n(planes[p]);
+            if(glm::dot(n, centre) + planes[p].w < -glm::dot(glm::abs(n), extent))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// how many objects of one kind a pass tested and kept
+struct CullCount
+{
+    int tested;
+    int visible;
+
+    CullCount() :
+        tested(0), visible(0) {}
+
+    void add(int testedCount, int visibleCount)
+    {
+        tested += testedCount;
+        visible += visibleCount;
+    }
+};
+
+// bounding spheres, one array per component
+class SphereBatch
+{
+public:
+    std::vector<float> x, y, z, r;
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        z.clear();
+        r.clear();
+    }
+
+    void add(const glm::vec4 &sphere)
+    {
+        x.push_back(sphere.x);
+        y.push_back(sphere.y);
+        z.push_back(sphere.z);
+        r.push_back(sphere.w);
+    }
+
+    int size() const
+    {
+        return (int)x.size();
+    }
+
+    // the indices of the spheres the frustum sees, in order; returns how many
+    int cull(const Frustum &frustum, std::vector<int> &visible) const
+    {
+        const int n = size();
+        visible.resize(n);
+        int *out = visible.data();
+        int i = 0;
+#ifdef FRUSTUM_SIMD
+        __m128 nx[6], ny[6], nz[6], nw[6];
+        broadcastPlanes(frustum, nx, ny, nz, nw);
+        for(; i + 4 <= n; i += 4)
+        {
+            __m128 px = _mm_loadu_ps(&x[i]), py = _mm_loadu_ps(&y[i]), pz = _mm_loadu_ps(&z[i]);
+            __m128 minus = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&r[i]));
+            int inside = 15;
+            for(int p=0; p<6 && inside != 0; ++p)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], px), _mm_mul_ps(ny[p], py)),
+                                      _mm_add_ps(_mm_mul_ps(nz[p], pz), nw[p]));
+                inside &= _mm_movemask_ps(_mm_cmpge_ps(d, minus));
+            }
+            out = writeMask(out, i, inside);
+        }
+#endif
+        for(; i<n; ++i)
+        {
+            if(frustum.sees(glm::vec4(x[i], y[i], z[i], r[i])))
+            {
+                *out++ = i;
+            }
+        }
+        int count = (int)(out - visible.data());
+        visible.resize(count);
+        return count;
+    }
+
+private:
+#ifdef FRUSTUM_SIMD
+    friend class BoxBatch;
+
+    static void broadcastPlanes(const Frustum &frustum, __m128 nx[6], __m128 ny[6], __m128 nz[6], __m128 nw[6])
+    {
+        for(int p=0; p<6; ++p)
+        {
+            nx[p] = _mm_set1_ps(frustum.planes[p].x);
+            ny[p] = _mm_set1_ps(frustum.planes[p].y);
+            nz[p] = _mm_set1_ps(frustum.planes[p].z);
+            nw[p] = _mm_set1_ps(frustum.planes[p].w);
+        }
+    }
+
+    // the indices first..first+3 whose bit is set in `mask`
+    static int *writeMask(int *out, int first, int mask)
+    {
+        for(int k=0; k<4; ++k)
+        {
+            if(mask & (1 << k))
+            {
+                *out++ = first + k;
+            }
+        }
+        return out;
+    }
+#endif
+};
+
+// axis-aligned boxes as centre and half extent, one array per component
+class BoxBatch
+{
+public:
+    std::vector<float> x, y, z;    // centre
+    std::vector<float> ex, ey, ez; // half extent
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        z.clear();
+        ex.clear();
+        ey.clear();
+        ez.clear();
+    }
+
+    void add(const glm::vec3 &low, const glm::vec3 &high)
+    {
+        glm::vec3 centre = 0.5f * (low + high);
+        glm::vec3 extent = 0.5f * (high - low);
+        x.push_back(centre.x);
+        y.push_back(centre.y);
+        z.push_back(centre.z);
+        ex.push_back(extent.x);
+        ey.push_back(extent.y);
+        ez.push_back(extent.z);
+    }
+
+    int size() const
+    {
+        return (int)x.size();
+    }
+
+    // the indices of the boxes the frustum sees, in order; returns how many
+    int cull(const Frustum &frustum, std::vector<int> &visible) const
+    {
+        const int n = size();
+        visible.resize(n);
+        int *out = visible.data();
+        int i = 0;
+#ifdef FRUSTUM_SIMD
+        __m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+        SphereBatch::broadcastPlanes(frustum, nx, ny, nz, nw);
+        for(int p=0; p<6; ++p)
+        {
+            ax[p] = _mm_set1_ps(std::fabs(frustum.planes[p].x));
+            ay[p] = _mm_set1_ps(std::fabs(frustum.planes[p].y));
+            az[p] = _mm_set1_ps(std::fabs(frustum.planes[p].z));
+        }
+        for(; i + 4 <= n; i += 4)
+        {
+            __m128 px = _mm_loadu_ps(&x[i]), py = _mm_loadu_ps(&y[i]), pz = _mm_loadu_ps(&z[i]);
+            __m128 qx = _mm_loadu_ps(&ex[i]), qy = _mm_loadu_ps(&ey[i]), qz = _mm_loadu_ps(&ez[i]);
+            int inside = 15;
+            for(int p=0; p<6 && inside != 0; ++p)
+            {
+                // signed distance of the centre against the projected radius of the box
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], px), _mm_mul_ps(ny[p], py)),
+                                      _mm_add_ps(_mm_mul_ps(nz[p], pz), nw[p]));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], qx), _mm_mul_ps(ay[p], qy)), _mm_mul_ps(az[p], qz));
+                inside &= _mm_movemask_ps(_mm_cmpge_ps(d, _mm_sub_ps(_mm_setzero_ps(), radius)));
+            }
+            out = SphereBatch::writeMask(out, i, inside);
+        }
+#endif
+        for(; i<n; ++i)
+        {
+            glm::vec3 centre(x[i], y[i], z[i]), extent(ex[i], ey[i], ez[i]);
+            if(frustum.sees(centre - extent, centre + extent))
+            {
+                *out++ = i;
+            }
+        }
+        int count = (int)(out - visible.data());
+        visible.resize(count);
+        return count;
+    }
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,264 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job system. Every thread, the one that made the JobSystem
+// included, owns a deque of jobs: it pushes and pops at the back, so it keeps
+// working on what it queued last, while idle threads steal from the front of
+// the others' deques. A JobCounter counts the unfinished jobs of a batch;
+// wait() runs queued jobs until the count reaches zero instead of blocking,
+// and a job can be held back until another counter reaches zero. Jobs are
+// started from the thread that made the JobSystem or from inside other jobs.
+
+class JobCounter;
+
+struct Job
+{
+    std::function<void()> work;
+    JobCounter* counter;
+};
+
+class JobCounter
+{
+public:
+    JobCounter() :
+        pending(0) {}
+
+    bool done() const
+    {
+        return pending.load() == 0;
+    }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> pending;
+    std::mutex mutex;         // held while the count drops, so a waiter never sees a counter still in use
+    std::vector<Job> waiting; // started when pending reaches zero
+
+    JobCounter(const JobCounter&);
+    JobCounter& operator=(const JobCounter&);
+};
+
+class JobSystem
+{
+public:
+    JobSystem() :
+        stopping(false), queued(0), sleeping(0)
+    {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+
+    ~JobSystem()
+    {
+        stop();
+    }
+
+    // threads including the caller
+    int size() const
+    {
+        return (int)queues.size();
+    }
+
+    // not while jobs are queued
+    void resize(int threads)
+    {
+        stop();
+        stopping = false;
+        queues.clear();
+        for(int i=0; i<std::max(1, threads); ++i)
+        {
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        }
+        for(int i=1; i<size(); ++i)
+        {
+            workers.push_back(std::thread(&JobSystem::loop, this, i));
+        }
+    }
+
+    // queue `work`, counted by `counter`; held back until `after` is done when given
+    void run(const std::function<void()> &work, JobCounter &counter, JobCounter *after = NULL)
+    {
+        ++counter.pending;
+        Job job = { work, &counter };
+        if(after != NULL)
+        {
+            std::lock_guard<std::mutex> lock(after->mutex);
+            if(after->pending.load() > 0)
+            {
+                after->waiting.push_back(job);
+                return;
+            }
+        }
+        push(job);
+    }
+
+    // work(first, count) over [0, count) in slices of `grain`, one job each
+    void parallelFor(int count, int grain, const std::function<void(int, int)> &work, JobCounter &counter, JobCounter *after = NULL)
+    {
+        for(int first = 0; first < count; first += grain)
+        {
+            int slice = std::min(grain, count - first);
+            run([work, first, slice]() { work(first, slice); }, counter, after);
+        }
+    }
+
+    // the same, returning when every slice is done
+    void parallelFor(int count, int grain, const std::function<void(int, int)> &work)
+    {
+        JobCounter counter;
+        parallelFor(count, grain, work, counter);
+        wait(counter);
+    }
+
+    // run jobs, this thread's own first, until the counter reaches zero
+    void wait(JobCounter &counter)
+    {
+        const int thread = threadIndex();
+        while(counter.pending.load() > 0)
+        {
+            Job job;
+            if(take(thread, job))
+            {
+                execute(job);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        std::lock_guard<std::mutex> lock(counter.mutex);
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per thread, the caller's first
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::atomic<int> queued;   // jobs in all deques
+    std::atomic<int> sleeping; // workers waiting for a job
+
+    // the deque a thread pushes to: 0 for the thread that made the system
+    static int &threadIndex()
+    {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    void push(const Job &job)
+    {
+        {
+            Queue &queue = *queues[threadIndex()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        ++queued;
+        if(sleeping.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wake.notify_one();
+        }
+    }
+
+    // the newest job of our own deque, else the oldest of someone else's
+    bool take(int thread, Job &job)
+    {
+        for(int k=0; k<size(); ++k)
+        {
+            Queue &queue = *queues[(thread + k) % size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(queue.jobs.empty())
+            {
+                continue;
+            }
+            if(k == 0)
+            {
+                job = queue.jobs.back();
+                queue.jobs.pop_back();
+            }
+            else
+            {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+            }
+            --queued;
+            return true;
+        }
+        return false;
+    }
+
+    // run the job, then start whatever waited for its counter to empty
+    void execute(Job &job)
+    {
+        job.work();
+
+        JobCounter &counter = *job.counter;
+        std::vector<Job> released;
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            if(--counter.pending == 0)
+            {
+                released.swap(counter.waiting);
+            }
+        }
+        for(size_t i=0; i<released.size(); ++i)
+        {
+            push(released[i]);
+        }
+    }
+
+    void loop(int thread)
+    {
+        threadIndex() = thread;
+        for(;;)
+        {
+            Job job;
+            if(take(thread, job))
+            {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            ++sleeping;
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            --sleeping;
+            if(stopping)
+            {
+                return;
+            }
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(size_t i=0; i<workers.size(); ++i)
+        {
+            workers[i].join();
+        }
+        workers.clear();
+    }
+};
+
+#endif // JOBS_H
@@ -0,0 +1,244 @@
+#ifndef SHADER_BUILDER_H
+#define SHADER_BUILDER_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "program_cache.h"
+
+// Shader programs built side by side instead of one after another. submit()
+// reads the sources and either loads the program from the program cache or
+// hands every compile and the link to the driver without asking how they
+// went, so with GL_KHR_parallel_shader_compile the driver's compiler threads
+// work on all of them at once. poll(), called once per frame, asks each
+// pending program for GL_COMPLETION_STATUS_KHR, which never blocks, and only
+// then reads its logs, stores it in the cache and adopts it into its
+// ShaderProgram, whose ID stays 0 until then, and for good when a compile
+// or the link failed; passes drawn with a program that is not ready yet are
+// skipped. Without the extension poll() finishes everything on its first
+// call, still after all compiles were queued. finish() waits for the rest.
+// Defines passed to submit() make variants of one pair of files; each
+// variant has its own program cache entry. A geometry shader, when given, is
+// a third stage of the same program.
+
+// `defines` put after the #version line of `source`, or at the top when it has none
+inline void injectDefines(std::string &source, const std::string &defines)
+{
+    if(defines.empty())
+    {
+        return;
+    }
+    size_t version = source.find("#version");
+    size_t line = version == std::string::npos ? 0 : source.find('\n', version);
+    if(line == std::string::npos)
+    {
+        source += '\n';
+        line = source.size();
+    }
+    else if(version != std::string::npos)
+    {
+        ++line;
+    }
+    source.insert(line, defines);
+}
+
+class ShaderBuilder
+{
+public:
+    double seconds; // from the first submit() to the last program ready
+
+    ShaderBuilder() :
+        seconds(0.0), checked(false), parallel(false) {}
+
+    // build a program from two files, or three with a geometry shader, into `target`; `ready` runs
+    // once it is linked. `defines` goes into every stage right after its #version line
+    void submit(ShaderProgram &target, const std::string &vertexPath, const std::string &fragmentPath,
+                const std::function<void()> &ready = std::function<void()>(), const std::string &defines = std::string(),
+                const std::string &geometryPath = std::string())
+    {
+        if(!checked)
+        {
+            checked = true;
+            start = std::chrono::steady_clock::now();
+#ifdef GL_COMPLETION_STATUS_KHR
+#ifdef __GLEW_H__
+            parallel = GLEW_KHR_parallel_shader_compile != 0;
+#else
+            parallel = true;
+#endif
+            if(parallel)
+            {
+                // as many compiler threads as the driver likes
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            }
+#endif
+        }
+
+        Build build;
+        build.target = &target;
+        build.ready = ready;
+        build.names[0] = vertexPath;
+        build.names[1] = fragmentPath;
+        build.names[2] = geometryPath;
+        build.stages = geometryPath.empty() ? 2 : 3;
+        std::string sources[3];
+        for(int i=0; i<build.stages; ++i)
+        {
+            if(!readShaderFile(build.names[i], sources[i]))
+            {
+                printf("Impossible to open %s. Are you in the right directory ?\n", build.names[i].c_str());
+                getchar();
+                exit(-1);
+            }
+            injectDefines(sources[i], defines);
+        }
+
+        const char *pointers[3] = { sources[0].c_str(), sources[1].c_str(), sources[2].c_str() };
+        build.key = programCache().key(pointers, build.stages);
+        build.program = programCache().load(build.key);
+        build.cached = build.program != 0;
+        if(!build.cached)
+        {
+            const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+            build.program = glCreateProgram();
+            for(int i=0; i<build.stages; ++i)
+            {
+                build.shaders[i] = glCreateShader(types[i]);
+                glShaderSource(build.shaders[i], 1, &pointers[i], NULL);
+                glCompileShader(build.shaders[i]);
+                glAttachShader(build.program, build.shaders[i]);
+            }
+            programCache().retrievable(build.program);
+            glLinkProgram(build.program);
+        }
+        pending.push_back(build);
+    }
+
+    // adopt the programs that finished since the last call; returns how many are still building
+    int poll()
+    {
+        return collect(false);
+    }
+
+    // wait for every program
+    void finish()
+    {
+        collect(true);
+    }
+
+    int waiting() const
+    {
+        return (int)pending.size();
+    }
+
+    void report() const
+    {
+        const ProgramCache &cache = programCache();
+        std::printf("programs: %d from cache, %d compiled (%d rejected), all ready after %.1f ms%s\n",
+                    cache.hits, cache.compiled, cache.rejected, seconds * 1000.0, parallel ? ", compiled in parallel" : "");
+    }
+
+private:
+    struct Build
+    {
+        ShaderProgram *target;
+        std::function<void()> ready;
+        std::string names[3];
+        int stages;
+        std::string key;
+        GLuint program;
+        GLuint shaders[3];
+        bool cached;
+    };
+
+    std::vector<Build> pending;
+    bool checked;
+    bool parallel;
+    std::chrono::steady_clock::time_point start;
+
+    int collect(bool wait)
+    {
+        size_t kept = 0;
+        for(size_t i=0; i<pending.size(); ++i)
+        {
+            if(!wait && !linked(pending[i]))
+            {
+                pending[kept++] = pending[i];
+                continue;
+            }
+            adopt(pending[i]);
+        }
+        pending.resize(kept);
+        return (int)kept;
+    }
+
+    // has the driver finished with the program; only asks when that cannot block
+    bool linked(const Build &build) const
+    {
+#ifdef GL_COMPLETION_STATUS_KHR
+        if(parallel)
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+            return done == GL_TRUE;
+        }
+#endif
+        return true;
+    }
+
+    // the checks loadShaders makes straight after each call, made now that they cannot stall;
+    // a program that failed is dropped, so its target stays at ID 0 and its passes stay skipped
+    void adopt(Build &build)
+    {
+        if(!build.cached)
+        {
+            GLint success;
+            GLchar infoLog[512];
+            bool failed = false;
+            for(int i=0; i<build.stages; ++i)
+            {
+                glGetShaderiv(build.shaders[i], GL_COMPILE_STATUS, &success);
+                if(!success)
+                {
+                    glGetShaderInfoLog(build.shaders[i], 512, NULL, infoLog);
+                    std::cout << "ERROR::SHADER::" << build.names[i] << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+                    failed = true;
+                }
+                glDeleteShader(build.shaders[i]);
+            }
+            glGetProgramiv(build.program, GL_LINK_STATUS, &success);
+            if(!success)
+            {
+                glGetProgramInfoLog(build.program, 512, NULL, infoLog);
+                std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+                failed = true;
+            }
+            if(failed)
+            {
+                glDeleteProgram(build.program);
+                build.program = 0;
+            }
+            else
+            {
+                programCache().store(build.key, build.program);
+            }
+        }
+
+        if(build.program != 0)
+        {
+            build.target->link(build.program);
+            if(build.ready)
+            {
+                build.ready();
+            }
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+#endif // SHADER_BUILDER_H
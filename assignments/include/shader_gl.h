@@ -3,21 +3,13 @@
 #include <sstream>
 #include <iostream>
 
+#include "program_cache.h"
+
 GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_path)
 {
-    // Create the shaders
     // Read the Vertex Shader code from the file
     std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_shader_path, std::ios::in);
-
-    if (VertexShaderStream.is_open())
-    {
-        std::string Line = "";
-        while (getline(VertexShaderStream, Line))
-            VertexShaderCode += "\n" + Line;
-        VertexShaderStream.close();
-    }
-    else
+    if (!readShaderFile(vertex_shader_path, VertexShaderCode))
     {
         printf("Impossible to open %s. Are you in the right directory ?\n", vertex_shader_path.c_str());
         getchar();
@@ -26,22 +18,22 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 
     // Read the Fragment Shader code from the file
     std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_shader_path, std::ios::in);
-
-    if (FragmentShaderStream.is_open())
-    {
-        std::string Line = "";
-        while (getline(FragmentShaderStream, Line))
-            FragmentShaderCode += "\n" + Line;
-        FragmentShaderStream.close();
-    }
-    else
+    if (!readShaderFile(fragment_shader_path, FragmentShaderCode))
     {
         printf("Impossible to open %s. Are you in the right directory?\n", fragment_shader_path.c_str());
         getchar();
         exit(-1);
     }
 
+    // The same sources linked on an earlier run on this driver
+    const char *sources[2] = { VertexShaderCode.c_str(), FragmentShaderCode.c_str() };
+    std::string key = programCache().key(sources, 2);
+    GLuint cached = programCache().load(key);
+    if (cached != 0)
+    {
+        return cached;
+    }
+
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
     char const * VertexSourcePointer = VertexShaderCode.c_str();
     glShaderSource(vertexShader, 1, &VertexSourcePointer, NULL);
@@ -71,6 +63,7 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
     GLuint shaderProgram = glCreateProgram();
     glAttachShader(shaderProgram, vertexShader);
     glAttachShader(shaderProgram, fragmentShader);
+    programCache().retrievable(shaderProgram);
     glLinkProgram(shaderProgram);
     // Check for linking errors
     glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
@@ -82,5 +75,6 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
     glDeleteShader(vertexShader); //free up memory
     glDeleteShader(fragmentShader);
 
+    programCache().store(key, shaderProgram);
     return shaderProgram;
 }
@@ -0,0 +1,198 @@
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+
+// GL calls made (or saved) by the shader layer, reset by the caller every frame
+struct GLStats
+{
+    long cachedLookups;     // glGetUniformLocation calls answered by a ShaderProgram cache instead
+    long uniformCalls;      // glUniform* calls
+    long blockUpdates;      // uniform buffer updates
+    long blockUniforms;     // glUniform* calls replaced by those updates
+
+    GLStats() :
+        cachedLookups(0), uniformCalls(0), blockUpdates(0), blockUniforms(0) {}
+};
+
+// the process-wide counts every ShaderProgram adds to
+inline GLStats &glStats()
+{
+    static GLStats stats;
+    return stats;
+}
+
+// A linked program with the locations of all its active uniforms resolved once.
+// The setters mirror the ones of learnopengl's Shader; names that are not active
+// map to -1, which glUniform* ignores just like before.
+class ShaderProgram
+{
+public:
+    GLuint ID;
+    std::unordered_map<std::string, GLint> locations;
+    int blockMembers; // active uniforms living in uniform blocks
+
+    ShaderProgram() :
+        ID(0), blockMembers(0) {}
+
+    explicit ShaderProgram(GLuint program) :
+        ID(0), blockMembers(0)
+    {
+        link(program);
+    }
+
+    // adopt a linked program and cache its uniform locations
+    void link(GLuint program)
+    {
+        ID = program;
+        locations.clear();
+        blockMembers = 0;
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for(GLint i=0; i<count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniform(name.data(), length);
+
+            GLint location = glGetUniformLocation(ID, uniform.c_str());
+            if(location < 0)
+            {
+                // members of uniform blocks have no location
+                ++blockMembers;
+                continue;
+            }
+            locations[uniform] = location;
+
+            // "lights[0]" is also reachable as "lights", and the other elements by their index
+            size_t bracket = uniform.find("[0]");
+            if(bracket != std::string::npos && bracket + 3 == uniform.size())
+            {
+                const std::string array = uniform.substr(0, bracket);
+                locations[array] = location;
+                for(GLint element=1; element<size; ++element)
+                {
+                    const std::string indexed = array + "[" + std::to_string(element) + "]";
+                    locations[indexed] = glGetUniformLocation(ID, indexed.c_str());
+                }
+            }
+        }
+    }
+
+    // linked and adopted; a ShaderBuilder leaves ID at 0 until then
+    bool ready() const
+    {
+        return ID != 0;
+    }
+
+    // connect a named uniform block to a binding point; false if the program has no such block
+    bool bindBlock(const char *name, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, name);
+        if(index == GL_INVALID_INDEX)
+        {
+            return false;
+        }
+        glUniformBlockBinding(ID, index, binding);
+        return true;
+    }
+
+    GLint location(const std::string &name) const
+    {
+        ++glStats().cachedLookups;
+        std::unordered_map<std::string, GLint>::const_iterator it = locations.find(name);
+        return it == locations.end() ? -1 : it->second;
+    }
+
+    // activate the shader
+    // ------------------------------------------------------------------------
+    void use() const
+    {
+        glUseProgram(ID);
+    }
+    // utility uniform functions
+    // ------------------------------------------------------------------------
+    void setBool(const std::string &name, bool value) const
+    {
+        ++glStats().uniformCalls;
+        glUniform1i(location(name), (int)value);
+    }
+    void setInt(const std::string &name, int value) const
+    {
+        ++glStats().uniformCalls;
+        glUniform1i(location(name), value);
+    }
+    void setFloat(const std::string &name, float value) const
+    {
+        ++glStats().uniformCalls;
+        glUniform1f(location(name), value);
+    }
+    void setVec3(const std::string &name, const glm::vec3 &value) const
+    {
+        ++glStats().uniformCalls;
+        glUniform3fv(location(name), 1, &value[0]);
+    }
+    void setVec4(const std::string &name, const glm::vec4 &value) const
+    {
+        ++glStats().uniformCalls;
+        glUniform4fv(location(name), 1, &value[0]);
+    }
+    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    {
+        ++glStats().uniformCalls;
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
+};
+
+// A std140 uniform block backed by one buffer object; T must match the
+// block's std140 layout (use vec4 on the C++ side for vec3 members).
+template<typename T>
+class UniformBuffer
+{
+public:
+    GLuint ID;
+    GLuint binding;
+    int sharedUniforms; // glUniform* calls one update stands in for
+
+    UniformBuffer() :
+        ID(0), binding(0), sharedUniforms(0) {}
+
+    void create(GLuint bindingPoint)
+    {
+        binding = bindingPoint;
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    // bind the program's block of this name to the buffer
+    void attach(const ShaderProgram &program, const char *blockName)
+    {
+        if(program.bindBlock(blockName, binding))
+        {
+            sharedUniforms += program.blockMembers;
+        }
+    }
+
+    void update(const T &data) const
+    {
+        ++glStats().blockUpdates;
+        glStats().blockUniforms += sharedUniforms;
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <functional>
+#include <map>
+#include <string>
+
+#include "shader_builder.h"
+
+// Permutations of one shader: a program per combination of compile-time
+// features, each compiled with its features as #define lines instead of
+// branching per fragment on uniforms. A variant is named by its defines, the
+// exact text injected after #version, so the caller decides which features
+// exist; find() is a lookup in the variants built so far. Variants go
+// through a ShaderBuilder and so the program cache, one blob each.
+
+class ShaderVariants
+{
+public:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string geometryPath; // empty for none
+
+    ShaderVariants(const std::string &vertex, const std::string &fragment, const std::string &geometry = std::string()) :
+        vertexPath(vertex), fragmentPath(fragment), geometryPath(geometry) {}
+
+    // queue the variant for `defines` unless it is queued already; `ready` gets it once linked
+    void submit(ShaderBuilder &builder, const std::string &defines,
+                const std::function<void(ShaderProgram&)> &ready = std::function<void(ShaderProgram&)>())
+    {
+        if(variants.count(defines) != 0)
+        {
+            return;
+        }
+        // std::map never moves its elements, so the builder may keep the address
+        ShaderProgram &program = variants[defines];
+        builder.submit(program, vertexPath, fragmentPath, [&program, ready]()
+        {
+            if(ready)
+            {
+                ready(program);
+            }
+        }, defines, geometryPath);
+    }
+
+    // the variant for `defines`, NULL when it was never submitted; it may not be ready() yet
+    const ShaderProgram *find(const std::string &defines) const
+    {
+        std::map<std::string, ShaderProgram>::const_iterator it = variants.find(defines);
+        return it == variants.end() ? NULL : &it->second;
+    }
+
+    int size() const
+    {
+        return (int)variants.size();
+    }
+
+private:
+    std::map<std::string, ShaderProgram> variants;
+};
+
+#endif // SHADER_VARIANTS_H
@@ -34,13 +34,6 @@ class mat2 {
     mat2( GLfloat m00, GLfloat m10, GLfloat m01, GLfloat m11 )
 	{ _m[0] = vec2( m00, m01 ); _m[1] = vec2( m10, m11 ); }
 
-    mat2( const mat2& m ) {
-	if ( *this != m ) {
-	    _m[0] = m._m[0];
-	    _m[1] = m._m[1];
-	} 
-    }
-
     //
     //  --- Indexing Operator ---
     //
@@ -173,14 +166,13 @@ class mat2 {
 
 inline
 mat2 matrixCompMult( const mat2& A, const mat2& B ) {
-    return mat2( A[0][0]*B[0][0], A[0][1]*B[0][1],
-		 A[1][0]*B[1][0], A[1][1]*B[1][1] );
+    return mat2( A[0]*B[0], A[1]*B[1] );
 }
 
 inline
-mat2 transpose( const mat2& A ) {
-    return mat2( A[0][0], A[1][0],
-		 A[0][1], A[1][1] );
+mat2 transpose( const mat2& A ) {  // the constructor takes columns: pass A's rows
+    return mat2( A[0][0], A[0][1],
+		 A[1][0], A[1][1] );
 }
 
 //----------------------------------------------------------------------------
@@ -212,15 +204,6 @@ class mat3 {
 	    _m[2] = vec3( m20, m21, m22 );
 	}
 
-    mat3( const mat3& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-	    } 
-	}
-
     //
     //  --- Indexing Operator ---
     //
@@ -358,27 +341,66 @@ class mat3 {
 
 inline
 mat3 matrixCompMult( const mat3& A, const mat3& B ) {
-    return mat3( A[0][0]*B[0][0], A[0][1]*B[0][1], A[0][2]*B[0][2],
-		 A[1][0]*B[1][0], A[1][1]*B[1][1], A[1][2]*B[1][2],
-		 A[2][0]*B[2][0], A[2][1]*B[2][1], A[2][2]*B[2][2] );
+    return mat3( A[0]*B[0], A[1]*B[1], A[2]*B[2] );
 }
 
 inline
-mat3 transpose( const mat3& A ) {
-    return mat3( A[0][0], A[1][0], A[2][0],
-		 A[0][1], A[1][1], A[2][1],
-		 A[0][2], A[1][2], A[2][2] );
+mat3 transpose( const mat3& A ) {  // the constructor takes columns: pass A's rows
+    return mat3( A[0][0], A[0][1], A[0][2],
+		 A[1][0], A[1][1], A[1][2],
+		 A[2][0], A[2][1], A[2][2] );
 }
 
 //----------------------------------------------------------------------------
 //
-//  mat4.h - 4D square matrix
+//  mat4.h - 4D square matrix, rows of aligned vec4s
 //
 
 class mat4 {
 
     vec4  _m[4];
 
+    //  row i of a * b is b's rows weighted by a's row i
+    static mat4 multiply( const mat4& a, const mat4& b ) {
+#if defined(ANGEL_SIMD) && defined(__AVX__)
+	// two rows per 8-wide register
+	__m256 b0 = _mm256_broadcast_ps( reinterpret_cast<const __m128*>( &b._m[0].x ) );
+	__m256 b1 = _mm256_broadcast_ps( reinterpret_cast<const __m128*>( &b._m[1].x ) );
+	__m256 b2 = _mm256_broadcast_ps( reinterpret_cast<const __m128*>( &b._m[2].x ) );
+	__m256 b3 = _mm256_broadcast_ps( reinterpret_cast<const __m128*>( &b._m[3].x ) );
+	__m256 r01 = _mm256_loadu_ps( &a._m[0].x ), r23 = _mm256_loadu_ps( &a._m[2].x );
+	__m256 c01 = _mm256_add_ps(
+	    _mm256_add_ps( _mm256_mul_ps( _mm256_shuffle_ps( r01, r01, 0x00 ), b0 ), _mm256_mul_ps( _mm256_shuffle_ps( r01, r01, 0x55 ), b1 ) ),
+	    _mm256_add_ps( _mm256_mul_ps( _mm256_shuffle_ps( r01, r01, 0xAA ), b2 ), _mm256_mul_ps( _mm256_shuffle_ps( r01, r01, 0xFF ), b3 ) ) );
+	__m256 c23 = _mm256_add_ps(
+	    _mm256_add_ps( _mm256_mul_ps( _mm256_shuffle_ps( r23, r23, 0x00 ), b0 ), _mm256_mul_ps( _mm256_shuffle_ps( r23, r23, 0x55 ), b1 ) ),
+	    _mm256_add_ps( _mm256_mul_ps( _mm256_shuffle_ps( r23, r23, 0xAA ), b2 ), _mm256_mul_ps( _mm256_shuffle_ps( r23, r23, 0xFF ), b3 ) ) );
+	return mat4( _mm256_castps256_ps128( c01 ), _mm256_extractf128_ps( c01, 1 ),
+		     _mm256_castps256_ps128( c23 ), _mm256_extractf128_ps( c23, 1 ) );
+#elif defined(ANGEL_SIMD)
+	__m128 b0 = b._m[0].simd(), b1 = b._m[1].simd(), b2 = b._m[2].simd(), b3 = b._m[3].simd();
+	return mat4( row( a._m[0].simd(), b0, b1, b2, b3 ), row( a._m[1].simd(), b0, b1, b2, b3 ),
+		     row( a._m[2].simd(), b0, b1, b2, b3 ), row( a._m[3].simd(), b0, b1, b2, b3 ) );
+#else
+	mat4  c( 0.0 );
+	for ( int i = 0; i < 4; ++i ) {
+	    for ( int j = 0; j < 4; ++j ) {
+		for ( int k = 0; k < 4; ++k ) {
+		    c[i][j] += a._m[i][k] * b._m[k][j];
+		}
+	    }
+	}
+	return c;
+#endif
+    }
+
+#ifdef ANGEL_SIMD
+    static __m128 row( __m128 r, __m128 b0, __m128 b1, __m128 b2, __m128 b3 ) {
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_shuffle_ps( r, r, 0x00 ), b0 ), _mm_mul_ps( _mm_shuffle_ps( r, r, 0x55 ), b1 ) ),
+			   _mm_add_ps( _mm_mul_ps( _mm_shuffle_ps( r, r, 0xAA ), b2 ), _mm_mul_ps( _mm_shuffle_ps( r, r, 0xFF ), b3 ) ) );
+    }
+#endif
+
    public:
     //
     //  --- Constructors and Destructors ---
@@ -401,16 +423,6 @@ class mat4 {
 	    _m[3] = vec4( m30, m31, m32, m33 );
 	}
 
-    mat4( const mat4& m )
-	{
-	    if ( *this != m ) {
-		_m[0] = m._m[0];
-		_m[1] = m._m[1];
-		_m[2] = m._m[2];
-		_m[3] = m._m[3];
-	    } 
-	}
-
     //
     //  --- Indexing Operator ---
     //
@@ -447,19 +459,8 @@ class mat4 {
     friend mat4 operator * ( const GLfloat s, const mat4& m )
 	{ return m * s; }
 	
-    mat4 operator * ( const mat4& m ) const {
-	mat4  a( 0.0 );
-
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
-	return a;
-    }
+    mat4 operator * ( const mat4& m ) const
+	{ return multiply( *this, m ); }
 
     //
     //  --- (modifying) Arithematic Operators ---
@@ -480,19 +481,8 @@ class mat4 {
 	return *this;
     }
 
-    mat4& operator *= ( const mat4& m ) {
-	mat4  a( 0.0 );
-
-	for ( int i = 0; i < 4; ++i ) {
-	    for ( int j = 0; j < 4; ++j ) {
-		for ( int k = 0; k < 4; ++k ) {
-		    a[i][j] += _m[i][k] * m[k][j];
-		}
-	    }
-	}
-
-	return *this = a;
-    }
+    mat4& operator *= ( const mat4& m )
+	{ return *this = multiply( *this, m ); }
 
     mat4& operator /= ( const GLfloat s ) {
 #ifdef DEBUG
@@ -512,11 +502,22 @@ class mat4 {
     //
 
     vec4 operator * ( const vec4& v ) const {  // m * v
+#ifdef ANGEL_SIMD
+	// the columns weighted by v's components; in a loop over vertices
+	// the transpose into columns does not change and is hoisted out
+	__m128 c0 = _m[0].simd(), c1 = _m[1].simd(), c2 = _m[2].simd(), c3 = _m[3].simd();
+	_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+	__m128 p = v.simd();
+	return vec4( _mm_add_ps(
+	    _mm_add_ps( _mm_mul_ps( _mm_shuffle_ps( p, p, 0x00 ), c0 ), _mm_mul_ps( _mm_shuffle_ps( p, p, 0x55 ), c1 ) ),
+	    _mm_add_ps( _mm_mul_ps( _mm_shuffle_ps( p, p, 0xAA ), c2 ), _mm_mul_ps( _mm_shuffle_ps( p, p, 0xFF ), c3 ) ) ) );
+#else
 	return vec4( _m[0][0]*v.x + _m[0][1]*v.y + _m[0][2]*v.z + _m[0][3]*v.w,
 		     _m[1][0]*v.x + _m[1][1]*v.y + _m[1][2]*v.z + _m[1][3]*v.w,
 		     _m[2][0]*v.x + _m[2][1]*v.y + _m[2][2]*v.z + _m[2][3]*v.w,
 		     _m[3][0]*v.x + _m[3][1]*v.y + _m[3][2]*v.z + _m[3][3]*v.w
 	    );
+#endif
     }
 	
     //
@@ -551,19 +552,115 @@ class mat4 {
 
 inline
 mat4 matrixCompMult( const mat4& A, const mat4& B ) {
-    return mat4(
-	A[0][0]*B[0][0], A[0][1]*B[0][1], A[0][2]*B[0][2], A[0][3]*B[0][3],
-	A[1][0]*B[1][0], A[1][1]*B[1][1], A[1][2]*B[1][2], A[1][3]*B[1][3],
-	A[2][0]*B[2][0], A[2][1]*B[2][1], A[2][2]*B[2][2], A[2][3]*B[2][3],
-	A[3][0]*B[3][0], A[3][1]*B[3][1], A[3][2]*B[3][2], A[3][3]*B[3][3] );
+    return mat4( A[0]*B[0], A[1]*B[1], A[2]*B[2], A[3]*B[3] );
 }
 
 inline
 mat4 transpose( const mat4& A ) {
-    return mat4( A[0][0], A[1][0], A[2][0], A[3][0],
-		 A[0][1], A[1][1], A[2][1], A[3][1],
-		 A[0][2], A[1][2], A[2][2], A[3][2],
-		 A[0][3], A[1][3], A[2][3], A[3][3] );
+#ifdef ANGEL_SIMD
+    __m128 r0 = A[0].simd(), r1 = A[1].simd(), r2 = A[2].simd(), r3 = A[3].simd();
+    _MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+    return mat4( r0, r1, r2, r3 );
+#else
+    // the constructor takes columns: pass A's rows
+    return mat4( A[0][0], A[0][1], A[0][2], A[0][3],
+		 A[1][0], A[1][1], A[1][2], A[1][3],
+		 A[2][0], A[2][1], A[2][2], A[2][3],
+		 A[3][0], A[3][1], A[3][2], A[3][3] );
+#endif
+}
+
+#ifdef ANGEL_SIMD
+//  2x2 blocks held row-major in one register: ( a b c d ) is | a b |
+//                                                            | c d |
+#define ANGEL_SWIZZLE( v, x, y, z, w )  _mm_shuffle_ps( v, v, _MM_SHUFFLE(w,z,y,x) )
+
+inline __m128 mat2Mul( __m128 a, __m128 b )     // a * b
+{
+    return _mm_add_ps( _mm_mul_ps( a, ANGEL_SWIZZLE(b, 0,3,0,3) ),
+		       _mm_mul_ps( ANGEL_SWIZZLE(a, 1,0,3,2), ANGEL_SWIZZLE(b, 2,1,2,1) ) );
+}
+
+inline __m128 mat2AdjMul( __m128 a, __m128 b )  // adjugate(a) * b
+{
+    return _mm_sub_ps( _mm_mul_ps( ANGEL_SWIZZLE(a, 3,3,0,0), b ),
+		       _mm_mul_ps( ANGEL_SWIZZLE(a, 1,1,2,2), ANGEL_SWIZZLE(b, 2,3,0,1) ) );
+}
+
+inline __m128 mat2MulAdj( __m128 a, __m128 b )  // a * adjugate(b)
+{
+    return _mm_sub_ps( _mm_mul_ps( a, ANGEL_SWIZZLE(b, 3,0,3,0) ),
+		       _mm_mul_ps( ANGEL_SWIZZLE(a, 1,0,3,2), ANGEL_SWIZZLE(b, 2,1,2,1) ) );
+}
+#endif // ANGEL_SIMD
+
+//  Inverse of a non-singular matrix
+inline
+mat4 inverse( const mat4& M ) {
+#ifdef ANGEL_SIMD
+    // blockwise: M = | A B |, each block 2x2
+    //                | C D |
+    __m128 m0 = M[0].simd(), m1 = M[1].simd(), m2 = M[2].simd(), m3 = M[3].simd();
+    __m128 A = _mm_movelh_ps( m0, m1 ), B = _mm_movehl_ps( m1, m0 );
+    __m128 C = _mm_movelh_ps( m2, m3 ), D = _mm_movehl_ps( m3, m2 );
+
+    // ( |A| |B| |C| |D| )
+    __m128 detSub = _mm_sub_ps(
+	_mm_mul_ps( _mm_shuffle_ps( m0, m2, _MM_SHUFFLE(2,0,2,0) ), _mm_shuffle_ps( m1, m3, _MM_SHUFFLE(3,1,3,1) ) ),
+	_mm_mul_ps( _mm_shuffle_ps( m0, m2, _MM_SHUFFLE(3,1,3,1) ), _mm_shuffle_ps( m1, m3, _MM_SHUFFLE(2,0,2,0) ) ) );
+    __m128 detA = ANGEL_SWIZZLE(detSub, 0,0,0,0), detB = ANGEL_SWIZZLE(detSub, 1,1,1,1);
+    __m128 detC = ANGEL_SWIZZLE(detSub, 2,2,2,2), detD = ANGEL_SWIZZLE(detSub, 3,3,3,3);
+
+    __m128 D_C = mat2AdjMul( D, C );
+    __m128 A_B = mat2AdjMul( A, B );
+    __m128 X = _mm_sub_ps( _mm_mul_ps( detD, A ), mat2Mul( B, D_C ) );
+    __m128 W = _mm_sub_ps( _mm_mul_ps( detA, D ), mat2Mul( C, A_B ) );
+    __m128 Y = _mm_sub_ps( _mm_mul_ps( detB, C ), mat2MulAdj( D, A_B ) );
+    __m128 Z = _mm_sub_ps( _mm_mul_ps( detC, B ), mat2MulAdj( A, D_C ) );
+
+    // |M| = |A||D| + |B||C| - tr( (A#B)(D#C) )
+    __m128 tr = _mm_mul_ps( A_B, ANGEL_SWIZZLE(D_C, 0,2,1,3) );
+    tr = _mm_add_ps( tr, _mm_movehl_ps( tr, tr ) );
+    tr = _mm_add_ps( ANGEL_SWIZZLE(tr, 0,0,0,0), ANGEL_SWIZZLE(tr, 1,1,1,1) );
+    __m128 detM = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( detA, detD ), _mm_mul_ps( detB, detC ) ), tr );
+
+    __m128 rDetM = _mm_div_ps( _mm_setr_ps( 1.0f, -1.0f, -1.0f, 1.0f ), detM );
+    X = _mm_mul_ps( X, rDetM );
+    Y = _mm_mul_ps( Y, rDetM );
+    Z = _mm_mul_ps( Z, rDetM );
+    W = _mm_mul_ps( W, rDetM );
+
+    // the adjugate of each block, put back in rows
+    return mat4( _mm_shuffle_ps( X, Y, _MM_SHUFFLE(1,3,1,3) ),
+		 _mm_shuffle_ps( X, Y, _MM_SHUFFLE(0,2,0,2) ),
+		 _mm_shuffle_ps( Z, W, _MM_SHUFFLE(1,3,1,3) ),
+		 _mm_shuffle_ps( Z, W, _MM_SHUFFLE(0,2,0,2) ) );
+#else
+    // cofactors from the 2x2 minors of the top and bottom row pairs
+    GLfloat s0 = M[0][0]*M[1][1] - M[1][0]*M[0][1];
+    GLfloat s1 = M[0][0]*M[1][2] - M[1][0]*M[0][2];
+    GLfloat s2 = M[0][0]*M[1][3] - M[1][0]*M[0][3];
+    GLfloat s3 = M[0][1]*M[1][2] - M[1][1]*M[0][2];
+    GLfloat s4 = M[0][1]*M[1][3] - M[1][1]*M[0][3];
+    GLfloat s5 = M[0][2]*M[1][3] - M[1][2]*M[0][3];
+    GLfloat c5 = M[2][2]*M[3][3] - M[3][2]*M[2][3];
+    GLfloat c4 = M[2][1]*M[3][3] - M[3][1]*M[2][3];
+    GLfloat c3 = M[2][1]*M[3][2] - M[3][1]*M[2][2];
+    GLfloat c2 = M[2][0]*M[3][3] - M[3][0]*M[2][3];
+    GLfloat c1 = M[2][0]*M[3][2] - M[3][0]*M[2][2];
+    GLfloat c0 = M[2][0]*M[3][1] - M[3][0]*M[2][1];
+    GLfloat r = GLfloat(1.0) / ( s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0 );
+
+    return mat4(
+	( M[1][1]*c5 - M[1][2]*c4 + M[1][3]*c3) * r, (-M[1][0]*c5 + M[1][2]*c2 - M[1][3]*c1) * r,
+	( M[1][0]*c4 - M[1][1]*c2 + M[1][3]*c0) * r, (-M[1][0]*c3 + M[1][1]*c1 - M[1][2]*c0) * r,
+	(-M[0][1]*c5 + M[0][2]*c4 - M[0][3]*c3) * r, ( M[0][0]*c5 - M[0][2]*c2 + M[0][3]*c1) * r,
+	(-M[0][0]*c4 + M[0][1]*c2 - M[0][3]*c0) * r, ( M[0][0]*c3 - M[0][1]*c1 + M[0][2]*c0) * r,
+	( M[3][1]*s5 - M[3][2]*s4 + M[3][3]*s3) * r, (-M[3][0]*s5 + M[3][2]*s2 - M[3][3]*s1) * r,
+	( M[3][0]*s4 - M[3][1]*s2 + M[3][3]*s0) * r, (-M[3][0]*s3 + M[3][1]*s1 - M[3][2]*s0) * r,
+	(-M[2][1]*s5 + M[2][2]*s4 - M[2][3]*s3) * r, ( M[2][0]*s5 - M[2][2]*s2 + M[2][3]*s1) * r,
+	(-M[2][0]*s4 + M[2][1]*s2 - M[2][3]*s0) * r, ( M[2][0]*s3 - M[2][1]*s1 + M[2][2]*s0) * r );
+#endif
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,346 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Math microbenchmark, run with "horse_glfw --bench math".
+// The Angel mat4/vec4 of include/ against the scalar Angel code they replaced
+// and against GLM, on the operations traverse() and the part functions use.
+// The results are first checked against the scalar code, and the benchmark
+// fails without timing anything when they differ. No window is opened.
+//----------------------------------------------------------------------------
+
+// the Angel mat4/vec4 as they were before the SIMD rewrite, for comparison
+namespace AngelScalar
+{
+struct vec4
+{
+    GLfloat x, y, z, w;
+
+    vec4(GLfloat s = GLfloat(0.0)) : x(s), y(s), z(s), w(s) {}
+    vec4(GLfloat x, GLfloat y, GLfloat z, GLfloat w) : x(x), y(y), z(z), w(w) {}
+    vec4(const vec4& v) { x = v.x;  y = v.y;  z = v.z;  w = v.w; }
+
+    GLfloat& operator[](int i) { return *(&x + i); }
+    const GLfloat operator[](int i) const { return *(&x + i); }
+};
+
+class mat4
+{
+    vec4 _m[4];
+
+public:
+    mat4(const GLfloat d = GLfloat(1.0)) { _m[0].x = d;  _m[1].y = d;  _m[2].z = d;  _m[3].w = d; }
+
+    mat4(const mat4& m)
+    {
+        if(*this != m)
+        {
+            _m[0] = m._m[0];
+            _m[1] = m._m[1];
+            _m[2] = m._m[2];
+            _m[3] = m._m[3];
+        }
+    }
+
+    vec4& operator[](int i) { return _m[i]; }
+    const vec4& operator[](int i) const { return _m[i]; }
+
+    mat4 operator*(const mat4& m) const
+    {
+        mat4 a(0.0);
+        for(int i=0; i<4; ++i)
+            for(int j=0; j<4; ++j)
+                for(int k=0; k<4; ++k)
+                    a[i][j] += _m[i][k] * m[k][j];
+        return a;
+    }
+
+    vec4 operator*(const vec4& v) const
+    {
+        return vec4(_m[0][0]*v.x + _m[0][1]*v.y + _m[0][2]*v.z + _m[0][3]*v.w,
+                    _m[1][0]*v.x + _m[1][1]*v.y + _m[1][2]*v.z + _m[1][3]*v.w,
+                    _m[2][0]*v.x + _m[2][1]*v.y + _m[2][2]*v.z + _m[2][3]*v.w,
+                    _m[3][0]*v.x + _m[3][1]*v.y + _m[3][2]*v.z + _m[3][3]*v.w);
+    }
+
+    operator const GLfloat*() const { return &_m[0].x; }
+    operator GLfloat*() { return &_m[0].x; }
+};
+}
+
+// mean nanoseconds per element of `work` over `count` elements
+template<typename Function>
+double timePerElement(int count, int iterations, Function work)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i=0; i<iterations; ++i)
+    {
+        work();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations / count;
+}
+
+float randomEntry()
+{
+    return (float)(rand() % 2000) / 100.0f - 10.0f;
+}
+
+// the same random matrix in all three layouts; GLM stores columns, Angel rows
+void randomMatrix(AngelScalar::mat4 &scalar, mat4 &angel, glm::mat4 &glmMatrix)
+{
+    for(int i=0; i<4; ++i)
+    {
+        for(int j=0; j<4; ++j)
+        {
+            float entry = randomEntry();
+            scalar[i][j] = angel[i][j] = glmMatrix[j][i] = entry;
+        }
+    }
+}
+
+// Gauss-Jordan elimination with partial pivoting in double, the reference for inverse();
+// false when the matrix is too close to singular for a float inverse to be compared with it
+bool referenceInverse(const AngelScalar::mat4 &m, double out[4][4])
+{
+    double a[4][8];
+    for(int i=0; i<4; ++i)
+    {
+        for(int j=0; j<4; ++j)
+        {
+            a[i][j] = m[i][j];
+            a[i][j + 4] = i == j ? 1.0 : 0.0;
+        }
+    }
+    for(int c=0; c<4; ++c)
+    {
+        int pivot = c;
+        for(int r=c+1; r<4; ++r)
+        {
+            if(fabs(a[r][c]) > fabs(a[pivot][c]))
+                pivot = r;
+        }
+        if(fabs(a[pivot][c]) < 1e-9)
+            return false;
+        for(int j=0; j<8; ++j)
+            std::swap(a[c][j], a[pivot][j]);
+        for(int r=0; r<4; ++r)
+        {
+            if(r == c)
+                continue;
+            double f = a[r][c] / a[c][c];
+            for(int j=0; j<8; ++j)
+                a[r][j] -= f * a[c][j];
+        }
+    }
+
+    double largestM = 0.0, largestInverse = 0.0;
+    for(int i=0; i<4; ++i)
+    {
+        for(int j=0; j<4; ++j)
+        {
+            out[i][j] = a[i][j + 4] / a[i][i];
+            largestM = std::max(largestM, fabs((double)m[i][j]));
+            largestInverse = std::max(largestInverse, fabs(out[i][j]));
+        }
+    }
+    return largestM * largestInverse < 1000.0; // a rough condition number
+}
+
+// largest absolute entry of a matrix in any of the layouts
+template<typename Matrix>
+double largestEntry(const Matrix &m)
+{
+    double largest = 0.0;
+    for(int i=0; i<4; ++i)
+        for(int j=0; j<4; ++j)
+            largest = std::max(largest, fabs((double)m[i][j]));
+    return largest;
+}
+
+// largest difference between an Angel matrix and a reference, entry by entry
+template<typename Reference>
+double largestDifference(const mat4 &angel, const Reference &reference)
+{
+    double largest = 0.0;
+    for(int i=0; i<4; ++i)
+        for(int j=0; j<4; ++j)
+            largest = std::max(largest, fabs((double)angel[i][j] - (double)reference[i][j]));
+    return largest;
+}
+
+// reports one result beyond its tolerance; returns 1 so the caller can count them
+int mismatch(const char *name, int i, double difference, double tolerance)
+{
+    fprintf(stderr, "%s: element %d differs from the scalar reference by %g (tolerance %g)\n", name, i, difference, tolerance);
+    return 1;
+}
+
+// the SIMD mat4 multiply, vec4 transform, transpose and inverse against the scalar code on `count`
+// random inputs, stopping at the first that differs; the tolerances allow for the float rounding of a
+// different order of operations only. Returns how many results of that input differ
+int checkMath(int count)
+{
+    int failures = 0;
+    int inverses = 0;
+    int checked = 0;
+    for(; checked<count && failures==0; ++checked)
+    {
+        AngelScalar::mat4 scalarA, scalarB;
+        mat4 angelA, angelB;
+        glm::mat4 glmA, glmB;
+        randomMatrix(scalarA, angelA, glmA);
+        randomMatrix(scalarB, angelB, glmB);
+        const double scale = largestEntry(scalarA) * largestEntry(scalarB);
+
+        double difference = largestDifference(angelA * angelB, scalarA * scalarB);
+        if(difference > 1e-5 * scale)
+            failures += mismatch("mat4 multiply", checked, difference, 1e-5 * scale);
+
+        float x = randomEntry(), y = randomEntry(), z = randomEntry();
+        AngelScalar::vec4 scalarMoved = scalarA * AngelScalar::vec4(x, y, z, 1.0f);
+        vec4 angelMoved = angelA * vec4(x, y, z, 1.0f);
+        difference = 0.0;
+        for(int k=0; k<4; ++k)
+            difference = std::max(difference, fabs((double)angelMoved[k] - (double)scalarMoved[k]));
+        if(difference > 1e-5 * largestEntry(scalarA) * 10.0)
+            failures += mismatch("vec4 transform", checked, difference, 1e-5 * largestEntry(scalarA) * 10.0);
+
+        // a transpose only moves entries, so it must be exact
+        AngelScalar::mat4 scalarTransposed;
+        for(int r=0; r<4; ++r)
+            for(int c=0; c<4; ++c)
+                scalarTransposed[r][c] = scalarA[c][r];
+        difference = largestDifference(transpose(angelA), scalarTransposed);
+        if(difference != 0.0)
+            failures += mismatch("mat4 transpose", checked, difference, 0.0);
+
+        double reference[4][4];
+        if(referenceInverse(scalarA, reference))
+        {
+            // the error of a float inverse grows with |M| |M^-1|^2
+            const double tolerance = 1e-4 * largestEntry(scalarA) * largestEntry(reference) * largestEntry(reference);
+            difference = largestDifference(inverse(angelA), reference);
+            if(difference > tolerance)
+                failures += mismatch("mat4 inverse", checked, difference, tolerance);
+            ++inverses;
+        }
+    }
+    printf("%d matrices (%d inverses) checked against the scalar reference: %s\n",
+           checked, inverses, failures == 0 ? "all match" : "MISMATCH");
+    return failures;
+}
+
+void printLine(const char *name, int count, double scalar, double angel, double glmTime)
+{
+    printf("%-18s %8d  scalar %7.2f ns  angel %7.2f ns  glm %7.2f ns  x%.1f over scalar\n",
+           name, count, scalar, angel, glmTime, scalar / angel);
+}
+
+// -1 when the SIMD results do not match the scalar code
+int benchmarkMath()
+{
+    if(checkMath(10000) != 0)
+    {
+        return -1;
+    }
+
+    const int count = 100000;
+    const int iterations = 20;
+    const int vertices = 10000; // in cache, so the arithmetic is timed rather than memory
+
+    std::vector<AngelScalar::mat4> scalarA(count), scalarB(count), scalarOut(count);
+    std::vector<mat4> angelA(count), angelB(count), angelOut(count);
+    std::vector<glm::mat4> glmA(count), glmB(count), glmOut(count);
+    for(int i=0; i<count; ++i)
+    {
+        randomMatrix(scalarA[i], angelA[i], glmA[i]);
+        randomMatrix(scalarB[i], angelB[i], glmB[i]);
+    }
+    volatile float sink = 0.0f;
+
+    // out = a * b
+    double scalar = timePerElement(count, iterations, [&]() { for(int i=0; i<count; ++i) scalarOut[i] = scalarA[i] * scalarB[i]; });
+    double angel = timePerElement(count, iterations, [&]() { for(int i=0; i<count; ++i) angelOut[i] = angelA[i] * angelB[i]; });
+    double glmTime = timePerElement(count, iterations, [&]() { for(int i=0; i<count; ++i) glmOut[i] = glmA[i] * glmB[i]; });
+    sink = sink + scalarOut[count - 1][0][0] + angelOut[count - 1][0][0] + glmOut[count - 1][0][0];
+    printLine("mat4 multiply", count, scalar, angel, glmTime);
+
+    // model_view * instance * parent, the shape of the part functions: temporaries and copies
+    double scalarChain = timePerElement(count, iterations, [&]()
+    {
+        for(int i=0; i<count; ++i)
+        {
+            AngelScalar::mat4 modelView = scalarA[i];
+            AngelScalar::mat4 instance = scalarB[i] * scalarA[count - 1 - i];
+            scalarOut[i] = modelView * instance;
+        }
+    });
+    double angelChain = timePerElement(count, iterations, [&]()
+    {
+        for(int i=0; i<count; ++i)
+        {
+            mat4 modelView = angelA[i];
+            mat4 instance = angelB[i] * angelA[count - 1 - i];
+            angelOut[i] = modelView * instance;
+        }
+    });
+    double glmChain = timePerElement(count, iterations, [&]()
+    {
+        for(int i=0; i<count; ++i)
+        {
+            glm::mat4 modelView = glmA[i];
+            glm::mat4 instance = glmB[i] * glmA[count - 1 - i];
+            glmOut[i] = modelView * instance;
+        }
+    });
+    sink = sink + scalarOut[0][0][0] + angelOut[0][0][0] + glmOut[0][0][0];
+    printLine("mat4 compose", count, scalarChain, angelChain, glmChain);
+
+    // one matrix over a vertex buffer, many times
+    std::vector<AngelScalar::vec4> scalarPoints(vertices), scalarMoved(vertices);
+    std::vector<vec4> angelPoints(vertices), angelMoved(vertices);
+    std::vector<glm::vec4> glmPoints(vertices), glmMoved(vertices);
+    for(int i=0; i<vertices; ++i)
+    {
+        float x = randomEntry(), y = randomEntry(), z = randomEntry();
+        scalarPoints[i] = AngelScalar::vec4(x, y, z, 1.0f);
+        angelPoints[i] = vec4(x, y, z, 1.0f);
+        glmPoints[i] = glm::vec4(x, y, z, 1.0f);
+    }
+    const AngelScalar::mat4 scalarM = scalarA[0];
+    const mat4 angelM = angelA[0];
+    const glm::mat4 glmM = glmA[0];
+    scalar = timePerElement(vertices, iterations * 100, [&]() { for(int i=0; i<vertices; ++i) scalarMoved[i] = scalarM * scalarPoints[i]; });
+    angel = timePerElement(vertices, iterations * 100, [&]() { for(int i=0; i<vertices; ++i) angelMoved[i] = angelM * angelPoints[i]; });
+    glmTime = timePerElement(vertices, iterations * 100, [&]() { for(int i=0; i<vertices; ++i) glmMoved[i] = glmM * glmPoints[i]; });
+    sink = sink + scalarMoved[vertices - 1].x + angelMoved[vertices - 1].x + glmMoved[vertices - 1].x;
+    printLine("vec4 transform", vertices, scalar, angel, glmTime);
+
+    // transpose and inverse had no working scalar version to compare with
+    angel = timePerElement(count, iterations, [&]() { for(int i=0; i<count; ++i) angelOut[i] = transpose(angelA[i]); });
+    glmTime = timePerElement(count, iterations, [&]() { for(int i=0; i<count; ++i) glmOut[i] = glm::transpose(glmA[i]); });
+    sink = sink + angelOut[count - 1][0][1] + glmOut[count - 1][0][1];
+    printf("%-18s %8d  angel %7.2f ns  glm %7.2f ns\n", "mat4 transpose", count, angel, glmTime);
+
+    angel = timePerElement(count, iterations, [&]() { for(int i=0; i<count; ++i) angelOut[i] = inverse(angelA[i]); });
+    glmTime = timePerElement(count, iterations, [&]() { for(int i=0; i<count; ++i) glmOut[i] = glm::inverse(glmA[i]); });
+    sink = sink + angelOut[count - 1][0][1] + glmOut[count - 1][0][1];
+    printf("%-18s %8d  angel %7.2f ns  glm %7.2f ns\n", "mat4 inverse", count, angel, glmTime);
+    return 0;
+}
+
+// 0 on success, -1 for an unknown benchmark or a failed check
+int runBenchmark(const char *name)
+{
+    if(strcmp(name, "math") == 0)
+    {
+        return benchmarkMath();
+    }
+    fprintf(stderr, "unknown benchmark %s (math)\n", name);
+    return -1;
+}
@@ -1,5 +1,6 @@
 
 #include "Angel.h"
+#include "program_cache.h"
 
 namespace Angel {
 
@@ -38,8 +39,7 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 	{ fShaderFile, GL_FRAGMENT_SHADER, NULL }
     };
 
-    GLuint program = glCreateProgram();
-    
+    const char* sources[2];
     for ( int i = 0; i < 2; ++i ) {
 	Shader& s = shaders[i];
 	s.source = readShaderSource( s.filename );
@@ -47,7 +47,23 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 	    std::cerr << "Failed to read " << s.filename << std::endl;
 	    exit( EXIT_FAILURE );
 	}
+	sources[i] = s.source;
+    }
+
+    /* the same sources linked on an earlier run on this driver */
+    std::string key = programCache().key( sources, 2 );
+    GLuint program = programCache().load( key );
+    if ( program != 0 ) {
+	for ( int i = 0; i < 2; ++i )
+	    delete [] shaders[i].source;
+	glUseProgram( program );
+	return program;
+    }
+
+    program = glCreateProgram();
 
+    for ( int i = 0; i < 2; ++i ) {
+	Shader& s = shaders[i];
 	GLuint shader = glCreateShader( s.type );
 	glShaderSource( shader, 1, (const GLchar**) &s.source, NULL );
 	glCompileShader( shader );
@@ -72,6 +88,7 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
     }
 
     /* link  and error check */
+    programCache().retrievable( program );
     glLinkProgram(program);
 
     GLint  linked;
@@ -88,6 +105,8 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 	exit( EXIT_FAILURE );
     }
 
+    programCache().store( key, program );
+
     /* use program object */
     glUseProgram(program);
 
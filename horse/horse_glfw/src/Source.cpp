@@ -7,10 +7,12 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Angel.h"
+#include "profiler.h"
 #include <assert.h>
 #include "MatrixStack.h"
 #include "Node.h"
 #include "Horse.h"
+#include "Benchmark.h"
 
 typedef Angel::vec4 point4;
 typedef Angel::vec4 color4;
@@ -54,8 +56,8 @@ enum
     Quit
 };
 
-MatrixStack  mvstack;
-mat4         base_model;
+const int    MVSTACK_DEPTH = 32;
+MatrixStack<MVSTACK_DEPTH> mvstack; // the top is the current model matrix
 GLuint       shader_model;
 
 // Joint angles with initial values
@@ -145,17 +147,15 @@ void traverse(Node* node)
         return;
     }
 
-    mvstack.push(base_model);
-
-    base_model *= node->transform;
-    node->render();
-
-    if (node->child)
     {
-        traverse(node->child);
-    }
+        MatrixStack<MVSTACK_DEPTH>::Scope scope(mvstack, node->transform);
+        node->render();
 
-    base_model = mvstack.pop();
+        if (node->child)
+        {
+            traverse(node->child);
+        }
+    }
 
     if (node->sibling)
     {
@@ -167,137 +167,93 @@ void traverse(Node* node)
 
 void torso()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * TORSO_HEIGHT, 0.0) * Scale(TORSO_WIDTH, TORSO_HEIGHT, TORSO_DEPTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void neck()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * NECK_HEIGHT, 0.0) * Scale(NECK_WIDTH, NECK_HEIGHT, NECK_DEPTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void head()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * HEAD_HEIGHT, 0.0) * Scale(HEAD_WIDTH, HEAD_HEIGHT, HEAD_DEPTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void left_upper_arm()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * UPPER_ARM_HEIGHT, 0.0) * Scale(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void left_lower_arm()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * LOWER_ARM_HEIGHT, 0.0) * Scale(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void right_upper_arm()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * UPPER_ARM_HEIGHT, 0.0) * Scale(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void right_lower_arm()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * LOWER_ARM_HEIGHT, 0.0) * Scale(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void left_upper_leg()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * UPPER_LEG_HEIGHT, 0.0) * Scale(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH));
 
     glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(0.65f, 0.65f, 0.65f));
     glm::mat4 translate = glm::translate(glm::mat4(0.1f), glm::vec3(0, -1, 0));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void left_lower_leg()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * LOWER_LEG_HEIGHT, 0.0) * Scale(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void right_upper_leg()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * UPPER_LEG_HEIGHT, 0.0) * Scale(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void right_lower_leg()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (Translate(0.0, 0.5 * LOWER_LEG_HEIGHT, 0.0) * Scale(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH));
 
-    glUniformMatrix4fv(shader_model, 1, GL_TRUE, base_model * instance);
+    glUniformMatrix4fv(shader_model, 1, GL_TRUE, mvstack.top() * instance);
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 
@@ -387,8 +343,16 @@ int init_window(int width, int height, const std::string title)
 
     return 0;
 }
-int main()
+int main(int argc, char *argv[])
 {
+    // "--profile [trace.json]" times the frames
+    const char *trace = profileArguments(argc, argv);
+
+    // "--bench <name>" runs a benchmark instead
+    if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return runBenchmark(argv[2]);
+    }
 
     if (init_window(WIDTH, HEIGHT, TITLE) != 0)
     {
@@ -449,16 +413,26 @@ int main()
 
     while (!glfwWindowShouldClose(window))
     {
+        profiler().frame();
+        PROFILE_GPU_ZONE("frame");
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        traverse(&nodes[Torso]);
+        {
+            PROFILE_GPU_ZONE("traverse");
+            traverse(&nodes[Torso]);
+        }
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        {
+            PROFILE_ZONE("swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
+    profileReport(trace);
 
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
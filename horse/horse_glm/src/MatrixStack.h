@@ -1,30 +1,114 @@
+#include <stdio.h>
+
+// Fixed-capacity stack of model matrices stored inline, so traversing the
+// hierarchy never touches the heap. The top is the current matrix, identity
+// at the start: push() saves it, multiply() composes a child transform onto it
+// in place and pop() restores the saved one. Overflow and underflow are
+// reported and refused in every build, not only where assert() is compiled in.
+template<int N, typename Matrix = glm::mat4>
 class MatrixStack
 {
-    int    _index;
-    int    _size;
-    glm::mat4*  _matrices;
+    int _index;
+    int _errors;
+    alignas(16) Matrix _matrices[N];
+
+    void error(const char* what)
+    {
+        if (_errors++ == 0)
+        {
+            fprintf(stderr, "MatrixStack<%d>: %s\n", N, what);
+        }
+    }
 
 public:
-    MatrixStack(int numMatrices = 32) :_index(0), _size(numMatrices)
+    MatrixStack() : _index(0), _errors(0)
     {
-        _matrices = new glm::mat4[numMatrices];
+        _matrices[0] = Matrix(1.0f);
     }
 
-    ~MatrixStack()
+    const Matrix& top() const
     {
-        delete[]_matrices;
+        return _matrices[_index];
     }
 
-    void push(const glm::mat4& m)
+    void load(const Matrix& m)
     {
-        assert(_index + 1 < _size);
-        _matrices[_index++] = m;
+        _matrices[_index] = m;
     }
 
-    glm::mat4& pop(void)
+    // top = top * m
+    void multiply(const Matrix& m)
     {
-        assert(_index - 1 >= 0);
-        _index--;
-        return _matrices[_index];
+        _matrices[_index] *= m;
+    }
+
+    // saves the top; false, with nothing pushed, when the stack is full
+    bool push()
+    {
+        if (_index + 1 >= N)
+        {
+            error("push past the capacity");
+            return false;
+        }
+        _matrices[_index + 1] = _matrices[_index];
+        _index++;
+        return true;
+    }
+
+    // push() and multiply(m) in one write, without copying the top first
+    bool push(const Matrix& m)
+    {
+        if (_index + 1 >= N)
+        {
+            error("push past the capacity");
+            return false;
+        }
+        _matrices[_index + 1] = _matrices[_index] * m;
+        _index++;
+        return true;
+    }
+
+    // drops the top and returns it; the bottom matrix is never popped
+    Matrix pop()
+    {
+        if (_index == 0)
+        {
+            error("pop of an empty stack");
+            return _matrices[0];
+        }
+        return _matrices[_index--];
     }
+
+    int depth() const
+    {
+        return _index;
+    }
+
+    // overflows and underflows so far, only the first is printed
+    int errors() const
+    {
+        return _errors;
+    }
+
+    // pushes on construction and pops at the end of the scope
+    class Scope
+    {
+        MatrixStack& _stack;
+        bool _pushed;
+
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+
+    public:
+        explicit Scope(MatrixStack& stack) : _stack(stack), _pushed(stack.push()) {}
+        Scope(MatrixStack& stack, const Matrix& m) : _stack(stack), _pushed(stack.push(m)) {}
+
+        ~Scope()
+        {
+            if (_pushed)
+            {
+                _stack.pop();
+            }
+        }
+    };
 };
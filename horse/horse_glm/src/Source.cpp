@@ -12,6 +12,8 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "profiler.h"
+#include "program_cache.h"
 #include <assert.h>
 #include "MatrixStack.h"
 #include "Node.h"
@@ -29,14 +31,7 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 	// Create the shaders
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_shader_path, std::ios::in);
-
-	if (VertexShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	} else {
+	if (!readShaderFile(vertex_shader_path, VertexShaderCode)) {
 		printf("Impossible to open %s. Are you in the right directory ?\n", vertex_shader_path.c_str());
 		getchar();
 		exit(-1);
@@ -44,19 +39,20 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_shader_path, std::ios::in);
-
-	if (FragmentShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	} else {
+	if (!readShaderFile(fragment_shader_path, FragmentShaderCode)) {
 		printf("Impossible to open %s. Are you in the right directory?\n", fragment_shader_path.c_str());
 		getchar();
 		exit(-1);
 	}
 
+	// The same sources linked on an earlier run on this driver
+	const char *sources[2] = { VertexShaderCode.c_str(), FragmentShaderCode.c_str() };
+	std::string key = programCache().key(sources, 2);
+	GLuint cached = programCache().load(key);
+	if (cached != 0) {
+		return cached;
+	}
+
 	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
 	char const * VertexSourcePointer = VertexShaderCode.c_str();
 	glShaderSource(vertexShader, 1, &VertexSourcePointer, NULL);
@@ -84,6 +80,7 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 	GLuint shaderProgram = glCreateProgram();
 	glAttachShader(shaderProgram, vertexShader);
 	glAttachShader(shaderProgram, fragmentShader);
+	programCache().retrievable(shaderProgram);
 	glLinkProgram(shaderProgram);
 	// Check for linking errors
 	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
@@ -94,6 +91,7 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 	glDeleteShader(vertexShader); //free up memory
 	glDeleteShader(fragmentShader);
 
+	programCache().store(key, shaderProgram);
 	return shaderProgram;
 }
 
@@ -133,8 +131,8 @@ enum
     Quit
 };
 
-MatrixStack  mvstack;
-mat4         base_model;
+const int    MVSTACK_DEPTH = 32;
+MatrixStack<MVSTACK_DEPTH> mvstack; // the top is the current model matrix
 GLuint       shader_model;
 
 // Joint angles with initial values
@@ -224,17 +222,15 @@ void traverse(Node* node)
         return;
     }
 
-    mvstack.push(base_model);
-
-    base_model *= node->transform;
-    node->render();
-
-    if (node->child)
     {
-        traverse(node->child);
-    }
+        MatrixStack<MVSTACK_DEPTH>::Scope scope(mvstack, node->transform);
+        node->render();
 
-    base_model = mvstack.pop();
+        if (node->child)
+        {
+            traverse(node->child);
+        }
+    }
 
     if (node->sibling)
     {
@@ -246,131 +242,89 @@ void traverse(Node* node)
 
 void torso()
 {
-    mvstack.push(base_model);
     glm::mat4 translate = glm::translate(glm::mat4(0.1f), vec3(0.0f, 0.5f * TORSO_HEIGHT, 0.0f));
     glm::mat4 scale = glm::scale(glm::mat4(0.1f), vec3(TORSO_WIDTH, TORSO_HEIGHT, TORSO_DEPTH));
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * translate * scale));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * translate * scale));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void neck()
 {
-    mvstack.push(base_model);
     glm::mat4 translate = glm::translate(glm::mat4(0.1f), vec3(0.0, 0.5 * NECK_HEIGHT, 0.0));
     glm::mat4 scale = glm::scale(glm::mat4(0.1f), vec3(NECK_WIDTH, NECK_HEIGHT, NECK_DEPTH));
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * translate * scale));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * translate * scale));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void head()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * HEAD_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(HEAD_WIDTH, HEAD_HEIGHT, HEAD_DEPTH)));
 
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void left_upper_arm()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * UPPER_ARM_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH)));
 
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void left_lower_arm()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * LOWER_ARM_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH)));
 
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void right_upper_arm()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * UPPER_ARM_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH)));
 
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void right_lower_arm()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * LOWER_ARM_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH)));
 
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void left_upper_leg()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * UPPER_LEG_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH)));
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void left_lower_leg()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * LOWER_LEG_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH)));
 
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void right_upper_leg()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * UPPER_LEG_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH)));
 
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 void right_lower_leg()
 {
-    mvstack.push(base_model);
-
     mat4 instance = (translate(mat4(1.0), vec3(0.0, 0.5 * LOWER_LEG_HEIGHT, 0.0)) * scale(mat4(1.0), vec3(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH)));
 
-    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(base_model * instance));
+    glUniformMatrix4fv(shader_model, 1, GL_FALSE, value_ptr(mvstack.top() * instance));
     glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-    base_model = mvstack.pop();
 }
 
 
@@ -470,8 +424,10 @@ int init_window(int width, int height, const std::string title)
 
     return 0;
 }
-int main()
+int main(int argc, char *argv[])
 {
+    // "--profile [trace.json]" times the frames
+    const char *trace = profileArguments(argc, argv);
 
     if (init_window(WIDTH, HEIGHT, TITLE) != 0)
     {
@@ -527,22 +483,32 @@ int main()
     GLuint Shader_Projection = glGetUniformLocation(program, "Shader_Projection");
     glUniformMatrix4fv(Shader_Projection, 1, GL_FALSE, glm::value_ptr(Projection));
 
-    base_model *= (&nodes[Torso])->transform;
+    mvstack.multiply((&nodes[Torso])->transform);
 
     while (!glfwWindowShouldClose(window))
     {
+        profiler().frame();
+        PROFILE_GPU_ZONE("frame");
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        traverse(&nodes[Torso]);
-       // base_model *= (&nodes[Torso])->transform;
+        {
+            PROFILE_GPU_ZONE("traverse");
+            traverse(&nodes[Torso]);
+        }
+       // mvstack.multiply((&nodes[Torso])->transform);
         //(&nodes[Torso])->render();
        //(&nodes[Neck])->render();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        {
+            PROFILE_ZONE("swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
+    profileReport(trace);
 
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
@@ -0,0 +1,407 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Scoped frame profiling. PROFILE_ZONE("name") times the enclosing scope on
+// the CPU with steady_clock; PROFILE_GPU_ZONE("name") also brackets it with
+// two GL_TIMESTAMP queries, so GPU zones may nest (GL_TIME_ELAPSED cannot).
+// frame(), called once per frame on the GL thread, collects only the queries
+// the GPU reports available, so reading them back never stalls the pipeline.
+// Every zone goes into a rolling window per name, which summary() prints as
+// percentiles, and, while tracing, into a Chrome trace-event file that
+// chrome://tracing or Perfetto opens. GPU zones are only legal on the thread
+// owning the GL context. Define PROFILER_DISABLED to compile the zones out.
+
+const int PROFILER_WINDOW = 240;       // samples kept per zone for the percentiles
+const size_t PROFILER_EVENTS = 1 << 20; // trace events kept before new ones are dropped
+
+class Profiler
+{
+public:
+    bool enabled; // zones are skipped while false
+    bool tracing; // zones are also kept for writeTrace()
+
+    Profiler() :
+        enabled(false), tracing(false), dropped(0), gpuChecked(false), gpuSupported(false), gpuOffset(0.0),
+        origin(std::chrono::steady_clock::now()) {}
+
+    // microseconds since the profiler was created
+    double now() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    // a GL_TIMESTAMP query issued now, 0 when the context has no timer queries
+    GLuint timestamp()
+    {
+        if(!gpuChecked)
+        {
+            gpuChecked = true;
+#ifdef __GLEW_H__
+            gpuSupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+#else
+            gpuSupported = true;
+#endif
+            calibrate();
+        }
+        if(!gpuSupported)
+        {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(queries.empty())
+        {
+            queries.resize(32);
+            glGenQueries((GLsizei)queries.size(), &queries[0]);
+        }
+        GLuint query = queries.back();
+        queries.pop_back();
+        glQueryCounter(query, GL_TIMESTAMP);
+        return query;
+    }
+
+    void cpuZone(const char *name, double start, double end)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int thread = threadIndex();
+        samplesOf(name).add(false, (float)((end - start) / 1000.0));
+        trace(name, thread, start, end - start);
+    }
+
+    // the pair of queries resolves in some later frame()
+    void gpuZone(const char *name, GLuint begin, GLuint end)
+    {
+        if(begin == 0 || end == 0)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        PendingZone zone = { name, begin, end };
+        pending.push_back(zone);
+    }
+
+    // collects the GPU zones whose queries have landed; call once per frame
+    void frame()
+    {
+        resolve(false);
+    }
+
+    // waits for every GPU zone still in flight, before a summary or a trace at exit
+    void finish()
+    {
+        resolve(true);
+    }
+
+    // median, 95th and 99th percentile and worst of the last PROFILER_WINDOW samples per zone, in ms
+    void summary(FILE *out = stdout)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fprintf(out, "%-24s%7s%7s%7s%7s  %7s%7s%7s%7s\n", "zone (ms)", "cpu p50", "p95", "p99", "max", "gpu p50", "p95", "p99", "max");
+        for(size_t i=0; i<zones.size(); ++i)
+        {
+            fprintf(out, "%-24s", zones[i].name.c_str());
+            printPercentiles(out, zones[i].cpu);
+            fprintf(out, "  ");
+            printPercentiles(out, zones[i].gpu);
+            fprintf(out, "\n");
+        }
+        if(dropped > 0)
+        {
+            fprintf(out, "%zu trace events dropped past %zu\n", dropped, PROFILER_EVENTS);
+        }
+    }
+
+    // the trace-event JSON of everything recorded while tracing; false when the file cannot be written
+    bool writeTrace(const char *path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        FILE *file = fopen(path, "w");
+        if(file == NULL)
+        {
+            return false;
+        }
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+        for(size_t i=0; i<threads.size(); ++i)
+        {
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                    (int)i + 1, i == 0 ? "main" : "worker", (int)i);
+        }
+        for(size_t i=0; i<events.size(); ++i)
+        {
+            const Event &e = events[i];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    escaped(e.name).c_str(), e.thread == 0 ? "gpu" : "cpu", e.thread, e.start, e.duration);
+        }
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+
+private:
+    // the last PROFILER_WINDOW durations of one zone, in ms
+    struct Samples
+    {
+        std::string name;
+        std::vector<float> cpu, gpu;
+        int nextCpu, nextGpu;
+
+        Samples(const char *name) :
+            name(name), nextCpu(0), nextGpu(0) {}
+
+        void add(bool onGpu, float ms)
+        {
+            std::vector<float> &window = onGpu ? gpu : cpu;
+            int &next = onGpu ? nextGpu : nextCpu;
+            if((int)window.size() < PROFILER_WINDOW)
+            {
+                window.push_back(ms);
+            }
+            else
+            {
+                window[next] = ms;
+            }
+            next = (next + 1) % PROFILER_WINDOW;
+        }
+    };
+
+    struct Event
+    {
+        const char *name;
+        int thread;      // 0 is the GPU, 1 the first thread that recorded a zone
+        double start;    // us on the CPU clock
+        double duration; // us
+    };
+
+    struct PendingZone
+    {
+        const char *name;
+        GLuint begin, end;
+    };
+
+    std::mutex mutex;
+    std::vector<Samples> zones;       // in the order they were first seen
+    std::map<std::string, int> index; // zone name to zones[]
+    std::vector<Event> events;
+    size_t dropped;
+    std::vector<std::thread::id> threads;
+
+    std::vector<GLuint> queries; // free timestamp queries
+    std::vector<PendingZone> pending;
+    bool gpuChecked, gpuSupported;
+    double gpuOffset; // CPU us minus GPU us, to put both on one timeline
+
+    std::chrono::steady_clock::time_point origin;
+
+    // the GPU clock paired with the CPU clock once, at the first GPU zone
+    void calibrate()
+    {
+        if(!gpuSupported)
+        {
+            return;
+        }
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuOffset = now() - gpuNow / 1000.0;
+    }
+
+    void resolve(bool wait)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t kept = 0;
+        for(size_t i=0; i<pending.size(); ++i)
+        {
+            PendingZone zone = pending[i];
+            GLint available = 1;
+            if(!wait)
+            {
+                glGetQueryObjectiv(zone.end, GL_QUERY_RESULT_AVAILABLE, &available);
+            }
+            if(!available)
+            {
+                pending[kept++] = zone;
+                continue;
+            }
+
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(zone.begin, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(zone.end, GL_QUERY_RESULT, &end);
+            queries.push_back(zone.begin);
+            queries.push_back(zone.end);
+
+            double duration = (end - begin) / 1000.0;
+            samplesOf(zone.name).add(true, (float)(duration / 1000.0));
+            trace(zone.name, 0, begin / 1000.0 + gpuOffset, duration);
+        }
+        pending.resize(kept);
+    }
+
+    Samples &samplesOf(const char *name)
+    {
+        std::map<std::string, int>::iterator it = index.find(name);
+        if(it != index.end())
+        {
+            return zones[it->second];
+        }
+        index[name] = (int)zones.size();
+        zones.push_back(Samples(name));
+        return zones.back();
+    }
+
+    // trace track of the calling thread, from 1
+    int threadIndex()
+    {
+        std::thread::id id = std::this_thread::get_id();
+        for(size_t i=0; i<threads.size(); ++i)
+        {
+            if(threads[i] == id)
+            {
+                return (int)i + 1;
+            }
+        }
+        threads.push_back(id);
+        return (int)threads.size();
+    }
+
+    void trace(const char *name, int thread, double start, double duration)
+    {
+        if(!tracing)
+        {
+            return;
+        }
+        if(events.size() >= PROFILER_EVENTS)
+        {
+            ++dropped;
+            return;
+        }
+        Event e = { name, thread, start, duration };
+        events.push_back(e);
+    }
+
+    static void printPercentiles(FILE *out, std::vector<float> samples)
+    {
+        if(samples.empty())
+        {
+            fprintf(out, "%28s", "-");
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        const int n = (int)samples.size();
+        fprintf(out, "%7.3f%7.3f%7.3f%7.3f", samples[n / 2], samples[std::min(n - 1, n * 95 / 100)],
+                samples[std::min(n - 1, n * 99 / 100)], samples[n - 1]);
+    }
+
+    static std::string escaped(const char *name)
+    {
+        std::string out;
+        for(const char *c = name; *c; ++c)
+        {
+            if(*c == '"' || *c == '\\')
+            {
+                out += '\\';
+            }
+            out += *c;
+        }
+        return out;
+    }
+};
+
+// the process-wide profiler the zone macros record into
+inline Profiler &profiler()
+{
+    static Profiler instance;
+    return instance;
+}
+
+// "--profile [trace.json]" among the program arguments turns the profiler on;
+// returns the trace file when one was named
+inline const char *profileArguments(int argc, char *argv[])
+{
+    for(int i=1; i<argc; ++i)
+    {
+        if(strcmp(argv[i], "--profile") == 0)
+        {
+            profiler().enabled = true;
+            if(i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+            {
+                profiler().tracing = true;
+                return argv[i + 1];
+            }
+        }
+    }
+    return NULL;
+}
+
+// the percentiles, and the trace when a file is given; the GL context must still be current
+inline void profileReport(const char *trace)
+{
+    if(!profiler().enabled)
+    {
+        return;
+    }
+    profiler().finish();
+    profiler().summary();
+    if(trace != NULL && !profiler().writeTrace(trace))
+    {
+        fprintf(stderr, "Failed to write %s\n", trace);
+    }
+}
+
+// times its own lifetime; use it through the macros below
+class ProfileZone
+{
+public:
+    ProfileZone(const char *name, bool gpu) :
+        name(name), active(profiler().enabled), begin(0), start(0.0)
+    {
+        if(active)
+        {
+            begin = gpu ? profiler().timestamp() : 0;
+            start = profiler().now();
+        }
+    }
+
+    ~ProfileZone()
+    {
+        if(!active)
+        {
+            return;
+        }
+        profiler().cpuZone(name, start, profiler().now());
+        if(begin != 0)
+        {
+            profiler().gpuZone(name, begin, profiler().timestamp());
+        }
+    }
+
+private:
+    const char *name;
+    bool active;
+    GLuint begin;
+    double start;
+
+    ProfileZone(const ProfileZone &);
+    ProfileZone &operator=(const ProfileZone &);
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#ifdef PROFILER_DISABLED
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#else
+#define PROFILE_ZONE(name) ProfileZone PROFILE_JOIN(profileZone, __LINE__)(name, false)
+#define PROFILE_GPU_ZONE(name) ProfileZone PROFILE_JOIN(profileZone, __LINE__)(name, true)
+#endif
+
+#endif // PROFILER_H
@@ -9,6 +9,17 @@
 
 #include "Angel.h"
 
+//  vec4 and mat4 use SSE where the target has it (every x86-64 does), and
+//  mat4 products AVX as well when built with -mavx; define ANGEL_NO_SIMD
+//  to force the plain loops.
+#if !defined(ANGEL_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#  define ANGEL_SIMD
+#  include <emmintrin.h>
+#  ifdef __AVX__
+#    include <immintrin.h>
+#  endif
+#endif
+
 namespace Angel {
 
 //////////////////////////////////////////////////////////////////////////////
@@ -31,9 +42,6 @@ struct vec2 {
     vec2( GLfloat x, GLfloat y ) :
 	x(x), y(y) {}
 
-    vec2( const vec2& v )
-	{ x = v.x;  y = v.y;  }
-
     //
     //  --- Indexing Operator ---
     //
@@ -170,8 +178,6 @@ struct vec3 {
     vec3( GLfloat x, GLfloat y, GLfloat z ) :
 	x(x), y(y), z(z) {}
 
-    vec3( const vec3& v ) { x = v.x;  y = v.y;  z = v.z; }
-
     vec3( const vec2& v, const float f ) { x = v.x;  y = v.y;  z = f; }
 
     //
@@ -299,11 +305,11 @@ vec3 cross(const vec3& a, const vec3& b )
 
 //////////////////////////////////////////////////////////////////////////////
 //
-//  vec4 - 4D vector
+//  vec4 - 4D vector, 16-byte aligned so it loads as one SSE register
 //
 //////////////////////////////////////////////////////////////////////////////
 
-struct vec4 {
+struct alignas(16) vec4 {
 
     GLfloat  x;
     GLfloat  y;
@@ -320,7 +326,11 @@ struct vec4 {
     vec4( GLfloat x, GLfloat y, GLfloat z, GLfloat w ) :
 	x(x), y(y), z(z), w(w) {}
 
-    vec4( const vec4& v ) { x = v.x;  y = v.y;  z = v.z;  w = v.w; }
+#ifdef ANGEL_SIMD
+    vec4( __m128 v ) { _mm_store_ps( &x, v ); }
+
+    __m128 simd() const { return _mm_load_ps( &x ); }
+#endif
 
     vec4( const vec3& v, const float w = 1.0 ) : w(w)
 	{ x = v.x;  y = v.y;  z = v.z; }
@@ -339,6 +349,22 @@ struct vec4 {
     //  --- (non-modifying) Arithematic Operators ---
     //
 
+#ifdef ANGEL_SIMD
+    vec4 operator - () const  // unary minus operator
+	{ return vec4( _mm_sub_ps( _mm_setzero_ps(), simd() ) ); }
+
+    vec4 operator + ( const vec4& v ) const
+	{ return vec4( _mm_add_ps( simd(), v.simd() ) ); }
+
+    vec4 operator - ( const vec4& v ) const
+	{ return vec4( _mm_sub_ps( simd(), v.simd() ) ); }
+
+    vec4 operator * ( const GLfloat s ) const
+	{ return vec4( _mm_mul_ps( simd(), _mm_set1_ps( s ) ) ); }
+
+    vec4 operator * ( const vec4& v ) const
+	{ return vec4( _mm_mul_ps( simd(), v.simd() ) ); }
+#else
     vec4 operator - () const  // unary minus operator
 	{ return vec4( -x, -y, -z, -w ); }
 
@@ -352,7 +378,8 @@ struct vec4 {
 	{ return vec4( s*x, s*y, s*z, s*w ); }
 
     vec4 operator * ( const vec4& v ) const
-	{ return vec4( x*v.x, y*v.y, z*v.z, w*v.z ); }
+	{ return vec4( x*v.x, y*v.y, z*v.z, w*v.w ); }
+#endif
 
     friend vec4 operator * ( const GLfloat s, const vec4& v )
 	{ return v * s; }
@@ -375,16 +402,16 @@ struct vec4 {
     //
 
     vec4& operator += ( const vec4& v )
-	{ x += v.x;  y += v.y;  z += v.z;  w += v.w;  return *this; }
+	{ return *this = *this + v; }
 
     vec4& operator -= ( const vec4& v )
-	{ x -= v.x;  y -= v.y;  z -= v.z;  w -= v.w;  return *this; }
+	{ return *this = *this - v; }
 
     vec4& operator *= ( const GLfloat s )
-	{ x *= s;  y *= s;  z *= s;  w *= s;  return *this; }
+	{ return *this = *this * s; }
 
     vec4& operator *= ( const vec4& v )
-	{ x *= v.x, y *= v.y, z *= v.z, w *= v.w;  return *this; }
+	{ return *this = *this * v; }
 
     vec4& operator /= ( const GLfloat s ) {
 #ifdef DEBUG
@@ -430,7 +457,14 @@ struct vec4 {
 
 inline
 GLfloat dot( const vec4& u, const vec4& v ) {
-    return u.x*v.x + u.y*v.y + u.z*v.z + u.w+v.w;
+#ifdef ANGEL_SIMD
+    __m128 p = _mm_mul_ps( u.simd(), v.simd() );
+    p = _mm_add_ps( p, _mm_movehl_ps( p, p ) );
+    p = _mm_add_ss( p, _mm_shuffle_ps( p, p, _MM_SHUFFLE(1,1,1,1) ) );
+    return _mm_cvtss_f32( p );
+#else
+    return u.x*v.x + u.y*v.y + u.z*v.z + u.w*v.w;
+#endif
 }
 
 inline
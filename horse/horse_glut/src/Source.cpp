@@ -1,5 +1,6 @@
 
 #include "Angel.h"
+#include "profiler.h"
 #include <assert.h>
 #include "MatrixStack.h"
 #include "Node.h"
@@ -46,9 +47,10 @@ enum {
 	Quit
 };
 
-MatrixStack  mvstack;
-mat4         model_view;
+const int    MVSTACK_DEPTH = 32;
+MatrixStack<MVSTACK_DEPTH> mvstack; // the top is the current model matrix
 GLuint       ModelView, Projection;
+const char*  profileTrace = NULL; // "--profile" trace file
 
 int Index = 0;
 
@@ -90,7 +92,8 @@ GLint angle = Torso;
 Node  nodes[NumNodes];
 
 
-int NEED_STEP = 10;
+// seconds each step takes to reach its pose, by the clock rather than by frames
+float step_seconds = 1.0f / 6.0f;
 int status;
 enum {
 	Stop = 0,
@@ -136,14 +139,12 @@ traverse(Node* node)
 {
 	if (node == NULL) { return; }
 
-	mvstack.push(model_view);
-
-	model_view *= node->transform;
-	node->render();
-
-	if (node->child) { traverse(node->child); }
+	{
+		MatrixStack<MVSTACK_DEPTH>::Scope scope(mvstack, node->transform);
+		node->render();
 
-	model_view = mvstack.pop();
+		if (node->child) { traverse(node->child); }
+	}
 
 	if (node->sibling) { traverse(node->sibling); }
 }
@@ -153,144 +154,100 @@ traverse(Node* node)
 void
 torso()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * TORSO_HEIGHT, 0.0) * Scale(TORSO_WIDTH, TORSO_HEIGHT, TORSO_DEPTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 neck()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * NECK_HEIGHT, 0.0) * Scale(NECK_WIDTH, NECK_HEIGHT, NECK_DEPTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 head()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * HEAD_HEIGHT, 0.0) * Scale(HEAD_WIDTH, HEAD_HEIGHT, HEAD_DEPTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 left_upper_arm()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * UPPER_ARM_HEIGHT, 0.0) * Scale(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 left_lower_arm()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * LOWER_ARM_HEIGHT, 0.0) * Scale(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 right_upper_arm()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * UPPER_ARM_HEIGHT, 0.0) * Scale(UPPER_ARM_WIDTH, UPPER_ARM_HEIGHT, UPPER_ARM_WIDTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 right_lower_arm()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * LOWER_ARM_HEIGHT, 0.0) * Scale(LOWER_ARM_WIDTH, LOWER_ARM_HEIGHT, LOWER_ARM_WIDTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 left_upper_leg()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * UPPER_LEG_HEIGHT, 0.0) * Scale(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 left_lower_leg()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * LOWER_LEG_HEIGHT, 0.0) * Scale(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 right_upper_leg()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * UPPER_LEG_HEIGHT, 0.0) * Scale(UPPER_LEG_WIDTH, UPPER_LEG_HEIGHT, UPPER_LEG_WIDTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 void
 right_lower_leg()
 {
-	mvstack.push(model_view);
-
 	mat4 instance = (Translate(0.0, 0.5 * LOWER_LEG_HEIGHT, 0.0) * Scale(LOWER_LEG_WIDTH, LOWER_LEG_HEIGHT, LOWER_LEG_WIDTH));
 
-	glUniformMatrix4fv(ModelView, 1, GL_TRUE, model_view * instance);
+	glUniformMatrix4fv(ModelView, 1, GL_TRUE, mvstack.top() * instance);
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	model_view = mvstack.pop();
 }
 
 //----------------------------------------------------------------------------
@@ -298,8 +255,15 @@ right_lower_leg()
 void
 display()
 {
+	profiler().frame();
+	PROFILE_GPU_ZONE("display");
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	traverse(&nodes[Torso]);
+	{
+		PROFILE_GPU_ZONE("traverse");
+		traverse(&nodes[Torso]);
+	}
+	PROFILE_ZONE("swap");
 	glutSwapBuffers();
 }
 
@@ -318,8 +282,6 @@ mouse(int button, int state, int x, int y)
 		if (theta[angle] < 0.0) { theta[angle] += 360.0; }
 	}
 
-	mvstack.push(model_view);
-
 	switch (angle) {
 	case Torso:
 		nodes[Torso].transform =
@@ -371,8 +333,6 @@ mouse(int button, int state, int x, int y)
 			Translate(0.0, UPPER_ARM_HEIGHT, 0.0) * RotateX(theta[RightLowerArm]);
 		break;
 	}
-
-	model_view = mvstack.pop();
 	glutPostRedisplay();
 }
 
@@ -443,6 +403,7 @@ menu(int option)
 {
 	if (option == Quit)
 	{
+		profileReport(profileTrace);
 		exit(EXIT_SUCCESS);
 	}
 
@@ -476,7 +437,7 @@ reshape(int width, int height)
 	mat4 projection = Ortho(left, right, bottom, top, zNear, zFar);
 	glUniformMatrix4fv(Projection, 1, GL_TRUE, projection);
 
-	model_view = mat4(1.0);   // An Identity matrix
+	mvstack.load(mat4(1.0));   // An Identity matrix
 }
 
 //----------------------------------------------------------------------------
@@ -988,37 +949,70 @@ void running_step(int running_count) {
 }
 
 int current_step;
-int processed_steps = 0;
-void idle() {
-	if (status != Stop) {
-		if (processed_steps == 0 && status == Walking) {
-			for (int i = 0; i < NumNodes; i++) {
-				target[i] = 0;
-			}
-			walking_step(current_step);
-			for (int i = 0; i < NumNodes; i++)
-			{
-				if (target[i] != 0)
-					rotate(i, target[i]);
-			}
+
+// every step is a keyframe: the joints turn from where the step started
+// (step_from) to the step's pose (step_to) over step_seconds
+int step_start = 0; // GLUT_ELAPSED_TIME in ms when the current step started
+GLfloat step_from[NumNodes];
+GLfloat step_to[NumNodes];
+
+// an angle difference brought into [-180, 180), so joints turn the short way
+float shortest_arc(float degrees) {
+	return degrees - 360.0f * floor((degrees + 180.0f) / 360.0f);
+}
+
+// apply the current step to find its pose, then go back to where it starts
+void begin_step() {
+	for (int i = 0; i < NumNodes; i++)
+		step_from[i] = theta[i];
+
+	if (status == Walking) {
+		for (int i = 0; i < NumNodes; i++) {
+			target[i] = 0;
+		}
+		walking_step(current_step);
+		for (int i = 0; i < NumNodes; i++)
+		{
+			if (target[i] != 0)
+				rotate(i, target[i]);
 		}
-		else if (processed_steps == 0 && status == Running)
-			running_step(current_step);
+	}
+	else if (status == Running)
+		running_step(current_step);
+
+	for (int i = 0; i < NumNodes; i++) {
+		step_to[i] = theta[i];
+		rotate(i, step_from[i]);
+	}
+	step_start = glutGet(GLUT_ELAPSED_TIME);
+}
 
-		if (processed_steps == NEED_STEP)
+// a redisplay every 1/60 s while the horse moves, instead of spinning in an
+// idle callback that redraws as fast as it can even when nothing changes
+const int TICK_MS = 1000 / 60;
+
+void tick(int value) {
+	glutTimerFunc(TICK_MS, tick, 0);
+	if (status != Stop) {
+		float t = (glutGet(GLUT_ELAPSED_TIME) - step_start) / 1000.0f / step_seconds;
+		if (t >= 1.0f)
 		{
+			// land on the pose and start the next step from it
+			for (int i = 0; i < NumNodes; i++)
+				rotate(i, step_to[i]);
 			printf("Step %d\n", current_step);
 			current_step++;
 			if (current_step == 9) {
 				current_step = 1;
 			}
-			processed_steps = 0;
-		}
-		else {
-			processed_steps++;
+			begin_step();
+			t = 0.0f;
 		}
+
+		for (int i = 0; i < NumNodes; i++)
+			rotate(i, step_from[i] + t * shortest_arc(step_to[i] - step_from[i]));
+		glutPostRedisplay();
 	}
-	glutPostRedisplay();
 }
 
 void
@@ -1028,19 +1022,20 @@ keyboard(unsigned char key, int x, int y)
 	{
 		case 033: // Escape Key
 		case 'q': case 'Q':
+			profileReport(profileTrace);
 			exit(EXIT_SUCCESS);
 			break;
 		case 'a':
-			NEED_STEP = 20;
+			step_seconds = 1.0f / 3.0f;
 			current_step = 1;
 			status = Walking;
-			processed_steps = 0;
+			begin_step();
 			break;
 		case 'b':
-			NEED_STEP = 10;
+			step_seconds = 1.0f / 6.0f;
 			current_step = 1;
 			status = Running;
-			processed_steps = 0;
+			begin_step();
 			break;
 	}
 }
@@ -1051,6 +1046,8 @@ int
 main(int argc, char **argv)
 {
 	glutInit(&argc, argv);
+	// "--profile [trace.json]" times the frames, reported on quit
+	profileTrace = profileArguments(argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 	glutInitWindowSize(512, 512);
 	glutInitContextVersion(3, 2);
@@ -1069,7 +1066,7 @@ main(int argc, char **argv)
 	glutReshapeFunc(reshape);
 	glutKeyboardFunc(keyboard);
 	glutMouseFunc(mouse);
-	glutIdleFunc(idle);
+	glutTimerFunc(TICK_MS, tick, 0);
 
 	glutCreateMenu(menu);
 	glutAddMenuEntry("torso", Torso);
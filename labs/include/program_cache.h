@@ -0,0 +1,242 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define PROGRAM_CACHE_MKDIR(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define PROGRAM_CACHE_MKDIR(path) mkdir(path, 0755)
+#endif
+
+// Linked GL programs kept on disk between runs. A program is found by a
+// 64-bit FNV-1a hash of its shader sources and of the GL vendor, renderer
+// and version strings, so another GPU or a driver update misses instead of
+// handing the driver a binary it cannot use. load() makes the program with
+// glProgramBinary, or returns 0 when there is no blob or the driver rejects
+// it, deleting the blob; the caller then compiles as before, with
+// retrievable() before linking and store() after. Blobs go in
+// "shader_cache/" under the working directory, or in $SHADER_CACHE; an empty
+// $SHADER_CACHE turns the cache off, and so does a context without program
+// binary formats. readShaderFile() reads a source file in one go.
+
+class ProgramCache
+{
+public:
+    int hits;     // programs made from a blob
+    int compiled; // programs compiled and linked from source
+    int rejected; // blobs the driver refused, compiled again
+    double seconds; // spent between begin() and the end of the last load() or store()
+
+    ProgramCache() :
+        hits(0), compiled(0), rejected(0), seconds(0.0), checked(false), supported(false),
+        origin(std::chrono::steady_clock::now()) {}
+
+    // the name of a program's blob: its sources, in order, and the driver
+    std::string key(const char *const *sources, int count)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for(int i=0; i<count; ++i)
+        {
+            hash = fnv(hash, sources[i], std::char_traits<char>::length(sources[i]) + 1);
+        }
+        const std::string &driver = driverString();
+        hash = fnv(hash, driver.c_str(), driver.size());
+
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", hash);
+        return name;
+    }
+
+    // the cached program, linked and ready, or 0 to compile it
+    GLuint load(const std::string &key)
+    {
+        if(!available())
+        {
+            return 0;
+        }
+
+        std::ifstream file(path(key).c_str(), std::ios::in | std::ios::binary);
+        GLenum format = 0;
+        GLint length = 0;
+        if(!file.read((char*)&format, sizeof(format)) || !file.read((char*)&length, sizeof(length)) || length <= 0)
+        {
+            return 0;
+        }
+        std::vector<char> binary(length);
+        if(!file.read(binary.data(), length))
+        {
+            return 0;
+        }
+        file.close();
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, format, binary.data(), length);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if(linked != GL_TRUE)
+        {
+            glDeleteProgram(program);
+            std::remove(path(key).c_str());
+            ++rejected;
+            return 0;
+        }
+        ++hits;
+        lap();
+        return program;
+    }
+
+    // ask the driver to keep the binary of a program about to be linked
+    void retrievable(GLuint program)
+    {
+        if(available())
+        {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+    }
+
+    // write out the binary of a program that linked
+    void store(const std::string &key, GLuint program)
+    {
+        ++compiled;
+        GLint linked = GL_FALSE, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if(!available() || linked != GL_TRUE)
+        {
+            lap();
+            return;
+        }
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0)
+        {
+            lap();
+            return;
+        }
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        // written aside and renamed, so another run never reads half a blob
+        PROGRAM_CACHE_MKDIR(directory.c_str());
+        std::string target = path(key), partial = target + ".part";
+        std::ofstream file(partial.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write((const char*)&format, sizeof(format));
+        file.write((const char*)&length, sizeof(length));
+        file.write(binary.data(), length);
+        file.close();
+        std::remove(target.c_str());
+        if(!file || std::rename(partial.c_str(), target.c_str()) != 0)
+        {
+            std::remove(partial.c_str());
+        }
+        lap();
+    }
+
+    // start timing the programs loaded from here on
+    void begin()
+    {
+        origin = std::chrono::steady_clock::now();
+        seconds = 0.0;
+    }
+
+    void report() const
+    {
+        std::printf("programs: %d from cache, %d compiled (%d rejected) in %.1f ms%s\n",
+                    hits, compiled, rejected, seconds * 1000.0, supported ? "" : ", cache off");
+    }
+
+private:
+    bool checked;
+    bool supported;
+    std::string directory;
+    std::string driver;
+    std::chrono::steady_clock::time_point origin;
+
+    // program binaries, a place to keep them, and a current context to ask
+    bool available()
+    {
+        if(!checked)
+        {
+            checked = true;
+            const char *setting = std::getenv("SHADER_CACHE");
+            directory = setting != NULL ? setting : "shader_cache";
+#ifdef __GLEW_H__
+            supported = GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary;
+#else
+            supported = true;
+#endif
+            GLint formats = 0;
+            if(supported)
+            {
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            }
+            supported = formats > 0 && !directory.empty();
+        }
+        return supported;
+    }
+
+    const std::string &driverString()
+    {
+        if(driver.empty())
+        {
+            const GLenum names[4] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+            for(int i=0; i<4; ++i)
+            {
+                const GLubyte *name = glGetString(names[i]);
+                driver += name != NULL ? (const char*)name : "?";
+                driver += '\n';
+            }
+        }
+        return driver;
+    }
+
+    std::string path(const std::string &key) const
+    {
+        return directory + "/" + key + ".bin";
+    }
+
+    static unsigned long long fnv(unsigned long long hash, const char *bytes, size_t count)
+    {
+        for(size_t i=0; i<count; ++i)
+        {
+            hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    void lap()
+    {
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+    }
+};
+
+inline ProgramCache &programCache()
+{
+    static ProgramCache cache;
+    return cache;
+}
+
+// the whole of a shader file, false when it cannot be opened
+inline bool readShaderFile(const std::string &path, std::string &source)
+{
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    source = contents.str();
+    return true;
+}
+
+#endif // PROGRAM_CACHE_H
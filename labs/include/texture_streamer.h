@@ -0,0 +1,252 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads textures without stalling the render thread: request() hands out a
+// texture that shows a placeholder texel at once, worker threads decode the
+// image files with stb_image, and update() (called once per frame on the GL
+// thread) copies finished images into pixel buffer objects and uploads them.
+class TextureStreamer
+{
+public:
+    int loaded;  // uploads that have landed
+    int failed;  // files stb_image could not decode
+
+    TextureStreamer() :
+        loaded(0), failed(0), stopping(false), busy(0), nextPBO(0) {}
+
+    ~TextureStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(std::thread& worker : workers)
+        {
+            worker.join();
+        }
+        for(Image& image : decoded)
+        {
+            stbi_image_free(image.pixels);
+        }
+    }
+
+    // a texture holding the placeholder until the decoded image is uploaded
+    GLuint request(const std::string &path, GLint minFilter = GL_LINEAR, GLint magFilter = GL_LINEAR, GLint wrap = GL_REPEAT)
+    {
+        static const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+
+        start();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Image job;
+            job.texture = texture;
+            job.path = path;
+            job.pixels = NULL;
+            job.width = job.height = job.components = 0;
+            queued.push_back(job);
+        }
+        wake.notify_one();
+        return texture;
+    }
+
+    // upload finished images, at least one and then up to `budget` bytes per call
+    void update(size_t budget = 16 << 20)
+    {
+        size_t uploaded = 0;
+        while(uploaded < budget || uploaded == 0)
+        {
+            Image image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(decoded.empty())
+                {
+                    break;
+                }
+                image = decoded.front();
+                decoded.pop_front();
+            }
+            if(image.pixels == NULL)
+            {
+                std::cout << "Texture failed to load at path: " << image.path << std::endl;
+                ++failed;
+                continue;
+            }
+            uploaded += upload(image);
+            stbi_image_free(image.pixels);
+            ++loaded;
+        }
+    }
+
+    // requests not uploaded yet
+    int pending()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (int)(queued.size() + decoded.size()) + busy;
+    }
+
+    // block until every request has landed
+    void finish()
+    {
+        while(pending() > 0)
+        {
+            update((size_t)-1);
+            std::this_thread::yield();
+        }
+    }
+
+    // the pixel buffers; call while the context is still current
+    void release()
+    {
+        if(!pbos.empty())
+        {
+            glDeleteBuffers((GLsizei)pbos.size(), pbos.data());
+            pbos.clear();
+        }
+    }
+
+private:
+    struct Image
+    {
+        GLuint texture;
+        std::string path;
+        unsigned char *pixels;
+        int width, height, components;
+    };
+
+    static const int PBO_COUNT = 4; // round robin, so a buffer is reused once the GPU is done with it
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Image> queued;
+    std::deque<Image> decoded;
+    bool stopping;
+    int busy; // images being decoded right now
+
+    std::vector<GLuint> pbos;
+    int nextPBO;
+
+    // workers are started by the first request
+    void start()
+    {
+        if(!workers.empty())
+        {
+            return;
+        }
+        unsigned int count = std::max(1u, std::min(4u, std::thread::hardware_concurrency() - 1));
+        for(unsigned int i=0; i<count; ++i)
+        {
+            workers.push_back(std::thread(&TextureStreamer::decode, this));
+        }
+    }
+
+    void decode()
+    {
+        for(;;)
+        {
+            Image image;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !queued.empty(); });
+                if(stopping)
+                {
+                    return;
+                }
+                image = queued.front();
+                queued.pop_front();
+                ++busy;
+            }
+
+            image.pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &image.components, 0);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(image);
+            --busy;
+        }
+    }
+
+    // copy into the next pixel buffer and let glTexImage2D read from it; returns the bytes sent
+    size_t upload(const Image &image)
+    {
+        GLenum format = GL_RGBA;
+        if (image.components == 1)
+            format = GL_RED;
+        else if (image.components == 2)
+            format = GL_RG;
+        else if (image.components == 3)
+            format = GL_RGB;
+        size_t size = (size_t)image.width * image.height * image.components;
+
+        if(pbos.empty())
+        {
+            pbos.resize(PBO_COUNT);
+            glGenBuffers(PBO_COUNT, pbos.data());
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextPBO]);
+        nextPBO = (nextPBO + 1) % PBO_COUNT;
+
+        // orphan the old storage instead of waiting for the GPU to finish reading it
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void *target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        const void *source = NULL; // an offset into the pixel buffer
+        if(target != NULL)
+        {
+            memcpy(target, image.pixels, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        else
+        {
+            // could not map: upload straight from client memory
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            source = image.pixels;
+        }
+
+        // keep whatever the frame has bound on the active unit
+        GLint bound = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+
+        // rows of stb_image data are tightly packed
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, image.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, source);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, bound);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return size;
+    }
+
+    TextureStreamer(const TextureStreamer&);
+    TextureStreamer& operator=(const TextureStreamer&);
+};
+
+// the process-wide streamer every texture request goes through
+inline TextureStreamer &textureStreamer()
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+#endif
@@ -1,6 +1,13 @@
 #include "common/stdafx.h"
 
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+
 #include "objloader.hpp"
+#include "program_cache.h"
 
 #define STP		0.5f
 
@@ -14,21 +21,9 @@ float rx = 0.0f;
 
 GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_path) {
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_shader_path, std::ios::in);
-
-	if (VertexShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}
-	else {
+	if (!readShaderFile(vertex_shader_path, VertexShaderCode)) {
 		printf("Impossible to open %s. Are you in the right directory ?\n", vertex_shader_path.c_str());
 		getchar();
 		exit(-1);
@@ -36,20 +31,24 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_shader_path, std::ios::in);
-
-	if (FragmentShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
-	else {
+	if (!readShaderFile(fragment_shader_path, FragmentShaderCode)) {
 		printf("Impossible to open %s. Are you in the right directory ?\n", fragment_shader_path.c_str());
 		getchar();
 		exit(-1);
 	}
 
+	// The same sources linked on an earlier run on this driver
+	const char * Sources[2] = { VertexShaderCode.c_str(), FragmentShaderCode.c_str() };
+	std::string CacheKey = programCache().key(Sources, 2);
+	GLuint CachedID = programCache().load(CacheKey);
+	if (CachedID != 0) {
+		return CachedID;
+	}
+
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -91,6 +90,7 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 
 	glBindAttribLocation(ProgramID, 0, "in_Position");
 
+	programCache().retrievable(ProgramID);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -105,6 +105,7 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 	glDeleteShader(VertexShaderID); //free up memory
 	glDeleteShader(FragmentShaderID);
 
+	programCache().store(CacheKey, ProgramID);
 	return ProgramID;
 }
 
@@ -158,7 +159,97 @@ int init() {
 	return 0;
 }
 
-int main() {
+//------ LOADER BENCHMARK (lab_05 --bench) -------
+
+// n x n quads of two triangles, with v/vt/vn faces so that loadOBJ accepts it too
+void writeGridOBJ(const char * path, int n) {
+	FILE * file = fopen(path, "w");
+	for (int i = 0; i <= n; i++)
+		for (int j = 0; j <= n; j++)
+			fprintf(file, "v %f %f %f\n", (float)j / n, 0.1f * sinf(0.05f * (i + j)), (float)i / n);
+	for (int i = 0; i <= n; i++)
+		for (int j = 0; j <= n; j++)
+			fprintf(file, "vt %f %f\n", (float)j / n, (float)i / n);
+	fprintf(file, "vn 0 1 0\n");
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) {
+			int a = i * (n + 1) + j + 1, b = a + 1, c = a + n + 1, d = c + 1;
+			fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, c, c, b, b);
+			fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", b, b, c, c, d, d);
+		}
+	}
+	fclose(file);
+}
+
+template<typename Function>
+double timeLoad(Function load) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	load();
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+// loadOBJ against loadOBJIndexed on one and on all cores
+void benchmarkFile(const char * name, const char * path) {
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<glm::vec3> v, nv;
+	std::vector<glm::vec2> uv;
+	OBJMesh mesh;
+
+	bool loaded = false;
+	double scanned = timeLoad([&]() { loaded = loadOBJ(path, v, nv, uv); });
+	double single = timeLoad([&]() { loadOBJIndexed(path, mesh, 1); });
+	double parallel = timeLoad([&]() { loadOBJIndexed(path, mesh, cores); });
+
+	size_t deindexed = v.size() * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2));
+	size_t indexed = mesh.vertices.size() * sizeof(OBJVertex) + mesh.indices.size() * sizeof(uint32_t);
+	if (loaded)
+		printf("%-8s %9zu tris  loadOBJ %9.1f ms (%6.1f MB)", name, mesh.indices.size() / 3, scanned, deindexed / 1048576.0);
+	else
+		printf("%-8s %9zu tris  loadOBJ    failed              ", name, mesh.indices.size() / 3);
+	printf("  mmap x1 %8.1f ms  x%-2u %8.1f ms (%6.1f MB, %zu vertices)\n",
+		single, cores, parallel, indexed / 1048576.0, mesh.vertices.size());
+
+	// cold: parse and bake the cache; warm: map it and copy it out as glBufferData would
+	std::string cache = std::string(path) + ".mesh";
+	remove(cache.c_str());
+	MeshView view;
+	double cold = timeLoad([&]() { loadMeshCached(path, view); });
+	view.clear();
+	std::vector<char> upload(indexed);
+	double warm = timeLoad([&]() {
+		loadMeshCached(path, view);
+		memcpy(upload.data(), view.vertices, view.header->vertexCount * sizeof(OBJVertex));
+		memcpy(upload.data() + view.header->vertexCount * sizeof(OBJVertex), view.indices, view.header->indexCount * sizeof(uint32_t));
+	});
+	printf("%-8s %9s       cache bake %8.1f ms  warm map %8.1f ms%s\n", "", "", cold, warm, view.mapped ? "" : " (not writable)");
+	view.clear();
+	remove(cache.c_str());
+}
+
+int benchmarkLoaders() {
+	benchmarkFile("teddy", "../lab_03/teddy.obj");
+
+	const char * path = "bench_grid.obj";
+	writeGridOBJ(path, 708);  // 1,002,528 triangles
+	benchmarkFile("grid 1M", path);
+	writeGridOBJ(path, 2237); // 10,008,338 triangles
+	benchmarkFile("grid 10M", path);
+	remove(path);
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		return benchmarkLoaders();
+	}
+	// --cold drops the baked mesh to time a text load
+	if (argc > 1 && strcmp(argv[1], "--cold") == 0) {
+		remove("t.obj.mesh");
+	}
 
 	if (init() != 0) {
 		return -1;
@@ -168,34 +259,32 @@ int main() {
 	glUseProgram(shdr);
 
 
-    std::vector<glm::vec3> v;
-	std::vector<glm::vec3> nv;
-	std::vector<glm::vec2> uv;
-
-	loadOBJ("t.obj", v, nv, uv);
+	MeshView mesh;
+	bool parsed = false;
+	if (!loadMeshCached("t.obj", mesh, &parsed)) {
+		return -1;
+	}
+	const GLsizei indexCount = (GLsizei)mesh.header->indexCount;
 
 	GLuint VAO;
 	glGenVertexArrays(1, &VAO);
 	glBindVertexArray(VAO);
 
-    GLuint VBO_pos;
-	glGenBuffers(1, &VBO_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_pos);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*v.size(), &v[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_pos);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	GLuint VBO;
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(OBJVertex)*mesh.header->vertexCount, mesh.vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(OBJVertex), (void*)offsetof(OBJVertex, position));
 	glEnableVertexAttribArray(0);
-
-    GLuint VBO_norm;
-	glGenBuffers(1, &VBO_norm);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_norm);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*v.size(), &nv[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_norm);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(OBJVertex), (void*)offsetof(OBJVertex, normal));
 	glEnableVertexAttribArray(1);
 
+	GLuint EBO;
+	glGenBuffers(1, &EBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t)*indexCount, mesh.indices, GL_STATIC_DRAW);
+	mesh.clear(); // the buffers hold their own copy
+
 	//------ MODEL MATRIX ---------
 	glm::mat4 mm;
 	glm::mat4 scale;
@@ -242,7 +331,14 @@ int main() {
 		mm = translate * rotate * scale;
 
 		glUniformMatrix4fv(mm_addr, 1, false, glm::value_ptr(mm));
-		glDrawArrays(GL_TRIANGLES, 0, v.size());
+		glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+
+		if (start != std::chrono::steady_clock::time_point()) {
+			glFinish();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			printf("First frame after %.1f ms (%s)\n", elapsed.count(), parsed ? "text OBJ" : "binary mesh");
+			start = std::chrono::steady_clock::time_point();
+		}
 	}
 	return 0;
 }
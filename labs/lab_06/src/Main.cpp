@@ -1,7 +1,14 @@
 #include "common/stdafx.h"
 
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
 #include "objloader.hpp"
+#include "program_cache.h"
 #include "stb_image.h"
+#include "texture_streamer.h"
+#include "profiler.h"
 
 #define STP		0.5f
 
@@ -15,21 +22,9 @@ float rx = 0.0f;
 
 GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_path) {
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_shader_path, std::ios::in);
-
-	if (VertexShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}
-	else {
+	if (!readShaderFile(vertex_shader_path, VertexShaderCode)) {
 		printf("Impossible to open %s. Are you in the right directory ?\n", vertex_shader_path.c_str());
 		getchar();
 		exit(-1);
@@ -37,20 +32,24 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_shader_path, std::ios::in);
-
-	if (FragmentShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
-	else {
+	if (!readShaderFile(fragment_shader_path, FragmentShaderCode)) {
 		printf("Impossible to open %s. Are you in the right directory ?\n", fragment_shader_path.c_str());
 		getchar();
 		exit(-1);
 	}
 
+	// The same sources linked on an earlier run on this driver
+	const char * Sources[2] = { VertexShaderCode.c_str(), FragmentShaderCode.c_str() };
+	std::string CacheKey = programCache().key(Sources, 2);
+	GLuint CachedID = programCache().load(CacheKey);
+	if (CachedID != 0) {
+		return CachedID;
+	}
+
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -92,6 +91,7 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 
 	glBindAttribLocation(ProgramID, 0, "in_Position");
 
+	programCache().retrievable(ProgramID);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -106,6 +106,7 @@ GLuint loadShaders(std::string vertex_shader_path, std::string fragment_shader_p
 	glDeleteShader(VertexShaderID); //free up memory
 	glDeleteShader(FragmentShaderID);
 
+	programCache().store(CacheKey, ProgramID);
 	return ProgramID;
 }
 
@@ -159,7 +160,17 @@ int init() {
 	return 0;
 }
 
-int main() {
+int main(int argc, char * argv[]) {
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// --cold drops the baked mesh to time a text load
+	if (argc > 1 && strcmp(argv[1], "--cold") == 0) {
+		remove("t.obj.mesh");
+	}
+
+	// --profile [trace.json] times the frames
+	const char *trace = profileArguments(argc, argv);
 
 	if (init() != 0) {
 		return -1;
@@ -169,43 +180,34 @@ int main() {
 	glUseProgram(shdr);
 
 
-    std::vector<glm::vec3> v;
-	std::vector<glm::vec3> nv;
-	std::vector<glm::vec2> uv;
-
-	loadOBJ("t.obj", v, nv, uv);
+	MeshView mesh;
+	bool parsed = false;
+	if (!loadMeshCached("t.obj", mesh, &parsed)) {
+		return -1;
+	}
+	const GLsizei indexCount = (GLsizei)mesh.header->indexCount;
 
 	GLuint VAO;
 	glGenVertexArrays(1, &VAO);
 	glBindVertexArray(VAO);
 
-    GLuint VBO_pos;
-	glGenBuffers(1, &VBO_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_pos);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*v.size(), &v[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_pos);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	GLuint VBO;
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(OBJVertex)*mesh.header->vertexCount, mesh.vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(OBJVertex), (void*)offsetof(OBJVertex, position));
 	glEnableVertexAttribArray(0);
-
-    GLuint VBO_norm;
-	glGenBuffers(1, &VBO_norm);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_norm);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*v.size(), &nv[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_norm);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(OBJVertex), (void*)offsetof(OBJVertex, normal));
 	glEnableVertexAttribArray(1);
-
-	GLuint VBO_uv;
-	glGenBuffers(1, &VBO_uv);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_uv);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2)*uv.size(), &uv[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_uv);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(OBJVertex), (void*)offsetof(OBJVertex, uv));
 	glEnableVertexAttribArray(2);
 
+	GLuint EBO;
+	glGenBuffers(1, &EBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t)*indexCount, mesh.indices, GL_STATIC_DRAW);
+	mesh.clear(); // the buffers hold their own copy
+
 
 	//------ MODEL MATRIX ---------
 	glm::mat4 mm;
@@ -225,29 +227,9 @@ int main() {
 	glm::vec3 light_position = glm::vec3(1, 3, 0);
 
     //-------Texture -----
-    unsigned int texture_grid;
-    glGenTextures(1, &texture_grid);
-    glBindTexture(GL_TEXTURE_2D, texture_grid); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
-    // set the texture wrapping parameters
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    // load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    // The FileSystem::getPath(...) is part of the GitHub repository so we can find files on any IDE/platform; replace it with your own image path.
-    unsigned char *data = stbi_load("resources/flag.jpg", &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
+    // decoded on a worker thread; the texture is grey until textureStreamer().update() uploads it
+    unsigned int texture_grid = textureStreamer().request("resources/flag.jpg", GL_NEAREST, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, texture_grid);
 
 	//------ SHADER UNIFORMS -----
 	GLuint mm_addr = glGetUniformLocation(shdr, "m_m");
@@ -264,9 +246,15 @@ int main() {
 
 	glClearColor(.7, .7, .7, 0);
 	while (!glfwWindowShouldClose(window)) {
+		profiler().frame();
+		PROFILE_GPU_ZONE("frame");
 
 		glfwPollEvents();
-		glfwSwapBuffers(window);
+		{
+			PROFILE_ZONE("swap");
+			glfwSwapBuffers(window);
+		}
+		textureStreamer().update();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glUniformMatrix4fv(vm_addr, 1, false, glm::value_ptr(vm));
 
@@ -278,7 +266,18 @@ int main() {
 		mm = translate * rotate * scale;
 
 		glUniformMatrix4fv(mm_addr, 1, false, glm::value_ptr(mm));
-		glDrawArrays(GL_TRIANGLES, 0, v.size());
+		{
+			PROFILE_GPU_ZONE("draw");
+			glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+		}
+
+		if (start != std::chrono::steady_clock::time_point()) {
+			glFinish();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			printf("First frame after %.1f ms (%s)\n", elapsed.count(), parsed ? "text OBJ" : "binary mesh");
+			start = std::chrono::steady_clock::time_point();
+		}
 	}
+	profileReport(trace);
 	return 0;
 }
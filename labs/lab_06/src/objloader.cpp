@@ -1,5 +1,9 @@
 #include "common/stdafx.h"
 #include <vector>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <thread>
 //#include <stdio.h>
 //#include <cstring>
 #include <iostream>
@@ -8,6 +12,16 @@
 
 #pragma warning(disable:4996)
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
 bool loadOBJ(
 	const char * path,
 	std::vector<glm::vec3> & out_vertices,
@@ -100,3 +114,593 @@ bool loadOBJ(
 
 	return true;
 }
+
+//------ INDEXED LOADER -------
+
+// read-only view of a whole file, unmapped when it goes out of scope
+class MappedFile {
+public:
+	const char * data;
+	size_t size;
+
+	explicit MappedFile(const char * path) : data(nullptr), size(0) {
+#ifdef _WIN32
+		mapping = nullptr;
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		LARGE_INTEGER length;
+		if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+			return;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+			return;
+		data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = data ? (size_t)length.QuadPart : 0;
+#else
+		fd = open(path, O_RDONLY);
+		struct stat info;
+		if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0)
+			return;
+		void * view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED)
+			return;
+		madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+		data = (const char *)view;
+		size = (size_t)info.st_size;
+#endif
+	}
+
+	~MappedFile() {
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (data)
+			munmap((void *)data, size);
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	// an existing but empty file maps to nothing as well
+	bool opened() const {
+#ifdef _WIN32
+		return file != INVALID_HANDLE_VALUE;
+#else
+		return fd >= 0;
+#endif
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+};
+
+namespace {
+
+// run work(0) .. work(count - 1) on `count` threads, the first one on the caller's
+template<typename Function>
+void parallelFor(unsigned int count, Function work) {
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < count; i++)
+		workers.emplace_back(work, i);
+	work(0);
+	for (std::thread & worker : workers)
+		worker.join();
+}
+
+const int NO_INDEX = INT_MIN; // corner without uv or normal
+
+const double POWERS_OF_10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+inline const char * skipSpaces(const char * p, const char * end) {
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	return p;
+}
+
+inline const char * skipLine(const char * p, const char * end) {
+	const char * eol = (const char *)memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+// [+-]digits[.digits][(e|E)[+-]digits]; the first 19 significant digits are
+// gathered in an integer and scaled once, which is exact to a float's precision
+const char * parseFloat(const char * p, const char * end, float & out) {
+	p = skipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	for (; p < end && isDigit(*p); p++) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else
+			exponent++;
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && isDigit(*p); p++) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negativeExponent = *p++ == '-';
+		int e = 0;
+		for (; p < end && isDigit(*p); p++)
+			e = std::min(e * 10 + (*p - '0'), 1000);
+		exponent += negativeExponent ? -e : e;
+	}
+
+	double value = (double)mantissa;
+	if (exponent < 0) {
+		for (; exponent < -22; exponent += 22)
+			value /= 1e22;
+		value /= POWERS_OF_10[-exponent];
+	}
+	else {
+		for (; exponent > 22; exponent -= 22)
+			value *= 1e22;
+		value *= POWERS_OF_10[exponent];
+	}
+	out = (float)(negative ? -value : value);
+	return p;
+}
+
+// [-]digits; returns p unchanged when there is no number
+const char * parseIndex(const char * p, const char * end, int & out) {
+	const char * start = p;
+	bool negative = p < end && *p == '-';
+	if (negative)
+		p++;
+	if (p == end || !isDigit(*p))
+		return start;
+	int value = 0;
+	for (; p < end && isDigit(*p); p++)
+		value = value * 10 + (*p - '0');
+	out = negative ? -value : value;
+	return p;
+}
+
+// what one thread reads from its slice of the file
+struct OBJChunk {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<int> corners;     // position, uv, normal per corner, three corners per triangle
+	std::vector<size_t> relative; // corners entries given as negative indices, local to this chunk
+	bool valid;
+	OBJChunk() : valid(true) {}
+};
+
+struct OBJCorner {
+	int index[3];
+	bool relative[3];
+};
+
+// turn one OBJ index into a 0-based one: positive indices count from the start of
+// the file, negative ones back from the current element (fixed up after the merge)
+inline bool resolveIndex(int value, size_t count, int & index, bool & relative) {
+	if (value > 0) {
+		index = value - 1;
+		relative = false;
+		return true;
+	}
+	if (value < 0) {
+		index = (int)count + value;
+		relative = true;
+		return true;
+	}
+	return false;
+}
+
+void parseChunk(const char * p, const char * end, OBJChunk & chunk) {
+	std::vector<OBJCorner> face;
+	while (p < end) {
+		p = skipSpaces(p, end);
+		if (p == end)
+			break;
+		char next = p + 1 < end ? p[1] : '\n';
+		if (*p == 'v' && (next == ' ' || next == '\t')) {
+			glm::vec3 vertex;
+			p = parseFloat(p + 1, end, vertex.x);
+			p = parseFloat(p, end, vertex.y);
+			p = parseFloat(p, end, vertex.z);
+			chunk.positions.push_back(vertex);
+		}
+		else if (*p == 'v' && next == 't') {
+			glm::vec2 uv;
+			p = parseFloat(p + 2, end, uv.x);
+			p = parseFloat(p, end, uv.y);
+			uv.y = -uv.y; // same V flip as loadOBJ
+			chunk.uvs.push_back(uv);
+		}
+		else if (*p == 'v' && next == 'n') {
+			glm::vec3 normal;
+			p = parseFloat(p + 2, end, normal.x);
+			p = parseFloat(p, end, normal.y);
+			p = parseFloat(p, end, normal.z);
+			chunk.normals.push_back(normal);
+		}
+		else if (*p == 'f' && (next == ' ' || next == '\t')) {
+			face.clear();
+			p = skipSpaces(p + 1, end);
+			while (p < end && *p != '\n' && *p != '\r' && *p != '#') {
+				OBJCorner corner = { { NO_INDEX, NO_INDEX, NO_INDEX }, { false, false, false } };
+				int value = 0;
+				const char * q = parseIndex(p, end, value);
+				if (q == p || !resolveIndex(value, chunk.positions.size(), corner.index[0], corner.relative[0])) {
+					chunk.valid = false;
+					return;
+				}
+				p = q;
+				if (p < end && *p == '/') {
+					q = parseIndex(++p, end, value);
+					if (q != p && !resolveIndex(value, chunk.uvs.size(), corner.index[1], corner.relative[1])) {
+						chunk.valid = false;
+						return;
+					}
+					p = q;
+					if (p < end && *p == '/') {
+						q = parseIndex(++p, end, value);
+						if (q == p || !resolveIndex(value, chunk.normals.size(), corner.index[2], corner.relative[2])) {
+							chunk.valid = false;
+							return;
+						}
+						p = q;
+					}
+				}
+				face.push_back(corner);
+				p = skipSpaces(p, end);
+			}
+			// fan: (0, i, i + 1)
+			for (size_t i = 1; i + 1 < face.size(); i++) {
+				const OBJCorner * triangle[3] = { &face[0], &face[i], &face[i + 1] };
+				for (int c = 0; c < 3; c++) {
+					for (int k = 0; k < 3; k++) {
+						if (triangle[c]->relative[k])
+							chunk.relative.push_back(chunk.corners.size());
+						chunk.corners.push_back(triangle[c]->index[k]);
+					}
+				}
+			}
+		}
+		// anything else (comments, groups, materials, ...) is skipped
+		p = skipLine(p, end);
+	}
+}
+
+inline uint32_t hashCorner(const int * corner) {
+	uint32_t h = (uint32_t)corner[0] * 73856093u ^ (uint32_t)corner[1] * 19349663u ^ (uint32_t)corner[2] * 83492791u;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+inline unsigned int partitionOf(uint32_t hash, unsigned int partitions) {
+	return (unsigned int)(((uint64_t)hash * partitions) >> 32);
+}
+
+// the unique corners of one hash partition, in the order they first appear
+struct OBJPartition {
+	std::vector<uint32_t> keys;  // offset of the first occurrence in the corner array
+	std::vector<uint32_t> slots; // open addressing table of keys indices + 1, 0 = free
+	uint32_t base;
+
+	uint32_t insert(const std::vector<int> & corners, uint32_t corner, uint32_t hash) {
+		if ((keys.size() + 1) * 2 > slots.size())
+			grow(corners);
+		const int * key = &corners[(size_t)corner * 3];
+		size_t mask = slots.size() - 1;
+		for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+			uint32_t id = slots[slot];
+			if (id == 0) {
+				keys.push_back(corner);
+				slots[slot] = (uint32_t)keys.size();
+				return (uint32_t)keys.size() - 1;
+			}
+			if (memcmp(&corners[(size_t)keys[id - 1] * 3], key, 3 * sizeof(int)) == 0)
+				return id - 1;
+		}
+	}
+
+	void grow(const std::vector<int> & corners) {
+		slots.assign(std::max<size_t>(slots.size() * 2, 1024), 0);
+		size_t mask = slots.size() - 1;
+		for (size_t id = 0; id < keys.size(); id++) {
+			size_t slot = hashCorner(&corners[(size_t)keys[id] * 3]) & mask;
+			while (slots[slot] != 0)
+				slot = (slot + 1) & mask;
+			slots[slot] = (uint32_t)id + 1;
+		}
+	}
+};
+
+}
+
+bool loadOBJIndexed(
+	const char * path,
+	OBJMesh & mesh,
+	unsigned int threads) {
+
+	mesh.vertices.clear();
+	mesh.indices.clear();
+
+	MappedFile file(path);
+	if (!file.opened()) {
+		printf("Impossible to open %s ! Are you in the right path ?\n", path);
+		return false;
+	}
+	if (file.size == 0)
+		return true;
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	// small files are not worth a thread each
+	threads = (unsigned int)std::min<size_t>(threads, file.size / 65536 + 1);
+
+	// slices end after a newline so that no line is split between two threads
+	std::vector<const char *> bounds(threads + 1);
+	const char * end = file.data + file.size;
+	bounds[0] = file.data;
+	bounds[threads] = end;
+	for (unsigned int i = 1; i < threads; i++) {
+		const char * p = std::max(bounds[i - 1], file.data + file.size / threads * i);
+		bounds[i] = p == file.data ? p : skipLine(p - 1, end);
+	}
+
+	std::vector<OBJChunk> chunks(threads);
+	parallelFor(threads, [&](unsigned int i) { parseChunk(bounds[i], bounds[i + 1], chunks[i]); });
+
+	// where every chunk's elements start in the merged arrays
+	std::vector<size_t> positionBase(threads + 1, 0), uvBase(threads + 1, 0), normalBase(threads + 1, 0), cornerBase(threads + 1, 0);
+	for (unsigned int i = 0; i < threads; i++) {
+		if (!chunks[i].valid) {
+			printf("File can't be read: malformed face in %s\n", path);
+			return false;
+		}
+		positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+		uvBase[i + 1] = uvBase[i] + chunks[i].uvs.size();
+		normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+		cornerBase[i + 1] = cornerBase[i] + chunks[i].corners.size() / 3;
+	}
+	const size_t cornerCount = cornerBase[threads];
+	if (cornerCount > UINT32_MAX || positionBase[threads] > INT_MAX || uvBase[threads] > INT_MAX || normalBase[threads] > INT_MAX) {
+		printf("File can't be read: %s is too large for 32-bit indices\n", path);
+		return false;
+	}
+
+	std::vector<glm::vec3> positions(positionBase[threads]), normals(normalBase[threads]);
+	std::vector<glm::vec2> uvs(uvBase[threads]);
+	std::vector<int> corners(cornerCount * 3);
+	std::vector<uint32_t> hashes(cornerCount);
+	std::vector<char> inRange(threads, 1);
+
+	// merge: relative indices become absolute, everything is range checked and hashed
+	parallelFor(threads, [&](unsigned int i) {
+		OBJChunk & chunk = chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionBase[i]);
+		std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + uvBase[i]);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalBase[i]);
+
+		const size_t bases[3] = { positionBase[i], uvBase[i], normalBase[i] };
+		const size_t counts[3] = { positions.size(), uvs.size(), normals.size() };
+		for (size_t entry : chunk.relative)
+			chunk.corners[entry] += (int)bases[entry % 3];
+
+		int * out = &corners[cornerBase[i] * 3];
+		const size_t n = chunk.corners.size() / 3;
+		for (size_t c = 0; c < n; c++) {
+			for (int k = 0; k < 3; k++) {
+				int index = chunk.corners[c * 3 + k];
+				if (index != NO_INDEX && (index < 0 || (size_t)index >= counts[k]))
+					inRange[i] = 0;
+				out[c * 3 + k] = index;
+			}
+			hashes[cornerBase[i] + c] = hashCorner(&out[c * 3]);
+		}
+		std::vector<int>().swap(chunk.corners);
+	});
+	if (std::find(inRange.begin(), inRange.end(), 0) != inRange.end()) {
+		printf("File can't be read: face index out of range in %s\n", path);
+		return false;
+	}
+
+	// dedup: the high bits of a corner's hash pick its partition, owned by one thread
+	// which numbers its unique corners; the low bits pick the table slot
+	std::vector<OBJPartition> partitions(threads);
+	mesh.indices.resize(cornerCount);
+	parallelFor(threads, [&](unsigned int t) {
+		OBJPartition & partition = partitions[t];
+		for (size_t c = 0; c < cornerCount; c++) {
+			if (partitionOf(hashes[c], threads) == t)
+				mesh.indices[c] = partition.insert(corners, (uint32_t)c, hashes[c]);
+		}
+	});
+	for (unsigned int t = 0, base = 0; t < threads; t++) {
+		partitions[t].base = base;
+		base += (unsigned int)partitions[t].keys.size();
+	}
+
+	mesh.vertices.resize(partitions[threads - 1].base + partitions[threads - 1].keys.size());
+	parallelFor(threads, [&](unsigned int t) {
+		const OBJPartition & partition = partitions[t];
+		for (size_t id = 0; id < partition.keys.size(); id++) {
+			const int * key = &corners[(size_t)partition.keys[id] * 3];
+			OBJVertex & vertex = mesh.vertices[partition.base + id];
+			vertex.position = positions[key[0]];
+			vertex.uv = key[1] != NO_INDEX ? uvs[key[1]] : glm::vec2(0.0f);
+			vertex.normal = key[2] != NO_INDEX ? normals[key[2]] : glm::vec3(0.0f);
+		}
+		// partition-local ids become vertex indices, one slice of the buffer per thread
+		const size_t first = cornerCount / threads * t;
+		const size_t last = t + 1 == threads ? cornerCount : cornerCount / threads * (t + 1);
+		for (size_t c = first; c < last; c++)
+			mesh.indices[c] += partitions[partitionOf(hashes[c], threads)].base;
+	});
+
+	return true;
+}
+
+//------ BINARY MESH CACHE -------
+
+namespace {
+
+const char MESH_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+
+// size and modification time of the OBJ a cache was baked from
+bool sourceStamp(const char * path, uint64_t & size, int64_t & time) {
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return false;
+	size = (uint64_t)info.st_size;
+	time = (int64_t)info.st_mtime;
+	return true;
+}
+
+void meshBounds(const OBJMesh & mesh, MeshHeader & header) {
+	glm::vec3 low(0.0f), high(0.0f);
+	if (!mesh.vertices.empty())
+		low = high = mesh.vertices[0].position;
+	for (const OBJVertex & vertex : mesh.vertices) {
+		low = glm::min(low, vertex.position);
+		high = glm::max(high, vertex.position);
+	}
+	memcpy(header.boundsMin, &low[0], sizeof(header.boundsMin));
+	memcpy(header.boundsMax, &high[0], sizeof(header.boundsMax));
+}
+
+}
+
+bool writeMeshCache(const char * path, const OBJMesh & mesh, const char * source) {
+	MeshHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = MESH_VERSION;
+	header.vertexSize = sizeof(OBJVertex);
+	header.vertexCount = (uint32_t)mesh.vertices.size();
+	header.indexCount = (uint32_t)mesh.indices.size();
+	if (!sourceStamp(source, header.sourceSize, header.sourceTime))
+		return false;
+	meshBounds(mesh, header);
+
+	FILE * file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+	// the magic is written last, so a half written file never looks valid
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(mesh.vertices.data(), sizeof(OBJVertex), mesh.vertices.size(), file) == mesh.vertices.size()
+		&& fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file) == mesh.indices.size()
+		&& fseek(file, 0, SEEK_SET) == 0
+		&& fwrite(MESH_MAGIC, sizeof(MESH_MAGIC), 1, file) == 1;
+	written = fclose(file) == 0 && written;
+	if (!written)
+		remove(path);
+	return written;
+}
+
+MeshView::MeshView() : header(nullptr), vertices(nullptr), indices(nullptr), mapped(false), file(nullptr) {}
+
+MeshView::~MeshView() {
+	delete file;
+}
+
+void MeshView::clear() {
+	delete file;
+	file = nullptr;
+	mapped = false;
+	header = nullptr;
+	vertices = nullptr;
+	indices = nullptr;
+	parsed = OBJMesh();
+}
+
+bool MeshView::map(const char * path, const char * source) {
+	clear();
+	uint64_t size;
+	int64_t time;
+	if (!sourceStamp(source, size, time))
+		return false;
+
+	file = new MappedFile(path);
+	const MeshHeader * h = (const MeshHeader *)file->data;
+	if (file->size < sizeof(MeshHeader)
+		|| memcmp(h->magic, MESH_MAGIC, sizeof(MESH_MAGIC)) != 0
+		|| h->version != MESH_VERSION
+		|| h->vertexSize != sizeof(OBJVertex)
+		|| file->size != sizeof(MeshHeader) + (uint64_t)h->vertexCount * sizeof(OBJVertex) + (uint64_t)h->indexCount * sizeof(uint32_t)
+		|| h->sourceSize != size || h->sourceTime != time) {
+		clear();
+		return false;
+	}
+
+	header = h;
+	vertices = (const OBJVertex *)(file->data + sizeof(MeshHeader));
+	indices = (const uint32_t *)(vertices + h->vertexCount);
+	mapped = true;
+	return true;
+}
+
+bool MeshView::adopt(OBJMesh & mesh) {
+	clear();
+	parsed.vertices.swap(mesh.vertices);
+	parsed.indices.swap(mesh.indices);
+	memset(&bakedHeader, 0, sizeof(bakedHeader));
+	meshBounds(parsed, bakedHeader);
+	bakedHeader.vertexCount = (uint32_t)parsed.vertices.size();
+	bakedHeader.indexCount = (uint32_t)parsed.indices.size();
+	header = &bakedHeader;
+	vertices = parsed.vertices.data();
+	indices = parsed.indices.data();
+	return true;
+}
+
+bool loadMeshCached(const char * path, MeshView & view, bool * parsed) {
+	std::string cache = std::string(path) + ".mesh";
+	if (parsed)
+		*parsed = false;
+	if (view.map(cache.c_str(), path))
+		return true;
+	if (parsed)
+		*parsed = true;
+
+	OBJMesh mesh;
+	if (!loadOBJIndexed(path, mesh))
+		return false;
+	if (writeMeshCache(cache.c_str(), mesh, path) && view.map(cache.c_str(), path))
+		return true;
+
+	// no writable cache next to the asset: use the parsed mesh as it is
+	printf("Can't write %s, using the parsed mesh\n", cache.c_str());
+	return view.adopt(mesh);
+}
@@ -1,5 +1,6 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
+#include <stdint.h>
 #include <vector>
 
 bool loadOBJ(
@@ -9,4 +10,87 @@ std::vector<glm::vec3> & out_normals,
 std::vector<glm::vec2> & out_uvs
 );
 
+// one unique position/normal/uv combination of an indexed mesh
+struct OBJVertex {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;
+};
+
+// deduplicated mesh: the unique vertices and three indices per triangle
+struct OBJMesh {
+	std::vector<OBJVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// Memory-maps the file and parses it on `threads` threads (0: one per core).
+// Accepts v, v/vt, v//vn and v/vt/vn corners, negative (relative) indices and
+// polygons, which are split into triangle fans. Missing normals and uvs are zero.
+bool loadOBJIndexed(
+const char * path,
+OBJMesh & mesh,
+unsigned int threads = 0
+);
+
+//------ BINARY MESH CACHE -------
+
+const uint32_t MESH_VERSION = 1;
+
+// .mesh file layout: this header, vertexCount OBJVertex, indexCount uint32_t;
+// little endian, 64 bytes so the vertices that follow stay aligned
+struct MeshHeader {
+	char magic[4];           // "MESH"
+	uint32_t version;        // MESH_VERSION
+	uint32_t vertexSize;     // sizeof(OBJVertex)
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t reserved;
+	uint64_t sourceSize;     // size and modification time of the OBJ it was baked from
+	int64_t sourceTime;
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+class MappedFile;
+
+// A baked mesh mapped read-only: vertices and indices point straight into the
+// file and can be handed to glBufferData as they are.
+class MeshView {
+public:
+	const MeshHeader * header;
+	const OBJVertex * vertices;
+	const uint32_t * indices;
+	bool mapped; // false when the data comes from a parsed mesh instead
+
+	MeshView();
+	~MeshView();
+
+	// map a .mesh file, rejected when it is malformed or older than `source`
+	bool map(const char * path, const char * source);
+	// take over a parsed mesh when no cache could be written
+	bool adopt(OBJMesh & mesh);
+	void clear();
+
+private:
+	MappedFile * file;
+	OBJMesh parsed;
+	MeshHeader bakedHeader;
+	MeshView(const MeshView &);
+	MeshView & operator=(const MeshView &);
+};
+
+bool writeMeshCache(
+const char * path,
+const OBJMesh & mesh,
+const char * source
+);
+
+// Maps "<path>.mesh" when it is up to date; otherwise parses the OBJ with
+// loadOBJIndexed, bakes the cache next to it for the next run and sets *parsed.
+bool loadMeshCached(
+const char * path,
+MeshView & view,
+bool * parsed = nullptr
+);
+
 #endif